@@ -2,7 +2,6 @@
 
 #include <math.h>
 #include <stdbool.h>
-#include <stdlib.h>
 
 #include "backup/backup.h"
 #include "board_config.h"
@@ -35,12 +34,21 @@ static BoardConfig* s_config_ptr = NULL;
 // Initialization start time
 static uint64_t s_init_start_ms;
 
-// Launch detect sensor data buffer
-static SensorFrame* s_ld_buffer_data;
-static size_t s_ld_buffer_size = 0;
-static size_t s_ld_buffer_ridx = 0;
-static size_t s_ld_buffer_widx = 0;
-static size_t s_ld_buffer_entries = 0;
+// Frames received while the acceleration has been above the launch
+// threshold, oldest at s_ld_ring_start, overwritten oldest first when full
+static SensorFrame s_ld_ring[LD_RING_MAX_FRAMES];
+static size_t s_ld_ring_start = 0;
+static size_t s_ld_ring_entries = 0;
+static uint32_t s_ld_ring_dropped = 0;
+static LaunchReplayStats s_ld_stats;
+
+// States from the last launch replay, until they're taken for logging
+static StateFrame s_ld_states[LD_RING_MAX_FRAMES];
+static size_t s_ld_num_states = 0;
+
+// The frames of the current control cycle
+static const SensorFrame* s_cycle_frames = NULL;
+static size_t s_cycle_num_frames = 0;
 
 // Condition timers
 static CondTimer s_init_timer;
@@ -55,6 +63,14 @@ static uint64_t s_apogee_time_ms = 0;
 static bool s_stage_sep_locked = false;
 static bool s_stage_ignite_locked = false;
 
+// Stage lockout tilt limits, as the cosine of each angle and in rad/s
+static float s_sep_cos_min_angle;
+static float s_sep_cos_max_angle;
+static float s_sep_max_tilt_rate;
+static float s_ignite_cos_min_angle;
+static float s_ignite_cos_max_angle;
+static float s_ignite_max_tilt_rate;
+
 static uint64_t ms_since_launch() {
     if (s_launch_time_ms) {
         return MILLIS() - s_launch_time_ms;
@@ -71,6 +87,47 @@ static uint64_t ms_since_boost() {
     return 0;
 }
 
+static void ld_ring_push(const SensorFrame* sensor_frames, size_t num_frames) {
+    for (size_t i = 0; i < num_frames; i++) {
+        if (s_ld_ring_entries < LD_RING_MAX_FRAMES) {
+            s_ld_ring[(s_ld_ring_start + s_ld_ring_entries++) %
+                      LD_RING_MAX_FRAMES] = sensor_frames[i];
+        } else {
+            s_ld_ring[s_ld_ring_start++] = sensor_frames[i];
+            s_ld_ring_start %= LD_RING_MAX_FRAMES;
+            s_ld_ring_dropped++;
+        }
+    }
+}
+
+static void ld_ring_reset() {
+    s_ld_ring_start = 0;
+    s_ld_ring_entries = 0;
+    s_ld_ring_dropped = 0;
+}
+
+// Run the state estimation again from the oldest frame in the ring, as of the
+// given phase, so that it's caught up by the end of this control cycle
+static void ld_ring_replay(FlightPhase phase) {
+    uint64_t start_us = MICROS();
+
+    // Resetting clears the state estimation time, so set it to the time of
+    // the first stored frame minus the control loop period
+    se_reset();
+    se_set_time(s_ld_ring[s_ld_ring_start].timestamp / 1e6 -
+                s_config_ptr->control_loop_period_ms / 1e3);
+
+    se_fast_forward(phase, s_ld_ring, LD_RING_MAX_FRAMES, s_ld_ring_start,
+                    s_ld_ring_entries, s_ld_states);
+    s_ld_num_states = s_ld_ring_entries;
+
+    s_ld_stats.frames = s_ld_ring_entries;
+    s_ld_stats.dropped = s_ld_ring_dropped;
+    s_ld_stats.catchup_us = MICROS() - start_us;
+    PAL_LOGI("Launch replay caught up %lu frames (%lu dropped) in %lu us\n",
+             s_ld_stats.frames, s_ld_stats.dropped, s_ld_stats.catchup_us);
+}
+
 Status fp_init() {
     s_init_start_ms = MILLIS();
 
@@ -85,21 +142,16 @@ Status fp_init() {
     }
 
     if (s_config_ptr->launch_detect_replay) {
-        // Allocate buffer for storing sensor data during launch detection
-        // Dynamic allocation is gross, but it's during init so should be safe
-        s_ld_buffer_size = 1 + (s_config_ptr->boost_detect_period_ms /
-                                s_config_ptr->control_loop_period_ms);
-
-        s_ld_buffer_data = malloc(sizeof(SensorFrame) * s_ld_buffer_size);
-
-        if (s_ld_buffer_data == NULL) {
-            ASSERT_OK(STATUS_MEMORY_ERROR,
-                      "failed to allocate launch replay buffer");
+        // The replay still works if the boost detect period doesn't fit, but
+        // starts after launch
+        size_t replay_frames = 1 + (s_config_ptr->boost_detect_period_ms /
+                                    s_config_ptr->control_loop_period_ms);
+        if (replay_frames > LD_RING_MAX_FRAMES) {
+            PAL_LOGW("Launch replay needs %u frames, only keeping %u\n",
+                     replay_frames, LD_RING_MAX_FRAMES);
         }
-
-        PAL_LOGI("Allocated %u entry buffer for launch replay\n",
-                 s_ld_buffer_size);
     }
+    ld_ring_reset();
 
     // Initialize condition timers
     cond_timer_init(&s_init_timer, s_config_ptr->state_init_time_ms);
@@ -108,6 +160,18 @@ Status fp_init() {
     cond_timer_init(&s_drogue_delay_timer, s_config_ptr->drogue_delay_ms);
     cond_timer_init(&s_stage_sep_timer, s_config_ptr->stage_sep_delay_ms);
 
+    // Tilt limits, so the lockouts compare without any trig
+    s_sep_cos_min_angle = tilt_cos_limit(s_config_ptr->stage_min_sep_angle_deg);
+    s_sep_cos_max_angle = tilt_cos_limit(s_config_ptr->stage_max_sep_angle_deg);
+    s_sep_max_tilt_rate =
+        DEG_TO_RAD(s_config_ptr->stage_max_sep_tilt_rate_dps);
+    s_ignite_cos_min_angle =
+        tilt_cos_limit(s_config_ptr->stage_min_ignite_angle_deg);
+    s_ignite_cos_max_angle =
+        tilt_cos_limit(s_config_ptr->stage_max_ignite_angle_deg);
+    s_ignite_max_tilt_rate =
+        DEG_TO_RAD(s_config_ptr->stage_max_ignite_tilt_rate_dps);
+
 #ifdef HWIL_TEST
     // Always start from init for HWIL test
     *s_flight_phase_ptr = FP_INIT;
@@ -125,38 +189,21 @@ Status fp_init() {
 FlightPhase fp_get() { return *s_flight_phase_ptr; }
 
 Status fp_update(const SensorFrame* sensor_frame) {
-    FlightPhase flight_phase = *s_flight_phase_ptr;
-    const SensorFrame* latest_sensor_frame = NULL;
-
-    // If we're in flight and the launch replay buffer isn't empty,
-    // consume some stored frames and add the current one to the back
-    if (flight_phase > FP_READY && s_ld_buffer_entries) {
-        for (size_t i = 0; i < LD_REPLAY_FRAMES_PER_ITER; i++) {
-            if (!s_ld_buffer_entries) {
-                // If we ran out of stored frames, abort
-                break;
-            }
-
-            // Perform the update with the frame stored at this index
-            latest_sensor_frame = &s_ld_buffer_data[s_ld_buffer_ridx++];
-            se_update(flight_phase, latest_sensor_frame);
-            s_ld_buffer_ridx %= s_ld_buffer_size;
-            s_ld_buffer_entries--;
-        }
-    }
+    return fp_update_batch(sensor_frame, 1);
+}
 
-    if (!latest_sensor_frame) {
-        // No stored frames were processed, so update using latest
-        se_update(flight_phase, sensor_frame);
-        latest_sensor_frame = sensor_frame;
-    } else if (s_ld_buffer_entries) {
-        // If we haven't emptied the launch detect buffer, add the newly
-        // received frame to the end of the buffer for future use
-        s_ld_buffer_data[s_ld_buffer_widx++] = *sensor_frame;
-        s_ld_buffer_widx %= s_ld_buffer_size;
-        s_ld_buffer_entries++;
+Status fp_update_batch(const SensorFrame* sensor_frames, size_t num_frames) {
+    if (num_frames == 0) {
+        return STATUS_PARAMETER_ERROR;
     }
 
+    FlightPhase flight_phase = *s_flight_phase_ptr;
+    const SensorFrame* latest_sensor_frame = &sensor_frames[num_frames - 1];
+
+    se_update_batch(flight_phase, sensor_frames, num_frames);
+    s_cycle_frames = sensor_frames;
+    s_cycle_num_frames = num_frames;
+
     switch (flight_phase) {
         case FP_INIT:
             *s_flight_phase_ptr = fp_update_init(latest_sensor_frame);
@@ -203,13 +250,22 @@ Status fp_update(const SensorFrame* sensor_frame) {
 
     // If we are doing launch detection and the replay buffer has entries in it,
     // tell the control loop to not store the state since it could be replayed
-    if (flight_phase == FP_READY && s_ld_buffer_entries) {
+    if (flight_phase == FP_READY && s_ld_ring_entries) {
         return STATUS_BUSY;
     }
 
     return STATUS_OK;
 }
 
+const LaunchReplayStats* fp_launch_replay_stats() { return &s_ld_stats; }
+
+size_t fp_take_replay_states(const StateFrame** states) {
+    size_t num_states = s_ld_num_states;
+    *states = s_ld_states;
+    s_ld_num_states = 0;
+    return num_states;
+}
+
 FlightPhase fp_update_init(const SensorFrame* sensor_frame) {
     // During init, we want to record a reliable pressure value we can use to
     // determine the ground altitude later on, and check that the accelerometers
@@ -325,33 +381,22 @@ FlightPhase fp_update_ready(const SensorFrame* sensor_frame) {
             cond_timer_update(&s_boost_det_timer, acc_above_threshold);
 
         if (acc_above_threshold && s_config_ptr->launch_detect_replay) {
-            // If we need to replay launch, save the current frame in the buffer
-            if (s_ld_buffer_entries < s_ld_buffer_size) {
-                s_ld_buffer_data[s_ld_buffer_entries++] = *sensor_frame;
-            }
+            // If we need to replay launch, save this cycle's frames
+            ld_ring_push(s_cycle_frames, s_cycle_num_frames);
         } else {
             // If we're below the threshold, reset the buffer
-            s_ld_buffer_entries = 0;
+            ld_ring_reset();
         }
     }
 
     if (launch_detected) {
         s_launch_time_ms = MILLIS() - s_config_ptr->boost_detect_period_ms;
 
-        if (s_config_ptr->launch_detect_replay) {
-            // Reset the state estimation since we're
-            // replaying from the new start of the flight
-            se_reset();
-
-            // Resetting will clear the state estimation time, so we deal
-            // with that by setting it to the time of the first stored
-            // sensor frame minus the control loop period
-            se_set_time(s_ld_buffer_data[0].timestamp / 1e6 -
-                        s_config_ptr->control_loop_period_ms / 1e3);
-
-            // We're going to start consuming the replay buffer, so update the
-            // size to the number of entries we have stored
-            s_ld_buffer_size = s_ld_buffer_entries;
+        if (s_config_ptr->launch_detect_replay && s_ld_ring_entries) {
+            // Replay from the new start of the flight, up to this cycle's
+            // frames, so boost starts with an up to date state
+            ld_ring_replay(FP_BOOST);
+            ld_ring_reset();
         }
 
         // Reset the boost detection timer for use in boost
@@ -527,8 +572,7 @@ FlightStageStatus fp_stage_check_sep_lockout(const StateEst* state) {
 
     float velocity = state->velEkf;
     float altitude = state->posEkf;
-    float angle_deg =
-        quat_angle_from_vertical(&(state->orientation)) * M_PI / 180.0f;
+    const Tilt* tilt = se_tilt();
 
     if (velocity < s_config_ptr->stage_min_sep_velocity_mps ||
         velocity > s_config_ptr->stage_max_sep_velocity_mps) {
@@ -540,8 +584,11 @@ FlightStageStatus fp_stage_check_sep_lockout(const StateEst* state) {
         return FP_STG_NOGO;
     }
 
-    if (angle_deg < s_config_ptr->stage_min_sep_angle_deg ||
-        angle_deg > s_config_ptr->stage_max_sep_angle_deg) {
+    if (!tilt_within(tilt, s_sep_cos_min_angle, s_sep_cos_max_angle)) {
+        return FP_STG_NOGO;
+    }
+
+    if (!(tilt->rate <= s_sep_max_tilt_rate)) {
         return FP_STG_NOGO;
     }
 
@@ -566,8 +613,7 @@ FlightStageStatus fp_stage_check_ignite_lockout(const StateEst* state) {
 
     float velocity = state->velEkf;
     float altitude = state->posEkf;
-    float angle_deg =
-        quat_angle_from_vertical(&(state->orientation)) * M_PI / 180.0f;
+    const Tilt* tilt = se_tilt();
 
     if (velocity < s_config_ptr->stage_min_ignite_velocity_mps ||
         velocity > s_config_ptr->stage_max_ignite_velocity_mps) {
@@ -579,8 +625,11 @@ FlightStageStatus fp_stage_check_ignite_lockout(const StateEst* state) {
         return FP_STG_NOGO;
     }
 
-    if (angle_deg < s_config_ptr->stage_min_ignite_angle_deg ||
-        angle_deg > s_config_ptr->stage_max_ignite_angle_deg) {
+    if (!tilt_within(tilt, s_ignite_cos_min_angle, s_ignite_cos_max_angle)) {
+        return FP_STG_NOGO;
+    }
+
+    if (!(tilt->rate <= s_ignite_max_tilt_rate)) {
         return FP_STG_NOGO;
     }
 
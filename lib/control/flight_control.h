@@ -2,6 +2,7 @@
 #define FLIGHT_CONTROL_H
 
 #include "data.h"
+#include "state.pb.h"
 #include "status.h"
 
 typedef enum {
@@ -18,9 +19,16 @@ typedef enum {
 
 typedef enum { FP_STG_GO, FP_STG_NOGO, FP_STG_WAIT } FlightStageStatus;
 
-// How many buffered frames to consume each iter of the control loop
-// This MUST be strictly greater than 1 to deplete the buffer
-#define LD_REPLAY_FRAMES_PER_ITER (2)
+// Most frames kept for launch replay, which bounds the catch-up at launch to
+// this many EKF IMU steps. Enough for the boost detect period at the control
+// loop rate, plus some margin.
+#define LD_RING_MAX_FRAMES (64)
+
+typedef struct {
+    uint32_t frames;      // Frames replayed at launch
+    uint32_t dropped;     // Oldest frames overwritten before launch
+    uint32_t catchup_us;  // Time taken to replay them
+} LaunchReplayStats;
 
 Status fp_init();
 
@@ -28,4 +36,24 @@ FlightPhase fp_get();
 
 Status fp_update(const SensorFrame* sensor_frame);
 
+/**
+ * @brief Update from every frame received since the last control cycle,
+ * oldest first; see se_update_batch()
+ */
+Status fp_update_batch(const SensorFrame* sensor_frames, size_t num_frames);
+
+/**
+ * @brief How the last launch replay went; all zero until there's been one
+ */
+const LaunchReplayStats* fp_launch_replay_stats();
+
+/**
+ * @brief Take the states the last launch replay went through, oldest first,
+ * so that they can be logged. The states stored while the launch was being
+ * detected were held back, since they would be replayed.
+ *
+ * @return How many there are; 0 once they've been taken
+ */
+size_t fp_take_replay_states(const StateFrame** states);
+
 #endif  // FLIGHT_CONTROL_H
@@ -5,13 +5,13 @@
 #include "math.h"
 // #include "state_estimation.h"
 #include "atmosphere.h"
+#include "board_config.h"
 #include "stdlib.h"
 
 // MATRICES (STATIC)
 static mat x;          // state
 static mat P;          // state covar mat
 static mat F;          // state update mat
-static mat Q;          // process noise mat
 static mat H;          // state to meas mat
 static mat R;          // meas noise mat
 static mat y;          // residual
@@ -19,23 +19,45 @@ static mat S;          // ??? (intermediate update step)
 static mat K;          // Kalman Gain (intermediate update step)
 // static mat z;          // measurements excluding rotation
 static mat w;  // angular velocity measurements
+static mat U;  // unit upper triangular factor of P = UDU' (UD filter only)
+
+static mfloat D[NUM_TOT_STATES];  // diagonal factor of P = UDU'
+
+// An IMU step of the multirate filter, with the state from before it, so the
+// step can be run again after a measurement that arrived late
+typedef struct {
+    mfloat t;
+    FlightPhase phase;
+    mfloat acc_h;
+    mfloat acc_i;
+    mfloat w[NUM_ROT_MEAS];
+
+    mfloat t_prior;
+    mfloat x_prior[NUM_TOT_STATES];
+    mfloat P_prior[NUM_TOT_STATES * NUM_TOT_STATES];  // U for the UD filter
+    mfloat D_prior[NUM_TOT_STATES];                   // UD filter only
+} KfImuStep;
+
+static KfImuStep s_history[KF_HISTORY_LEN];
+static size_t s_history_next = 0;  // slot for the next step
+static size_t s_history_len = 0;
+static mfloat s_time = NAN;  // time of x and P in the multirate filter
 
 // static mfloat Q_vars[] = {1., 1., 1., 1., 1., 1., 1.};
 
 static mfloat Q_vars[NUM_TOT_STATES];  // get set in preprocess
 static mfloat R_diag[NUM_KIN_MEAS];    // get set in preprocess
 
-// TODO: Better place for all this config stuff
-// These copied from the values I used during python testing
-static const mfloat Q_VARS_1[NUM_TOT_STATES] = {
-    5, 5.0e-01, 5.0e+01, 1.0e-01, 1.0e-01, 1.0e-01, 1.0e-01};
-// 1.5, 1.0e-03, 4.0e+00, 1.0e-01, 1.0e-01, 1.0e-01, 1.0e-01};
-static const mfloat Q_VARS_2[NUM_TOT_STATES] = {10., .5,  .5, 0.1,
-                                                0.1, 0.1, 0.1};
-//                                          pressure, acc_h, acc_i
-static const mfloat R_DIAG_1[NUM_KIN_MEAS] = {40.0e-01, 6.e-04, 6.e-04};
-// static const mfloat R_DIAG_1[NUM_KIN_MEAS] = {30.0e-01, 5.e-04, 5.e-04};
-static const mfloat R_DIAG_2[NUM_KIN_MEAS] = {4, 1., 1.};
+// Normally replaced by the board config's from se_init
+static const KfNoise s_default_noise = {
+    .q_vars_1 = ESTIMATOR_DEFAULT_Q_VARS_1,
+    .q_vars_2 = ESTIMATOR_DEFAULT_Q_VARS_2,
+    .r_diag_1 = ESTIMATOR_DEFAULT_R_DIAG_1,
+    .r_diag_2 = ESTIMATOR_DEFAULT_R_DIAG_2,
+};
+static KfNoise s_noise_override;
+static const KfNoise* s_noise = &s_default_noise;
+static mfloat s_pressure_gate_stdevs = ESTIMATOR_DEFAULT_PRESSURE_GATE_STDEVS;
 
 // TODO: Initial height?
 static mfloat s_initial_height;
@@ -47,6 +69,8 @@ static mfloat K_UNDERWEIGHT = 2. / 4.;  // factor to scale K by
 // Just for debugging
 static arm_status math_status;   // Watch this for math debugging
 static kf_status filter_status;  // Watch this for kf debugging
+static bool s_sequential_update = KF_SEQUENTIAL_UPDATE;
+static bool s_ud_filter = KF_UD_FILTER;
 int iteration = 0;
 int pressure_gate_count = 0;
 int underweight_count = 0;  // consecutive underweights
@@ -209,7 +233,6 @@ Status kf_init_mats() {
     malloc_errors += (int)mat_alloc(&x, NUM_TOT_STATES, 1);
     malloc_errors += mat_alloc(&P, NUM_TOT_STATES, NUM_TOT_STATES);
     malloc_errors += mat_alloc(&F, NUM_TOT_STATES, NUM_TOT_STATES);
-    malloc_errors += mat_alloc(&Q, NUM_TOT_STATES, NUM_TOT_STATES);
     malloc_errors += mat_alloc(&H, NUM_KIN_MEAS, NUM_TOT_STATES);
     malloc_errors += mat_alloc(&R, NUM_KIN_MEAS, NUM_KIN_MEAS);
     malloc_errors += mat_alloc(&y, NUM_KIN_MEAS, 1);
@@ -217,8 +240,13 @@ Status kf_init_mats() {
     malloc_errors += mat_alloc(&w, 3, 1);  //
     malloc_errors += mat_alloc(&S, NUM_KIN_MEAS, NUM_KIN_MEAS);
     malloc_errors += mat_alloc(&K, NUM_TOT_STATES, NUM_KIN_MEAS);
+    malloc_errors += mat_alloc(&U, NUM_TOT_STATES, NUM_TOT_STATES);
 
     if (malloc_errors == 0) {
+        // F is identity except for the dt terms, which kf_F_matrix fills in
+        mfloat ones[NUM_TOT_STATES];
+        arm_fill_f32(1, ones, NUM_TOT_STATES);
+        mat_diag(&F, ones, true);
         return STATUS_OK;
     } else {
         return STATUS_MEMORY_ERROR;
@@ -229,12 +257,12 @@ void kf_free_mats() {
     free(x.pData);
     free(P.pData);
     free(F.pData);
-    free(Q.pData);
     free(H.pData);
     free(R.pData);
     free(y.pData);
     free(S.pData);
     free(K.pData);
+    free(U.pData);
 }
 
 void kf_init_state(const mfloat* x0, const mfloat* P0_diag) {
@@ -243,6 +271,44 @@ void kf_init_state(const mfloat* x0, const mfloat* P0_diag) {
     w.pData[0] = 0;
     w.pData[1] = 0;
     w.pData[2] = 0;
+    iteration = 0;
+    pressure_gate_count = 0;
+    kf_ud_factor();
+    kf_set_time(NAN);
+}
+
+// Variance of state i. The UD filter keeps only U and D, so it is formed
+// from row i of U rather than from P.
+static mfloat kf_var(int i) {
+    if (!s_ud_filter) {
+        return mat_val(&P, i, i);
+    }
+    const int n = NUM_TOT_STATES;
+    const mfloat* u = U.pData;
+    mfloat var = D[i];
+    for (int k = i + 1; k < n; k++) {
+        var += u[i * n + k] * u[i * n + k] * D[k];
+    }
+    return var;
+}
+
+// Predict and update with whichever filter is selected. The UD filter leaves
+// P alone; kf_var reads what's needed from U and D.
+static kf_status kf_predict_any(mfloat dt, const mfloat* w) {
+    if (s_ud_filter) {
+        return kf_predict_ud(dt, w);
+    }
+    return kf_predict(dt, w);
+}
+
+static kf_status kf_update_any(const mfloat* z, const mfloat* R_diag) {
+    if (s_ud_filter) {
+        return kf_update_ud(z, R_diag);
+    }
+    if (s_sequential_update) {
+        return kf_update_sequential(z, R_diag);
+    }
+    return kf_update(z, R_diag);
 }
 
 kf_status kf_do_kf(FlightPhase phase, KfInputVector input, mfloat dt) {
@@ -268,36 +334,249 @@ kf_status kf_do_kf(FlightPhase phase, KfInputVector input, mfloat dt) {
         kf_preprocess(z, R_diag, phase);  // adjust measurements and vars based
                                           // on current phase and state
     if (filter_status == KF_SUCCESS) {
-        filter_status = kf_predict(dt, w.pData);  // No NaNs can go in here!
-        kf_pressure_gate(z, 60);                  // gate pressure meas
-        filter_status = kf_update(z, R_diag);     // z can contain NaNs
+        filter_status = kf_predict_any(dt, w.pData);  // No NaNs can go in here!
+    }
+    if (filter_status == KF_SUCCESS) {
+        kf_pressure_gate(z, s_pressure_gate_stdevs);  // gate pressure meas
+        filter_status = kf_update_any(z, R_diag);     // z can contain NaNs
     }
 
     iteration++;  // this counter is just for debugging purposes
     return filter_status;
 }
 
+// MULTIRATE FILTER
+
+void kf_set_time(mfloat t) {
+    s_time = t;
+    s_history_len = 0;
+}
+
+// Predict up to t, if that's ahead of the state
+static kf_status kf_predict_to(mfloat t, const mfloat* w) {
+    kf_status status = KF_SUCCESS;
+    if (isnan(s_time)) {
+        s_time = t;
+    } else if (t > s_time) {
+        status = kf_predict_any(t - s_time, w);
+        s_time = t;
+    }
+    return status;
+}
+
+// Run a step from the state as it is now, saving that state first
+static kf_status kf_run_imu_step(KfImuStep* step) {
+    step->t_prior = s_time;
+    arm_copy_f32(x.pData, step->x_prior, NUM_TOT_STATES);
+    if (s_ud_filter) {
+        arm_copy_f32(U.pData, step->P_prior, NUM_TOT_STATES * NUM_TOT_STATES);
+        arm_copy_f32(D, step->D_prior, NUM_TOT_STATES);
+    } else {
+        arm_copy_f32(P.pData, step->P_prior, NUM_TOT_STATES * NUM_TOT_STATES);
+    }
+
+    mfloat z[NUM_KIN_MEAS] = {NAN, step->acc_h, step->acc_i};
+    filter_status = kf_preprocess(z, R_diag, step->phase);
+    if (filter_status != KF_SUCCESS) {
+        // Nothing to filter on the ground, but keep the time
+        s_time = step->t;
+        return filter_status;
+    }
+
+    filter_status = kf_predict_to(step->t, step->w);
+    if (filter_status == KF_SUCCESS) {
+        filter_status = kf_update_any(z, R_diag);
+    }
+    return filter_status;
+}
+
+kf_status kf_imu_step(FlightPhase phase, mfloat t, mfloat acc_h, mfloat acc_i,
+                      const mfloat* w_meas) {
+    // Keep the old w if this one has NaNs, as in kf_do_kf
+    bool nans[NUM_ROT_MEAS];
+    if (!mat_findNans(w_meas, NUM_ROT_MEAS, nans)) {
+        arm_copy_f32(w_meas, w.pData, NUM_ROT_MEAS);
+    }
+
+    KfImuStep* step = &s_history[s_history_next];
+    s_history_next = (s_history_next + 1) % KF_HISTORY_LEN;
+    if (s_history_len < KF_HISTORY_LEN) {
+        s_history_len++;
+    }
+
+    step->t = t;
+    step->phase = phase;
+    step->acc_h = acc_h;
+    step->acc_i = acc_i;
+    arm_copy_f32(w.pData, step->w, NUM_ROT_MEAS);
+
+    iteration++;  // this counter is just for debugging purposes
+    return kf_run_imu_step(step);
+}
+
+// The i-th most recent IMU step
+static KfImuStep* kf_history(size_t i) {
+    return &s_history[(s_history_next + KF_HISTORY_LEN - 1 - i) %
+                      KF_HISTORY_LEN];
+}
+
+// Go back to just before the first IMU step that came after time t, so a
+// measurement from then can be fused, and kf_replay can bring the state back
+// up to date. A measurement from before the state the history saved is
+// applied at that state's time instead, and one from after the latest step at
+// the latest step's time, rather than predicting ahead of the IMU.
+static kf_status kf_rewind(mfloat* t, FlightPhase* phase, const mfloat** w_step,
+                           size_t* num_later) {
+    if (!isnan(s_time) && *t > s_time) {
+        *t = s_time;
+    }
+
+    // IMU steps already run that come after this measurement
+    size_t n = 0;
+    while (n < s_history_len && kf_history(n)->t > *t) {
+        n++;
+    }
+    if (n == s_history_len && n > 0 && !(kf_history(n - 1)->t_prior <= *t)) {
+        return KF_TOO_OLD;  // from before anything still in the history
+    }
+
+    *w_step = w.pData;
+    if (n > 0) {
+        KfImuStep* first = kf_history(n - 1);
+        arm_copy_f32(first->x_prior, x.pData, NUM_TOT_STATES);
+        if (s_ud_filter) {
+            arm_copy_f32(first->P_prior, U.pData,
+                         NUM_TOT_STATES * NUM_TOT_STATES);
+            arm_copy_f32(first->D_prior, D, NUM_TOT_STATES);
+        } else {
+            arm_copy_f32(first->P_prior, P.pData,
+                         NUM_TOT_STATES * NUM_TOT_STATES);
+        }
+        s_time = first->t_prior;
+        *phase = first->phase;
+        *w_step = first->w;
+    }
+    *num_later = n;
+    return KF_SUCCESS;
+}
+
+// Run the last num_later IMU steps again, oldest first
+static void kf_replay(size_t num_later) {
+    for (size_t i = num_later; i > 0; i--) {
+        kf_run_imu_step(kf_history(i - 1));
+    }
+}
+
+kf_status kf_baro_step(FlightPhase phase, mfloat t, mfloat pressure) {
+    if (isnan(pressure)) {
+        return KF_NO_VALID_MEAS;  // no new reading, so nothing to update
+    }
+
+    size_t num_later;
+    const mfloat* w_step;
+    kf_status status = kf_rewind(&t, &phase, &w_step, &num_later);
+    if (status != KF_SUCCESS) {
+        return status;
+    }
+
+    mfloat z[NUM_KIN_MEAS] = {pressure, NAN, NAN};
+    status = kf_preprocess(z, R_diag, phase);
+    if (status == KF_SUCCESS) {
+        status = kf_predict_to(t, w_step);
+    }
+    if (status == KF_SUCCESS) {
+        kf_pressure_gate(z, s_pressure_gate_stdevs);
+        status = kf_update_any(z, R_diag);
+    }
+
+    kf_replay(num_later);
+    filter_status = status;
+    return status;
+}
+
+kf_status kf_gps_step(FlightPhase phase, mfloat t, const mfloat* z_gps,
+                      const mfloat* R_gps) {
+    bool nans[NUM_GPS_MEAS];
+    if (mat_findNans(z_gps, NUM_GPS_MEAS, nans) == NUM_GPS_MEAS) {
+        return KF_NO_VALID_MEAS;
+    }
+
+    size_t num_later;
+    const mfloat* w_step;
+    kf_status status = kf_rewind(&t, &phase, &w_step, &num_later);
+    if (status != KF_SUCCESS) {
+        return status;
+    }
+
+    // Only for the phase's noise and whether to filter at all
+    mfloat z[NUM_KIN_MEAS] = {NAN, NAN, NAN};
+    status = kf_preprocess(z, R_diag, phase);
+    if (status == KF_SUCCESS) {
+        status = kf_predict_to(t, w_step);
+    }
+    if (status == KF_SUCCESS) {
+        status = kf_update_gps(z_gps, R_gps);
+    }
+
+    kf_replay(num_later);
+    filter_status = status;
+    return status;
+}
+
 kf_status kf_predict(mfloat dt, const mfloat* w) {
     kf_F_matrix(dt);  // update F matrix with dt. Do this before f(x)!!!
 
     // self.x = self.f(self.x, dt, w=w) # use f(x) for EKF
     kf_fx(&x, dt, w);  // calculate (integrate) new state
 
-    mfloat temp_storage[NUM_TOT_STATES *
-                        NUM_TOT_STATES];  // temporary space to do matrix math
-    // NOTE: It might be more efficicient to permanently (staticly?) allocate
-    // space for temporary arrays that all functions can use
-    mat temp_square = {NUM_TOT_STATES, NUM_TOT_STATES, temp_storage};
-
     // P = F @ self.P @ F.T + self.Q
-    kf_Q_matrix(dt);                              // update Q matrix with dt
-    kf_F_matrix(dt);                              // update F with dt
-    mat_transposeMultiply(&F, &P, &temp_square);  // FPF'
-    arm_mat_add_f32(&temp_square, &Q, &P);        // P = FPF' + Q
+    kf_predict_P(dt);
 
     return KF_SUCCESS;
 }
 
+void kf_predict_P(mfloat dt) {
+    // F = [A 0; 0 I] where A is the h-v-a kinematic chain
+    //     A = [1 dt dt^2/2; 0 1 dt; 0 0 1]
+    // so FPF' = [A Pkk A', A Pkq; Pqk A', Pqq]. The quaternion block is left
+    // alone, and only rows/cols 0 and 1 of the kinematic part actually change.
+    // P is symmetric, so the lower triangle is mirrored instead of computed.
+    const int n = NUM_TOT_STATES;
+    const mfloat half_dt2 = .5f * dt * dt;
+    mfloat* p = P.pData;
+
+    // Rows: M = F * P (rows 0 and 1 only, row 0 first since it reads row 1)
+    for (int j = 0; j < n; j++) {
+        mfloat p1 = p[1 * n + j];
+        mfloat p2 = p[2 * n + j];
+        p[0 * n + j] += dt * p1 + half_dt2 * p2;
+        p[1 * n + j] = p1 + dt * p2;
+    }
+
+    // Cols: M * F' on the kinematic block, then mirror to keep P symmetric
+    for (int i = 0; i < NUM_KIN_STATES; i++) {
+        mfloat m1 = p[i * n + 1];
+        mfloat m2 = p[i * n + 2];
+        p[i * n + 0] += dt * m1 + half_dt2 * m2;
+        p[i * n + 1] = m1 + dt * m2;
+    }
+    p[1 * n + 0] = p[0 * n + 1];
+    p[2 * n + 0] = p[0 * n + 2];
+    p[2 * n + 1] = p[1 * n + 2];
+
+    // Cross terms: Pqk A' = (A Pkq)', which is already in the upper rows
+    for (int i = 0; i < NUM_KIN_STATES; i++) {
+        for (int j = NUM_KIN_STATES; j < n; j++) {
+            p[j * n + i] = p[i * n + j];
+        }
+    }
+
+    // + Q, which is diagonal (Q = diag(Q_vars * dt))
+    for (int i = 0; i < n; i++) {
+        p[i * n + i] += Q_vars[i] * dt;
+    }
+}
+
 kf_status kf_update(const mfloat* z, const mfloat* R_diag) {
     kf_status status;
     mfloat
@@ -384,6 +663,340 @@ kf_status kf_update(const mfloat* z, const mfloat* R_diag) {
     return KF_SUCCESS;
 }
 
+// Scalar update with a measurement of h * x[c], residual y and variance r.
+// The change in x is added to dx.
+static void kf_scalar_update(int c, mfloat h, mfloat y, mfloat r, mfloat* dx) {
+    const int n = NUM_TOT_STATES;
+    mfloat* p = P.pData;
+
+    // m = P H' (column c of P, scaled), s = H P H' + r
+    mfloat m[NUM_TOT_STATES];
+    for (int j = 0; j < n; j++) {
+        m[j] = p[j * n + c] * h;
+    }
+    mfloat s = h * m[c] + r;
+
+    // k = m / s
+    mfloat k[NUM_TOT_STATES];
+    mfloat s_inv = 1 / s;
+    for (int j = 0; j < n; j++) {
+        k[j] = m[j] * s_inv;
+    }
+
+    // x += k * y
+    for (int j = 0; j < n; j++) {
+        x.pData[j] += k[j] * y;
+        dx[j] += k[j] * y;
+    }
+
+    // Joseph form, scalar: P = (I - kH)P(I - kH)' + krk'
+    //                        = P - km' - mk' + kk's
+    // upper triangle, then mirror to keep P symmetric
+    for (int row = 0; row < n; row++) {
+        for (int col = row; col < n; col++) {
+            p[row * n + col] +=
+                -k[row] * m[col] - m[row] * k[col] + k[row] * k[col] * s;
+            p[col * n + row] = p[row * n + col];
+        }
+    }
+}
+
+kf_status kf_update_sequential(const mfloat* z, const mfloat* R_diag) {
+    // Each measurement only sees one state (h for baro, a for the accels), so
+    // H_i = h_i * e_c' and every update is a scalar: s = h^2 P[c][c] + r, no
+    // inverse and no resizing. NaN measurements are just skipped.
+    // All rows are linearized at the prior x (same as the batch update), so
+    // the residual is corrected by H_i * dx for the updates already applied.
+    const int cols[NUM_KIN_MEAS] = {KF_POS, KF_ACC, KF_ACC};
+    mfloat h[NUM_KIN_MEAS];
+    h[KF_BARO] = kf_dpdh(&x);
+    h[KF_ACC_H] = 1 / G;
+    h[KF_ACC_I] = 1 / G;
+
+    mfloat hx_space[NUM_KIN_MEAS];
+    mat hx = {NUM_KIN_MEAS, 1, hx_space};
+    kf_hx(&x, z, &hx);  // h(x) at the prior
+
+    mfloat dx[NUM_TOT_STATES] = {0};  // x - prior x
+    int num_valid = 0;
+
+    for (int i = 0; i < NUM_KIN_MEAS; i++) {
+        if (isnan(z[i])) {
+            continue;
+        }
+        num_valid++;
+
+        int c = cols[i];
+        mfloat y_i = z[i] - hx_space[i] - h[i] * dx[c];  // residual
+        kf_scalar_update(c, h[i], y_i, R_diag[i], dx);
+    }
+
+    if (num_valid == 0) {
+        return KF_NO_VALID_MEAS;
+    }
+
+    return KF_SUCCESS;
+}
+
+void kf_set_sequential_update(bool enable) { s_sequential_update = enable; }
+
+void kf_set_ud_filter(bool enable) {
+    if (enable && !s_ud_filter) {
+        kf_ud_factor();  // pick up from the current P
+    } else if (!enable && s_ud_filter) {
+        kf_ud_to_P();  // and hand P back
+    }
+    s_ud_filter = enable;
+}
+
+void kf_set_noise(const KfNoise* noise) {
+    if (noise == NULL) {
+        s_noise = &s_default_noise;
+        return;
+    }
+    s_noise_override = *noise;
+    s_noise = &s_noise_override;
+}
+
+const KfNoise* kf_get_noise() { return s_noise; }
+
+void kf_set_pressure_gate(mfloat stdevs) { s_pressure_gate_stdevs = stdevs; }
+
+void kf_ud_factor() {
+    // P = UDU', U unit upper triangular. Work from the last column back.
+    const int n = NUM_TOT_STATES;
+    mfloat* u = U.pData;
+    const mfloat* p = P.pData;
+    arm_fill_f32(0, u, n * n);
+
+    for (int j = n - 1; j >= 0; j--) {
+        mfloat d = p[j * n + j];
+        for (int k = j + 1; k < n; k++) {
+            d -= u[j * n + k] * u[j * n + k] * D[k];
+        }
+        D[j] = d;
+        u[j * n + j] = 1;
+
+        for (int i = 0; i < j; i++) {
+            mfloat sum = p[i * n + j];
+            for (int k = j + 1; k < n; k++) {
+                sum -= u[i * n + k] * u[j * n + k] * D[k];
+            }
+            u[i * n + j] = (d > 0) ? sum / d : 0;
+        }
+    }
+}
+
+void kf_ud_to_P() {
+    // P = UDU', P[i][j] = sum over k >= max(i, j) of U[i][k] D[k] U[j][k]
+    const int n = NUM_TOT_STATES;
+    const mfloat* u = U.pData;
+    mfloat* p = P.pData;
+
+    for (int i = 0; i < n; i++) {
+        for (int j = i; j < n; j++) {
+            mfloat sum = 0;
+            for (int k = j; k < n; k++) {
+                sum += u[i * n + k] * D[k] * u[j * n + k];
+            }
+            p[i * n + j] = sum;
+            p[j * n + i] = sum;
+        }
+    }
+}
+
+kf_status kf_predict_ud(mfloat dt, const mfloat* w) {
+    kf_F_matrix(dt);   // update F matrix with dt. Do this before f(x)!!!
+    kf_fx(&x, dt, w);  // calculate (integrate) new state
+
+    // Thornton's update of P = F UDU' F' + Q: modified weighted Gram-Schmidt
+    // on the rows of W = [FU | I] with weights diag(D, Q)
+    const int n = NUM_TOT_STATES;
+    const int m = 2 * NUM_TOT_STATES;
+    const mfloat half_dt2 = .5f * dt * dt;
+    const mfloat* u = U.pData;
+
+    mfloat W[NUM_TOT_STATES][2 * NUM_TOT_STATES];
+    mfloat Dw[2 * NUM_TOT_STATES];
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < n; k++) {
+            W[i][k] = u[i * n + k];
+            W[i][n + k] = (i == k) ? 1 : 0;
+        }
+        Dw[i] = D[i];
+        Dw[n + i] = Q_vars[i] * dt;
+    }
+
+    // FU only touches rows 0 and 1 (see kf_predict_P)
+    for (int k = 0; k < n; k++) {
+        W[0][k] += dt * W[1][k] + half_dt2 * W[2][k];
+        W[1][k] += dt * W[2][k];
+    }
+
+    // Row j of W is zero left of column j in each half: FU is still upper
+    // triangular, and only rows after j are subtracted from it. So only
+    // columns [j, n) and [n + j, 2n) are worked on. The new U and D are only
+    // kept if they're positive definite all the way through.
+    mfloat u_new[NUM_TOT_STATES * NUM_TOT_STATES];
+    mfloat D_new[NUM_TOT_STATES];
+    arm_fill_f32(0, u_new, n * n);
+    for (int j = n - 1; j >= 0; j--) {
+        mfloat c[2 * NUM_TOT_STATES];
+        mfloat d = 0;
+        for (int half = 0; half < m; half += n) {
+            for (int k = half + j; k < half + n; k++) {
+                c[k] = Dw[k] * W[j][k];
+                d += W[j][k] * c[k];
+            }
+        }
+        if (d <= 0) {
+            return KF_ERROR;  // lost positive definiteness
+        }
+        D_new[j] = d;
+        u_new[j * n + j] = 1;
+
+        mfloat d_inv = 1 / d;
+        for (int i = 0; i < j; i++) {
+            mfloat u_ij = 0;
+            for (int half = 0; half < m; half += n) {
+                for (int k = half + j; k < half + n; k++) {
+                    u_ij += W[i][k] * c[k];
+                }
+            }
+            u_ij *= d_inv;
+            u_new[i * n + j] = u_ij;
+            for (int half = 0; half < m; half += n) {
+                for (int k = half + j; k < half + n; k++) {
+                    W[i][k] -= u_ij * W[j][k];
+                }
+            }
+        }
+    }
+
+    arm_copy_f32(u_new, U.pData, n * n);
+    arm_copy_f32(D_new, D, n);
+    return KF_SUCCESS;
+}
+
+// Bierman's scalar update of U, D and x, with a measurement of h * x[c],
+// residual y and variance r. The change in x is added to dx.
+static void kf_scalar_update_ud(int c, mfloat h, mfloat y, mfloat r,
+                                mfloat* dx) {
+    const int n = NUM_TOT_STATES;
+    mfloat* u = U.pData;
+
+    // f = U'H', v = Df. Row c of U is zero left of the diagonal.
+    mfloat f[NUM_TOT_STATES];
+    mfloat v[NUM_TOT_STATES];
+    for (int j = 0; j < n; j++) {
+        f[j] = (j < c) ? 0 : u[c * n + j] * h;
+        v[j] = D[j] * f[j];
+    }
+
+    mfloat b[NUM_TOT_STATES];  // unscaled gain
+    mfloat alpha = r;
+    for (int j = 0; j < n; j++) {
+        mfloat beta = alpha;
+        alpha += f[j] * v[j];
+        mfloat lambda = -f[j] / beta;
+        D[j] *= beta / alpha;
+        for (int k = 0; k < j; k++) {
+            mfloat u_kj = u[k * n + j];
+            u[k * n + j] = u_kj + b[k] * lambda;
+            b[k] += u_kj * v[j];
+        }
+        b[j] = v[j];
+    }
+
+    // x += K * y, K = b / alpha
+    mfloat gain = y / alpha;
+    for (int j = 0; j < n; j++) {
+        x.pData[j] += b[j] * gain;
+        dx[j] += b[j] * gain;
+    }
+}
+
+kf_status kf_update_ud(const mfloat* z, const mfloat* R_diag) {
+    // Bierman's scalar update on U and D, one measurement at a time. As in
+    // kf_update_sequential, H_i = h_i * e_c' and all rows are linearized at the
+    // prior x, with the residual corrected for the updates already applied.
+    const int cols[NUM_KIN_MEAS] = {KF_POS, KF_ACC, KF_ACC};
+    mfloat h[NUM_KIN_MEAS];
+    h[KF_BARO] = kf_dpdh(&x);
+    h[KF_ACC_H] = 1 / G;
+    h[KF_ACC_I] = 1 / G;
+
+    mfloat hx_space[NUM_KIN_MEAS];
+    mat hx = {NUM_KIN_MEAS, 1, hx_space};
+    kf_hx(&x, z, &hx);  // h(x) at the prior
+
+    mfloat dx[NUM_TOT_STATES] = {0};  // x - prior x
+    int num_valid = 0;
+
+    for (int i = 0; i < NUM_KIN_MEAS; i++) {
+        if (isnan(z[i])) {
+            continue;
+        }
+        num_valid++;
+
+        int c = cols[i];
+        mfloat y_i = z[i] - hx_space[i] - h[i] * dx[c];  // residual
+        kf_scalar_update_ud(c, h[i], y_i, R_diag[i], dx);
+    }
+
+    if (num_valid == 0) {
+        return KF_NO_VALID_MEAS;
+    }
+
+    return KF_SUCCESS;
+}
+
+kf_status kf_update_gps(const mfloat* z_gps, const mfloat* R_gps) {
+    // Altitude and vertical velocity are states (H_i = e_c'), so each is a
+    // scalar update, as in kf_update_sequential. Altitude is compared AGL.
+    // Both are gated on their innovation at the prior. Unlike the pressure
+    // gate there's no giving in after a run of rejections: the baro keeps P
+    // small, so a GPS that disagrees would otherwise pull the state back and
+    // forth. If the state drifts without the baro, P grows and the gate opens.
+    const int cols[NUM_GPS_MEAS] = {KF_POS, KF_VEL};
+    mfloat y_gps[NUM_GPS_MEAS];
+    y_gps[KF_GPS_ALT] =
+        z_gps[KF_GPS_ALT] - (x.pData[KF_POS] - s_initial_height);
+    y_gps[KF_GPS_VEL] = z_gps[KF_GPS_VEL] - x.pData[KF_VEL];
+
+    int num_valid = 0;
+    for (int i = 0; i < NUM_GPS_MEAS; i++) {
+        if (isnan(y_gps[i])) {
+            continue;
+        }
+        mfloat s = kf_var(cols[i]) + R_gps[i];
+        if (y_gps[i] * y_gps[i] > KF_GPS_GATE * KF_GPS_GATE * s) {
+            y_gps[i] = NAN;  // reject meas
+            continue;
+        }
+        num_valid++;
+    }
+
+    if (num_valid == 0) {
+        return KF_NO_VALID_MEAS;
+    }
+
+    mfloat dx[NUM_TOT_STATES] = {0};  // x - prior x
+    for (int i = 0; i < NUM_GPS_MEAS; i++) {
+        if (isnan(y_gps[i])) {
+            continue;
+        }
+        int c = cols[i];
+        if (s_ud_filter) {
+            kf_scalar_update_ud(c, 1, y_gps[i] - dx[c], R_gps[i], dx);
+        } else {
+            kf_scalar_update(c, 1, y_gps[i] - dx[c], R_gps[i], dx);
+        }
+    }
+
+    return KF_SUCCESS;
+}
+
 kf_status kf_preprocess(mfloat* z, mfloat* R_diag, FlightPhase phase) {
     // TODO: Copying is a bad and inefficient way to do this but I don't want to
     // deal with pointers rn
@@ -397,14 +1010,14 @@ kf_status kf_preprocess(mfloat* z, mfloat* R_diag, FlightPhase phase) {
             return KF_PASS;
         case FP_BOOST:
         case FP_COAST:
-            arm_copy_f32(R_DIAG_1, R_diag, NUM_KIN_STATES);
-            arm_copy_f32(Q_VARS_1, Q_vars, NUM_TOT_STATES);
+            arm_copy_f32(s_noise->r_diag_1, R_diag, NUM_KIN_STATES);
+            arm_copy_f32(s_noise->q_vars_1, Q_vars, NUM_TOT_STATES);
             filter_status = KF_SUCCESS;
             break;
         case FP_DROGUE:
         case FP_MAIN:
-            arm_copy_f32(R_DIAG_2, R_diag, NUM_KIN_STATES);
-            arm_copy_f32(Q_VARS_2, Q_vars, NUM_TOT_STATES);
+            arm_copy_f32(s_noise->r_diag_2, R_diag, NUM_KIN_STATES);
+            arm_copy_f32(s_noise->q_vars_2, Q_vars, NUM_TOT_STATES);
             z[KF_ACC_H] =
                 NAN;  // remove accel measuremnts bc they aren't helpful anymore
             z[KF_ACC_I] = NAN;
@@ -413,7 +1026,13 @@ kf_status kf_preprocess(mfloat* z, mfloat* R_diag, FlightPhase phase) {
                                         // deployment spike happens at phase
                                         // transition
                 x.pData[KF_ACC] = -10;
+                if (s_ud_filter) {
+                    kf_ud_to_P();  // only happens the once, at deployment
+                }
                 mat_edit(&P, KF_ACC, KF_ACC, mat_val(&P, KF_ACC, KF_ACC) * 10);
+                if (s_ud_filter) {
+                    kf_ud_factor();
+                }
             }
             filter_status = KF_SUCCESS;
             break;
@@ -424,8 +1043,8 @@ kf_status kf_preprocess(mfloat* z, mfloat* R_diag, FlightPhase phase) {
     }
 
     // data preproccssing
-    if (fabs(x.pData[KF_ACC]) >
-        9.81 * IMU_ACCEL_MAX) {  // remove saturated imu accel meas
+    if (fabsf(x.pData[KF_ACC]) >
+        G * IMU_ACCEL_MAX) {  // remove saturated imu accel meas
         z[KF_ACC_I] = NAN;  // use x or z?
     }
     // if (x.pData[KF_VEL] >= BARO_SPEED_MAX) {
@@ -442,8 +1061,8 @@ kf_status kf_preprocess(mfloat* z, mfloat* R_diag, FlightPhase phase) {
     } else if (x.pData[KF_VEL] > BARO_SPEED_FULL) {
         // increase varaince when going fast but not supersonic yet
         mfloat vel = x.pData[KF_VEL];
-        mfloat scale = 0.1 * pow(vel - BARO_SPEED_FULL, 2) + 1;
-        R_diag[KF_BARO] = R_DIAG_1[KF_BARO] * scale;
+        mfloat scale = .1f * (vel - BARO_SPEED_FULL) * (vel - BARO_SPEED_FULL) + 1;
+        R_diag[KF_BARO] = s_noise->r_diag_1[KF_BARO] * scale;
     }
 
     return filter_status;
@@ -460,8 +1079,8 @@ void kf_pressure_gate(mfloat* z, mfloat stdevs) {
         if (!USE_LAYERED_ATMOSPHERE || (meas_alt == -1) || (isnan(meas_alt))) {
             meas_alt = kf_pressureToAlt(z[KF_BARO]);
         }
-        mfloat diff = fabs(meas_alt - x.pData[KF_POS]);
-        mfloat cutoff = (sqrtf(mat_val(&P, KF_POS, KF_POS)) * stdevs);
+        mfloat diff = fabsf(meas_alt - x.pData[KF_POS]);
+        mfloat cutoff = (sqrtf(kf_var(KF_POS)) * stdevs);
         if ((diff > 15) && (diff > cutoff) && (pressure_gate_count < 10) &&
             (iteration != 0)) {
             // if ((diff > 100) && (diff > cutoff)) {
@@ -473,23 +1092,12 @@ void kf_pressure_gate(mfloat* z, mfloat stdevs) {
     }
 }
 
-void kf_Q_matrix(mfloat dt) {
-    // Q = np.diag(self.Q_var*dt)
-    mat_diag(&Q, Q_vars, true);  // Make Q from Q_vars
-    mat_scale(&Q, dt);           // multiply by dt
-}
-
 void kf_F_matrix(mfloat dt) {
-    // No rotation
-    // NOTE: Remakes entire matrix, could be made more efficient by just
-    // updating dt values
-    mfloat diag[NUM_TOT_STATES];
-    arm_fill_f32(1, diag, NUM_TOT_STATES);  // making identity matrix
-    mat_diag(&F, diag, true);
-    // upper left: kinematic equations
-    mat_edit(&F, 0, 1, dt);
-    mat_edit(&F, 0, 2, .5 * dt * dt);
-    mat_edit(&F, 1, 2, dt);
+    // No rotation. Only the dt terms of the kinematic block change, the rest
+    // of F is set to identity once in kf_init_mats
+    F.pData[0 * NUM_TOT_STATES + 1] = dt;
+    F.pData[0 * NUM_TOT_STATES + 2] = .5f * dt * dt;
+    F.pData[1 * NUM_TOT_STATES + 2] = dt;
 }
 
 void kf_R_matrix(const mfloat* meas_vars, const mfloat* z) {
@@ -509,7 +1117,7 @@ void kf_R_matrix(const mfloat* meas_vars, const mfloat* z) {
     mat_diag(&R, new_R, true);  // Make R matrix
 }
 
-kf_status kf_H_matrix(const mat* x, const mfloat* z) {
+mfloat kf_dpdh(const mat* x) {
     mfloat dpdh;
     if USE_LAYERED_ATMOSPHERE {
         dpdh = atmos_calc_pressure_deriv(
@@ -518,11 +1126,16 @@ kf_status kf_H_matrix(const mat* x, const mfloat* z) {
     if (!USE_LAYERED_ATMOSPHERE || (dpdh == -1) || (isnan(dpdh))) {
         // This is the linearized state -> meas conversion
         mfloat a = 44330;
-        mfloat b = 5.25588;
+        mfloat b = 5.25588f;
         mfloat h =
             MAX(mat_val(x, 0, 0), 0);  // mat to ensure alt isn't negative
-        dpdh = (-b * SEA_LEVEL_PRESSURE * pow((a - h), (b - 1))) / pow(a, b);
+        dpdh = (-b * SEA_LEVEL_PRESSURE * powf((a - h), (b - 1))) / powf(a, b);
     }
+    return dpdh;
+}
+
+kf_status kf_H_matrix(const mat* x, const mfloat* z) {
+    mfloat dpdh = kf_dpdh(x);
 
     // Resize H for NaNs
     bool nans[NUM_KIN_MEAS];
@@ -565,18 +1178,18 @@ void kf_fx(mat* x, mfloat dt, const mfloat* w) {  // state update function
     mfloat diag[] = {1, 1, 1, 1};
     mat_diag(&w_mat, diag, false);  // put ones on diagonal
     // put values in. This is such a terrible way to write a matrix
-    mat_edit(&w_mat, 0, 1, .5 * dt * (-w[0]));
-    mat_edit(&w_mat, 0, 2, .5 * dt * (-w[1]));
-    mat_edit(&w_mat, 0, 3, .5 * dt * (-w[2]));
-    mat_edit(&w_mat, 1, 0, .5 * dt * (w[0]));
-    mat_edit(&w_mat, 1, 2, .5 * dt * (w[2]));
-    mat_edit(&w_mat, 1, 3, .5 * dt * (-w[1]));
-    mat_edit(&w_mat, 2, 0, .5 * dt * (w[1]));
-    mat_edit(&w_mat, 2, 1, .5 * dt * (-w[2]));
-    mat_edit(&w_mat, 2, 3, .5 * dt * (w[0]));
-    mat_edit(&w_mat, 3, 0, .5 * dt * (w[2]));
-    mat_edit(&w_mat, 3, 1, .5 * dt * (w[1]));
-    mat_edit(&w_mat, 3, 2, .5 * dt * (-w[0]));
+    mat_edit(&w_mat, 0, 1, .5f * dt * (-w[0]));
+    mat_edit(&w_mat, 0, 2, .5f * dt * (-w[1]));
+    mat_edit(&w_mat, 0, 3, .5f * dt * (-w[2]));
+    mat_edit(&w_mat, 1, 0, .5f * dt * (w[0]));
+    mat_edit(&w_mat, 1, 2, .5f * dt * (w[2]));
+    mat_edit(&w_mat, 1, 3, .5f * dt * (-w[1]));
+    mat_edit(&w_mat, 2, 0, .5f * dt * (w[1]));
+    mat_edit(&w_mat, 2, 1, .5f * dt * (-w[2]));
+    mat_edit(&w_mat, 2, 3, .5f * dt * (w[0]));
+    mat_edit(&w_mat, 3, 0, .5f * dt * (w[2]));
+    mat_edit(&w_mat, 3, 1, .5f * dt * (w[1]));
+    mat_edit(&w_mat, 3, 2, .5f * dt * (-w[0]));
 
     // do that quat integration
     mfloat qspace[] = {
@@ -586,9 +1199,9 @@ void kf_fx(mat* x, mfloat dt, const mfloat* w) {  // state update function
     mat q_out = {4, 1, &(x->pData[KF_Q0])};  // points to the memory in x
     arm_mat_mult_f32(&w_mat, &quat, &q_out);
     // make quat mag = 1
-    mfloat q_mag = sqrtf(pow(q_out.pData[0], 2) + pow(q_out.pData[1], 2) +
-                         pow(q_out.pData[2], 2) + pow(q_out.pData[3], 2));
-    mat_scale(&q_out, 1. / q_mag);
+    mfloat* q = q_out.pData;
+    mfloat q_mag = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    mat_scale(&q_out, 1.f / q_mag);
 }
 
 void kf_hx(const mat* x, const mfloat* z, mat* out) {
@@ -637,7 +1250,7 @@ void kf_resid(const mat* x, const mfloat* z, mat* out) {
 mfloat kf_altToPressure(mfloat alt) {
     // #assert alt> 0 #if altitude is negative it breaks
     // #alt = np.max([ alt, [0] ]) #it breaks with negative alt.
-    mfloat p = (pow((1 - alt / 44330), 5.25588)) * SEA_LEVEL_PRESSURE;
+    mfloat p = (powf((1 - alt / 44330), 5.25588f)) * SEA_LEVEL_PRESSURE;
     return p;
     // TODO: Checks for negative alt make NaN pressure
 }
@@ -660,17 +1273,17 @@ void kf_write_state(StateEst* state_ptr) {  // Height saved is AGL.
     state_ptr->velEkf = x.pData[KF_VEL];
     state_ptr->accEkf = x.pData[KF_ACC];
 
-    state_ptr->posVarEkf = mat_val(&P, KF_POS, KF_POS);
-    state_ptr->velVarEkf = mat_val(&P, KF_VEL, KF_VEL);
-    state_ptr->accVarEkf = mat_val(&P, KF_ACC, KF_ACC);
+    state_ptr->posVarEkf = kf_var(KF_POS);
+    state_ptr->velVarEkf = kf_var(KF_VEL);
+    state_ptr->accVarEkf = kf_var(KF_ACC);
 
     state_ptr->orientEkfw = x.pData[KF_Q0 + 0];
     state_ptr->orientEkfx = x.pData[KF_Q0 + 1];
     state_ptr->orientEkfy = x.pData[KF_Q0 + 2];
     state_ptr->orientEkfz = x.pData[KF_Q0 + 3];
 
-    state_ptr->orientVarEkfw = mat_val(&P, KF_Q0 + 0, KF_Q0 + 0);
-    state_ptr->orientVarEkfx = mat_val(&P, KF_Q0 + 1, KF_Q0 + 1);
-    state_ptr->orientVarEkfy = mat_val(&P, KF_Q0 + 2, KF_Q0 + 2);
-    state_ptr->orientVarEkfz = mat_val(&P, KF_Q0 + 3, KF_Q0 + 3);
+    state_ptr->orientVarEkfw = kf_var(KF_Q0 + 0);
+    state_ptr->orientVarEkfx = kf_var(KF_Q0 + 1);
+    state_ptr->orientVarEkfy = kf_var(KF_Q0 + 2);
+    state_ptr->orientVarEkfz = kf_var(KF_Q0 + 3);
 }
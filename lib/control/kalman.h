@@ -32,17 +32,41 @@
 #define NUM_ROT_STATES (4)  // rotation states (quaternion)
 #define NUM_KIN_MEAS (3)
 #define NUM_ROT_MEAS (3)
+#define NUM_GPS_MEAS (2)
 #define NUM_TOT_STATES (7)      /** total states */
 #define TIME_CONVERSION (1E6f)  //
 #define G (9.81f)
 #define SEA_LEVEL_PRESSURE (1013.25f) /** milibars */
-#define IMU_ACCEL_MAX (16. * 1)       // accel limit, g
+#define IMU_ACCEL_MAX (16.f * 1)      // accel limit, g
 #define BARO_SPEED_MAX (225)          // m/s
 #define BARO_SPEED_FULL (150)         // m/s
 #define DROGUE_ACCEL_CUTOFF (-20)
 #define USE_LAYERED_ATMOSPHERE \
     (false)  // whether kf uses basic or fancy atmosphere model
 
+// whether kf_do_kf defaults to the sequential (scalar) measurement update
+// instead of the batch update. Can be changed with kf_set_sequential_update
+#ifndef KF_SEQUENTIAL_UPDATE
+#define KF_SEQUENTIAL_UPDATE (false)
+#endif
+
+// whether kf_do_kf defaults to the UD factored filter (P = UDU', Thornton
+// predict and Bierman update) instead of propagating P directly. Can be changed
+// with kf_set_ud_filter
+#ifndef KF_UD_FILTER
+#define KF_UD_FILTER (false)
+#endif
+
+// IMU steps the multirate filter keeps, so a measurement that arrives up to
+// this many steps late can still be fused at the right time
+#ifndef KF_HISTORY_LEN
+#define KF_HISTORY_LEN (32)
+#endif
+
+// GPS measurements further than this many standard deviations from the state
+// are rejected
+#define KF_GPS_GATE (5)
+
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define SIGN(a) ((a) < (0.) ? (-1.) : (1.))
 
@@ -81,7 +105,8 @@ typedef enum {
     KF_ERROR = 1,
     KF_NO_VALID_MEAS = 2,
     KF_INVALID_W = 3,
-    KF_PASS = 4,  // Don't do anything
+    KF_PASS = 4,     // Don't do anything
+    KF_TOO_OLD = 5,  // Measurement is from before the multirate history
 } kf_status;
 
 // Use these enums for indexing x and z for readability and changeability
@@ -98,6 +123,20 @@ typedef enum {  // for z (meas)
     KF_ACC_I = 2,
 } kf_z_idx;
 
+typedef enum {  // for z_gps (GPS meas)
+    KF_GPS_ALT = 0,  // altitude AGL, m
+    KF_GPS_VEL = 1,  // vertical velocity, up, m/s
+} kf_gps_idx;
+
+// Process noise variances and kinematic measurement variances, in boost and
+// coast (_1) and under a parachute (_2)
+typedef struct {
+    mfloat q_vars_1[NUM_TOT_STATES];
+    mfloat q_vars_2[NUM_TOT_STATES];
+    mfloat r_diag_1[NUM_KIN_MEAS];  // pressure, acc_h, acc_i
+    mfloat r_diag_2[NUM_KIN_MEAS];
+} KfNoise;
+
 typedef struct {
     mfloat pressure;
     mfloat acc_h;
@@ -166,8 +205,59 @@ Status kf_init_mats();
 void kf_free_mats();
 void kf_init_state(const mfloat* x0, const mfloat* P0_diag);
 
+/**
+ * @brief Predict and update together, with everything measured at the same
+ * time
+ */
 kf_status kf_do_kf(FlightPhase phase, KfInputVector input, mfloat dt);
 
+/**
+ * MULTIRATE FILTER
+ *
+ * Instead of kf_do_kf, the prediction runs on every IMU sample (with the
+ * accelerometers as its measurement), and the baro and GPS updates run only
+ * when there's a reading. The last KF_HISTORY_LEN IMU steps are kept, so a
+ * reading older than the latest IMU sample is fused at its own time, and the
+ * steps after it are run again.
+ */
+
+/**
+ * @brief Start the multirate filter's timeline at t (NAN for the next IMU
+ * sample), forgetting the history. Needed when time goes backwards.
+ */
+void kf_set_time(mfloat t);
+
+/**
+ * @brief Predict to time t, then update with the accelerometers
+ *
+ * @param acc_h High-range accel along the vertical axis (g), can be NaN
+ * @param acc_i IMU accel along the vertical axis (g), can be NaN
+ * @param w_meas Angular velocity (rad/s); the last one is kept if it has NaNs
+ * @return kf_status KF_PASS on the ground, where only the time is tracked
+ */
+kf_status kf_imu_step(FlightPhase phase, mfloat t, mfloat acc_h, mfloat acc_i,
+                      const mfloat* w_meas);
+
+/**
+ * @brief Update with a baro reading taken at time t
+ *
+ * @param pressure NaN if there is no new reading, in which case nothing runs
+ * @return kf_status KF_TOO_OLD if t is from before the history
+ */
+kf_status kf_baro_step(FlightPhase phase, mfloat t, mfloat pressure);
+
+/**
+ * @brief Update with a GPS fix from time t, e.g. its timestamp less the
+ * receiver's latency. A fix from after the latest IMU sample is fused at that
+ * sample's time.
+ *
+ * @param z_gps Indexed by kf_gps_idx, NaN for what the fix doesn't have
+ * @param R_gps Measurement variances
+ * @return kf_status KF_TOO_OLD if t is from before the history
+ */
+kf_status kf_gps_step(FlightPhase phase, mfloat t, const mfloat* z_gps,
+                      const mfloat* R_gps);
+
 /**
  * @brief
  *
@@ -189,14 +279,102 @@ kf_status kf_predict(mfloat dt, const mfloat* w);
  */
 kf_status kf_update(const mfloat* z, const mfloat* R_diag);
 
+/**
+ * @brief Same as kf_update, but processes each valid measurement as a scalar
+ * update. No matrix inverse and no resizing of H/R/y/K for NaN measurements.
+ *
+ * @param z Measurements, can contain NaNs
+ * @param R_diag Measurement variances
+ * @return kf_status KF_NO_VALID_MEAS if all measurements are NaN
+ */
+kf_status kf_update_sequential(const mfloat* z, const mfloat* R_diag);
+
+/**
+ * @brief Select which measurement update kf_do_kf uses
+ *
+ * @param enable true for kf_update_sequential, false for kf_update
+ */
+void kf_set_sequential_update(bool enable);
+
+/**
+ * @brief Select whether kf_do_kf runs the UD factored filter. Enabling it
+ * factors the current P. While it runs, U and D are the covariance and P is
+ * left stale; disabling it forms P from them again.
+ *
+ * @param enable true for the UD filter, false for the standard one
+ */
+void kf_set_ud_filter(bool enable);
+
+/**
+ * @brief Use different noise parameters from kf_preprocess on
+ *
+ * @param noise Copied; NULL goes back to the defaults
+ */
+void kf_set_noise(const KfNoise* noise);
+
+/**
+ * @brief The noise parameters in use
+ */
+const KfNoise* kf_get_noise();
+
+/**
+ * @brief Standard deviations from the altitude past which kf_do_kf and
+ * kf_baro_step gate pressure measurements (see kf_pressure_gate)
+ */
+void kf_set_pressure_gate(mfloat stdevs);
+
+void kf_ud_factor();  // factor P into U and D
+void kf_ud_to_P();    // P = UDU'
+
+/**
+ * @brief UD version of kf_predict. Propagates U and D with Thornton's
+ * modified weighted Gram-Schmidt, never forming P.
+ *
+ * @param dt
+ * @param w
+ * @return kf_status KF_ERROR if D would no longer be positive, in which case
+ * U and D are left as they were
+ */
+kf_status kf_predict_ud(mfloat dt, const mfloat* w);
+
+/**
+ * @brief UD version of kf_update_sequential. Bierman's scalar update of U and
+ * D for each valid measurement, no inverse and no Joseph form.
+ *
+ * @param z Measurements, can contain NaNs
+ * @param R_diag Measurement variances
+ * @return kf_status KF_NO_VALID_MEAS if all measurements are NaN
+ */
+kf_status kf_update_ud(const mfloat* z, const mfloat* R_diag);
+
+/**
+ * @brief Scalar updates with GPS altitude and vertical velocity, with whichever
+ * filter is selected. Each is skipped if NaN, or if it fails the KF_GPS_GATE
+ * innovation gate.
+ *
+ * @param z_gps Indexed by kf_gps_idx, can contain NaNs
+ * @param R_gps Measurement variances
+ * @return kf_status KF_NO_VALID_MEAS if nothing was fused
+ */
+kf_status kf_update_gps(const mfloat* z_gps, const mfloat* R_gps);
+
 kf_status kf_preprocess(mfloat* z, mfloat* R_diag, FlightPhase phase);
 
 void kf_pressure_gate(mfloat* z, mfloat stdevs);
 
-void kf_Q_matrix(mfloat dt);  // process noise matrix
+/**
+ * @brief P = FPF' + Q, using the block structure of F, the symmetry of P, and
+ * the diagonal Q. Equivalent to the dense product, but with a fraction of the
+ * flops.
+ *
+ * @param dt
+ */
+void kf_predict_P(mfloat dt);
+
 void kf_F_matrix(mfloat dt);  // state update matrix (linearized)
 void kf_R_matrix(const mfloat* meas_vars,
                  const mfloat* z);  // measurement noise matrix
+mfloat kf_dpdh(const mat* x);  // d(pressure)/d(alt) at the current state
 kf_status kf_H_matrix(const mat* x,
                       const mfloat* z);  // measurement matrix (linearized)
 /**
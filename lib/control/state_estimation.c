@@ -5,32 +5,44 @@
 
 #include "atmosphere.h"
 #include "backup/backup.h"
-#include "filter/median_filter.h"
 #include "filter/sma_filter.h"
+#include "filter/smooth_diff.h"
 #include "kalman.h"
 #include "quat.h"
-#include "sample_window.h"
 #include "vector.h"
 
-#define DEG_TO_RAD(x) (x * M_PI / 180)
-
 #define CHUTE_DEPLOYED(x) \
     ((x) == FP_DROGUE || (x) == FP_MAIN || (x) == FP_LANDED)
 
+// Fields of GpsFrame.valid_flags, as packed from GPS_Fix_TypeDef
+#define GPS_FIX_TYPE(flags) (((flags) >> 3) & 0b11111)
+#define GPS_FIX_VALID(flags) (((flags) >> 8) & 0b1)
+#define GPS_INVALID_LLH(flags) (((flags) >> 19) & 0b1)
+#define GPS_FIX_3D 3
+#define GPS_FIX_GNSS_DR 4
+
+_Static_assert(ESTIMATOR_NUM_STATES == NUM_TOT_STATES,
+               "Estimator config Q size doesn't match the EKF");
+_Static_assert(ESTIMATOR_NUM_KIN_MEAS == NUM_KIN_MEAS,
+               "Estimator config R size doesn't match the EKF");
+
 typedef Vector* (*OrientFunc)(float, float, float, Vector*);
 static OrientFunc get_orientation_function(SensorDirection up_dir);
 
 static StateEst* s_state_ptr = NULL;
 
-static MedianFilter s_baro_alt_median;
-static SmaFilter s_baro_alt_sma;
-static SmaFilter s_baro_vel_sma;
+static SmoothDiff s_baro;
 
-static SampleWindow s_baro_alt_window;
-static SampleWindow s_baro_time_window;
+// GPS altitude (MSL) on the pad, which GPS altitude in flight is relative to
+static SmaFilter s_gps_ground;
+
+static Tilt s_tilt;
 
 static OrientFunc orientation_function = NULL;
 
+// Acceleration of the latest frame, reused when both accelerometers fail
+static Vector s_current_acc;
+
 static Vector s_grav_vec = {.x = -G_MAG, .y = 0.f, .z = 0.f};
 
 static float* s_ground_alt_ptr;
@@ -96,14 +108,7 @@ static float se_baro_weight(float alt_m, float vel_mps) {
     float vel_weight = vel_weight_clamp * vel_weight_logistic;
 
     // Also weight by the health of the baro filters
-    float alt_median_filter_weight =
-        (float)s_baro_alt_median.size / (float)s_baro_alt_median.capacity;
-    float alt_sma_filter_weight =
-        (float)s_baro_alt_sma.size / (float)s_baro_alt_sma.capacity;
-    float alt_filter_weight = alt_median_filter_weight * alt_sma_filter_weight;
-    float vel_filter_weight =
-        (float)s_baro_vel_sma.size / (float)s_baro_vel_sma.capacity;
-    float filter_weight = alt_filter_weight * vel_filter_weight;
+    float filter_weight = smooth_diff_fill(&s_baro);
 
     float total_weight = alt_weight * vel_weight * filter_weight;
     return total_weight < 0.f ? 0.f : total_weight > 1.f ? 1.f : total_weight;
@@ -118,17 +123,61 @@ static float se_baro_alt_m(float p_mbar) {
     return se_valid_pressure(p_mbar) ? alt_m : NAN;
 }
 
+static bool valid_variances(const float* vars, size_t len, bool allow_zero) {
+    for (size_t i = 0; i < len; i++) {
+        // Written so that NAN fails
+        if (!(vars[i] <= ESTIMATOR_MAX_VARIANCE &&
+              (vars[i] > 0 || (allow_zero && vars[i] == 0)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool valid_window(uint32_t len, uint32_t min, uint32_t max) {
+    return len >= min && len <= max;
+}
+
+Status se_check_config(const EstimatorConfig* config) {
+    bool valid =
+        config->version == ESTIMATOR_CONFIG_VERSION &&
+        valid_variances(config->q_vars_1, NUM_TOT_STATES, true) &&
+        valid_variances(config->q_vars_2, NUM_TOT_STATES, true) &&
+        valid_variances(config->r_diag_1, NUM_KIN_MEAS, false) &&
+        valid_variances(config->r_diag_2, NUM_KIN_MEAS, false) &&
+        config->pressure_gate_stdevs >= ESTIMATOR_MIN_PRESSURE_GATE_STDEVS &&
+        config->pressure_gate_stdevs <= ESTIMATOR_MAX_PRESSURE_GATE_STDEVS &&
+        valid_window(config->baro_alt_median_window, 1,
+                     MEDIAN_FILTER_MAX_CAPACITY) &&
+        valid_window(config->baro_alt_sma_window, 1,
+                     SMA_FILTER_MAX_CAPACITY) &&
+        valid_window(config->baro_diff_window, 2,
+                     SAMPLE_WINDOW_MAX_CAPACITY) &&
+        valid_window(config->baro_vel_sma_window, 1, SMA_FILTER_MAX_CAPACITY);
+
+    return valid ? STATUS_OK : STATUS_PARAMETER_ERROR;
+}
+
 Status se_init() {
-    ASSERT_OK(median_filter_init(&s_baro_alt_median, BARO_ALT_MEDIAN_WINDOW),
-              "failed to init baro alt median filter\n");
-    ASSERT_OK(sma_filter_init(&s_baro_alt_sma, BARO_ALT_SMA_WINDOW),
-              "failed to init baro alt sma filter\n");
-    ASSERT_OK(sma_filter_init(&s_baro_vel_sma, BARO_VEL_SMA_WINDOW),
-              "failed to init baro vel sma filter\n");
-    ASSERT_OK(sample_window_init(&s_baro_alt_window, BARO_DIFF_WINDOW),
-              "failed to init baro diff alt window\n");
-    ASSERT_OK(sample_window_init(&s_baro_time_window, BARO_DIFF_WINDOW),
-              "failed to init baro diff time window\n");
+    static const EstimatorConfig s_default_config = ESTIMATOR_CONFIG_DEFAULT;
+    const EstimatorConfig* est_config = &config_get_ptr()->estimator;
+    if (se_check_config(est_config) != STATUS_OK) {
+        PAL_LOGW("Estimator config is invalid; using defaults\n");
+        est_config = &s_default_config;
+    }
+
+    const SmoothDiffConfig baro_config = {
+        .median_len = est_config->baro_alt_median_window,
+        .sma_len = est_config->baro_alt_sma_window,
+        .diff_len = est_config->baro_diff_window,
+        .rate_sma_len = est_config->baro_vel_sma_window,
+    };
+    ASSERT_OK(smooth_diff_init(&s_baro, &baro_config),
+              "failed to init baro filters\n");
+    ASSERT_OK(sma_filter_init(&s_gps_ground, GPS_GROUND_SMA_WINDOW),
+              "failed to init GPS ground filter\n");
+    ASSERT_OK(tilt_init(&s_tilt, TILT_RATE_WINDOW),
+              "failed to init tilt filter\n");
 
     s_state_ptr = &(backup_get_ptr()->state_estimate);
     s_ground_alt_ptr = &(backup_get_ptr()->ground_alt_m);
@@ -140,6 +189,13 @@ Status se_init() {
 
     // kf init
     ASSERT_OK(kf_init_mats(), "failed to allocate memory for kf matrices");
+    KfNoise noise;
+    memcpy(noise.q_vars_1, est_config->q_vars_1, sizeof(noise.q_vars_1));
+    memcpy(noise.q_vars_2, est_config->q_vars_2, sizeof(noise.q_vars_2));
+    memcpy(noise.r_diag_1, est_config->r_diag_1, sizeof(noise.r_diag_1));
+    memcpy(noise.r_diag_2, est_config->r_diag_2, sizeof(noise.r_diag_2));
+    kf_set_noise(&noise);
+    kf_set_pressure_gate(est_config->pressure_gate_stdevs);
     mfloat x0[NUM_TOT_STATES] = {0, 0, 0, 1,
                                  0, 0, 0};  // TODO: get these from config file
     mfloat P0_diag[NUM_TOT_STATES] = {30, 30, 500, 1,
@@ -161,18 +217,17 @@ Status se_init() {
 }
 
 Status se_reset() {
-    median_filter_reset(&s_baro_alt_median);
-    sma_filter_reset(&s_baro_alt_sma);
-    sma_filter_reset(&s_baro_vel_sma);
-    sample_window_reset(&s_baro_alt_window);
-    sample_window_reset(&s_baro_time_window);
+    smooth_diff_reset(&s_baro);
+    tilt_reset(&s_tilt);
     memset(s_state_ptr, 0, sizeof(StateEst));
     s_state_ptr->orientation.w = 1;
+    kf_set_time(NAN);
     return STATUS_OK;
 }
 
 Status se_set_time(float t_s) {
     s_state_ptr->time = t_s;
+    kf_set_time(t_s);
     PAL_LOGI("State estimation time reinitialized to %.1f \n", t_s);
     return STATUS_OK;
 }
@@ -186,6 +241,8 @@ Status se_set_ground_pressure(float p_mbar) {
 
 const StateEst* se_predict() { return s_state_ptr; }
 
+const Tilt* se_tilt() { return &s_tilt; }
+
 StateFrame se_as_frame() {
     StateFrame frame = {
         .timestamp = (uint64_t)(s_state_ptr->time * 1e6f),
@@ -243,7 +300,12 @@ StateFrame se_as_frame() {
     return frame;
 }
 
-Status se_update(FlightPhase phase, const SensorFrame* sensor_frame) {
+// Everything that runs for every frame: picking sensors, the baro filters,
+// integration, and the EKF prediction and updates. Without ekf_baro, the
+// EKF still predicts and updates with the accelerometers, but skips the baro
+// update.
+static void se_integrate(FlightPhase phase, const SensorFrame* sensor_frame,
+                         bool ekf_baro) {
     // Sensor timestamp is in us, so convert to seconds (float)
     float t = sensor_frame->timestamp / 1e6f;
     float dt = t - s_state_ptr->time;
@@ -252,8 +314,6 @@ Status se_update(FlightPhase phase, const SensorFrame* sensor_frame) {
     /***********************/
     /* ACCELERATION UPDATE */
     /***********************/
-    static Vector s_current_acc;
-
     Vector acc_h;
     Vector acc_i;
 
@@ -336,31 +396,11 @@ Status se_update(FlightPhase phase, const SensorFrame* sensor_frame) {
     /***********************/
     /* LINEAR MODEL UPDATE */
     /***********************/
-    // Median filter on the first stage for outlier rejection
-    median_filter_insert(&s_baro_alt_median, baro_alt);
-    float median_baro_alt = median_filter_get_median(&s_baro_alt_median);
-
-    // SMA filter on the second stage for smoothing
-    sma_filter_insert(&s_baro_alt_sma, median_baro_alt);
-    s_state_ptr->posBaro = sma_filter_get_mean(&s_baro_alt_sma);
-
-    // Calculate baro velocity using the differentiaton window
-    sample_window_insert(&s_baro_alt_window, s_state_ptr->posBaro);
-    sample_window_insert(&s_baro_time_window, s_state_ptr->time);
-    float old_baro_alt = sample_window_get(&s_baro_alt_window, 0);
-    float old_baro_time = sample_window_get(&s_baro_time_window, 0);
-    float baro_alt_diff = s_state_ptr->posBaro - old_baro_alt;
-    float baro_time_diff = s_state_ptr->time - old_baro_time;
-    float baro_vel = baro_alt_diff / baro_time_diff;
-
-    // SMA filter on the velocity calculated above
-    sma_filter_insert(&s_baro_vel_sma, baro_vel);
-    s_state_ptr->velBaro = sma_filter_get_mean(&s_baro_vel_sma);
-
-    // If the filters empty out, the baro estimates can be NAN, so make sure to
-    // not infect the main state estimates with the NANovirus
-    bool baro_valid =
-        !isnan(s_state_ptr->posBaro) && !isnan(s_state_ptr->velBaro);
+    // Outlier rejection and smoothing, then velocity from the smoothed
+    // altitude, all in one pass
+    smooth_diff_update(&s_baro, s_state_ptr->time, baro_alt);
+    s_state_ptr->posBaro = s_baro.value;
+    s_state_ptr->velBaro = s_baro.rate;
 
     // Acceleration updates
     float last_imu_acc = s_state_ptr->accImu;
@@ -376,6 +416,59 @@ Status se_update(FlightPhase phase, const SensorFrame* sensor_frame) {
     // Always update acceleration
     s_state_ptr->accVert = s_state_ptr->accImu;
 
+    /*************************/
+    /* INERTIAL MODEL UPDATE */
+    /*************************/
+    if (FP_BOOST <= phase && phase <= FP_MAIN) {
+        Vector vec_temp;
+        Quaternion quat_temp;
+
+        Vector iacc_old = s_state_ptr->accGeo;
+        Vector ivel_old = s_state_ptr->velGeo;
+
+        quat_rot_inv(&(s_current_acc), &(s_state_ptr->orientation),
+                     &(s_state_ptr->accGeo));
+
+        vec_iadd(&(s_state_ptr->accGeo), &s_grav_vec);
+
+        vec_int_step(&(s_state_ptr->velGeo), &iacc_old,
+                     &(s_state_ptr->accGeo), dt, &vec_temp);
+        vec_copy(&vec_temp, &(s_state_ptr->velGeo));
+
+        vec_int_step(&(s_state_ptr->posGeo), &ivel_old,
+                     &(s_state_ptr->velGeo), dt, &vec_temp);
+        vec_copy(&vec_temp, &(s_state_ptr->posGeo));
+
+        quat_step(&(s_state_ptr->orientation), &(s_state_ptr->angVelBody), dt,
+                  &quat_temp);
+        quat_copy(&quat_temp, &(s_state_ptr->orientation));
+
+        tilt_update(&s_tilt, &(s_state_ptr->orientation),
+                    &(s_state_ptr->angVelBody));
+    }
+
+    /********************/
+    /* EKF MODEL UPDATE */
+    /********************/
+    // Predict to every IMU sample, and update with the baro only when there's
+    // a reading. Outside of flight, the EKF only keeps track of the time.
+    mfloat w_meas[NUM_ROT_MEAS] = {rot.x, rot.y, rot.z};
+    kf_imu_step(phase, t,  ///
+                se_valid_acc(acc_h.x) ? acc_h.x : NAN,
+                se_valid_acc(acc_i.x) ? acc_i.x : NAN, w_meas);
+    if (ekf_baro) {
+        kf_baro_step(phase, t, se_valid_pressure(pressure) ? pressure : NAN);
+    }
+}
+
+// Everything that runs once per control cycle: blending the linear model, and
+// writing out the EKF state
+static void se_fuse(FlightPhase phase) {
+    // If the filters empty out, the baro estimates can be NAN, so make sure to
+    // not infect the main state estimates with the NANovirus
+    bool baro_valid =
+        !isnan(s_state_ptr->posBaro) && !isnan(s_state_ptr->velBaro);
+
     // Combined state updates
     if (FP_BOOST <= phase && phase <= FP_MAIN) {
         if (phase == FP_DROGUE || phase == FP_MAIN) {
@@ -401,50 +494,110 @@ Status se_update(FlightPhase phase, const SensorFrame* sensor_frame) {
         }
     } else {
         // If we're on the ground, skip all state updates
-        return STATUS_OK;
+        return;
     }
 
-    /*************************/
-    /* INERTIAL MODEL UPDATE */
-    /*************************/
-    Vector vec_temp;
-    Quaternion quat_temp;
+    kf_write_state(s_state_ptr);  // write new state to StateEst
+}
 
-    Vector iacc_old = s_state_ptr->accGeo;
-    Vector ivel_old = s_state_ptr->velGeo;
+Status se_update_batch(FlightPhase phase, const SensorFrame* sensor_frames,
+                       size_t num_frames) {
+    if (num_frames == 0) {
+        return STATUS_PARAMETER_ERROR;
+    }
 
-    quat_rot_inv(&(s_current_acc), &(s_state_ptr->orientation),
-                 &(s_state_ptr->accGeo));
+    // Integrate and filter every frame, then combine the results once
+    for (size_t i = 0; i < num_frames; i++) {
+        se_integrate(phase, &sensor_frames[i], true);
+    }
+    se_fuse(phase);
 
-    vec_iadd(&(s_state_ptr->accGeo), &s_grav_vec);
+    return STATUS_OK;
+}
 
-    vec_int_step(&(s_state_ptr->velGeo), &iacc_old, &(s_state_ptr->accGeo), dt,
-                 &vec_temp);
-    vec_copy(&vec_temp, &(s_state_ptr->velGeo));
+Status se_fast_forward(FlightPhase phase, const SensorFrame* ring,
+                       size_t capacity, size_t start, size_t num_frames,
+                       StateFrame* states) {
+    if (num_frames == 0 || num_frames > capacity || start >= capacity) {
+        return STATUS_PARAMETER_ERROR;
+    }
 
-    vec_int_step(&(s_state_ptr->posGeo), &ivel_old, &(s_state_ptr->velGeo), dt,
-                 &vec_temp);
-    vec_copy(&vec_temp, &(s_state_ptr->posGeo));
+    // The newest frame with a reading gets the one baro update
+    size_t baro_idx = num_frames;
+    for (size_t i = num_frames; i-- > 0;) {
+        if (se_valid_pressure(ring[(start + i) % capacity].pressure)) {
+            baro_idx = i;
+            break;
+        }
+    }
 
-    quat_step(&(s_state_ptr->orientation), &(s_state_ptr->angVelBody), dt,
-              &quat_temp);
-    quat_copy(&quat_temp, &(s_state_ptr->orientation));
+    // Combined after every frame, as if each had been its own cycle, so that
+    // every state on the way can be logged
+    for (size_t i = 0; i < num_frames; i++) {
+        se_integrate(phase, &ring[(start + i) % capacity], i == baro_idx);
+        se_fuse(phase);
+        if (states != NULL) {
+            states[i] = se_as_frame();
+            states[i].flight_phase = phase;
+        }
+    }
 
-    /********************/
-    /* EKF MODEL UPDATE */
-    /********************/
-    KfInputVector kf_input = {
-        .pressure = se_valid_pressure(pressure) ? pressure : NAN,
-        .acc_h = se_valid_acc(acc_h.x) ? acc_h.x : NAN,
-        .acc_i = se_valid_acc(acc_i.x) ? acc_i.x : NAN,
-        .rot_x = rot.x,
-        .rot_y = rot.y,
-        .rot_z = rot.z,
-    };
+    return STATUS_OK;
+}
+
+Status se_update(FlightPhase phase, const SensorFrame* sensor_frame) {
+    return se_update_batch(phase, sensor_frame, 1);
+}
+
+Status se_update_gps(FlightPhase phase, const GpsFrame* gps_frame) {
+    uint64_t flags = gps_frame->valid_flags;
+    uint32_t fix_type = GPS_FIX_TYPE(flags);
+    if ((fix_type != GPS_FIX_3D && fix_type != GPS_FIX_GNSS_DR) ||
+        !GPS_FIX_VALID(flags) || GPS_INVALID_LLH(flags) ||
+        gps_frame->num_sats < GPS_MIN_SATS) {
+        return STATUS_DATA_ERROR;
+    }
+
+    // Written so that NAN accuracies fail
+    bool alt_ok = gps_frame->accuracy_vertical <= GPS_MAX_ACC_VERT_M;
+    bool vel_ok = gps_frame->accuracy_speed <= GPS_MAX_ACC_SPEED_MPS;
 
-    kf_do_kf(phase, kf_input, dt);  // TODO: status output here
-    kf_write_state(s_state_ptr);    // write new state to StateEst
+    if (phase < FP_BOOST) {
+        // On the pad, only keep track of where the ground is
+        if (!(gps_frame->accuracy_vertical <= GPS_MAX_ACC_GROUND_M)) {
+            return STATUS_DATA_ERROR;
+        }
+        sma_filter_insert(&s_gps_ground, gps_frame->height_msl);
+        return STATUS_OK;
+    }
+    if (phase > FP_MAIN) {
+        return STATUS_OK;
+    }
+
+    // The EKF's altitude is AGL, so without a ground altitude only the
+    // velocity can be used
+    bool ground_ok = s_gps_ground.size == s_gps_ground.capacity;
+    mfloat z_gps[NUM_GPS_MEAS] = {NAN, NAN};
+    mfloat R_gps[NUM_GPS_MEAS] = {NAN, NAN};
+    if (alt_ok && ground_ok) {
+        float acc = fmaxf(gps_frame->accuracy_vertical, GPS_MIN_ACC_VERT_M);
+        z_gps[KF_GPS_ALT] =
+            gps_frame->height_msl - sma_filter_get_mean(&s_gps_ground);
+        R_gps[KF_GPS_ALT] = acc * acc;
+    }
+    if (vel_ok) {
+        float acc = fmaxf(gps_frame->accuracy_speed, GPS_MIN_ACC_SPEED_MPS);
+        z_gps[KF_GPS_VEL] = -gps_frame->vel_down;
+        R_gps[KF_GPS_VEL] = acc * acc;
+    }
+
+    // The EKF goes back to when the fix was taken, then catches up again
+    float t = gps_frame->timestamp / 1e6f - GPS_LATENCY_S;
+    if (kf_gps_step(phase, t, z_gps, R_gps) != KF_SUCCESS) {
+        return STATUS_DATA_ERROR;
+    }
 
+    kf_write_state(s_state_ptr);
     return STATUS_OK;
 }
 
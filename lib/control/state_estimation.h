@@ -1,29 +1,52 @@
 #ifndef STATE_ESTIMATION_H
 #define STATE_ESTIMATION_H
 
+#include "board_config.h"
 #include "flight_control.h"
+#include "gps.pb.h"
 #include "quat.h"
 #include "sensor.pb.h"
 #include "state.pb.h"
 #include "status.h"
+#include "tilt.h"
 #include "vector.h"
 
 #ifndef LOW_G_MAX_ACC
 #define LOW_G_MAX_ACC (15)
 #endif
 
-#ifndef M_PI
-#define M_PI (3.1415926535f)
-#endif
-
 #ifndef G_MAG
 #define G_MAG (9.81f)
 #endif
 
-#define BARO_ALT_MEDIAN_WINDOW 25
-#define BARO_ALT_SMA_WINDOW 50
-#define BARO_VEL_SMA_WINDOW 25
-#define BARO_DIFF_WINDOW 5
+// Bounds on the estimator block of the board config
+#define ESTIMATOR_MAX_VARIANCE (1e6f)
+#define ESTIMATOR_MIN_PRESSURE_GATE_STDEVS (1.f)
+#define ESTIMATOR_MAX_PRESSURE_GATE_STDEVS (1000.f)
+
+// How old a GPS fix is when it's polled: the receiver solves at 8 Hz, so on
+// average half a navigation period, plus the time to compute and send it
+#define GPS_LATENCY_S (0.1f)
+
+// GPS fixes used by the EKF need a 3D solution, and at least this quality
+#define GPS_MIN_SATS 6
+#define GPS_MAX_ACC_VERT_M (10.f)
+#define GPS_MAX_ACC_SPEED_MPS (2.f)
+
+// The receiver's accuracy estimates can be optimistic, so the EKF never trusts
+// a fix more than this
+#define GPS_MIN_ACC_VERT_M (2.f)
+#define GPS_MIN_ACC_SPEED_MPS (0.2f)
+
+// Fixes averaged on the pad for the GPS ground altitude. GPS altitude is only
+// fused once the window is full of fixes at least this good, since any error
+// in the ground altitude is a bias against the baro for the whole flight
+#define GPS_GROUND_SMA_WINDOW 50
+#define GPS_MAX_ACC_GROUND_M (3.f)
+
+// Samples the tilt rate is smoothed over, so one noisy gyro reading doesn't
+// lock out a stage
+#define TILT_RATE_WINDOW 10
 
 typedef struct {
     float time;  // seconds
@@ -78,6 +101,19 @@ typedef enum {
     IMU_Z_DOWN
 } SensorDirection;
 
+/**
+ * @brief Check an estimator config against its version and bounds: positive
+ * finite variances, a sane pressure gate, and filter windows that fit the
+ * statically sized filters
+ *
+ * @return STATUS_PARAMETER_ERROR if it can't be used
+ */
+Status se_check_config(const EstimatorConfig* config);
+
+/**
+ * @brief Set up the filters and EKF from the board config's estimator block,
+ * or the defaults if it fails se_check_config()
+ */
 Status se_init();
 
 Status se_reset();
@@ -88,8 +124,58 @@ Status se_set_ground_pressure(float p_mbar);
 
 const StateEst* se_predict();
 
+/**
+ * @brief Tilt of the body axis from vertical, updated with the attitude in
+ * flight; level until launch
+ */
+const Tilt* se_tilt();
+
 StateFrame se_as_frame();
 
 Status se_update(FlightPhase phase, const SensorFrame* sensor_frame);
 
+/**
+ * @brief Update from several frames at once, e.g. everything the sensors
+ * produced since the last control cycle
+ *
+ * Every frame is integrated, and the EKF predicts, at its own timestamp, with
+ * a baro update wherever a frame has a reading. The estimates are combined
+ * once at the end. se_update() is a batch of one.
+ *
+ * @param sensor_frames In order, oldest first
+ */
+Status se_update_batch(FlightPhase phase, const SensorFrame* sensor_frames,
+                       size_t num_frames);
+
+/**
+ * @brief Catch up on frames that are already in the past, e.g. launch replay
+ *
+ * As se_update_batch(), except that the EKF only takes its IMU steps (a
+ * predict and the accelerometer update), and gets a single baro update from
+ * the newest reading at the end. The baro filters still see every reading.
+ * The cost is one IMU step per frame. The accelerometer updates are kept
+ * since they're all that drives the acceleration state through boost. The
+ * estimates are combined after every frame.
+ *
+ * @param ring Frames in order, oldest first, wrapping around at capacity
+ * @param start Index in ring of the oldest frame
+ * @param states If not NULL, gets the state after each frame, num_frames of
+ * them, as of phase
+ */
+Status se_fast_forward(FlightPhase phase, const SensorFrame* ring,
+                       size_t capacity, size_t start, size_t num_frames,
+                       StateFrame* states);
+
+/**
+ * @brief Fuse a GPS fix into the EKF, at its timestamp less GPS_LATENCY_S
+ *
+ * On the ground, good fixes only go towards the GPS ground altitude. In
+ * flight, the altitude above it (once it's known) and the vertical velocity
+ * are fused, each only if the fix is good enough. Call after se_update_batch()
+ * for the sensor frames up to the fix's time.
+ *
+ * @return STATUS_DATA_ERROR if the fix wasn't used
+ */
+Status se_update_gps(FlightPhase phase, const GpsFrame* gps_frame);
+
 #endif  // STATE_ESTIMATION_H
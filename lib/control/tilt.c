@@ -0,0 +1,62 @@
+#include "tilt.h"
+
+#include <math.h>
+
+Status tilt_init(Tilt* tilt, size_t rate_window) {
+    Status status = sma_filter_init(&tilt->rate_sma, rate_window);
+    tilt_reset(tilt);
+    return status;
+}
+
+void tilt_reset(Tilt* tilt) {
+    tilt->cos_tilt = 1;
+    tilt->rate = 0;
+    tilt->max_rate = 0;
+    sma_filter_reset(&tilt->rate_sma);
+}
+
+void tilt_update(Tilt* tilt, const Quaternion* orientation,
+                 const Vector* ang_vel_body) {
+    // The vertical component of the rotated body x axis is the top left of
+    // the rotation matrix, 1 - 2(y^2 + z^2) for a unit quaternion, or this
+    // for any other
+    float w2 = orientation->w * orientation->w;
+    float x2 = orientation->x * orientation->x;
+    float y2 = orientation->y * orientation->y;
+    float z2 = orientation->z * orientation->z;
+    float cos_tilt = (w2 + x2 - y2 - z2) / (w2 + x2 + y2 + z2);
+
+    // Rounding can take it just past the ends; a NAN stays NAN
+    if (cos_tilt > 1) {
+        cos_tilt = 1;
+    } else if (cos_tilt < -1) {
+        cos_tilt = -1;
+    }
+    tilt->cos_tilt = cos_tilt;
+
+    sma_filter_insert(&tilt->rate_sma,
+                      sqrtf(ang_vel_body->y * ang_vel_body->y +
+                            ang_vel_body->z * ang_vel_body->z));
+    float rate = sma_filter_get_mean(&tilt->rate_sma);
+    if (!isnan(rate)) {
+        tilt->rate = rate;
+        if (rate > tilt->max_rate) {
+            tilt->max_rate = rate;
+        }
+    }
+}
+
+float tilt_cos_limit(float angle_deg) {
+    if (angle_deg <= 0) {
+        return 1;
+    }
+    if (angle_deg >= 180) {
+        return -1;
+    }
+    return cosf(DEG_TO_RAD(angle_deg));
+}
+
+bool tilt_within(const Tilt* tilt, float cos_min_angle, float cos_max_angle) {
+    // Cosine falls as the angle grows. Written so that a NAN tilt fails.
+    return tilt->cos_tilt <= cos_min_angle && tilt->cos_tilt >= cos_max_angle;
+}
@@ -0,0 +1,58 @@
+#ifndef TILT_H
+#define TILT_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "filter/sma_filter.h"
+#include "quat.h"
+#include "status.h"
+#include "vector.h"
+
+/**
+ * @brief How far the body axis (x, along the rocket) is from vertical, and how
+ * fast it's swinging, kept up to date with the attitude
+ *
+ * The tilt is kept as its cosine, the vertical component of the body axis,
+ * so limits are compared against cosines and nothing needs acos. The rate is
+ * the angular rate across the body axis, which bounds how fast the tilt can
+ * change and also catches coning.
+ */
+typedef struct {
+    float cos_tilt;  // Cosine of the angle from vertical, in [-1, 1]
+    float rate;      // Across the body axis, rad/s, smoothed
+    float max_rate;  // Largest smoothed rate since the last reset, rad/s
+    SmaFilter rate_sma;
+} Tilt;
+
+/**
+ * @brief Start level and still
+ *
+ * @param rate_window Samples the rate is smoothed over
+ */
+Status tilt_init(Tilt* tilt, size_t rate_window);
+
+void tilt_reset(Tilt* tilt);
+
+/**
+ * @brief Update from a new attitude, which needn't be normalized, and body
+ * angular rates (rad/s)
+ */
+void tilt_update(Tilt* tilt, const Quaternion* orientation,
+                 const Vector* ang_vel_body);
+
+/**
+ * @brief Cosine of the angle from vertical, for comparing with cos_tilt
+ *
+ * Angles outside [0, 180] degrees are clamped, so a limit past either end
+ * never trips.
+ */
+float tilt_cos_limit(float angle_deg);
+
+/**
+ * @brief Whether the tilt is between two angles from vertical, given as
+ * tilt_cos_limit() of each
+ */
+bool tilt_within(const Tilt* tilt, float cos_min_angle, float cos_max_angle);
+
+#endif  // TILT_H
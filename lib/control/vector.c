@@ -43,7 +43,7 @@ float vec_dot(const Vector *v1, const Vector *v2) {
 
 Vector *vec_cross(const Vector *v1, const Vector *v2, Vector *v_out) {
     v_out->x = v1->y * v2->z - v1->z * v2->y;
-    v_out->y = v1->z * v2->z - v1->x * v2->z;
+    v_out->y = v1->z * v2->x - v1->x * v2->z;
     v_out->z = v1->x * v2->y - v1->y * v2->x;
     return v_out;
 }
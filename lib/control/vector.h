@@ -1,12 +1,20 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <math.h>
+
 typedef struct {
     float x, y, z;
 } Vector;
 
 #define VEC_ZERO ((Vector){0, 0, 0})
 
+#ifndef M_PI
+#define M_PI (3.1415926535f)
+#endif
+
+#define DEG_TO_RAD(x) ((x) * (float)M_PI / 180.f)
+
 Vector *vec_copy(const Vector *vec, Vector *v_out);
 Vector *vec_add(const Vector *v1, const Vector *v2, Vector *v_out);
 Vector *vec_sub(const Vector *v1, const Vector *v2, Vector *v_out);
@@ -1,6 +1,7 @@
 #include "pspcom.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "board_mgmt.h"
 #include "camera.h"
@@ -12,31 +13,6 @@
 static uint8_t pyro_armed[5];
 static uint64_t pyro_armed_start[5];
 
-uint16_t crc16(uint16_t checksum, pspcommsg *msg) {
-    // Some code is taken from ChatGPT
-    uint8_t *msg_content = (uint8_t *)malloc(5 + msg->payload_len);
-    msg_content[0] = '!';
-    msg_content[1] = '$';
-    msg_content[2] = (uint8_t)msg->payload_len;
-    msg_content[3] = (uint8_t)msg->device_id;
-    msg_content[4] = (uint8_t)msg->msg_id;
-    for (int i = 0; i < msg->payload_len; i++) {
-        msg_content[5 + i] = msg->payload[i];
-    }
-    for (int i = 0; i < 5 + msg->payload_len; i++) {
-        checksum ^= (uint16_t)msg_content[i] << 8;  // XOR with next byte
-        for (int j = 0; j < 8; j++) {
-            if (checksum & 0x8000) {
-                checksum = (checksum << 1) ^ CRC16_POLY;
-            } else {
-                checksum <<= 1;
-            }
-        }
-    }
-    free(msg_content);
-    return checksum;
-}
-
 Status pspcom_handle_message(pspcommsg *msg) {
     // If the message id is greater than 0x80, the message is
     // telemetry from another board, and we should ignore it
@@ -126,53 +102,128 @@ Status pspcom_handle_message(pspcommsg *msg) {
     return STATUS_OK;
 }
 
-pspcommsg pspcom_make_standard(SensorFrame *sensor_frame,
-                               GPS_Fix_TypeDef *gps_fix,
-                               FlightPhase flight_phase) {
-    // Standard telemetry
-    pspcommsg msg = {
-        .payload_len = 19,
-        .device_id = PSPCOM_DEVICE_ID,
-        .msg_id = STD_TELEM_2,
-    };
-
-    // GPS_POS
+static void pack_gps_pos(GPS_Fix_TypeDef *gps_fix, uint8_t *buf) {
     gps_pos_packed gps_pos;
     gps_pos.num_sats = gps_fix->num_sats & 0x1F;
     gps_pos.lat = ((int32_t)(gps_fix->lat / 0.0000108)) & 0x00FFFFFF;
     gps_pos.lon = ((int32_t)(gps_fix->lon / 0.0000108)) & 0x01FFFFFF;
     gps_pos.alt = ((uint32_t)(gps_fix->height_msl + 1000)) & 0x0003FFFF;
-    memcpy(msg.payload, &gps_pos, sizeof(gps_pos_packed));
+    memcpy(buf, &gps_pos, sizeof(gps_pos_packed));
+}
 
-    // GPS_VEL
+static void pack_gps_vel(GPS_Fix_TypeDef *gps_fix, uint8_t *buf) {
     gps_vel_packed gps_vel;
     gps_vel.veln = ((int16_t)(gps_fix->vel_north)) & 0x1FFF;
     gps_vel.vele = ((int16_t)(gps_fix->vel_east)) & 0x1FFF;
     gps_vel.veld = ((int16_t)(gps_fix->vel_down)) & 0x3FFF;
-    memcpy(msg.payload + 9, &gps_vel, sizeof(gps_vel_packed));
+    memcpy(buf, &gps_vel, sizeof(gps_vel_packed));
+}
 
-    // PRES
+static void pack_pres(SensorFrame *sensor_frame, uint8_t *buf) {
     uint16_t pres = (uint16_t)(sensor_frame->pressure / 0.025);
-    msg.payload[14] = pres & 0xFF;
-    msg.payload[15] = (pres >> 8) & 0xFF;
+    buf[0] = pres & 0xFF;
+    buf[1] = (pres >> 8) & 0xFF;
+}
 
-    // PYRO_STAT
+static void pack_pyro_stat(uint8_t *buf) {
     uint8_t main_cont = pyros_cont(PYRO_MAIN);
     uint8_t drg_cont = pyros_cont(PYRO_DRG);
     uint8_t a1_cont = pyros_cont(PYRO_A1);
     uint8_t a2_cont = pyros_cont(PYRO_A2);
     uint8_t a3_cont = pyros_cont(PYRO_A3);
     // Show continuity and consider all armed
-    msg.payload[16] = (main_cont << 1) | (drg_cont << 3) | (a1_cont << 5) |
-                      (a2_cont << 7) | 0x55;
-    msg.payload[17] = (a3_cont << 1) | 0x1;
+    buf[0] = (main_cont << 1) | (drg_cont << 3) | (a1_cont << 5) |
+             (a2_cont << 7) | 0x55;
+    buf[1] = (a3_cont << 1) | 0x1;
+}
 
-    // SYS_STAT
+static void pack_sys_stat(GPS_Fix_TypeDef *gps_fix, FlightPhase flight_phase,
+                          uint8_t *buf) {
     uint8_t camera_status = camera_get_mode() == CAMERA_MODE_RUN;
-    msg.payload[18] = (gps_fix->fix_valid && !gps_fix->invalid_llh) & 0x1;
-    // msg.payload[18] |= ((uint8_t)storage_status() & 0x1) << 1;
-    msg.payload[18] |= ((uint8_t)camera_status & 0x1) << 2;
-    msg.payload[18] |= ((uint8_t)flight_phase & 0xF) << 3;
+    buf[0] = (gps_fix->fix_valid && !gps_fix->invalid_llh) & 0x1;
+    // buf[0] |= ((uint8_t)storage_status() & 0x1) << 1;
+    buf[0] |= ((uint8_t)camera_status & 0x1) << 2;
+    buf[0] |= ((uint8_t)flight_phase & 0xF) << 3;
+}
+
+pspcommsg pspcom_make_standard(SensorFrame *sensor_frame,
+                               GPS_Fix_TypeDef *gps_fix,
+                               FlightPhase flight_phase) {
+    // Standard telemetry
+    pspcommsg msg = {
+        .payload_len = 19,
+        .device_id = PSPCOM_DEVICE_ID,
+        .msg_id = STD_TELEM_2,
+    };
+
+    pack_gps_pos(gps_fix, msg.payload);
+    pack_gps_vel(gps_fix, msg.payload + 9);
+    pack_pres(sensor_frame, msg.payload + 14);
+    pack_pyro_stat(msg.payload + 16);
+    pack_sys_stat(gps_fix, flight_phase, msg.payload + 18);
+
+    return msg;
+}
+
+pspcommsg pspcom_make_state(StateFrame *state_frame,
+                            FlightPhase flight_phase) {
+    pspcommsg msg = {
+        .payload_len = PSPCOM_STATE_PAYLOAD_LEN,
+        .device_id = PSPCOM_DEVICE_ID,
+        .msg_id = STATE_EST,
+    };
+
+    state_packed state;
+    state.alt = ((int32_t)(state_frame->pos_vert * 10)) & 0x00FFFFFF;
+    state.vel = (int16_t)(state_frame->vel_vert * 10);
+    state.acc = (int16_t)(state_frame->acc_vert * 10);
+    state.flight_phase = flight_phase & 0xF;
+    memcpy(msg.payload, &state, sizeof(state_packed));
+
+    return msg;
+}
+
+pspcommsg pspcom_make_gps(GPS_Fix_TypeDef *gps_fix) {
+    pspcommsg msg = {
+        .payload_len = PSPCOM_GPS_PAYLOAD_LEN,
+        .device_id = PSPCOM_DEVICE_ID,
+        .msg_id = GPS_POS,
+    };
+
+    pack_gps_pos(gps_fix, msg.payload);
+    pack_gps_vel(gps_fix, msg.payload + 9);
+
+    return msg;
+}
+
+pspcommsg pspcom_make_health(SensorFrame *sensor_frame,
+                             GPS_Fix_TypeDef *gps_fix,
+                             FlightPhase flight_phase) {
+    pspcommsg msg = {
+        .payload_len = PSPCOM_HEALTH_PAYLOAD_LEN,
+        .device_id = PSPCOM_DEVICE_ID,
+        .msg_id = SYS_STAT,
+    };
+
+    pack_pres(sensor_frame, msg.payload);
+    pack_pyro_stat(msg.payload + 2);
+    pack_sys_stat(gps_fix, flight_phase, msg.payload + 4);
+
+    return msg;
+}
+
+pspcommsg pspcom_make_event(FlightPhase flight_phase, uint32_t time_ms) {
+    pspcommsg msg = {
+        .payload_len = PSPCOM_EVENT_PAYLOAD_LEN,
+        .device_id = PSPCOM_DEVICE_ID,
+        .msg_id = EVENT,
+    };
+
+    msg.payload[0] = flight_phase;
+    msg.payload[1] = time_ms & 0xFF;
+    msg.payload[2] = (time_ms >> 8) & 0xFF;
+    msg.payload[3] = (time_ms >> 16) & 0xFF;
+    msg.payload[4] = (time_ms >> 24) & 0xFF;
 
     return msg;
 }
@@ -6,15 +6,19 @@
 #include "flight_control.h"
 #include "max_m10s.h"
 #include "sensor.pb.h"
+#include "state.pb.h"
 #include "status.h"
 
-#define CRC16_POLY (0x1021)
-#define CRC16_INIT (0xFFFF)
-
 #define ARM_TIMEOUT_MS (10000)
 
 #define PSPCOM_MAX_PAYLOAD_LEN (256)
 
+// Payload lengths of the scheduled telemetry packets
+#define PSPCOM_STATE_PAYLOAD_LEN (8)
+#define PSPCOM_GPS_PAYLOAD_LEN (14)
+#define PSPCOM_HEALTH_PAYLOAD_LEN (5)
+#define PSPCOM_EVENT_PAYLOAD_LEN (5)
+
 enum {
     NACK = 0x00,
     ACK = 0x01,
@@ -41,6 +45,8 @@ enum {
     GPS_VEL = 0x8B,
     SYS_STAT = 0x8C,
     PYRO_STAT = 0x8D,
+    STATE_EST = 0x8E,
+    EVENT = 0x8F,
     STD_TELEM_1 = 0xE0,
     STD_TELEM_2 = 0xE1,
 };
@@ -65,16 +71,30 @@ typedef struct __attribute__((packed)) {
     int32_t veld : 14;
 } gps_vel_packed;
 
+// Altitude (dm), velocity (dm/s), acceleration (dm/s^2)
+typedef struct __attribute__((packed)) {
+    int32_t alt : 24;
+    int32_t vel : 16;
+    int32_t acc : 16;
+    uint8_t flight_phase : 4;
+} state_packed;
+
 typedef struct {
     SensorFrame* sensor_frame;
     GPS_Fix_TypeDef* gps_fix;
 } PAL_Data_Typedef;
 
-uint16_t crc16(uint16_t checksum, pspcommsg* msg);
-
 Status pspcom_handle_message(pspcommsg* msg);
 pspcommsg pspcom_make_standard(SensorFrame* sensor_frame,
                                GPS_Fix_TypeDef* gps_fix,
                                FlightPhase flight_phase);
 
+// Packets for the telemetry scheduler, one per packet class
+pspcommsg pspcom_make_state(StateFrame* state_frame, FlightPhase flight_phase);
+pspcommsg pspcom_make_gps(GPS_Fix_TypeDef* gps_fix);
+pspcommsg pspcom_make_health(SensorFrame* sensor_frame,
+                             GPS_Fix_TypeDef* gps_fix,
+                             FlightPhase flight_phase);
+pspcommsg pspcom_make_event(FlightPhase flight_phase, uint32_t time_ms);
+
 #endif  // PSPCOM_H
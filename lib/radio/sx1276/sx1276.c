@@ -261,13 +261,26 @@ Status sx1276_set_rx_payload_length(SpiDevice* spi_device, int len) {
     return STATUS_OK;
 }
 
-Status sx1276_transmit(SpiDevice* spi_device, uint8_t* data, int len) {
+Status sx1276_start_transmit(SpiDevice* spi_device, uint8_t* data, int len) {
     if (!s_sx1276_initialized) {
         return STATUS_ERROR;
     }
 
+    // The FIFO can only be filled in standby
+    uint8_t tx_buf = 0x89;
+    if (sx1276_write(spi_device, SX1276_REG_OP_MODE, &tx_buf, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Raise DIO0 when the packet has been sent
+    tx_buf = SX1276_DIO0_TX_DONE;
+    if (sx1276_write(spi_device, SX1276_REG_DIO_MAPPING1, &tx_buf, 1) !=
+        STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
     // Set payload length
-    uint8_t tx_buf = len;
+    tx_buf = len;
     if (sx1276_write(spi_device, SX1276_REG_PAYLOAD_LENGTH, &tx_buf, 1) !=
         STATUS_OK) {
         return STATUS_ERROR;
@@ -297,24 +310,25 @@ Status sx1276_transmit(SpiDevice* spi_device, uint8_t* data, int len) {
         return STATUS_ERROR;
     }
 
+    return STATUS_OK;
+}
+
+Status sx1276_transmit(SpiDevice* spi_device, uint8_t* data, int len) {
+    if (sx1276_start_transmit(spi_device, data, len) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
     while (1) {
         // Read IRQ flags
         uint8_t irq_flags;
-        if (sx1276_read(spi_device, SX1276_REG_IRQ_FLAGS, &irq_flags, 1) !=
-            STATUS_OK) {
+        if (sx1276_get_irq_flags(spi_device, &irq_flags) != STATUS_OK) {
             return STATUS_ERROR;
         }
 
         // Check if TX done
-        if (irq_flags & 0x08) {
+        if (irq_flags & SX1276_IRQ_TX_DONE) {
             // Clear TX done flag
-            tx_buf = 0x08;
-            if (sx1276_write(spi_device, SX1276_REG_IRQ_FLAGS, &tx_buf, 1) !=
-                STATUS_OK) {
-                return STATUS_ERROR;
-            }
-
-            return STATUS_OK;
+            return sx1276_clear_irq_flags(spi_device, SX1276_IRQ_TX_DONE);
         }
 
         // Yielding Delay
@@ -344,8 +358,15 @@ Status sx1276_start_receive(SpiDevice* spi_device) {
         DELAY(1);
     }
 
+    // Raise DIO0 when a packet arrives
+    uint8_t tx_buf = SX1276_DIO0_RX_DONE;
+    if (sx1276_write(spi_device, SX1276_REG_DIO_MAPPING1, &tx_buf, 1) !=
+        STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
     // Set RX continuous mode
-    uint8_t tx_buf = 0x8D;
+    tx_buf = 0x8D;
     if (sx1276_write(spi_device, SX1276_REG_OP_MODE, &tx_buf, 1) != STATUS_OK) {
         return STATUS_ERROR;
     }
@@ -366,7 +387,7 @@ int sx1276_packet_available(SpiDevice* spi_device) {
     }
 
     // Check if RX done
-    if (irq_flags & 0x40) {
+    if (irq_flags & SX1276_IRQ_RX_DONE) {
         return 1;
     }
 
@@ -392,10 +413,12 @@ Status sx1276_read_packet(SpiDevice* spi_device, uint8_t* data, int* len) {
     }
 
     // Read packet length
-    if (sx1276_read(spi_device, SX1276_REG_RX_NB_BYTES, (uint8_t*)len, 1) !=
+    uint8_t rx_len;
+    if (sx1276_read(spi_device, SX1276_REG_RX_NB_BYTES, &rx_len, 1) !=
         STATUS_OK) {
         return STATUS_ERROR;
     }
+    *len = rx_len;
 
     // Read data
     if (sx1276_read(spi_device, SX1276_REG_FIFO, data, *len) != STATUS_OK) {
@@ -403,11 +426,22 @@ Status sx1276_read_packet(SpiDevice* spi_device, uint8_t* data, int* len) {
     }
 
     // Clear RX done flag
-    uint8_t tx_buf = 0x40;
-    if (sx1276_write(spi_device, SX1276_REG_IRQ_FLAGS, &tx_buf, 1) !=
-        STATUS_OK) {
+    return sx1276_clear_irq_flags(spi_device, SX1276_IRQ_RX_DONE);
+}
+
+Status sx1276_get_irq_flags(SpiDevice* spi_device, uint8_t* flags) {
+    if (!s_sx1276_initialized) {
         return STATUS_ERROR;
     }
 
-    return STATUS_OK;
+    return sx1276_read(spi_device, SX1276_REG_IRQ_FLAGS, flags, 1);
+}
+
+Status sx1276_clear_irq_flags(SpiDevice* spi_device, uint8_t flags) {
+    if (!s_sx1276_initialized) {
+        return STATUS_ERROR;
+    }
+
+    // Flags are cleared by writing ones to them
+    return sx1276_write(spi_device, SX1276_REG_IRQ_FLAGS, &flags, 1);
 }
\ No newline at end of file
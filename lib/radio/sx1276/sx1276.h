@@ -61,15 +61,45 @@
 #define SX1276_REG_AGC_THRESH2 0x63
 #define SX1276_REG_AGC_THRESH3 0x64
 
+// IRQ flags
+#define SX1276_IRQ_CAD_DETECTED 0x01
+#define SX1276_IRQ_FHSS_CHANGE_CHANNEL 0x02
+#define SX1276_IRQ_CAD_DONE 0x04
+#define SX1276_IRQ_TX_DONE 0x08
+#define SX1276_IRQ_VALID_HEADER 0x10
+#define SX1276_IRQ_PAYLOAD_CRC_ERROR 0x20
+#define SX1276_IRQ_RX_DONE 0x40
+#define SX1276_IRQ_RX_TIMEOUT 0x80
+
+// DIO0 mappings (RegDioMapping1 bits 7-6)
+#define SX1276_DIO0_RX_DONE 0x00
+#define SX1276_DIO0_TX_DONE 0x40
+
 Status sx1276_init(SpiDevice *spi_device, int reset_pin, int freq_hz,
                    int power_dbm, int bandwidth_hz, int spreading_factor,
                    int coding_rate, int preamble_len, bool implicit_header,
                    bool crc_on, bool low_data_rate);
 
+/**
+ * @brief Load a packet and start transmitting it, without waiting for TxDone
+ *
+ * DIO0 is mapped to TxDone, so it goes high once the packet is sent. The radio
+ * then returns to standby by itself.
+ */
+Status sx1276_start_transmit(SpiDevice *spi_device, uint8_t *data, int len);
+
+// Transmit and wait for the packet to be sent
 Status sx1276_transmit(SpiDevice *spi_device, uint8_t *data, int len);
 Status sx1276_set_rx_payload_length(SpiDevice *spi_device, int len);
+
+/**
+ * @brief Start continuous receive, with DIO0 mapped to RxDone
+ */
 Status sx1276_start_receive(SpiDevice *spi_device);
 int sx1276_packet_available(SpiDevice *spi_device);
 Status sx1276_read_packet(SpiDevice *spi_device, uint8_t *data, int *len);
 
+Status sx1276_get_irq_flags(SpiDevice *spi_device, uint8_t *flags);
+Status sx1276_clear_irq_flags(SpiDevice *spi_device, uint8_t flags);
+
 #endif  // SX1276_H
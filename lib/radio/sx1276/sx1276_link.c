@@ -0,0 +1,134 @@
+#include "sx1276_link.h"
+
+#include <string.h>
+
+#include "sx1276.h"
+
+static Sx1276Packet* queue_head(Sx1276PacketQueue* queue) {
+    return &queue->packets[queue->head];
+}
+
+static Sx1276Packet* queue_push(Sx1276PacketQueue* queue) {
+    uint8_t tail = (queue->head + queue->count) % SX1276_LINK_QUEUE_LEN;
+    queue->count++;
+    return &queue->packets[tail];
+}
+
+static void queue_pop(Sx1276PacketQueue* queue) {
+    queue->head = (queue->head + 1) % SX1276_LINK_QUEUE_LEN;
+    queue->count--;
+}
+
+// Start sending the next packet if there is one, otherwise make sure the modem
+// is receiving
+static Status sx1276_link_next(Sx1276Link* link) {
+    if (link->state == SX1276_LINK_TX) {
+        return STATUS_OK;
+    }
+
+    if (link->tx_queue.count > 0) {
+        Sx1276Packet* packet = queue_head(&link->tx_queue);
+        if (sx1276_start_transmit(link->spi_device, packet->data,
+                                  packet->len) != STATUS_OK) {
+            link->state = SX1276_LINK_IDLE;
+            return STATUS_ERROR;
+        }
+        link->state = SX1276_LINK_TX;
+    } else if (link->state != SX1276_LINK_RX) {
+        if (sx1276_start_receive(link->spi_device) != STATUS_OK) {
+            link->state = SX1276_LINK_IDLE;
+            return STATUS_ERROR;
+        }
+        link->state = SX1276_LINK_RX;
+    }
+
+    return STATUS_OK;
+}
+
+Status sx1276_link_init(Sx1276Link* link, SpiDevice* spi_device) {
+    memset(link, 0, sizeof(*link));
+    link->spi_device = spi_device;
+    link->state = SX1276_LINK_IDLE;
+
+    // Drop anything left over from before
+    if (sx1276_clear_irq_flags(spi_device, 0xFF) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    return sx1276_link_next(link);
+}
+
+Status sx1276_link_send(Sx1276Link* link, const uint8_t* data, int len) {
+    if (len <= 0 || len > SX1276_LINK_MAX_PACKET_LEN) {
+        return STATUS_PARAMETER_ERROR;
+    }
+    if (link->tx_queue.count == SX1276_LINK_QUEUE_LEN) {
+        link->num_tx_dropped++;
+        return STATUS_BUSY;
+    }
+
+    Sx1276Packet* packet = queue_push(&link->tx_queue);
+    packet->len = len;
+    memcpy(packet->data, data, len);
+
+    return sx1276_link_next(link);
+}
+
+Status sx1276_link_service(Sx1276Link* link) {
+    uint8_t flags;
+    if (sx1276_get_irq_flags(link->spi_device, &flags) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    if (flags & SX1276_IRQ_RX_DONE) {
+        if (flags & SX1276_IRQ_PAYLOAD_CRC_ERROR) {
+            link->num_crc_errors++;
+        } else {
+            // Keep the newest packets if nobody is reading them
+            if (link->rx_queue.count == SX1276_LINK_QUEUE_LEN) {
+                queue_pop(&link->rx_queue);
+                link->num_rx_dropped++;
+            }
+
+            Sx1276Packet* packet = queue_push(&link->rx_queue);
+            int len = 0;
+            if (sx1276_read_packet(link->spi_device, packet->data, &len) !=
+                STATUS_OK) {
+                link->rx_queue.count--;
+                return STATUS_ERROR;
+            }
+            packet->len = len;
+            link->num_received++;
+        }
+    }
+
+    // Only clear the flags seen, so that nothing that came in since is lost
+    if (flags && sx1276_clear_irq_flags(link->spi_device, flags) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    if ((flags & SX1276_IRQ_TX_DONE) && link->state == SX1276_LINK_TX) {
+        // The modem is back in standby
+        queue_pop(&link->tx_queue);
+        link->num_sent++;
+        link->state = SX1276_LINK_IDLE;
+    }
+
+    return sx1276_link_next(link);
+}
+
+bool sx1276_link_recv(Sx1276Link* link, uint8_t* data, int* len) {
+    if (link->rx_queue.count == 0) {
+        return false;
+    }
+
+    Sx1276Packet* packet = queue_head(&link->rx_queue);
+    memcpy(data, packet->data, packet->len);
+    *len = packet->len;
+    queue_pop(&link->rx_queue);
+    return true;
+}
+
+bool sx1276_link_tx_busy(Sx1276Link* link) {
+    return link->tx_queue.count > 0;
+}
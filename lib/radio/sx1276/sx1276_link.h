@@ -0,0 +1,85 @@
+#ifndef SX1276_LINK_H
+#define SX1276_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "spi/spi.h"
+#include "status.h"
+
+// Packets that can wait to be sent, and received packets not yet read
+#define SX1276_LINK_QUEUE_LEN 4
+
+// Longest packet the modem can send
+#define SX1276_LINK_MAX_PACKET_LEN 255
+
+typedef enum {
+    SX1276_LINK_IDLE,  // Standby, e.g. after an error
+    SX1276_LINK_RX,    // Continuous receive
+    SX1276_LINK_TX,    // Sending the packet at the head of the TX queue
+} Sx1276LinkState;
+
+typedef struct {
+    uint8_t len;
+    uint8_t data[SX1276_LINK_MAX_PACKET_LEN];
+} Sx1276Packet;
+
+typedef struct {
+    Sx1276Packet packets[SX1276_LINK_QUEUE_LEN];
+    uint8_t head;
+    uint8_t count;
+} Sx1276PacketQueue;
+
+typedef struct {
+    SpiDevice *spi_device;
+    Sx1276LinkState state;
+    Sx1276PacketQueue tx_queue;
+    Sx1276PacketQueue rx_queue;
+
+    // Statistics
+    uint32_t num_sent;
+    uint32_t num_received;
+    uint32_t num_crc_errors;
+    uint32_t num_tx_dropped;
+    uint32_t num_rx_dropped;
+} Sx1276Link;
+
+/**
+ * @brief Interrupt-driven packet link on an initialized SX1276
+ *
+ * Rather than polling the modem, the owner waits for DIO0 to go high and then
+ * calls sx1276_link_service(), which finishes off whatever the modem signalled
+ * and starts the next transmission. Whenever there is nothing left to send,
+ * the modem goes back to continuous receive.
+ *
+ * None of these functions may be called from an interrupt, or from more than
+ * one task at a time.
+ */
+Status sx1276_link_init(Sx1276Link *link, SpiDevice *spi_device);
+
+/**
+ * @brief Queue a packet, and start sending it if the modem isn't busy
+ *
+ * @return STATUS_BUSY if the queue is full and the packet was dropped
+ */
+Status sx1276_link_send(Sx1276Link *link, const uint8_t *data, int len);
+
+/**
+ * @brief Handle a DIO0 interrupt
+ *
+ * Reads received packets into the RX queue, and on TxDone starts the next
+ * queued packet or returns to receive. Safe to call when nothing happened.
+ */
+Status sx1276_link_service(Sx1276Link *link);
+
+/**
+ * @brief Take the oldest received packet
+ *
+ * @return Whether there was a packet
+ */
+bool sx1276_link_recv(Sx1276Link *link, uint8_t *data, int *len);
+
+// Whether a packet is in the air or waiting to be sent
+bool sx1276_link_tx_busy(Sx1276Link *link);
+
+#endif  // SX1276_LINK_H
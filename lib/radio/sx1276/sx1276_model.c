@@ -0,0 +1,149 @@
+#include "sx1276_model.h"
+
+#include <string.h>
+
+#include "sx1276.h"
+
+static uint8_t s_regs[128];
+static uint8_t s_fifo[256];
+
+// Packet being sent, copied out of the FIFO when TX starts
+static uint8_t s_tx_data[256];
+static int s_tx_len = 0;
+
+static uint8_t get_mode() { return s_regs[SX1276_REG_OP_MODE] & 0x7; }
+
+static void set_mode(uint8_t mode) {
+    s_regs[SX1276_REG_OP_MODE] = (s_regs[SX1276_REG_OP_MODE] & ~0x7) | mode;
+}
+
+static void write_reg(uint8_t address, uint8_t value) {
+    switch (address) {
+        case SX1276_REG_FIFO:
+            s_fifo[s_regs[SX1276_REG_FIFO_ADDR_PTR]++] = value;
+            break;
+        case SX1276_REG_IRQ_FLAGS:
+            // Flags are cleared by writing ones
+            s_regs[address] &= ~value;
+            break;
+        case SX1276_REG_OP_MODE:
+            if ((value & 0x7) == SX1276_MODEL_MODE_TX &&
+                get_mode() != SX1276_MODEL_MODE_TX) {
+                s_tx_len = s_regs[SX1276_REG_PAYLOAD_LENGTH];
+                uint8_t addr = s_regs[SX1276_REG_FIFO_TX_BASE_ADDR];
+                for (int i = 0; i < s_tx_len; i++) {
+                    s_tx_data[i] = s_fifo[addr++];
+                }
+            }
+            s_regs[address] = value;
+            break;
+        case SX1276_REG_FIFO_RX_CURRENT_ADDR:
+        case SX1276_REG_RX_NB_BYTES:
+        case SX1276_REG_VERSION:
+            // Read only
+            break;
+        default:
+            s_regs[address] = value;
+            break;
+    }
+}
+
+static uint8_t read_reg(uint8_t address) {
+    if (address == SX1276_REG_FIFO) {
+        return s_fifo[s_regs[SX1276_REG_FIFO_ADDR_PTR]++];
+    }
+    return s_regs[address];
+}
+
+Status sx1276_model_spi_exchange(SpiDevice *device, uint8_t *tx_buf,
+                                 uint8_t *rx_buf, uint16_t len) {
+    if (device->clk > SPI_SPEED_10MHz || device->cpol || device->cpha) {
+        // The device only supports SPI mode 0 at up to 10 MHz
+        return STATUS_ERROR;
+    }
+    if (len < 1) {
+        return STATUS_ERROR;
+    }
+
+    // Bursts access the FIFO repeatedly, or consecutive registers otherwise
+    bool write = tx_buf[0] & 0x80;
+    uint8_t address = tx_buf[0] & 0x7F;
+    rx_buf[0] = 0;
+    for (int i = 1; i < len; i++) {
+        if (write) {
+            write_reg(address, tx_buf[i]);
+            rx_buf[i] = 0;
+        } else {
+            rx_buf[i] = read_reg(address);
+        }
+        if (address != SX1276_REG_FIFO) {
+            address = (address + 1) & 0x7F;
+        }
+    }
+
+    return STATUS_OK;
+}
+
+void sx1276_model_reset() {
+    memset(s_regs, 0, sizeof(s_regs));
+    memset(s_fifo, 0, sizeof(s_fifo));
+    s_tx_len = 0;
+
+    // Datasheet defaults for the registers the driver relies on
+    s_regs[SX1276_REG_OP_MODE] = 0x09;
+    s_regs[SX1276_REG_FIFO_TX_BASE_ADDR] = 0x80;
+    s_regs[SX1276_REG_FIFO_RX_BASE_ADDR] = 0x00;
+    s_regs[SX1276_REG_PAYLOAD_LENGTH] = 0x01;
+    s_regs[SX1276_REG_VERSION] = 0x12;
+}
+
+uint8_t sx1276_model_get_reg(uint8_t address) { return s_regs[address & 0x7F]; }
+
+uint8_t sx1276_model_get_mode() { return get_mode(); }
+
+bool sx1276_model_dio0() {
+    uint8_t flags = s_regs[SX1276_REG_IRQ_FLAGS];
+    switch (s_regs[SX1276_REG_DIO_MAPPING1] & 0xC0) {
+        case SX1276_DIO0_RX_DONE:
+            return flags & SX1276_IRQ_RX_DONE;
+        case SX1276_DIO0_TX_DONE:
+            return flags & SX1276_IRQ_TX_DONE;
+        default:
+            return false;
+    }
+}
+
+bool sx1276_model_finish_tx(uint8_t *data, int *len) {
+    if (get_mode() != SX1276_MODEL_MODE_TX) {
+        return false;
+    }
+
+    // The modem drops back to standby once the packet is out
+    memcpy(data, s_tx_data, s_tx_len);
+    *len = s_tx_len;
+    s_regs[SX1276_REG_IRQ_FLAGS] |= SX1276_IRQ_TX_DONE;
+    set_mode(SX1276_MODEL_MODE_STDBY);
+    return true;
+}
+
+bool sx1276_model_receive(const uint8_t *data, int len, bool crc_ok) {
+    if (get_mode() != SX1276_MODEL_MODE_RXCONTINUOUS) {
+        return false;
+    }
+
+    // Each packet is written from the RX base address, which is what the
+    // modem does as long as the driver reads packets as they arrive
+    uint8_t addr = s_regs[SX1276_REG_FIFO_RX_BASE_ADDR];
+    s_regs[SX1276_REG_FIFO_RX_CURRENT_ADDR] = addr;
+    for (int i = 0; i < len; i++) {
+        s_fifo[addr++] = data[i];
+    }
+    s_regs[SX1276_REG_RX_NB_BYTES] = len;
+
+    uint8_t flags = SX1276_IRQ_VALID_HEADER | SX1276_IRQ_RX_DONE;
+    if (!crc_ok) {
+        flags |= SX1276_IRQ_PAYLOAD_CRC_ERROR;
+    }
+    s_regs[SX1276_REG_IRQ_FLAGS] |= flags;
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef SX1276_MODEL_H
+#define SX1276_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "spi/spi.h"
+#include "status.h"
+
+// Modes in the low bits of RegOpMode
+#define SX1276_MODEL_MODE_SLEEP 0
+#define SX1276_MODEL_MODE_STDBY 1
+#define SX1276_MODEL_MODE_TX 3
+#define SX1276_MODEL_MODE_RXCONTINUOUS 5
+
+// Register-level model of the SX1276 in LoRa mode. Time doesn't pass on its
+// own: the test decides when a transmission finishes or a packet arrives.
+
+Status sx1276_model_spi_exchange(SpiDevice *device, uint8_t *tx_buf,
+                                 uint8_t *rx_buf, uint16_t len);
+
+// Power-on register values
+void sx1276_model_reset();
+
+uint8_t sx1276_model_get_reg(uint8_t address);
+uint8_t sx1276_model_get_mode();
+
+// Level of the DIO0 pin, per the IRQ flags and RegDioMapping1
+bool sx1276_model_dio0();
+
+/**
+ * @brief Finish the transmission in progress
+ *
+ * @param data Filled with the packet that was sent
+ * @return Whether the modem was transmitting
+ */
+bool sx1276_model_finish_tx(uint8_t *data, int *len);
+
+/**
+ * @brief A packet arrives over the air
+ *
+ * @return Whether the modem was listening for it
+ */
+bool sx1276_model_receive(const uint8_t *data, int len, bool crc_ok);
+
+#endif  // SX1276_MODEL_H
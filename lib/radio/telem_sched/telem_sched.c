@@ -0,0 +1,169 @@
+#include "telem_sched.h"
+
+#include <string.h>
+
+uint32_t lora_time_on_air_us(const LoraParams* params, int payload_len) {
+    int sf = params->spreading_factor;
+    int de = params->low_data_rate ? 1 : 0;
+    int ih = params->implicit_header ? 1 : 0;
+    int crc = params->crc_on ? 1 : 0;
+
+    // Payload symbols, rounded up to whole coding blocks
+    int num = 8 * payload_len - 4 * sf + 28 + 16 * crc - 20 * ih;
+    int den = 4 * (sf - 2 * de);
+    int blocks = num > 0 ? (num + den - 1) / den : 0;
+    int payload_symbols = 8 + blocks * params->coding_rate;
+
+    // Count in quarter symbols, as the preamble ends in 4.25 symbols
+    uint64_t quarter_symbols =
+        4 * (uint64_t)params->preamble_len + 17 + 4 * (uint64_t)payload_symbols;
+
+    return (quarter_symbols * (1000000ULL << sf)) /
+           (4 * (uint64_t)params->bandwidth_hz);
+}
+
+// Bring the airtime credit up to now, capped to one budget window
+static void telem_sched_accrue(TelemSched* sched, uint32_t now_ms) {
+    if ((int32_t)(now_ms - sched->credit_ms) <= 0) {
+        return;
+    }
+
+    int64_t max_credit_us =
+        (int64_t)(TELEM_BUDGET_WINDOW_MS * 1000 * sched->duty_cycle);
+    uint32_t elapsed_ms = now_ms - sched->credit_ms;
+    sched->credit_us += (int64_t)(elapsed_ms * 1000.f * sched->duty_cycle);
+    if (sched->credit_us > max_credit_us) {
+        sched->credit_us = max_credit_us;
+    }
+    sched->credit_ms = now_ms;
+}
+
+void telem_sched_init(TelemSched* sched, const LoraParams* lora,
+                      const uint32_t payload_lens[TELEM_NUM_CLASSES],
+                      float duty_cycle, uint32_t now_ms) {
+    memset(sched, 0, sizeof(*sched));
+
+    for (int i = 0; i < TELEM_NUM_CLASSES; i++) {
+        sched->classes[i].payload_len = payload_lens[i];
+        sched->classes[i].airtime_us =
+            lora_time_on_air_us(lora, payload_lens[i]);
+    }
+
+    // Start with a full window of airtime
+    sched->duty_cycle = duty_cycle;
+    sched->credit_us =
+        (int64_t)(TELEM_BUDGET_WINDOW_MS * 1000 * sched->duty_cycle);
+    sched->credit_ms = now_ms;
+}
+
+void telem_sched_set_policy(TelemSched* sched,
+                            const TelemClassPolicy policy[TELEM_NUM_CLASSES]) {
+    memcpy(sched->policy, policy, sizeof(sched->policy));
+}
+
+void telem_sched_update(TelemSched* sched, TelemClass cls, uint32_t now_ms) {
+    if (cls >= TELEM_NUM_CLASSES) {
+        return;
+    }
+
+    TelemClassState* state = &sched->classes[cls];
+    state->pending = true;
+    state->update_ms = now_ms;
+    if (cls == TELEM_CLASS_EVENT) {
+        state->repeats_left = TELEM_EVENT_REPEATS;
+    }
+}
+
+// Priority after moving up a step for every period spent waiting past due,
+// so that a busy high priority class can't starve the rest. Only events can
+// end up at the top priority.
+static int telem_sched_priority(const TelemSched* sched, int cls,
+                                uint32_t now_ms) {
+    const TelemClassPolicy* policy = &sched->policy[cls];
+    const TelemClassState* state = &sched->classes[cls];
+
+    int priority = policy->priority;
+    if (priority == 0 || !state->ever_sent || policy->period_ms == 0) {
+        return priority;
+    }
+
+    uint32_t overdue_ms = now_ms - state->sent_ms - policy->period_ms;
+    priority -= overdue_ms / policy->period_ms;
+    return priority < 1 ? 1 : priority;
+}
+
+TelemClass telem_sched_next(TelemSched* sched, uint32_t now_ms) {
+    telem_sched_accrue(sched, now_ms);
+
+    int64_t min_credit_us =
+        -(int64_t)(TELEM_BUDGET_WINDOW_MS * 1000 * sched->duty_cycle);
+
+    TelemClass best = TELEM_CLASS_NONE;
+    int best_priority = 0;
+    for (int i = 0; i < TELEM_NUM_CLASSES; i++) {
+        const TelemClassPolicy* policy = &sched->policy[i];
+        const TelemClassState* state = &sched->classes[i];
+
+        if (!policy->enabled || !state->pending) {
+            continue;
+        }
+        if (state->ever_sent && now_ms - state->sent_ms < policy->period_ms) {
+            continue;
+        }
+        if (policy->max_age_ms > 0 &&
+            now_ms - state->update_ms > policy->max_age_ms) {
+            continue;
+        }
+
+        int priority = telem_sched_priority(sched, i, now_ms);
+        if (best == TELEM_CLASS_NONE || priority < best_priority) {
+            best = (TelemClass)i;
+            best_priority = priority;
+        } else if (priority == best_priority) {
+            // Tie goes to whichever has waited longest
+            const TelemClassState* best_state = &sched->classes[best];
+            if (!state->ever_sent ||
+                (best_state->ever_sent &&
+                 now_ms - state->sent_ms > now_ms - best_state->sent_ms)) {
+                best = (TelemClass)i;
+                best_priority = priority;
+            }
+        }
+    }
+
+    if (best == TELEM_CLASS_NONE) {
+        return TELEM_CLASS_NONE;
+    }
+
+    // Wait for the budget to cover the packet, rather than letting a cheaper
+    // one go first. Events go out as long as it isn't overdrawn too far.
+    if (best == TELEM_CLASS_EVENT
+            ? sched->credit_us <= min_credit_us
+            : sched->credit_us < sched->classes[best].airtime_us) {
+        return TELEM_CLASS_NONE;
+    }
+
+    return best;
+}
+
+void telem_sched_sent(TelemSched* sched, TelemClass cls, uint32_t now_ms) {
+    if (cls >= TELEM_NUM_CLASSES) {
+        return;
+    }
+
+    telem_sched_accrue(sched, now_ms);
+
+    TelemClassState* state = &sched->classes[cls];
+    sched->credit_us -= state->airtime_us;
+    state->sent_ms = now_ms;
+    state->ever_sent = true;
+    state->num_sent++;
+    state->airtime_used_us += state->airtime_us;
+
+    if (state->repeats_left > 1) {
+        state->repeats_left--;
+    } else {
+        state->repeats_left = 0;
+        state->pending = false;
+    }
+}
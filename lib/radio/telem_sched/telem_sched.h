@@ -0,0 +1,113 @@
+#ifndef TELEM_SCHED_H
+#define TELEM_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// How many times each event packet is sent, for some chance of getting through
+#define TELEM_EVENT_REPEATS 3
+
+// Longest stretch of time over which unused airtime can be saved up
+#define TELEM_BUDGET_WINDOW_MS 10000
+
+typedef struct {
+    int bandwidth_hz;
+    int spreading_factor;
+    int coding_rate;  // 5 to 8, for 4/5 to 4/8
+    int preamble_len;
+    bool implicit_header;
+    bool crc_on;
+    bool low_data_rate;
+} LoraParams;
+
+// Packet classes, in no particular order (priorities come from the policy)
+typedef enum {
+    TELEM_CLASS_EVENT,   // Flight phase changes
+    TELEM_CLASS_STATE,   // Estimated altitude, velocity and acceleration
+    TELEM_CLASS_GPS,     // Position and velocity fix
+    TELEM_CLASS_HEALTH,  // Pyro continuity and system status
+    TELEM_NUM_CLASSES,
+    TELEM_CLASS_NONE = TELEM_NUM_CLASSES,
+} TelemClass;
+
+typedef struct {
+    bool enabled;
+    uint8_t priority;     // Lower is sent first
+    uint32_t period_ms;   // Minimum time between packets of the class
+    uint32_t max_age_ms;  // Don't send data older than this (0 for no limit)
+} TelemClassPolicy;
+
+typedef struct {
+    bool pending;  // New data since the last packet
+    uint32_t repeats_left;
+    uint32_t payload_len;
+    uint32_t airtime_us;
+    uint32_t update_ms;
+    uint32_t sent_ms;
+    bool ever_sent;
+
+    // Statistics
+    uint32_t num_sent;
+    uint64_t airtime_used_us;
+} TelemClassState;
+
+typedef struct {
+    TelemClassPolicy policy[TELEM_NUM_CLASSES];
+    TelemClassState classes[TELEM_NUM_CLASSES];
+    float duty_cycle;
+    int64_t credit_us;  // Airtime available to spend right now
+    uint32_t credit_ms;  // Time the credit was last brought up to date
+} TelemSched;
+
+/**
+ * @brief Time on air of a LoRa packet, per the SX1276 datasheet
+ *
+ * @param payload_len Bytes in the packet, including any addressing
+ */
+uint32_t lora_time_on_air_us(const LoraParams* params, int payload_len);
+
+/**
+ * @brief Set up the scheduler
+ *
+ * @param lora Modem settings, used to work out the airtime of each class
+ * @param payload_lens Packet length of each class, in bytes
+ * @param duty_cycle Fraction of time the radio may spend transmitting
+ */
+void telem_sched_init(TelemSched* sched, const LoraParams* lora,
+                      const uint32_t payload_lens[TELEM_NUM_CLASSES],
+                      float duty_cycle, uint32_t now_ms);
+
+/**
+ * @brief Change the rates and priorities, e.g. when the flight phase changes
+ */
+void telem_sched_set_policy(TelemSched* sched,
+                            const TelemClassPolicy policy[TELEM_NUM_CLASSES]);
+
+/**
+ * @brief Mark that new data is available for a class
+ *
+ * For events, this queues TELEM_EVENT_REPEATS packets.
+ */
+void telem_sched_update(TelemSched* sched, TelemClass cls, uint32_t now_ms);
+
+/**
+ * @brief Pick the class to send next
+ *
+ * Out of the enabled classes with fresh data whose period has passed, the one
+ * with the lowest priority value is chosen, and then the one that has waited
+ * longest. A class moves up one priority step for each period it waits past
+ * due. If the budget doesn't cover the chosen packet yet, nothing is sent.
+ * Events are sent even if that overdraws the budget, until it is overdrawn by
+ * a full budget window.
+ *
+ * @return The class to send, or TELEM_CLASS_NONE if nothing should be sent
+ * right now
+ */
+TelemClass telem_sched_next(TelemSched* sched, uint32_t now_ms);
+
+/**
+ * @brief Account for a packet of the given class having been sent
+ */
+void telem_sched_sent(TelemSched* sched, TelemClass cls, uint32_t now_ms);
+
+#endif  // TELEM_SCHED_H
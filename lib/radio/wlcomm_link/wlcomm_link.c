@@ -0,0 +1,211 @@
+#include "wlcomm_link.h"
+
+#include <string.h>
+
+// CRC-16/CCITT of each nibble, so a byte takes two lookups rather than eight
+// shifts
+static const uint16_t s_crc_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+uint16_t wlcomm_link_crc16(uint16_t crc, const uint8_t* data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        crc = (crc << 4) ^ s_crc_table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ s_crc_table[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
+
+uint32_t wlcomm_link_encode(const uint8_t* body, uint8_t* frame) {
+    uint32_t body_len = WLCOMM_LINK_HEADER_LEN + body[0];
+    frame[0] = WLCOMM_LINK_SYNC_0;
+    frame[1] = WLCOMM_LINK_SYNC_1;
+    memcpy(frame + WLCOMM_LINK_SYNC_LEN, body, body_len);
+
+    uint32_t len = WLCOMM_LINK_SYNC_LEN + body_len;
+    uint16_t crc = wlcomm_link_crc16(0xFFFF, frame, len);
+    frame[len++] = crc & 0xFF;
+    frame[len++] = crc >> 8;
+    return len;
+}
+
+/*************/
+/* RECEIVING */
+/*************/
+
+void wlcomm_link_rx_init(WlcommRx* rx, const uint8_t* buf, uint32_t size) {
+    memset(rx, 0, sizeof(*rx));
+    rx->buf = buf;
+    rx->size = size;
+}
+
+void wlcomm_link_rx_written(WlcommRx* rx, uint32_t wr) {
+    wr %= rx->size;
+    rx->received += (wr + rx->size - rx->wr) % rx->size;
+    rx->wr = wr;
+}
+
+void wlcomm_link_rx_restart(WlcommRx* rx) {
+    // The reader's position follows the total, so move that on to the start
+    // of the buffer, far enough that the reader sees it was lapped
+    rx->received += (rx->size - rx->wr) % rx->size + 2 * rx->size;
+    rx->wr = 0;
+}
+
+bool wlcomm_link_rx_pending(const WlcommRx* rx) {
+    return rx->received != rx->parsed;
+}
+
+// Contiguous bytes from off bytes past the read position, at most *len
+static const uint8_t* span(const WlcommRx* rx, uint32_t off, uint32_t* len) {
+    uint32_t i = (rx->rd + off) % rx->size;
+    if (*len > rx->size - i) {
+        *len = rx->size - i;
+    }
+    return rx->buf + i;
+}
+
+static uint8_t byte_at(const WlcommRx* rx, uint32_t off) {
+    return rx->buf[(rx->rd + off) % rx->size];
+}
+
+static void consume(WlcommRx* rx, uint32_t len) {
+    rx->rd = (rx->rd + len) % rx->size;
+    rx->parsed += len;
+}
+
+static uint16_t crc_of(const WlcommRx* rx, uint32_t off, uint32_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len > 0) {
+        uint32_t n = len;
+        const uint8_t* p = span(rx, off, &n);
+        crc = wlcomm_link_crc16(crc, p, n);
+        off += n;
+        len -= n;
+    }
+    return crc;
+}
+
+static void copy_out(const WlcommRx* rx, uint32_t off, uint8_t* dst,
+                     uint32_t len) {
+    while (len > 0) {
+        uint32_t n = len;
+        const uint8_t* p = span(rx, off, &n);
+        memcpy(dst, p, n);
+        dst += n;
+        off += n;
+        len -= n;
+    }
+}
+
+// Bytes before the next possible start of a frame
+static uint32_t find_sync(const WlcommRx* rx, uint32_t avail) {
+    uint32_t skip = 0;
+    while (skip < avail) {
+        uint32_t n = avail - skip;
+        const uint8_t* p = span(rx, skip, &n);
+        const uint8_t* sync = memchr(p, WLCOMM_LINK_SYNC_0, n);
+        if (sync != NULL) {
+            return skip + (sync - p);
+        }
+        skip += n;
+    }
+    return skip;
+}
+
+bool wlcomm_link_rx_next(WlcommRx* rx, uint8_t* body) {
+    while (1) {
+        uint32_t received = rx->received;
+        uint32_t avail = received - rx->parsed;
+        if (avail > rx->size) {
+            // Only what was written since the writer last went back to the
+            // start of the buffer can be trusted
+            uint32_t lost = avail - received % rx->size;
+            rx->stats.overruns++;
+            rx->stats.skipped += lost;
+            consume(rx, lost);
+            avail -= lost;
+        }
+
+        uint32_t skip = find_sync(rx, avail);
+        rx->stats.skipped += skip;
+        consume(rx, skip);
+        avail -= skip;
+
+        if (avail < WLCOMM_LINK_SYNC_LEN) {
+            return false;
+        }
+        if (byte_at(rx, 1) != WLCOMM_LINK_SYNC_1) {
+            rx->stats.skipped++;
+            consume(rx, 1);
+            continue;
+        }
+        if (avail < WLCOMM_LINK_SYNC_LEN + WLCOMM_LINK_HEADER_LEN) {
+            return false;
+        }
+
+        uint32_t body_len =
+            WLCOMM_LINK_HEADER_LEN + byte_at(rx, WLCOMM_LINK_SYNC_LEN);
+        uint32_t crc_off = WLCOMM_LINK_SYNC_LEN + body_len;
+        if (avail < crc_off + WLCOMM_LINK_CRC_LEN) {
+            return false;
+        }
+
+        uint16_t crc = byte_at(rx, crc_off) | byte_at(rx, crc_off + 1) << 8;
+        if (crc_of(rx, 0, crc_off) != crc) {
+            // Look again from just after this start
+            rx->stats.crc_errors++;
+            consume(rx, 1);
+            continue;
+        }
+
+        copy_out(rx, WLCOMM_LINK_SYNC_LEN, body, body_len);
+        consume(rx, crc_off + WLCOMM_LINK_CRC_LEN);
+        rx->stats.frames++;
+        return true;
+    }
+}
+
+/***********/
+/* SENDING */
+/***********/
+
+void wlcomm_link_tx_init(WlcommTx* tx) { memset(tx, 0, sizeof(*tx)); }
+
+WlcommTxSlot* wlcomm_link_tx_reserve(WlcommTx* tx) {
+    WlcommTxSlot* slot = &tx->slots[tx->head % WLCOMM_LINK_TX_SLOTS];
+    if (slot->state != WLCOMM_TX_FREE) {
+        tx->dropped++;
+        return NULL;
+    }
+    slot->state = WLCOMM_TX_FILLING;
+    tx->head++;
+    return slot;
+}
+
+void wlcomm_link_tx_fill(WlcommTxSlot* slot, const uint8_t* body) {
+    slot->len = wlcomm_link_encode(body, slot->frame);
+    slot->state = WLCOMM_TX_READY;
+}
+
+WlcommTxSlot* wlcomm_link_tx_start(WlcommTx* tx) {
+    WlcommTxSlot* slot = &tx->slots[tx->tail % WLCOMM_LINK_TX_SLOTS];
+    if (tx->tail == tx->head || slot->state != WLCOMM_TX_READY) {
+        return NULL;
+    }
+    slot->state = WLCOMM_TX_SENDING;
+    return slot;
+}
+
+void wlcomm_link_tx_done(WlcommTx* tx) {
+    WlcommTxSlot* slot = &tx->slots[tx->tail % WLCOMM_LINK_TX_SLOTS];
+    if (slot->state != WLCOMM_TX_SENDING) {
+        return;
+    }
+    slot->state = WLCOMM_TX_FREE;
+    tx->tail++;
+    tx->sent++;
+}
+
+bool wlcomm_link_tx_busy(const WlcommTx* tx) { return tx->head != tx->tail; }
@@ -0,0 +1,178 @@
+#ifndef WLCOMM_LINK_H
+#define WLCOMM_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "status.h"
+
+// Frames are "!$", the body, then the CRC-16 (CCITT, initial value 0xFFFF) of
+// everything before it, least significant byte first. The body is the
+// payload length, device ID, message ID and payload, laid out like pspcommsg.
+#define WLCOMM_LINK_SYNC_0 '!'
+#define WLCOMM_LINK_SYNC_1 '$'
+#define WLCOMM_LINK_SYNC_LEN 2
+#define WLCOMM_LINK_HEADER_LEN 3
+#define WLCOMM_LINK_CRC_LEN 2
+#define WLCOMM_LINK_MAX_PAYLOAD_LEN 255
+#define WLCOMM_LINK_MAX_BODY_LEN \
+    (WLCOMM_LINK_HEADER_LEN + WLCOMM_LINK_MAX_PAYLOAD_LEN)
+#define WLCOMM_LINK_MAX_FRAME_LEN \
+    (WLCOMM_LINK_SYNC_LEN + WLCOMM_LINK_MAX_BODY_LEN + WLCOMM_LINK_CRC_LEN)
+
+// Frames that can wait to be sent
+#define WLCOMM_LINK_TX_SLOTS 4
+
+/**
+ * @brief CRC-16 of data, continuing from crc
+ */
+uint16_t wlcomm_link_crc16(uint16_t crc, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief Build a frame around a body
+ *
+ * @param frame Room for WLCOMM_LINK_MAX_FRAME_LEN bytes
+ * @return Length of the frame
+ */
+uint32_t wlcomm_link_encode(const uint8_t* body, uint8_t* frame);
+
+// Receiving
+
+typedef struct {
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t skipped;   // Bytes thrown away looking for the start of a frame
+    uint32_t overruns;  // Times the writer lapped the reader or restarted
+} WlcommRxStats;
+
+/**
+ * @brief Frames received into a ring buffer, e.g. by DMA in circular mode
+ *
+ * The writer (an interrupt) calls wlcomm_link_rx_written() with how far it has
+ * got, and the reader (one task) calls wlcomm_link_rx_next(). Bytes are only
+ * read in place, a span at a time, and only copied out once a whole frame
+ * with a good CRC is there.
+ */
+typedef struct {
+    const uint8_t* buf;
+    uint32_t size;
+
+    // Writer only
+    uint32_t wr;
+
+    // Bytes written and consumed in total, so a full lap isn't lost
+    volatile uint32_t received;
+    uint32_t parsed;
+
+    // Reader only
+    uint32_t rd;
+    WlcommRxStats stats;
+} WlcommRx;
+
+/**
+ * @brief Set up to parse frames from buf
+ *
+ * @param size A power of two, so positions stay in step with the totals
+ */
+void wlcomm_link_rx_init(WlcommRx* rx, const uint8_t* buf, uint32_t size);
+
+/**
+ * @brief Account for bytes written, up to (not including) position wr
+ *
+ * Must be called at least twice per lap of the buffer, e.g. on the half and
+ * full transfer interrupts as well as on an idle line.
+ */
+void wlcomm_link_rx_written(WlcommRx* rx, uint32_t wr);
+
+/**
+ * @brief The writer is starting again from the beginning of the buffer, e.g.
+ * after a reception error. Anything from before that not yet parsed is
+ * thrown away, and counted as an overrun.
+ */
+void wlcomm_link_rx_restart(WlcommRx* rx);
+
+/**
+ * @brief Whether there are bytes that haven't been parsed
+ */
+bool wlcomm_link_rx_pending(const WlcommRx* rx);
+
+/**
+ * @brief Take the next whole frame with a good CRC
+ *
+ * Noise is skipped over, and after a bad CRC the search starts again from the
+ * byte after the bad frame's start, so a frame hidden in it isn't lost.
+ *
+ * @param body Room for WLCOMM_LINK_MAX_BODY_LEN bytes
+ * @return Whether a frame was found; if not, the rest of one may still be to
+ * come
+ */
+bool wlcomm_link_rx_next(WlcommRx* rx, uint8_t* body);
+
+// Sending
+
+typedef enum {
+    WLCOMM_TX_FREE,
+    WLCOMM_TX_FILLING,
+    WLCOMM_TX_READY,
+    WLCOMM_TX_SENDING,
+} WlcommTxSlotState;
+
+typedef struct {
+    uint8_t frame[WLCOMM_LINK_MAX_FRAME_LEN];
+    uint16_t len;
+    volatile uint8_t state;  // WlcommTxSlotState
+} WlcommTxSlot;
+
+typedef struct {
+    WlcommTxSlot slots[WLCOMM_LINK_TX_SLOTS];
+    uint32_t head;  // Next slot to hand out
+    uint32_t tail;  // Oldest slot not yet sent
+
+    // Statistics
+    uint32_t sent;
+    uint32_t dropped;
+} WlcommTx;
+
+/**
+ * @brief Ring of frames waiting to be sent, in order, by DMA
+ *
+ * A sender reserves a slot, encodes into it and marks it ready, then starts
+ * a transfer if none is running. The transfer complete interrupt marks the
+ * slot done and starts the next. Senders can encode at the same time; a ready
+ * frame waits for any reserved before it.
+ *
+ * wlcomm_link_tx_reserve(), wlcomm_link_tx_start() and wlcomm_link_tx_done()
+ * must not run at the same time as each other (e.g. in a critical section).
+ */
+void wlcomm_link_tx_init(WlcommTx* tx);
+
+/**
+ * @brief Hand out the next slot
+ *
+ * @return NULL if every slot is in use, and the frame was dropped
+ */
+WlcommTxSlot* wlcomm_link_tx_reserve(WlcommTx* tx);
+
+/**
+ * @brief Encode a body into a reserved slot, and mark it ready to send
+ */
+void wlcomm_link_tx_fill(WlcommTxSlot* slot, const uint8_t* body);
+
+/**
+ * @brief The slot to send next, marked as being sent
+ *
+ * @return NULL if a frame is already being sent, or the oldest isn't ready
+ */
+WlcommTxSlot* wlcomm_link_tx_start(WlcommTx* tx);
+
+/**
+ * @brief Free the slot that was being sent
+ */
+void wlcomm_link_tx_done(WlcommTx* tx);
+
+/**
+ * @brief Whether any frame is waiting or being sent
+ */
+bool wlcomm_link_tx_busy(const WlcommTx* tx);
+
+#endif  // WLCOMM_LINK_H
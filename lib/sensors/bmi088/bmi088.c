@@ -214,4 +214,50 @@ Gyro bmi088_gyro_read(I2cDevice* device) {
     gyro.gyroZ = (int16_t)(((uint16_t)buf[5] << 8) | (uint16_t)buf[4]) * cf;
 
     return gyro;
-}
\ No newline at end of file
+}
+
+// Signal new data on the accelerometer INT1 and gyroscope INT3 pins
+Status bmi088_enable_drdy_int(I2cDevice* acc_device, I2cDevice* gyro_device) {
+    uint8_t buf;
+
+    if (!s_initialized) {
+        return STATUS_STATE_ERROR;
+    }
+
+    // Accelerometer INT1 as a push-pull, active high output
+    buf = 0x0A;
+    if (bmi088_write_verify(acc_device, BMI088_ACC_INT1_IO_CONF, &buf, 1) !=
+        STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Map accelerometer data ready to INT1
+    buf = 0x04;
+    if (bmi088_write_verify(acc_device, BMI088_ACC_INT1_INT2_MAP_DATA, &buf,
+                            1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Enable the gyroscope data ready interrupt
+    buf = 0x80;
+    if (bmi088_write(gyro_device, BMI088_GYRO_INT_CTRL, &buf, 1) !=
+        STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Gyroscope INT3 as a push-pull, active high output
+    buf = 0x01;
+    if (bmi088_write(gyro_device, BMI088_GYRO_INT3_INT4_IO_CONF, &buf, 1) !=
+        STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Map gyroscope data ready to INT3
+    buf = 0x01;
+    if (bmi088_write(gyro_device, BMI088_GYRO_INT3_INT4_IO_MAP, &buf, 1) !=
+        STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    return STATUS_OK;
+}
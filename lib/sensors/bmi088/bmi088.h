@@ -20,6 +20,8 @@
 #define BMI088_ACC_Z_MSB 0x17
 #define BMI088_ACC_CONF 0x40
 #define BMI088_ACC_RANGE 0x41
+#define BMI088_ACC_INT1_IO_CONF 0x53
+#define BMI088_ACC_INT1_INT2_MAP_DATA 0x58
 #define BMI088_ACC_OUT BMI088_ACC_X_LSB
 #define BMI088_ACC_PWR_CONF 0x7C
 #define BMI088_ACC_PWR_CTRL 0x7D
@@ -37,6 +39,9 @@
 #define BMI088_GYRO_BANDWIDTH 0x10
 #define BMI088_GYRO_OUT BMI088_GYRO_X_LSB
 #define BMI088_GYRO_SOFTRESET 0x14
+#define BMI088_GYRO_INT_CTRL 0x15
+#define BMI088_GYRO_INT3_INT4_IO_CONF 0x16
+#define BMI088_GYRO_INT3_INT4_IO_MAP 0x18
 
 // Settings
 typedef enum {
@@ -90,6 +95,9 @@ Status bmi088_init(I2cDevice* acc_device, I2cDevice* gyro_device,
 Accel bmi088_acc_read(I2cDevice* device);
 Gyro bmi088_gyro_read(I2cDevice* device);
 
+// Drive the accelerometer INT1 and gyroscope INT3 pins high on new data
+Status bmi088_enable_drdy_int(I2cDevice* acc_device, I2cDevice* gyro_device);
+
 #endif  // BMI088_H
 
 // God I hope this is right
\ No newline at end of file
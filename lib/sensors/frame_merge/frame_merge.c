@@ -0,0 +1,103 @@
+#include "frame_merge.h"
+
+#include <math.h>
+#include <string.h>
+
+static const uint8_t s_num_values[FRAME_NUM_SOURCES] = {
+    [FRAME_SOURCE_ACC_H] = 3, [FRAME_SOURCE_ACC_I] = 3,
+    [FRAME_SOURCE_ROT_I] = 3, [FRAME_SOURCE_MAG_I] = 3,
+    [FRAME_SOURCE_BARO] = 2,
+};
+
+// Where each source's values go in the frame
+static float* frame_fields(SensorFrame* frame, FrameSource source) {
+    switch (source) {
+        case FRAME_SOURCE_ACC_H:
+            return &frame->acc_h_x;
+        case FRAME_SOURCE_ACC_I:
+            return &frame->acc_i_x;
+        case FRAME_SOURCE_ROT_I:
+            return &frame->rot_i_x;
+        case FRAME_SOURCE_MAG_I:
+            return &frame->mag_i_x;
+        case FRAME_SOURCE_BARO:
+        default:
+            return &frame->temperature;
+    }
+}
+
+static uint64_t abs_diff(uint64_t a, uint64_t b) {
+    return a > b ? a - b : b - a;
+}
+
+Status frame_merge_init(FrameMerge* merge, FrameSource timebase,
+                        uint32_t max_age_us) {
+    if (timebase >= FRAME_NUM_SOURCES) {
+        return STATUS_PARAMETER_ERROR;
+    }
+
+    memset(merge, 0, sizeof(*merge));
+    merge->timebase = timebase;
+    merge->max_age_us = max_age_us;
+
+    return STATUS_OK;
+}
+
+Status frame_merge_sample(FrameMerge* merge, FrameSource source,
+                          uint64_t capture_us, const float* values) {
+    if (source >= FRAME_NUM_SOURCES) {
+        return STATUS_PARAMETER_ERROR;
+    }
+
+    FrameSample* sample = &merge->latest[source];
+    FrameSourceStats* stats = &merge->stats[source];
+    if (sample->valid && !sample->taken) {
+        stats->overwritten++;
+    }
+    stats->samples++;
+
+    sample->capture_us = capture_us;
+    memcpy(sample->values, values, s_num_values[source] * sizeof(float));
+    sample->valid = true;
+    sample->taken = false;
+
+    return STATUS_OK;
+}
+
+bool frame_merge_is_recent(const FrameMerge* merge, FrameSource source,
+                           uint64_t now_us) {
+    const FrameSample* sample = &merge->latest[source];
+    return sample->valid &&
+           abs_diff(sample->capture_us, now_us) <= merge->max_age_us;
+}
+
+void frame_merge_take(FrameMerge* merge, uint64_t now_us, SensorFrame* frame) {
+    // Stamp the frame with the timebase's capture, if it is new
+    const FrameSample* timebase = &merge->latest[merge->timebase];
+    uint64_t timestamp = now_us;
+    if (timebase->valid && !timebase->taken) {
+        timestamp = timebase->capture_us;
+    }
+    if (merge->frames > 0 && timestamp <= merge->last_timestamp) {
+        timestamp = merge->last_timestamp + 1;
+    }
+    frame->timestamp = timestamp;
+
+    for (int source = 0; source < FRAME_NUM_SOURCES; source++) {
+        FrameSample* sample = &merge->latest[source];
+        float* fields = frame_fields(frame, source);
+        if (frame_merge_is_recent(merge, source, timestamp)) {
+            memcpy(fields, sample->values,
+                   s_num_values[source] * sizeof(float));
+            sample->taken = true;
+        } else {
+            for (int i = 0; i < s_num_values[source]; i++) {
+                fields[i] = NAN;
+            }
+            merge->stats[source].stale++;
+        }
+    }
+
+    merge->last_timestamp = timestamp;
+    merge->frames++;
+}
@@ -0,0 +1,78 @@
+#ifndef FRAME_MERGE_H
+#define FRAME_MERGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sensor.pb.h"
+#include "status.h"
+
+// Most values a source fills in
+#define FRAME_MERGE_MAX_VALUES 3
+
+/**
+ * @brief The groups of SensorFrame fields, each sampled on its own schedule
+ */
+typedef enum {
+    FRAME_SOURCE_ACC_H,  // acc_h_x, acc_h_y, acc_h_z
+    FRAME_SOURCE_ACC_I,  // acc_i_x, acc_i_y, acc_i_z
+    FRAME_SOURCE_ROT_I,  // rot_i_x, rot_i_y, rot_i_z
+    FRAME_SOURCE_MAG_I,  // mag_i_x, mag_i_y, mag_i_z
+    FRAME_SOURCE_BARO,   // temperature, pressure
+    FRAME_NUM_SOURCES,
+} FrameSource;
+
+typedef struct {
+    uint64_t capture_us;
+    float values[FRAME_MERGE_MAX_VALUES];
+    bool valid;  // Sampled at least once
+    bool taken;  // Already put into a frame
+} FrameSample;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t overwritten;  // Replaced before they made it into a frame
+    uint32_t stale;        // Frames left without a value, it being too old
+} FrameSourceStats;
+
+/**
+ * @brief Builds SensorFrames out of samples captured at different times
+ *
+ * Only the latest sample of each source is kept. Each frame is stamped with
+ * the capture time of the timebase source's sample, and takes every other
+ * source's latest sample captured within max_age_us of that. Sources without
+ * one are left NAN, as a failed read would be.
+ */
+typedef struct {
+    FrameSample latest[FRAME_NUM_SOURCES];
+    FrameSourceStats stats[FRAME_NUM_SOURCES];
+    FrameSource timebase;
+    uint32_t max_age_us;
+    uint64_t last_timestamp;
+    uint32_t frames;
+} FrameMerge;
+
+Status frame_merge_init(FrameMerge* merge, FrameSource timebase,
+                        uint32_t max_age_us);
+
+/**
+ * @brief Add a source's sample, as many values as the source fills in
+ */
+Status frame_merge_sample(FrameMerge* merge, FrameSource source,
+                          uint64_t capture_us, const float* values);
+
+/**
+ * @brief Whether a source has a sample no older than max_age_us
+ */
+bool frame_merge_is_recent(const FrameMerge* merge, FrameSource source,
+                           uint64_t now_us);
+
+/**
+ * @brief Merge the latest samples into a frame
+ *
+ * Frame timestamps always increase. When the timebase has no new sample, the
+ * frame is stamped now_us instead.
+ */
+void frame_merge_take(FrameMerge* merge, uint64_t now_us, SensorFrame* frame);
+
+#endif  // FRAME_MERGE_H
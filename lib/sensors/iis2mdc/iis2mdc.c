@@ -61,3 +61,27 @@ Mag iis2mdc_read(I2cDevice* device) {
 
     return mag;
 }
+
+Status iis2mdc_enable_drdy_int(I2cDevice* device) {
+    uint8_t buf[2];
+
+    if (!s_initialized) {
+        return STATUS_STATE_ERROR;
+    }
+
+    buf[0] = IIS2MDC_CFG_C;
+    if (i2c_write(device, buf, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+    if (i2c_read(device, buf + 1, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Keep the rest of the configuration, and set DRDY_on_PIN
+    buf[1] |= (1 << 0);
+    if (i2c_write_verify(device, buf, 2) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    return STATUS_OK;
+}
@@ -30,4 +30,7 @@ Status iis2mdc_init(I2cDevice* device, Iis2mdcODR odr);
 // Read the acceleration registers
 Mag iis2mdc_read(I2cDevice* device);
 
+// Drive the DRDY pin high while new data is waiting to be read
+Status iis2mdc_enable_drdy_int(I2cDevice* device);
+
 #endif  // IIS2MDC_H
@@ -9,6 +9,9 @@
 static Kx134Range s_curr_range = 0;
 static bool s_initialized = false;
 
+// CNTL1 DRDYE, kept set across reconfiguration once the interrupt is enabled
+static uint8_t s_drdye = 0;
+
 /**
  * @brief Function for SPI read of a KX134 register
  *
@@ -128,6 +131,7 @@ Status kx134_init(I2cDevice* device, Kx134OutputDataRate rate,
 
     // enable sensor and set range
     s_curr_range = range;
+    s_drdye = 0;
     tx_buf = 0xC0 | range;
     if (kx134_write(device, KX134_CNTL1, &tx_buf, 1) != STATUS_OK) {
         return STATUS_ERROR;
@@ -217,7 +221,7 @@ Status kx134_config(I2cDevice* device, Kx134OutputDataRate rate,
     }
 
     // enable sensor and set range
-    tx_buf = 0xC0 | range;
+    tx_buf = 0xC0 | s_drdye | range;
     if (kx134_write(device, KX134_CNTL1, &tx_buf, 1) != STATUS_OK) {
         return STATUS_ERROR;
     }
@@ -246,4 +250,45 @@ Status kx134_config(I2cDevice* device, Kx134OutputDataRate rate,
     }
 
     return STATUS_OK;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Pulse INT1 high each time new data is ready
+ *
+ * @param device SPI device
+ * @return Status
+ */
+Status kx134_enable_drdy_int(I2cDevice* device) {
+    uint8_t tx_buf;
+
+    if (!s_initialized) {
+        return STATUS_STATE_ERROR;
+    }
+
+    // Interrupts can only be configured in standby
+    tx_buf = s_curr_range;
+    if (kx134_write(device, KX134_CNTL1, &tx_buf, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // INT1 enabled, active high, pulsed
+    tx_buf = 0x38;
+    if (kx134_write(device, KX134_INC1, &tx_buf, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Route data ready to INT1
+    tx_buf = 0x10;
+    if (kx134_write(device, KX134_INC4, &tx_buf, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Back to operating, with data ready reporting
+    s_drdye = 0x20;
+    tx_buf = 0xC0 | s_drdye | s_curr_range;
+    if (kx134_write(device, KX134_CNTL1, &tx_buf, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    return STATUS_OK;
+}
@@ -237,4 +237,7 @@ Accel kx134_read_accel(I2cDevice* device);
 Status kx134_config(I2cDevice* device, Kx134OutputDataRate rate,
                     Kx134Range range);
 
+// Pulse INT1 each time new data is ready
+Status kx134_enable_drdy_int(I2cDevice* device);
+
 #endif  // KX134_H
\ No newline at end of file
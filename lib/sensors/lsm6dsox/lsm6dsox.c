@@ -244,4 +244,23 @@ Status lsm6dsox_config_gyro(SpiDevice* device, Lsm6dsoxGyroDataRate rate,
     g_current_gyro_range = range;
 
     return STATUS_OK;
-}
\ No newline at end of file
+}
+
+Status lsm6dsox_enable_drdy_int(SpiDevice* device) {
+    uint8_t tx_buf;
+
+    // Pulsed rather than latched until the data is read
+    tx_buf = 0x80;
+    if (lsm6dsox_write(device, LSM6DSOX_COUNTER_BDR_REG1, &tx_buf, 1) !=
+        STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    // Accelerometer and gyroscope data ready on INT1
+    tx_buf = 0x03;
+    if (lsm6dsox_write(device, LSM6DSOX_INT1_CTRL, &tx_buf, 1) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    return STATUS_OK;
+}
@@ -8,6 +8,8 @@
 #include "status.h"
 
 // Register Definitions
+#define LSM6DSOX_COUNTER_BDR_REG1 0x0B
+#define LSM6DSOX_INT1_CTRL 0x0D
 #define LSM6DSOX_CTRL1_XL 0x10
 #define LSM6DSOX_CTRL2_G 0x11
 #define LSM6DSOX_CTRL3_C 0x12
@@ -81,4 +83,7 @@ Status lsm6dsox_config_accel(SpiDevice* device, Lsm6dsoxAccelDataRate rate,
 Status lsm6dsox_config_gyro(SpiDevice* device, Lsm6dsoxGyroDataRate rate,
                             Lsm6dsoxGyroRange range);
 
+// Pulse INT1 when new accelerometer or gyroscope data is ready
+Status lsm6dsox_enable_drdy_int(SpiDevice* device);
+
 #endif // LSM6DSOX_H
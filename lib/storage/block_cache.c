@@ -0,0 +1,153 @@
+#include "block_cache.h"
+
+#include <string.h>
+
+void block_cache_init(BlockCache* cache, BlockCacheReadFn read,
+                      BlockCacheWriteFn write, void* ctx, uint32_t num_blocks) {
+    cache->read = read;
+    cache->write = write;
+    cache->ctx = ctx;
+    cache->num_blocks = num_blocks;
+    cache->write_count = 0;
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    block_cache_invalidate(cache);
+}
+
+void block_cache_invalidate(BlockCache* cache) {
+    for (int i = 0; i < BLOCK_CACHE_NUM_RUNS; i++) {
+        cache->runs[i].count = 0;
+    }
+    cache->next_run = 0;
+    cache->next_lba = UINT32_MAX;
+}
+
+// Cached copy of a block, or NULL
+static uint8_t* find_block(BlockCache* cache, uint32_t lba) {
+    for (int i = 0; i < BLOCK_CACHE_NUM_RUNS; i++) {
+        BlockCacheRun* run = &cache->runs[i];
+        if (lba >= run->lba && lba - run->lba < run->count) {
+            return run->data + (lba - run->lba) * BLOCK_CACHE_BLOCK_LEN;
+        }
+    }
+    return NULL;
+}
+
+// Read count blocks from lba into the next run in the ring
+static Status fill_run(BlockCache* cache, uint32_t lba, uint32_t count) {
+    BlockCacheRun* run = &cache->runs[cache->next_run];
+    cache->next_run = (cache->next_run + 1) % BLOCK_CACHE_NUM_RUNS;
+
+    run->count = 0;
+    Status status = cache->read(cache->ctx, run->data, lba, count);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    run->lba = lba;
+    run->count = count;
+    cache->stats.disk_reads++;
+    return STATUS_OK;
+}
+
+// Whether any of count blocks from lba are being held back
+static bool overlaps_write(BlockCache* cache, uint32_t lba, uint32_t count) {
+    return cache->write_count > 0 &&
+           lba < cache->write_lba + cache->write_count &&
+           cache->write_lba < lba + count;
+}
+
+Status block_cache_flush(BlockCache* cache) {
+    if (cache->write_count == 0) {
+        return STATUS_OK;
+    }
+
+    // Held blocks are kept if the write fails, so it can be tried again
+    Status status = cache->write(cache->ctx, cache->write_data,
+                                 cache->write_lba, cache->write_count);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    cache->write_count = 0;
+    cache->stats.disk_writes++;
+    return STATUS_OK;
+}
+
+Status block_cache_read(BlockCache* cache, uint32_t lba, uint8_t* buf,
+                        uint32_t count) {
+    if (count > cache->num_blocks || lba > cache->num_blocks - count) {
+        return STATUS_PARAMETER_ERROR;
+    }
+
+    bool sequential = lba == cache->next_lba;
+    cache->next_lba = lba + count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t* block = find_block(cache, lba + i);
+        if (block == NULL) {
+            // Read ahead if the host is going through the disk in order,
+            // otherwise just what was asked for (up to a run)
+            uint32_t run_count = count - i;
+            if (sequential || run_count > BLOCK_CACHE_RUN_BLOCKS) {
+                run_count = BLOCK_CACHE_RUN_BLOCKS;
+            }
+            if (run_count > cache->num_blocks - (lba + i)) {
+                run_count = cache->num_blocks - (lba + i);
+            }
+
+            // Blocks being held back have to reach the disk before they're
+            // read, or the run would keep the old copy. (Cached blocks are
+            // kept up to date as they're written.)
+            Status status = STATUS_OK;
+            if (overlaps_write(cache, lba + i, run_count)) {
+                status = block_cache_flush(cache);
+            }
+            if (status == STATUS_OK) {
+                status = fill_run(cache, lba + i, run_count);
+            }
+            if (status != STATUS_OK) {
+                return status;
+            }
+            cache->stats.misses++;
+            block = find_block(cache, lba + i);
+        } else {
+            cache->stats.hits++;
+        }
+        memcpy(buf + i * BLOCK_CACHE_BLOCK_LEN, block, BLOCK_CACHE_BLOCK_LEN);
+    }
+
+    return STATUS_OK;
+}
+
+Status block_cache_write(BlockCache* cache, uint32_t lba, const uint8_t* buf,
+                         uint32_t count) {
+    if (count > cache->num_blocks || lba > cache->num_blocks - count) {
+        return STATUS_PARAMETER_ERROR;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* data = buf + i * BLOCK_CACHE_BLOCK_LEN;
+
+        // Keep any cached copy up to date
+        uint8_t* cached = find_block(cache, lba + i);
+        if (cached != NULL) {
+            memcpy(cached, data, BLOCK_CACHE_BLOCK_LEN);
+        }
+
+        // Write out what's held back if this doesn't carry on from it
+        if (cache->write_count == BLOCK_CACHE_WRITE_BLOCKS ||
+            (cache->write_count > 0 &&
+             lba + i != cache->write_lba + cache->write_count)) {
+            Status status = block_cache_flush(cache);
+            if (status != STATUS_OK) {
+                return status;
+            }
+        }
+        if (cache->write_count == 0) {
+            cache->write_lba = lba + i;
+        }
+        memcpy(cache->write_data + cache->write_count * BLOCK_CACHE_BLOCK_LEN,
+               data, BLOCK_CACHE_BLOCK_LEN);
+        cache->write_count++;
+    }
+
+    return STATUS_OK;
+}
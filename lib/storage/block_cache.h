@@ -0,0 +1,88 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "status.h"
+
+#define BLOCK_CACHE_BLOCK_LEN 512
+
+// Blocks in each read-ahead run, and the number of runs in the ring
+#define BLOCK_CACHE_RUN_BLOCKS 16
+#define BLOCK_CACHE_NUM_RUNS 2
+
+// Most consecutive blocks that are written to the disk in one go
+#define BLOCK_CACHE_WRITE_BLOCKS 16
+
+// Reads and writes count consecutive blocks starting at lba
+typedef Status (*BlockCacheReadFn)(void* ctx, uint8_t* buf, uint32_t lba,
+                                   uint32_t count);
+typedef Status (*BlockCacheWriteFn)(void* ctx, const uint8_t* buf,
+                                    uint32_t lba, uint32_t count);
+
+typedef struct {
+    uint32_t lba;
+    uint32_t count;  // 0 if it holds nothing
+    uint8_t data[BLOCK_CACHE_RUN_BLOCKS * BLOCK_CACHE_BLOCK_LEN];
+} BlockCacheRun;
+
+typedef struct {
+    uint32_t hits;         // Blocks read from the cache
+    uint32_t misses;       // Blocks that had to be read from the disk
+    uint32_t disk_reads;   // Reads from the disk, of one or more blocks
+    uint32_t disk_writes;  // Writes to the disk, of one or more blocks
+} BlockCacheStats;
+
+// Block cache for a disk that is read and written mostly in order, e.g. by a
+// USB host copying files. Reads that carry on from the last one fill a whole
+// run of blocks at once, and consecutive writes are held back and written
+// together. The buffers are in the struct, so put it wherever the disk's DMA
+// can reach.
+typedef struct {
+    BlockCacheReadFn read;
+    BlockCacheWriteFn write;
+    void* ctx;
+    uint32_t num_blocks;
+
+    BlockCacheRun runs[BLOCK_CACHE_NUM_RUNS];
+    uint32_t next_run;  // Next run in the ring to be refilled
+    uint32_t next_lba;  // Where a sequential read would start
+
+    uint32_t write_lba;
+    uint32_t write_count;
+    uint8_t write_data[BLOCK_CACHE_WRITE_BLOCKS * BLOCK_CACHE_BLOCK_LEN];
+
+    BlockCacheStats stats;
+} BlockCache;
+
+void block_cache_init(BlockCache* cache, BlockCacheReadFn read,
+                      BlockCacheWriteFn write, void* ctx, uint32_t num_blocks);
+
+/**
+ * @brief Read count blocks starting at lba into buf
+ */
+Status block_cache_read(BlockCache* cache, uint32_t lba, uint8_t* buf,
+                        uint32_t count);
+
+/**
+ * @brief Write count blocks starting at lba from buf. They may only reach
+ * the disk on a later write or block_cache_flush.
+ */
+Status block_cache_write(BlockCache* cache, uint32_t lba, const uint8_t* buf,
+                         uint32_t count);
+
+/**
+ * @brief Write out any blocks that are being held back. If that fails, they
+ * are still held back.
+ */
+Status block_cache_flush(BlockCache* cache);
+
+/**
+ * @brief Forget what was read, e.g. after something else wrote to the disk.
+ * Blocks being held back are kept, so flush first if needed.
+ */
+void block_cache_invalidate(BlockCache* cache);
+
+#endif  // BLOCK_CACHE_H
@@ -0,0 +1,118 @@
+// Generated by scripts/gen_frame_encode.py from lib/storage/proto, do not edit
+
+#include "frame_encode.h"
+
+#include <string.h>
+
+// Tags are passed as their varint encoding, first byte lowest
+static inline uint8_t* put_tag(uint8_t* p, uint16_t tag) {
+    *p++ = tag & 0xFF;
+    if (tag > 0xFF) {
+        *p++ = tag >> 8;
+    }
+    return p;
+}
+
+// Fields with default values are left out, as in proto3
+static inline uint8_t* put_varint(uint8_t* p, uint16_t tag, uint64_t value) {
+    if (value == 0) {
+        return p;
+    }
+    p = put_tag(p, tag);
+    while (value >= 0x80) {
+        *p++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+// Like nanopb, only +0 counts as the default, since it compares the bytes.
+// Note: fixed32 is little endian, so this assumes a little endian host.
+static inline uint8_t* put_float(uint8_t* p, uint16_t tag, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    if (bits == 0) {
+        return p;
+    }
+    p = put_tag(p, tag);
+    memcpy(p, &bits, 4);
+    return p + 4;
+}
+
+// The message is written after room for the longest length prefix, and moved
+// down if the actual prefix is shorter
+static inline size_t put_length(uint8_t* buf, size_t prefix_len, uint8_t* end) {
+    size_t len = end - (buf + prefix_len);
+    if (len < 0x80) {
+        if (prefix_len > 1) {
+            memmove(buf + 1, buf + prefix_len, len);
+        }
+        buf[0] = len;
+        return len + 1;
+    }
+    buf[0] = (len & 0x7F) | 0x80;
+    buf[1] = len >> 7;
+    return len + 2;
+}
+
+size_t frame_encode_sensor(const SensorFrame* frame, uint8_t* buf) {
+    uint8_t* p = buf + 1;
+    p = put_varint(p, 0x08, frame->timestamp);
+    p = put_float(p, 0x15, frame->temperature);
+    p = put_float(p, 0x1D, frame->pressure);
+    p = put_float(p, 0x25, frame->acc_h_x);
+    p = put_float(p, 0x2D, frame->acc_h_y);
+    p = put_float(p, 0x35, frame->acc_h_z);
+    p = put_float(p, 0x3D, frame->acc_i_x);
+    p = put_float(p, 0x45, frame->acc_i_y);
+    p = put_float(p, 0x4D, frame->acc_i_z);
+    p = put_float(p, 0x55, frame->rot_i_x);
+    p = put_float(p, 0x5D, frame->rot_i_y);
+    p = put_float(p, 0x65, frame->rot_i_z);
+    p = put_float(p, 0x6D, frame->mag_i_x);
+    p = put_float(p, 0x75, frame->mag_i_y);
+    p = put_float(p, 0x7D, frame->mag_i_z);
+    return put_length(buf, 1, p);
+}
+
+size_t frame_encode_state(const StateFrame* frame, uint8_t* buf) {
+    uint8_t* p = buf + 2;
+    p = put_varint(p, 0x08, frame->timestamp);
+    p = put_varint(p, 0x10, frame->flight_phase);
+    p = put_float(p, 0x1D, frame->pos_vert);
+    p = put_float(p, 0x25, frame->vel_vert);
+    p = put_float(p, 0x2D, frame->acc_vert);
+    p = put_float(p, 0x35, frame->pos_geo_x);
+    p = put_float(p, 0x3D, frame->pos_geo_y);
+    p = put_float(p, 0x45, frame->pos_geo_z);
+    p = put_float(p, 0x4D, frame->vel_geo_x);
+    p = put_float(p, 0x55, frame->vel_geo_y);
+    p = put_float(p, 0x5D, frame->vel_geo_z);
+    p = put_float(p, 0x65, frame->acc_geo_x);
+    p = put_float(p, 0x6D, frame->acc_geo_y);
+    p = put_float(p, 0x75, frame->acc_geo_z);
+    p = put_varint(p, 0x78, frame->gentimestamp);
+    p = put_float(p, 0x0185, frame->angvel_body_x);
+    p = put_float(p, 0x018D, frame->angvel_body_y);
+    p = put_float(p, 0x0195, frame->angvel_body_z);
+    p = put_float(p, 0x019D, frame->orient_geo_w);
+    p = put_float(p, 0x01A5, frame->orient_geo_x);
+    p = put_float(p, 0x01AD, frame->orient_geo_y);
+    p = put_float(p, 0x01B5, frame->orient_geo_z);
+    p = put_float(p, 0x01BD, frame->pos_ekf);
+    p = put_float(p, 0x01C5, frame->vel_ekf);
+    p = put_float(p, 0x01CD, frame->acc_ekf);
+    p = put_float(p, 0x01D5, frame->orient_ekf_w);
+    p = put_float(p, 0x01DD, frame->orient_ekf_x);
+    p = put_float(p, 0x01E5, frame->orient_ekf_y);
+    p = put_float(p, 0x01ED, frame->orient_ekf_z);
+    p = put_float(p, 0x01F5, frame->pos_var_ekf);
+    p = put_float(p, 0x01FD, frame->vel_var_ekf);
+    p = put_float(p, 0x0285, frame->acc_var_ekf);
+    p = put_float(p, 0x028D, frame->orient_var_ekf_w);
+    p = put_float(p, 0x0295, frame->orient_var_ekf_x);
+    p = put_float(p, 0x029D, frame->orient_var_ekf_y);
+    p = put_float(p, 0x02A5, frame->orient_var_ekf_z);
+    return put_length(buf, 2, p);
+}
@@ -0,0 +1,36 @@
+// Generated by scripts/gen_frame_encode.py from lib/storage/proto, do not edit
+
+#ifndef FRAME_ENCODE_H
+#define FRAME_ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sensor.pb.h"
+#include "state.pb.h"
+
+// Largest encoded message, including the length prefix
+#define FRAME_ENCODE_SENSOR_MAX_LEN 82
+#define FRAME_ENCODE_STATE_MAX_LEN 216
+
+/**
+ * @brief Encode a SensorFrame as a length-delimited protobuf message
+ *
+ * Writes the same bytes as nanopb with PB_ENCODE_DELIMITED
+ *
+ * @param buf At least FRAME_ENCODE_SENSOR_MAX_LEN bytes
+ * @return Bytes written
+ */
+size_t frame_encode_sensor(const SensorFrame* frame, uint8_t* buf);
+
+/**
+ * @brief Encode a StateFrame as a length-delimited protobuf message
+ *
+ * Writes the same bytes as nanopb with PB_ENCODE_DELIMITED
+ *
+ * @param buf At least FRAME_ENCODE_STATE_MAX_LEN bytes
+ * @return Bytes written
+ */
+size_t frame_encode_state(const StateFrame* frame, uint8_t* buf);
+
+#endif  // FRAME_ENCODE_H
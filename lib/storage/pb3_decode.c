@@ -0,0 +1,357 @@
+#include "pb3_decode.h"
+
+#include <string.h>
+
+#include "sensor_block.h"
+
+#define WT_VARINT 0
+#define WT_FIXED32 5
+
+static const Pb3Column s_sensor_cols[] = {
+    {"timestamp", PB3_COL_U64}, {"temperature", PB3_COL_F32},
+    {"pressure", PB3_COL_F32},  {"acc_h_x", PB3_COL_F32},
+    {"acc_h_y", PB3_COL_F32},   {"acc_h_z", PB3_COL_F32},
+    {"acc_i_x", PB3_COL_F32},   {"acc_i_y", PB3_COL_F32},
+    {"acc_i_z", PB3_COL_F32},   {"rot_i_x", PB3_COL_F32},
+    {"rot_i_y", PB3_COL_F32},   {"rot_i_z", PB3_COL_F32},
+    {"mag_i_x", PB3_COL_F32},   {"mag_i_y", PB3_COL_F32},
+    {"mag_i_z", PB3_COL_F32},
+};
+
+static const Pb3Column s_state_cols[] = {
+    {"timestamp", PB3_COL_U64},        {"flight_phase", PB3_COL_U32},
+    {"pos_vert", PB3_COL_F32},         {"vel_vert", PB3_COL_F32},
+    {"acc_vert", PB3_COL_F32},         {"pos_geo_x", PB3_COL_F32},
+    {"pos_geo_y", PB3_COL_F32},        {"pos_geo_z", PB3_COL_F32},
+    {"vel_geo_x", PB3_COL_F32},        {"vel_geo_y", PB3_COL_F32},
+    {"vel_geo_z", PB3_COL_F32},        {"acc_geo_x", PB3_COL_F32},
+    {"acc_geo_y", PB3_COL_F32},        {"acc_geo_z", PB3_COL_F32},
+    {"gentimestamp", PB3_COL_U64},     {"angvel_body_x", PB3_COL_F32},
+    {"angvel_body_y", PB3_COL_F32},    {"angvel_body_z", PB3_COL_F32},
+    {"orient_geo_w", PB3_COL_F32},     {"orient_geo_x", PB3_COL_F32},
+    {"orient_geo_y", PB3_COL_F32},     {"orient_geo_z", PB3_COL_F32},
+    {"pos_ekf", PB3_COL_F32},          {"vel_ekf", PB3_COL_F32},
+    {"acc_ekf", PB3_COL_F32},          {"orient_ekf_w", PB3_COL_F32},
+    {"orient_ekf_x", PB3_COL_F32},     {"orient_ekf_y", PB3_COL_F32},
+    {"orient_ekf_z", PB3_COL_F32},     {"pos_var_ekf", PB3_COL_F32},
+    {"vel_var_ekf", PB3_COL_F32},      {"acc_var_ekf", PB3_COL_F32},
+    {"orient_var_ekf_w", PB3_COL_F32}, {"orient_var_ekf_x", PB3_COL_F32},
+    {"orient_var_ekf_y", PB3_COL_F32}, {"orient_var_ekf_z", PB3_COL_F32},
+};
+
+static const Pb3Column s_gps_cols[] = {
+    {"timestamp", PB3_COL_U64},      {"year", PB3_COL_U32},
+    {"month", PB3_COL_U32},          {"day", PB3_COL_U32},
+    {"hour", PB3_COL_U32},           {"min", PB3_COL_U32},
+    {"sec", PB3_COL_U32},            {"valid_flags", PB3_COL_U64},
+    {"num_sats", PB3_COL_U32},       {"lon", PB3_COL_F32},
+    {"lat", PB3_COL_F32},            {"height", PB3_COL_F32},
+    {"height_msl", PB3_COL_F32},     {"accuracy_horiz", PB3_COL_F32},
+    {"accuracy_vertical", PB3_COL_F32}, {"vel_north", PB3_COL_F32},
+    {"vel_east", PB3_COL_F32},       {"vel_down", PB3_COL_F32},
+    {"ground_speed", PB3_COL_F32},   {"hdg", PB3_COL_F32},
+    {"accuracy_speed", PB3_COL_F32}, {"accuracy_hdg", PB3_COL_F32},
+};
+
+#define NUM_COLS(cols) (sizeof(cols) / sizeof(cols[0]))
+
+// max_len: tag (1 byte below field 16, else 2) plus 10 bytes per uint64,
+// 5 per uint32 and 4 per float
+static const Pb3Schema s_schemas[PB3_NUM_KINDS] = {
+    [PB3_SENSOR] = {"sensor", s_sensor_cols, NUM_COLS(s_sensor_cols), 81},
+    [PB3_STATE] = {"state", s_state_cols, NUM_COLS(s_state_cols), 214},
+    [PB3_GPS] = {"gps", s_gps_cols, NUM_COLS(s_gps_cols), 136},
+    [PB3_SENSOR_BLOCK] = {"sensor_block", s_sensor_cols,
+                          NUM_COLS(s_sensor_cols), SENSOR_BLOCK_MAX_LEN},
+};
+
+static const char* const s_fname_prefixes[PB3_NUM_KINDS] = {
+    [PB3_SENSOR] = "dat_",
+    [PB3_STATE] = "fsl_",
+    [PB3_GPS] = "gps_",
+    [PB3_SENSOR_BLOCK] = "sbk_",
+};
+
+// Returns bytes used, 0 if buf ends first, or -1 if longer than max_bytes
+static inline int read_varint(const uint8_t* buf, const uint8_t* end,
+                              int max_bytes, uint64_t* value) {
+    uint64_t result = 0;
+    for (int i = 0; i < max_bytes; i++) {
+        if (buf + i >= end) {
+            return 0;
+        }
+        result |= (uint64_t)(buf[i] & 0x7F) << (7 * i);
+        if (!(buf[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+const Pb3Schema* pb3_schema(Pb3Kind kind) {
+    if (kind >= PB3_NUM_KINDS) {
+        return NULL;
+    }
+    return &s_schemas[kind];
+}
+
+bool pb3_kind_from_name(const char* name, Pb3Kind* kind) {
+    for (int i = 0; i < PB3_NUM_KINDS; i++) {
+        if (strcmp(name, s_schemas[i].name) == 0) {
+            *kind = (Pb3Kind)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool pb3_kind_from_fname(const char* fname, Pb3Kind* kind) {
+    const char* base = fname;
+    for (const char* c = fname; *c; c++) {
+        if (*c == '/' || *c == '\\') {
+            base = c + 1;
+        }
+    }
+
+    for (int i = 0; i < PB3_NUM_KINDS; i++) {
+        const char* prefix = s_fname_prefixes[i];
+        if (strncmp(base, prefix, strlen(prefix)) == 0) {
+            *kind = (Pb3Kind)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t pb3_parse_header(const uint8_t* buf, size_t len, char* spec,
+                        size_t spec_len) {
+    for (size_t i = 0; i < len && i < PB3_MAX_HEADER_LEN; i++) {
+        if (buf[i] == '\n') {
+            if (i == 0) {
+                return 0;
+            }
+            if (spec_len > 0) {
+                size_t n = i < spec_len - 1 ? i : spec_len - 1;
+                memcpy(spec, buf, n);
+                spec[n] = '\0';
+            }
+            return i + 1;
+        }
+        if (buf[i] < 0x20 || buf[i] > 0x7E) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+Pb3RecordResult pb3_decode_record(const Pb3Schema* schema, const uint8_t* buf,
+                                  size_t len, Pb3Value* values,
+                                  size_t* consumed) {
+    const uint8_t* end = buf + len;
+
+    uint64_t msg_len = 0;
+    int n = read_varint(buf, end, 2, &msg_len);
+    if (n == 0) {
+        return PB3_RECORD_SHORT;
+    }
+    if (n < 0 || msg_len == 0 || msg_len > schema->max_len) {
+        return PB3_RECORD_BAD;
+    }
+    if (len - n < msg_len) {
+        return PB3_RECORD_SHORT;
+    }
+
+    const uint8_t* p = buf + n;
+    const uint8_t* msg_end = p + msg_len;
+    memset(values, 0, schema->num_cols * sizeof(Pb3Value));
+
+    uint64_t last_field = 0;
+    while (p < msg_end) {
+        uint64_t tag = 0;
+        n = read_varint(p, msg_end, 2, &tag);
+        if (n <= 0) {
+            return PB3_RECORD_BAD;
+        }
+        p += n;
+
+        // nanopb writes each field once, in field number order
+        uint64_t field = tag >> 3;
+        if (field <= last_field || field > schema->num_cols) {
+            return PB3_RECORD_BAD;
+        }
+        last_field = field;
+
+        Pb3Value* value = &values[field - 1];
+        switch (schema->cols[field - 1].type) {
+            case PB3_COL_F32:
+                if ((tag & 7) != WT_FIXED32 || msg_end - p < 4) {
+                    return PB3_RECORD_BAD;
+                }
+                memcpy(&value->f, p, 4);
+                p += 4;
+                break;
+            case PB3_COL_U32:
+                if ((tag & 7) != WT_VARINT) {
+                    return PB3_RECORD_BAD;
+                }
+                n = read_varint(p, msg_end, 5, &value->u);
+                if (n <= 0 || value->u > UINT32_MAX) {
+                    return PB3_RECORD_BAD;
+                }
+                p += n;
+                break;
+            case PB3_COL_U64:
+                if ((tag & 7) != WT_VARINT) {
+                    return PB3_RECORD_BAD;
+                }
+                n = read_varint(p, msg_end, 10, &value->u);
+                if (n <= 0) {
+                    return PB3_RECORD_BAD;
+                }
+                p += n;
+                break;
+        }
+    }
+
+    // Every logged frame is timestamped
+    if (values[0].u == 0) {
+        return PB3_RECORD_BAD;
+    }
+
+    *consumed = p - buf;
+    return PB3_RECORD_OK;
+}
+
+void pb3_decoder_init(Pb3Decoder* dec, Pb3Kind kind) {
+    dec->kind = kind;
+    dec->schema = pb3_schema(kind);
+    dec->in_sync = true;
+    dec->records = 0;
+    dec->resyncs = 0;
+    dec->skipped_bytes = 0;
+}
+
+// Check that a candidate record is followed by more valid records
+static Pb3RecordResult pb3_confirm_sync(const Pb3Schema* schema,
+                                        const uint8_t* buf, size_t len,
+                                        bool eof) {
+    Pb3Value values[PB3_MAX_FIELDS];
+    size_t pos = 0;
+    for (int i = 0; i < PB3_RESYNC_RECORDS; i++) {
+        size_t consumed;
+        Pb3RecordResult res =
+            pb3_decode_record(schema, buf + pos, len - pos, values, &consumed);
+        if (res == PB3_RECORD_SHORT) {
+            // Running into the end of the stream is as good as it gets
+            return eof ? PB3_RECORD_OK : PB3_RECORD_SHORT;
+        }
+        if (res == PB3_RECORD_BAD) {
+            return PB3_RECORD_BAD;
+        }
+        pos += consumed;
+    }
+    return PB3_RECORD_OK;
+}
+
+static void emit_sensor_frame(const SensorFrame* frame, Pb3RecordCallback cb,
+                              void* ctx) {
+    Pb3Value values[NUM_COLS(s_sensor_cols)];
+    const float* channels[SENSOR_BLOCK_NUM_CHANNELS] = {
+        &frame->temperature, &frame->pressure, &frame->acc_h_x,
+        &frame->acc_h_y,     &frame->acc_h_z,  &frame->acc_i_x,
+        &frame->acc_i_y,     &frame->acc_i_z,  &frame->rot_i_x,
+        &frame->rot_i_y,     &frame->rot_i_z,  &frame->mag_i_x,
+        &frame->mag_i_y,     &frame->mag_i_z,
+    };
+    values[0].u = frame->timestamp;
+    for (int i = 0; i < SENSOR_BLOCK_NUM_CHANNELS; i++) {
+        values[i + 1].f = *channels[i];
+    }
+    cb(values, ctx);
+}
+
+static size_t decode_sensor_blocks(Pb3Decoder* dec, const uint8_t* buf,
+                                   size_t len, bool eof, Pb3RecordCallback cb,
+                                   void* ctx) {
+    SensorFrame frames[SENSOR_BLOCK_MAX_FRAMES];
+
+    size_t pos = 0;
+    while (pos < len) {
+        uint32_t num_frames;
+        size_t consumed;
+        SensorBlockResult res = sensor_block_decode(
+            buf + pos, len - pos, frames, &num_frames, &consumed);
+
+        if (res == SENSOR_BLOCK_SHORT) {
+            if (!eof) {
+                break;
+            }
+            res = SENSOR_BLOCK_BAD;
+        }
+
+        if (res == SENSOR_BLOCK_OK) {
+            dec->in_sync = true;
+            dec->records += num_frames;
+            for (uint32_t i = 0; i < num_frames; i++) {
+                emit_sensor_frame(&frames[i], cb, ctx);
+            }
+            pos += consumed;
+        } else {
+            if (dec->in_sync) {
+                dec->in_sync = false;
+                dec->resyncs++;
+            }
+            dec->skipped_bytes++;
+            pos++;
+        }
+    }
+
+    return pos;
+}
+
+size_t pb3_decode_buffer(Pb3Decoder* dec, const uint8_t* buf, size_t len,
+                         bool eof, Pb3RecordCallback cb, void* ctx) {
+    if (dec->kind == PB3_SENSOR_BLOCK) {
+        return decode_sensor_blocks(dec, buf, len, eof, cb, ctx);
+    }
+
+    const Pb3Schema* schema = dec->schema;
+    Pb3Value values[PB3_MAX_FIELDS];
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t consumed;
+        Pb3RecordResult res =
+            pb3_decode_record(schema, buf + pos, len - pos, values, &consumed);
+
+        if (res == PB3_RECORD_OK && !dec->in_sync) {
+            res = pb3_confirm_sync(schema, buf + pos + consumed,
+                                   len - pos - consumed, eof);
+        }
+
+        if (res == PB3_RECORD_SHORT) {
+            if (!eof) {
+                break;
+            }
+            // A record cut off by the end of the file
+            res = PB3_RECORD_BAD;
+        }
+
+        if (res == PB3_RECORD_OK) {
+            dec->in_sync = true;
+            dec->records++;
+            cb(values, ctx);
+            pos += consumed;
+        } else {
+            if (dec->in_sync) {
+                dec->in_sync = false;
+                dec->resyncs++;
+            }
+            dec->skipped_bytes++;
+            pos++;
+        }
+    }
+
+    return pos;
+}
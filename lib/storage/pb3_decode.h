@@ -0,0 +1,141 @@
+#ifndef PB3_DECODE_H
+#define PB3_DECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest header line (firmware specifier + newline) that will be accepted
+#define PB3_MAX_HEADER_LEN 256
+
+// Number of valid records that must follow a candidate record before the
+// decoder trusts it again after hitting corrupted data
+#define PB3_RESYNC_RECORDS 2
+
+// Largest field number in any of the logged messages
+#define PB3_MAX_FIELDS 36
+
+// Smallest buffer pb3_decode_buffer can always make progress with (a record
+// plus the ones checked after it while resyncing, or a whole sensor block)
+#define PB3_MIN_BUFFER_LEN 4096
+
+typedef enum {
+    PB3_SENSOR,
+    PB3_STATE,
+    PB3_GPS,
+    PB3_SENSOR_BLOCK,  // SensorFrames packed by sensor_block_encode
+    PB3_NUM_KINDS,
+} Pb3Kind;
+
+typedef enum {
+    PB3_COL_U32,
+    PB3_COL_U64,
+    PB3_COL_F32,
+} Pb3ColType;
+
+typedef struct {
+    const char* name;
+    Pb3ColType type;
+} Pb3Column;
+
+// Column i holds field number i + 1 (the logged messages have no gaps)
+typedef struct {
+    const char* name;
+    const Pb3Column* cols;
+    size_t num_cols;
+    size_t max_len;  // Largest possible encoded message
+} Pb3Schema;
+
+typedef union {
+    uint64_t u;
+    float f;
+} Pb3Value;
+
+typedef enum {
+    PB3_RECORD_OK,
+    PB3_RECORD_SHORT,  // Need more bytes to decide
+    PB3_RECORD_BAD,    // Not a valid record at this offset
+} Pb3RecordResult;
+
+typedef void (*Pb3RecordCallback)(const Pb3Value* values, void* ctx);
+
+typedef struct {
+    Pb3Kind kind;
+    const Pb3Schema* schema;
+    bool in_sync;
+    uint64_t records;
+    uint64_t resyncs;        // Corrupted regions skipped over
+    uint64_t skipped_bytes;  // Total bytes discarded while resyncing
+} Pb3Decoder;
+
+/**
+ * @brief Get the column layout for a message type
+ */
+const Pb3Schema* pb3_schema(Pb3Kind kind);
+
+/**
+ * @brief Match "sensor", "state", "gps" or "sensor_block" to a message type
+ *
+ * @return false if the name is not recognized
+ */
+bool pb3_kind_from_name(const char* name, Pb3Kind* kind);
+
+/**
+ * @brief Guess the message type from a task_storage file name
+ *
+ * Recognizes the dat_, fsl_, gps_ and sbk_ prefixes (any directory is
+ * ignored)
+ *
+ * @return false if the name does not match any of the prefixes
+ */
+bool pb3_kind_from_fname(const char* fname, Pb3Kind* kind);
+
+/**
+ * @brief Parse the firmware specifier line at the start of a file
+ *
+ * The specifier is copied (without the newline) into spec, truncated to
+ * spec_len - 1 characters.
+ *
+ * @return Bytes taken by the header including the newline, or 0 if buf does
+ * not start with a printable line of at most PB3_MAX_HEADER_LEN bytes
+ */
+size_t pb3_parse_header(const uint8_t* buf, size_t len, char* spec,
+                        size_t spec_len);
+
+/**
+ * @brief Decode a single length-delimited record
+ *
+ * A record is only accepted if it has the layout nanopb produces for the
+ * schema: fields in increasing order with the expected wire types, and a
+ * non-zero timestamp. Missing fields are zero, as in proto3.
+ *
+ * @param values Output, schema->num_cols entries
+ * @param consumed Output, bytes taken by the record including its length
+ */
+Pb3RecordResult pb3_decode_record(const Pb3Schema* schema, const uint8_t* buf,
+                                  size_t len, Pb3Value* values,
+                                  size_t* consumed);
+
+/**
+ * @brief Start decoding a stream of records
+ */
+void pb3_decoder_init(Pb3Decoder* dec, Pb3Kind kind);
+
+/**
+ * @brief Decode as many records as possible from a buffer
+ *
+ * Corrupted bytes are skipped one at a time until a record is found that is
+ * followed by PB3_RESYNC_RECORDS more valid records. Sensor blocks carry a
+ * CRC, so any block that checks out is trusted straight away, and each of its
+ * frames is passed to cb as a row of the sensor schema.
+ *
+ * @param eof Whether buf runs to the end of the stream; if not, the caller
+ * should present the unconsumed bytes again with more data appended
+ * @param cb Called with each decoded record
+ *
+ * @return Number of bytes consumed from buf
+ */
+size_t pb3_decode_buffer(Pb3Decoder* dec, const uint8_t* buf, size_t len,
+                         bool eof, Pb3RecordCallback cb, void* ctx);
+
+#endif  // PB3_DECODE_H
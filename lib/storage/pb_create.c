@@ -1,20 +1,20 @@
 #include "pb_create.h"
 
+#include "frame_encode.h"
+
+_Static_assert(SENSOR_BUF_LEN >= FRAME_ENCODE_SENSOR_MAX_LEN,
+               "Sensor buffer too small");
+_Static_assert(STATE_BUF_LEN >= FRAME_ENCODE_STATE_MAX_LEN,
+               "State buffer too small");
+
 static pb_byte_t s_sensor_buffer[SENSOR_BUF_LEN];
 static pb_byte_t s_gps_buffer[GPS_BUF_LEN];
 static pb_byte_t s_state_buffer[STATE_BUF_LEN];
 
+// Sensor and state frames are written every control cycle, so they use the
+// generated encoders instead of walking the nanopb descriptors
 pb_byte_t* create_sensor_buffer(SensorFrame* frame, size_t* size) {
-    pb_ostream_t sensor_ostream =
-        pb_ostream_from_buffer(s_sensor_buffer, SENSOR_BUF_LEN);
-
-    bool encode_success = pb_encode_ex(&sensor_ostream, &SensorFrame_msg, frame,
-                                       PB_ENCODE_DELIMITED);
-    if (!encode_success) {
-        return NULL;
-    }
-
-    *size = sensor_ostream.bytes_written;
+    *size = frame_encode_sensor(frame, s_sensor_buffer);
 
     return s_sensor_buffer;
 }
@@ -35,16 +35,7 @@ pb_byte_t* create_gps_buffer(GpsFrame* frame, size_t* size) {
 }
 
 pb_byte_t* create_state_buffer(StateFrame* frame, size_t* size) {
-    pb_ostream_t state_ostream =
-        pb_ostream_from_buffer(s_state_buffer, STATE_BUF_LEN);
-
-    bool encode_success = pb_encode_ex(&state_ostream, &StateFrame_msg, frame,
-                                       PB_ENCODE_DELIMITED);
-    if (!encode_success) {
-        return NULL;
-    }
-
-    *size = state_ostream.bytes_written;
+    *size = frame_encode_state(frame, s_state_buffer);
 
     return s_state_buffer;
 }
\ No newline at end of file
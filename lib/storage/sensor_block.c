@@ -0,0 +1,266 @@
+#include "sensor_block.h"
+
+#include <math.h>
+#include <string.h>
+
+// Largest quantized magnitude, so that every delta fits in 32 bits
+#define MAX_QUANTIZED (1 << 30)
+
+static const size_t s_channel_offsets[SENSOR_BLOCK_NUM_CHANNELS] = {
+    offsetof(SensorFrame, temperature), offsetof(SensorFrame, pressure),
+    offsetof(SensorFrame, acc_h_x),     offsetof(SensorFrame, acc_h_y),
+    offsetof(SensorFrame, acc_h_z),     offsetof(SensorFrame, acc_i_x),
+    offsetof(SensorFrame, acc_i_y),     offsetof(SensorFrame, acc_i_z),
+    offsetof(SensorFrame, rot_i_x),     offsetof(SensorFrame, rot_i_y),
+    offsetof(SensorFrame, rot_i_z),     offsetof(SensorFrame, mag_i_x),
+    offsetof(SensorFrame, mag_i_y),     offsetof(SensorFrame, mag_i_z),
+};
+
+// Steps at or below half the LSB of each sensor
+static const int8_t s_default_exps[SENSOR_BLOCK_NUM_CHANNELS] = {
+    -7,  -7,        // MS5637: 0.01 deg C, 0.11 mbar at OSR 256
+    -10, -10, -10,  // KX134: 1.95 mg
+    -11, -11, -11,  // BMI088: 0.73 mg
+    -5,  -5,  -5,   // BMI088: 0.061 dps
+    -10, -10, -10,  // IIS2MDC: 1.5 mgauss
+};
+
+static inline float get_channel(const SensorFrame* frame, int channel) {
+    float value;
+    memcpy(&value, (const uint8_t*)frame + s_channel_offsets[channel], 4);
+    return value;
+}
+
+static inline void set_channel(SensorFrame* frame, int channel, float value) {
+    memcpy((uint8_t*)frame + s_channel_offsets[channel], &value, 4);
+}
+
+static inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline uint8_t* put_varint(uint8_t* p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+// Returns the byte after the varint, or NULL if it runs past end
+static inline const uint8_t* get_varint(const uint8_t* p, const uint8_t* end,
+                                        uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// CRC-16/CCITT-FALSE, a byte at a time without a table
+static uint16_t crc16_ccitt(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 8) | (crc << 8);
+        crc ^= data[i];
+        crc ^= (crc & 0xFF) >> 4;
+        crc ^= crc << 12;
+        crc ^= (crc & 0xFF) << 5;
+    }
+    return crc;
+}
+
+int8_t sensor_block_default_exp(int channel) {
+    return s_default_exps[channel];
+}
+
+// Coarsen the step if a value is too large to quantize, and fall back to raw
+// floats if there's anything that can't be quantized at all
+static int8_t choose_exp(const SensorBlockEncoder* enc, int channel) {
+    float max_abs = 0;
+    for (uint32_t i = 0; i < enc->num_frames; i++) {
+        float value = get_channel(&enc->frames[i], channel);
+        if (!isfinite(value)) {
+            return SENSOR_BLOCK_RAW;
+        }
+        max_abs = fmaxf(max_abs, fabsf(value));
+    }
+
+    int exp = s_default_exps[channel];
+    while (ldexpf(max_abs, -exp) >= MAX_QUANTIZED) {
+        exp++;
+    }
+    return exp;
+}
+
+void sensor_block_init(SensorBlockEncoder* enc) { enc->num_frames = 0; }
+
+bool sensor_block_add(SensorBlockEncoder* enc, const SensorFrame* frame) {
+    if (enc->num_frames < SENSOR_BLOCK_MAX_FRAMES) {
+        enc->frames[enc->num_frames++] = *frame;
+    }
+    return enc->num_frames == SENSOR_BLOCK_MAX_FRAMES;
+}
+
+// Note: raw floats are copied directly, so this assumes a little endian host
+size_t sensor_block_encode(SensorBlockEncoder* enc, uint8_t* buf) {
+    uint32_t num_frames = enc->num_frames;
+    if (num_frames == 0) {
+        return 0;
+    }
+    const SensorFrame* frames = enc->frames;
+
+    uint8_t* p = buf + 4;
+    *p++ = num_frames;
+    p = put_varint(p, frames[0].timestamp);
+
+    int8_t exps[SENSOR_BLOCK_NUM_CHANNELS];
+    for (int c = 0; c < SENSOR_BLOCK_NUM_CHANNELS; c++) {
+        exps[c] = choose_exp(enc, c);
+        *p++ = (uint8_t)exps[c];
+    }
+
+    // Frames come at a steady rate, so the deltas barely change
+    int64_t last_delta = 0;
+    for (uint32_t i = 1; i < num_frames; i++) {
+        int64_t delta = frames[i].timestamp - frames[i - 1].timestamp;
+        p = put_varint(p, zigzag(delta - last_delta));
+        last_delta = delta;
+    }
+
+    for (int c = 0; c < SENSOR_BLOCK_NUM_CHANNELS; c++) {
+        if (exps[c] == SENSOR_BLOCK_RAW) {
+            for (uint32_t i = 0; i < num_frames; i++) {
+                float value = get_channel(&frames[i], c);
+                memcpy(p, &value, 4);
+                p += 4;
+            }
+            continue;
+        }
+
+        int64_t last_q = 0;
+        for (uint32_t i = 0; i < num_frames; i++) {
+            int64_t q = lrintf(ldexpf(get_channel(&frames[i], c), -exps[c]));
+            p = put_varint(p, zigzag(q - last_q));
+            last_q = q;
+        }
+    }
+
+    size_t payload_len = p - (buf + 4);
+    buf[0] = SENSOR_BLOCK_MAGIC0;
+    buf[1] = SENSOR_BLOCK_MAGIC1;
+    buf[2] = payload_len & 0xFF;
+    buf[3] = payload_len >> 8;
+
+    uint16_t crc = crc16_ccitt(buf, p - buf);
+    *p++ = crc & 0xFF;
+    *p++ = crc >> 8;
+
+    enc->num_frames = 0;
+    return p - buf;
+}
+
+SensorBlockResult sensor_block_decode(const uint8_t* buf, size_t len,
+                                      SensorFrame* frames,
+                                      uint32_t* num_frames, size_t* consumed) {
+    // Check as much of the header as is there
+    const uint8_t magic[2] = {SENSOR_BLOCK_MAGIC0, SENSOR_BLOCK_MAGIC1};
+    for (size_t i = 0; i < 2; i++) {
+        if (i >= len) {
+            return SENSOR_BLOCK_SHORT;
+        }
+        if (buf[i] != magic[i]) {
+            return SENSOR_BLOCK_BAD;
+        }
+    }
+    if (len < 4) {
+        return SENSOR_BLOCK_SHORT;
+    }
+    size_t payload_len = buf[2] | (buf[3] << 8);
+    if (payload_len < SENSOR_BLOCK_HEADER_LEN - 4 - 9 ||
+        payload_len > SENSOR_BLOCK_MAX_LEN - 6) {
+        return SENSOR_BLOCK_BAD;
+    }
+    size_t total_len = 4 + payload_len + 2;
+    if (len < total_len) {
+        return SENSOR_BLOCK_SHORT;
+    }
+
+    const uint8_t* p = buf + 4;
+    const uint8_t* end = p + payload_len;
+    uint16_t crc = end[0] | (end[1] << 8);
+    if (crc16_ccitt(buf, end - buf) != crc) {
+        return SENSOR_BLOCK_BAD;
+    }
+
+    // From here on the block is intact, unless it was written wrongly
+    uint32_t n = *p++;
+    if (n == 0 || n > SENSOR_BLOCK_MAX_FRAMES) {
+        return SENSOR_BLOCK_BAD;
+    }
+    memset(frames, 0, n * sizeof(SensorFrame));
+
+    uint64_t value;
+    if ((p = get_varint(p, end, &value)) == NULL) {
+        return SENSOR_BLOCK_BAD;
+    }
+    frames[0].timestamp = value;
+
+    int8_t exps[SENSOR_BLOCK_NUM_CHANNELS];
+    if (end - p < SENSOR_BLOCK_NUM_CHANNELS) {
+        return SENSOR_BLOCK_BAD;
+    }
+    memcpy(exps, p, SENSOR_BLOCK_NUM_CHANNELS);
+    p += SENSOR_BLOCK_NUM_CHANNELS;
+
+    int64_t delta = 0;
+    for (uint32_t i = 1; i < n; i++) {
+        if ((p = get_varint(p, end, &value)) == NULL) {
+            return SENSOR_BLOCK_BAD;
+        }
+        delta += unzigzag(value);
+        frames[i].timestamp = frames[i - 1].timestamp + delta;
+    }
+
+    for (int c = 0; c < SENSOR_BLOCK_NUM_CHANNELS; c++) {
+        if (exps[c] == SENSOR_BLOCK_RAW) {
+            if ((size_t)(end - p) < 4 * n) {
+                return SENSOR_BLOCK_BAD;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                float f;
+                memcpy(&f, p, 4);
+                set_channel(&frames[i], c, f);
+                p += 4;
+            }
+            continue;
+        }
+
+        int64_t q = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if ((p = get_varint(p, end, &value)) == NULL) {
+                return SENSOR_BLOCK_BAD;
+            }
+            q += unzigzag(value);
+            set_channel(&frames[i], c, (float)ldexp((double)q, exps[c]));
+        }
+    }
+
+    if (p != end) {
+        return SENSOR_BLOCK_BAD;
+    }
+
+    *num_frames = n;
+    *consumed = total_len;
+    return SENSOR_BLOCK_OK;
+}
@@ -0,0 +1,86 @@
+#ifndef SENSOR_BLOCK_H
+#define SENSOR_BLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sensor.pb.h"
+
+// Compact record holding several consecutive SensorFrames. Each channel is
+// quantized to a power of two step finer than the sensor's own resolution, and
+// stored as zigzag varint deltas from the previous frame.
+//
+// Layout (little endian):
+//   u8 magic[2]   0xB1 0x0C
+//   u16 len       bytes from num_frames up to the CRC
+//   u8 num_frames
+//   varint        timestamp of the first frame
+//   i8 exp[14]    per channel, values are q * 2^exp (SENSOR_BLOCK_RAW: the
+//                 channel is stored as raw floats, e.g. if it has a NaN)
+//   zigzag        num_frames - 1 timestamp deltas, each relative to the
+//                 previous delta (the first one to 0)
+//   per channel   zigzag q of the first frame, then num_frames - 1 zigzag
+//                 deltas, or num_frames floats if raw
+//   u16 crc       CRC-16/CCITT of everything from the magic on
+
+#define SENSOR_BLOCK_MAX_FRAMES 32
+#define SENSOR_BLOCK_NUM_CHANNELS 14
+
+#define SENSOR_BLOCK_MAGIC0 0xB1
+#define SENSOR_BLOCK_MAGIC1 0x0C
+
+// Exponent marking a channel stored as raw floats
+#define SENSOR_BLOCK_RAW INT8_MIN
+
+// Largest encoded block: header, 10 bytes per timestamp, 5 per quantized value
+#define SENSOR_BLOCK_HEADER_LEN (4 + 1 + 10 + SENSOR_BLOCK_NUM_CHANNELS)
+#define SENSOR_BLOCK_MAX_LEN                                      \
+    (SENSOR_BLOCK_HEADER_LEN + 10 * SENSOR_BLOCK_MAX_FRAMES +     \
+     5 * SENSOR_BLOCK_NUM_CHANNELS * SENSOR_BLOCK_MAX_FRAMES + 2)
+
+typedef struct {
+    SensorFrame frames[SENSOR_BLOCK_MAX_FRAMES];
+    uint32_t num_frames;
+} SensorBlockEncoder;
+
+typedef enum {
+    SENSOR_BLOCK_OK,
+    SENSOR_BLOCK_SHORT,  // Need more bytes to decide
+    SENSOR_BLOCK_BAD,    // Not a valid block at this offset
+} SensorBlockResult;
+
+/**
+ * @brief Quantization step of a channel when it is in range, e.g. 2^-11 g
+ * for the IMU accelerometer (0.73 mg LSB)
+ */
+int8_t sensor_block_default_exp(int channel);
+
+void sensor_block_init(SensorBlockEncoder* enc);
+
+/**
+ * @brief Add a frame to the current block
+ *
+ * @return Whether the block is now full and should be encoded
+ */
+bool sensor_block_add(SensorBlockEncoder* enc, const SensorFrame* frame);
+
+/**
+ * @brief Encode the frames added so far, and start a new block
+ *
+ * @param buf At least SENSOR_BLOCK_MAX_LEN bytes
+ * @return Bytes written, 0 if there were no frames
+ */
+size_t sensor_block_encode(SensorBlockEncoder* enc, uint8_t* buf);
+
+/**
+ * @brief Decode a block
+ *
+ * @param frames Output, up to SENSOR_BLOCK_MAX_FRAMES frames
+ * @param consumed Output, bytes taken by the block
+ */
+SensorBlockResult sensor_block_decode(const uint8_t* buf, size_t len,
+                                      SensorFrame* frames,
+                                      uint32_t* num_frames, size_t* consumed);
+
+#endif  // SENSOR_BLOCK_H
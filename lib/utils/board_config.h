@@ -9,6 +9,56 @@
 #define CONFIG_DIR "/config"
 #define CONFIG_FILENAME "board.conf"
 
+// Bump when the meaning of the estimator block changes, so a block from older
+// firmware is replaced by the defaults rather than misread
+#define ESTIMATOR_CONFIG_VERSION 1
+#define ESTIMATOR_NUM_STATES 7    // NUM_TOT_STATES in kalman.h
+#define ESTIMATOR_NUM_KIN_MEAS 3  // NUM_KIN_MEAS in kalman.h
+
+// Default EKF process noise variances per state (h, v, a, quaternion) and
+// measurement variances (pressure, acc_h, acc_i), in boost and coast (_1) and
+// under a parachute (_2). These are the values from python testing.
+#define ESTIMATOR_DEFAULT_Q_VARS_1 \
+    {5, 5.0e-01, 5.0e+01, 1.0e-01, 1.0e-01, 1.0e-01, 1.0e-01}
+#define ESTIMATOR_DEFAULT_Q_VARS_2 {10., .5, .5, 0.1, 0.1, 0.1, 0.1}
+#define ESTIMATOR_DEFAULT_R_DIAG_1 {40.0e-01, 6.e-04, 6.e-04}
+#define ESTIMATOR_DEFAULT_R_DIAG_2 {4, 1., 1.}
+#define ESTIMATOR_DEFAULT_PRESSURE_GATE_STDEVS (60)
+
+#define ESTIMATOR_CONFIG_DEFAULT                    \
+    {                                               \
+        .version = ESTIMATOR_CONFIG_VERSION,        \
+        .q_vars_1 = ESTIMATOR_DEFAULT_Q_VARS_1,     \
+        .q_vars_2 = ESTIMATOR_DEFAULT_Q_VARS_2,     \
+        .r_diag_1 = ESTIMATOR_DEFAULT_R_DIAG_1,     \
+        .r_diag_2 = ESTIMATOR_DEFAULT_R_DIAG_2,     \
+        .pressure_gate_stdevs =                     \
+            ESTIMATOR_DEFAULT_PRESSURE_GATE_STDEVS, \
+        .baro_alt_median_window = 25,               \
+        .baro_alt_sma_window = 50,                  \
+        .baro_diff_window = 5,                      \
+        .baro_vel_sma_window = 25,                  \
+    }
+
+typedef struct {
+    // ESTIMATOR_CONFIG_VERSION the block was written with
+    uint32_t version;
+    // EKF process noise variances in boost and coast, and under a parachute
+    float q_vars_1[ESTIMATOR_NUM_STATES];
+    float q_vars_2[ESTIMATOR_NUM_STATES];
+    // EKF measurement variances in boost and coast, and under a parachute
+    float r_diag_1[ESTIMATOR_NUM_KIN_MEAS];
+    float r_diag_2[ESTIMATOR_NUM_KIN_MEAS];
+    // standard deviations from the EKF altitude past which pressure is gated
+    float pressure_gate_stdevs;
+    // samples in the baro median filter, altitude SMA, velocity difference and
+    // velocity SMA
+    uint32_t baro_alt_median_window;
+    uint32_t baro_alt_sma_window;
+    uint32_t baro_diff_window;
+    uint32_t baro_vel_sma_window;
+} EstimatorConfig;
+
 typedef struct {
     // period in ms between state estimation update steps
     uint32_t control_loop_period_ms;
@@ -16,6 +66,16 @@ typedef struct {
     uint32_t sensor_loop_period_ms;
     // period in ms between file system flushes and pause request checks
     uint32_t storage_loop_period_ms;
+    // whether sensor frames are logged as compressed blocks (sbk_ files)
+    uint32_t storage_sensor_blocks;
+    // space in MB allocated to each log file when it is created
+    uint32_t storage_prealloc_mb;
+    // data in KB written to a log file before it is synced (0 for only at
+    // launch, apogee, landing and when idle)
+    uint32_t storage_sync_kb;
+    // age in ms of unsynced data after which a log file is synced, whenever
+    // the storage queues are empty (0 for never)
+    uint32_t storage_idle_sync_ms;
     // period in ms between polling the GPS
     uint32_t gps_loop_period_ms;
     // period in ms between checking for incoming telemetry messages
@@ -67,6 +127,8 @@ typedef struct {
     float stage_min_sep_angle_deg;
     // maximum angle from vertical in deg to separate stages
     float stage_max_sep_angle_deg;
+    // maximum tilt rate in deg/s to separate stages
+    float stage_max_sep_tilt_rate_dps;
     // stage separation pyro channel
     uint32_t stage_sep_pyro_channel;
 
@@ -88,6 +150,8 @@ typedef struct {
     float stage_min_ignite_angle_deg;
     // maximum angle from vertical in deg to IGNITE stage
     float stage_max_ignite_angle_deg;
+    // maximum tilt rate in deg/s to IGNITE stage
+    float stage_max_ignite_tilt_rate_dps;
     // stage separation pyro channel
     uint32_t stage_ignite_pyro_channel;
 
@@ -102,6 +166,12 @@ typedef struct {
     /* TELEMETRY SETTINGS */
     // Radio frequency in Hz at which telemetry is sent and received
     uint32_t telemetry_frequency_hz;
+    // Percentage of time the radio may spend transmitting telemetry
+    float telemetry_duty_cycle_pct;
+
+    /* ESTIMATOR SETTINGS */
+    // noise, gating and filter windows, checked by se_check_config()
+    EstimatorConfig estimator;
 
     // CRC-32 checksum of the config
     uint32_t checksum;
@@ -9,10 +9,8 @@ static Status list_find_median(MedianFilter* filter);
 static Status list_delete(MedianFilter* filter);
 
 Status median_filter_init(MedianFilter* filter, size_t capacity) {
-    // Try to allocate space for the filter
-    filter->data = malloc(capacity * sizeof(MedianFilterNode));
-    if (filter->data == NULL) {
-        return STATUS_MEMORY_ERROR;
+    if (capacity == 0 || capacity > MEDIAN_FILTER_MAX_CAPACITY) {
+        return STATUS_PARAMETER_ERROR;
     }
     filter->capacity = capacity;
 
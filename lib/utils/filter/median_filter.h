@@ -5,6 +5,9 @@
 
 #include "status.h"
 
+// Largest capacity, so filters can be statically allocated
+#define MEDIAN_FILTER_MAX_CAPACITY 64
+
 typedef struct MedianFilterNode {
     struct MedianFilterNode* next;
     struct MedianFilterNode* prev;
@@ -12,7 +15,9 @@ typedef struct MedianFilterNode {
 } MedianFilterNode;
 
 typedef struct {
-    MedianFilterNode* data;    // Array for storing samples
+    // Array for storing samples
+    MedianFilterNode data[MEDIAN_FILTER_MAX_CAPACITY];
+
     size_t capacity;           // Number of slots in the buffer
     size_t size;               // Number of samples in the buffer
     size_t tail;               // Index of the oldest sample in the buffer
@@ -3,10 +3,8 @@
 #include <math.h>
 
 Status sma_filter_init(SmaFilter* filter, size_t capacity) {
-    // Try to allocate space for the filter
-    filter->data = malloc(capacity * sizeof(float));
-    if (filter->data == NULL) {
-        return STATUS_MEMORY_ERROR;
+    if (capacity == 0 || capacity > SMA_FILTER_MAX_CAPACITY) {
+        return STATUS_PARAMETER_ERROR;
     }
     filter->capacity = capacity;
 
@@ -21,34 +19,54 @@ Status sma_filter_reset(SmaFilter* filter) {
     filter->tail = 0;
     filter->head = 0;
     filter->sum = 0;
+    filter->sum_comp = 0;
 
     return STATUS_OK;
 }
 
+// Kahan summation: sum_comp carries the low bits each addition loses
+static void sum_add(SmaFilter* filter, float value) {
+    float y = value - filter->sum_comp;
+    float t = filter->sum + y;
+    filter->sum_comp = (t - filter->sum) - y;
+    filter->sum = t;
+}
+
+static void sum_recompute(SmaFilter* filter) {
+    filter->sum = 0;
+    filter->sum_comp = 0;
+    size_t idx = filter->tail;
+    for (size_t i = 0; i < filter->size; i++) {
+        sum_add(filter, filter->data[idx++]);
+        idx = (idx < filter->capacity) ? idx : 0;
+    }
+}
+
+static void remove_oldest(SmaFilter* filter) {
+    sum_add(filter, -filter->data[filter->tail++]);
+    filter->tail = (filter->tail < filter->capacity) ? filter->tail : 0;
+    filter->size -= 1;
+}
+
 Status sma_filter_insert(SmaFilter* filter, float sample) {
-    // If we're at capacity, remove the sample at the tail
-    if (filter->size == filter->capacity) {
-        filter->sum -= filter->data[filter->tail++];
-        filter->size -= 1;
+    // If we're at capacity, or the sample is missing, remove the oldest
+    if (filter->size == filter->capacity || (isnan(sample) && filter->size)) {
+        remove_oldest(filter);
     }
 
-    if (!isnan(sample)) {
-        // Add the new sample to the filter if it's not NAN
-        filter->data[filter->head++] = sample;
-        filter->sum += sample;
-        filter->size += 1;
-    } else {
-        // If it is actually NAN, then remove a sample if we didn't already
-        // remove one due to reaching capacity (and if it's not empty)
-        if (0 < filter->size && filter->size < filter->capacity - 1) {
-            filter->sum -= filter->data[filter->tail++];
-            filter->size -= 1;
-        }
+    if (isnan(sample)) {
+        return STATUS_OK;
     }
 
-    // Fix indices if they overflowed
-    filter->head = (filter->head < filter->capacity) ? filter->head : 0;
-    filter->tail = (filter->tail < filter->capacity) ? filter->tail : 0;
+    filter->data[filter->head++] = sample;
+    sum_add(filter, sample);
+    filter->size += 1;
+
+    // Start each lap with an exact sum, which is cheap spread over the lap
+    if (filter->head == filter->capacity) {
+        filter->head = 0;
+        sum_recompute(filter);
+    }
 
     return STATUS_OK;
 }
@@ -5,19 +5,32 @@
 
 #include "status.h"
 
+// Largest capacity, so filters can be statically allocated
+#define SMA_FILTER_MAX_CAPACITY 64
+
 typedef struct {
-    float* data;      // Array for storing samples
+    // Array for storing samples
+    float data[SMA_FILTER_MAX_CAPACITY];
+
     size_t capacity;  // Number of slots in the filter
     size_t size;      // Number of samples in the filter
     size_t tail;      // Index of the oldest sample in the filter
     size_t head;      // Index at which the newest sample is to be inserted
     float sum;        // Sum of the samples in the filter
+    float sum_comp;   // Rounding error of sum, for Kahan summation
 } SmaFilter;
 
 Status sma_filter_init(SmaFilter* filter, size_t capacity);
 
 Status sma_filter_reset(SmaFilter* filter);
 
+/**
+ * @brief Add a sample, dropping the oldest if the filter is full
+ *
+ * A NAN sample isn't added, but still drops the oldest sample. The running
+ * sum is compensated, and recomputed from the samples once per lap of the
+ * buffer, so it doesn't drift however long the filter runs.
+ */
 Status sma_filter_insert(SmaFilter* filter, float sample);
 
 float sma_filter_get_mean(SmaFilter* filter);
@@ -0,0 +1,74 @@
+#include "smooth_diff.h"
+
+#include <math.h>
+
+Status smooth_diff_init(SmoothDiff* filter, const SmoothDiffConfig* config) {
+    Status status = median_filter_init(&filter->median, config->median_len);
+    if (status == STATUS_OK) {
+        status = sma_filter_init(&filter->sma, config->sma_len);
+    }
+    if (status == STATUS_OK) {
+        status = sample_window_init(&filter->value_window, config->diff_len);
+    }
+    if (status == STATUS_OK) {
+        status = sample_window_init(&filter->time_window, config->diff_len);
+    }
+    if (status == STATUS_OK) {
+        status = sma_filter_init(&filter->rate_sma, config->rate_sma_len);
+    }
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    filter->value = NAN;
+    filter->rate = NAN;
+    return STATUS_OK;
+}
+
+Status smooth_diff_reset(SmoothDiff* filter) {
+    median_filter_reset(&filter->median);
+    sma_filter_reset(&filter->sma);
+    sample_window_reset(&filter->value_window);
+    sample_window_reset(&filter->time_window);
+    sma_filter_reset(&filter->rate_sma);
+    filter->value = NAN;
+    filter->rate = NAN;
+    return STATUS_OK;
+}
+
+Status smooth_diff_update(SmoothDiff* filter, float t_s, float sample) {
+    // Median filter on the first stage for outlier rejection
+    Status status = median_filter_insert(&filter->median, sample);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    float median = median_filter_get_median(&filter->median);
+
+    // SMA filter on the second stage for smoothing
+    sma_filter_insert(&filter->sma, median);
+    filter->value = sma_filter_get_mean(&filter->sma);
+
+    // Difference across the window; the times are dropped along with the
+    // values, so the two stay paired
+    float t = isnan(filter->value) ? NAN : t_s;
+    sample_window_insert(&filter->value_window, filter->value);
+    sample_window_insert(&filter->time_window, t);
+    float old_value = sample_window_get(&filter->value_window, 0);
+    float old_t = sample_window_get(&filter->time_window, 0);
+    float rate = (filter->value - old_value) / (t - old_t);
+
+    // SMA filter on the rate calculated above
+    sma_filter_insert(&filter->rate_sma, rate);
+    filter->rate = sma_filter_get_mean(&filter->rate_sma);
+
+    return STATUS_OK;
+}
+
+float smooth_diff_fill(const SmoothDiff* filter) {
+    float median_fill =
+        (float)filter->median.size / (float)filter->median.capacity;
+    float sma_fill = (float)filter->sma.size / (float)filter->sma.capacity;
+    float rate_fill =
+        (float)filter->rate_sma.size / (float)filter->rate_sma.capacity;
+    return median_fill * sma_fill * rate_fill;
+}
@@ -0,0 +1,56 @@
+#ifndef SMOOTH_DIFF_H
+#define SMOOTH_DIFF_H
+
+#include <stdlib.h>
+
+#include "filter/median_filter.h"
+#include "filter/sma_filter.h"
+#include "sample_window.h"
+#include "status.h"
+
+// Window lengths of each stage, in samples
+typedef struct {
+    size_t median_len;    // Outlier rejection
+    size_t sma_len;       // Smoothing of the value
+    size_t diff_len;      // Samples the derivative is taken across
+    size_t rate_sma_len;  // Smoothing of the derivative
+} SmoothDiffConfig;
+
+/**
+ * @brief A signal and its rate of change, from noisy samples: a median filter
+ * then an SMA for the value, and a finite difference across a window of the
+ * smoothed values then another SMA for the rate
+ *
+ * Everything is statically sized, so it can be declared as a static.
+ */
+typedef struct {
+    MedianFilter median;
+    SmaFilter sma;
+    SampleWindow value_window;
+    SampleWindow time_window;
+    SmaFilter rate_sma;
+
+    float value;  // NAN until there's a sample
+    float rate;   // NAN until there are two
+} SmoothDiff;
+
+Status smooth_diff_init(SmoothDiff* filter, const SmoothDiffConfig* config);
+
+Status smooth_diff_reset(SmoothDiff* filter);
+
+/**
+ * @brief Run a sample through every stage
+ *
+ * A NAN sample drops the oldest sample from each stage instead, so the
+ * outputs go to NAN if samples stop coming.
+ *
+ * @param t_s Time of the sample
+ */
+Status smooth_diff_update(SmoothDiff* filter, float t_s, float sample);
+
+/**
+ * @brief How full the filters are, from 0 (empty) to 1 (all full)
+ */
+float smooth_diff_fill(const SmoothDiff* filter);
+
+#endif  // SMOOTH_DIFF_H
@@ -155,7 +155,7 @@ Status get_hwil_sensor_frame(SensorFrame* sensor_frame) {
     return STATUS_OK;
 }
 
-Status get_hwil_gps_fix(GPS_Fix_TypeDef* gps_fix) {
+Status get_hwil_gps_frame(GpsFrame* gps_frame) {
     // Catch up the HWIL data stream to real time
     while ((HWIL_GPS_DATA[s_hwil_gps_data_idx].timestamp < MICROS()) &&
            (s_hwil_gps_data_idx < HWIL_GPS_DATA_SIZE)) {
@@ -168,7 +168,18 @@ Status get_hwil_gps_fix(GPS_Fix_TypeDef* gps_fix) {
     }
 
     // Otherwise use the entry at the current index
-    *gps_fix = pb_frame_to_gps_fix(&HWIL_GPS_DATA[s_hwil_gps_data_idx]);
+    *gps_frame = HWIL_GPS_DATA[s_hwil_gps_data_idx];
+
+    return STATUS_OK;
+}
+
+Status get_hwil_gps_fix(GPS_Fix_TypeDef* gps_fix) {
+    GpsFrame gps_frame;
+    if (get_hwil_gps_frame(&gps_frame) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    *gps_fix = pb_frame_to_gps_fix(&gps_frame);
 
     return STATUS_OK;
 }
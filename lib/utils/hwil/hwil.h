@@ -13,6 +13,7 @@ extern const size_t HWIL_GPS_DATA_SIZE;
 extern const GpsFrame HWIL_GPS_DATA[];
 
 Status get_hwil_sensor_frame(SensorFrame* sensor_frame);
+Status get_hwil_gps_frame(GpsFrame* gps_frame);
 Status get_hwil_gps_fix(GPS_Fix_TypeDef* gps_fix);
 
 #endif  // HWIL_H
@@ -0,0 +1,154 @@
+#include "queue_stats.h"
+
+#include <stdio.h>
+
+static const char* s_level_names[QUEUE_STATS_NUM_LEVELS] = {
+    "0", "1/4", "1/2", "3/4", "<1", "1",
+};
+
+static QueueStats* s_queues[QUEUE_STATS_MAX_QUEUES];
+static size_t s_num_queues = 0;
+
+static void queue_stats_register(QueueStats* stats) {
+    for (size_t i = 0; i < s_num_queues; i++) {
+        if (s_queues[i] == stats) {
+            return;
+        }
+    }
+    if (s_num_queues < QUEUE_STATS_MAX_QUEUES) {
+        s_queues[s_num_queues++] = stats;
+    }
+}
+
+void queue_stats_init(QueueStats* stats, const char* name, uint32_t length,
+                      uint32_t* stamps_us, uint64_t now_us) {
+    *stats = (QueueStats){
+        .name = name,
+        .length = length,
+        .stamps_us = stamps_us,
+        .level_start_us = now_us,
+    };
+    queue_stats_register(stats);
+}
+
+uint32_t queue_stats_level(uint32_t depth, uint32_t length) {
+    if (depth == 0) {
+        return 0;
+    }
+    if (depth >= length) {
+        return QUEUE_STATS_NUM_LEVELS - 1;
+    }
+    // Quarters, rounded up
+    return (4 * depth + length - 1) / length;
+}
+
+uint32_t queue_stats_depth(const QueueStats* stats) {
+    int32_t depth = stats->sends - stats->receives - stats->discards;
+    if (depth < 0) {
+        return 0;
+    }
+    return (uint32_t)depth > stats->length ? stats->length : depth;
+}
+
+static void update_level(QueueStats* stats, uint64_t now_us) {
+    uint32_t depth = queue_stats_depth(stats);
+    if (depth > stats->high_water) {
+        stats->high_water = depth;
+    }
+
+    uint32_t level = queue_stats_level(depth, stats->length);
+    if (level != stats->level) {
+        stats->level_us[stats->level] += now_us - stats->level_start_us;
+        stats->level = level;
+        stats->level_start_us = now_us;
+    }
+}
+
+// Index of the send time of the oldest item in the queue
+static inline uint32_t oldest(const QueueStats* stats) {
+    return (stats->receives + stats->discards) % stats->length;
+}
+
+uint32_t queue_stats_oldest_age_us(const QueueStats* stats, uint64_t now_us) {
+    if (queue_stats_depth(stats) == 0) {
+        return 0;
+    }
+    return (uint32_t)now_us - stats->stamps_us[oldest(stats)];
+}
+
+void queue_stats_sent(QueueStats* stats, uint64_t now_us) {
+    stats->stamps_us[stats->sends % stats->length] = now_us;
+    stats->sends++;
+    update_level(stats, now_us);
+}
+
+void queue_stats_dropped(QueueStats* stats) { stats->drops++; }
+
+void queue_stats_overwritten(QueueStats* stats, uint64_t now_us) {
+    stats->discards++;
+    queue_stats_sent(stats, now_us);
+}
+
+void queue_stats_received(QueueStats* stats, uint64_t now_us) {
+    // The send time isn't known yet if the send isn't accounted for
+    uint32_t wait_us = queue_stats_oldest_age_us(stats, now_us);
+    if (wait_us > stats->max_wait_us) {
+        stats->max_wait_us = wait_us;
+    }
+    stats->receives++;
+    update_level(stats, now_us);
+}
+
+uint32_t queue_stats_new_drops(QueueStats* stats) {
+    uint32_t new_drops = stats->drops - stats->reported_drops;
+    stats->reported_drops = stats->drops;
+    return new_drops;
+}
+
+size_t queue_stats_format(const QueueStats* stats, uint64_t now_us, char* buf,
+                          size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+
+    int n = snprintf(
+        buf, len,
+        "%s: depth %lu/%lu (max %lu), oldest %lu us (max %lu us), %lu sent, "
+        "%lu dropped, %lu overwritten, time at fill",
+        stats->name, (unsigned long)queue_stats_depth(stats),
+        (unsigned long)stats->length, (unsigned long)stats->high_water,
+        (unsigned long)queue_stats_oldest_age_us(stats, now_us),
+        (unsigned long)stats->max_wait_us, (unsigned long)stats->sends,
+        (unsigned long)stats->drops, (unsigned long)stats->discards);
+    size_t pos = n < 0 ? 0 : n;
+
+    // Including the time at the current level so far
+    uint64_t level_us[QUEUE_STATS_NUM_LEVELS];
+    uint64_t total_us = 0;
+    for (int i = 0; i < QUEUE_STATS_NUM_LEVELS; i++) {
+        level_us[i] = stats->level_us[i];
+        if ((uint32_t)i == stats->level) {
+            level_us[i] += now_us - stats->level_start_us;
+        }
+        total_us += level_us[i];
+    }
+
+    for (int i = 0; i < QUEUE_STATS_NUM_LEVELS && pos < len; i++) {
+        if (level_us[i] == 0) {
+            continue;
+        }
+        n = snprintf(buf + pos, len - pos, " %s:%lu%%", s_level_names[i],
+                     (unsigned long)(100 * level_us[i] / total_us));
+        pos += n < 0 ? 0 : n;
+    }
+    if (pos < len) {
+        n = snprintf(buf + pos, len - pos, "\n");
+        pos += n < 0 ? 0 : n;
+    }
+
+    return pos < len ? pos : len - 1;
+}
+
+QueueStats* queue_stats_get(size_t index) {
+    return index < s_num_queues ? s_queues[index] : NULL;
+}
@@ -0,0 +1,103 @@
+#ifndef QUEUE_STATS_H
+#define QUEUE_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Time at depth is kept for these fill levels: empty, up to a quarter full,
+// up to half, up to three quarters, not quite full, and full
+#define QUEUE_STATS_NUM_LEVELS 6
+
+// Most queues that can be registered for queue_stats_get
+#define QUEUE_STATS_MAX_QUEUES 16
+
+// Enough for any queue_stats_format output
+#define QUEUE_STATS_FORMAT_LEN 256
+
+// Occupancy of one queue, built up from calls made after each send and
+// receive. Items are counted rather than the depth tracked, so a receive that
+// is accounted for before the send it follows only skews things briefly.
+typedef struct {
+    const char* name;
+    uint32_t length;
+    uint32_t* stamps_us;  // When each item was sent, indexed by count
+
+    uint32_t sends;
+    uint32_t receives;
+    uint32_t drops;     // Sends that failed because the queue was full
+    uint32_t discards;  // Items overwritten before they were received
+    uint32_t high_water;
+    uint32_t max_wait_us;  // Longest any received item spent in the queue
+
+    uint32_t level;
+    uint64_t level_start_us;
+    uint64_t level_us[QUEUE_STATS_NUM_LEVELS];
+
+    uint32_t reported_drops;  // For queue_stats_new_drops
+} QueueStats;
+
+/**
+ * @brief Set up a queue's statistics, and register it
+ *
+ * @param stamps_us Room for length send times
+ */
+void queue_stats_init(QueueStats* stats, const char* name, uint32_t length,
+                      uint32_t* stamps_us, uint64_t now_us);
+
+/**
+ * @brief Account for an item sent to the queue
+ */
+void queue_stats_sent(QueueStats* stats, uint64_t now_us);
+
+/**
+ * @brief Account for a send that failed because the queue was full
+ */
+void queue_stats_dropped(QueueStats* stats);
+
+/**
+ * @brief Account for an item written over the oldest one in a full queue,
+ * e.g. with xQueueOverwrite
+ */
+void queue_stats_overwritten(QueueStats* stats, uint64_t now_us);
+
+/**
+ * @brief Account for an item received from the queue
+ */
+void queue_stats_received(QueueStats* stats, uint64_t now_us);
+
+uint32_t queue_stats_depth(const QueueStats* stats);
+
+/**
+ * @brief Time the oldest item still in the queue has been waiting, 0 if the
+ * queue is empty
+ */
+uint32_t queue_stats_oldest_age_us(const QueueStats* stats, uint64_t now_us);
+
+/**
+ * @brief Fill level of a depth, see QUEUE_STATS_NUM_LEVELS
+ */
+uint32_t queue_stats_level(uint32_t depth, uint32_t length);
+
+/**
+ * @brief Sends dropped since the last call. Overwrites aren't included, as
+ * that's how single item queues that only hold the latest value are used.
+ */
+uint32_t queue_stats_new_drops(QueueStats* stats);
+
+/**
+ * @brief Write a one line summary of the statistics
+ *
+ * @return Characters written, not counting the terminating null
+ */
+size_t queue_stats_format(const QueueStats* stats, uint64_t now_us, char* buf,
+                          size_t len);
+
+/**
+ * @brief Registered queues, in the order they were set up
+ *
+ * @return NULL once index is past the last one
+ */
+QueueStats* queue_stats_get(size_t index);
+
+#endif  // QUEUE_STATS_H
@@ -3,10 +3,8 @@
 #include <math.h>
 
 Status sample_window_init(SampleWindow* window, size_t capacity) {
-    // Try to allocate space for the window
-    window->data = malloc(capacity * sizeof(float));
-    if (window->data == NULL) {
-        return STATUS_MEMORY_ERROR;
+    if (capacity == 0 || capacity > SAMPLE_WINDOW_MAX_CAPACITY) {
+        return STATUS_PARAMETER_ERROR;
     }
     window->capacity = capacity;
 
@@ -25,21 +23,15 @@ Status sample_window_reset(SampleWindow* window) {
 }
 
 Status sample_window_insert(SampleWindow* window, float sample) {
-    // If we're at capacity, remove the sample at the tail
-    if (window->size == window->capacity) {
+    // If we're at capacity, or the sample is missing, remove the oldest
+    if (window->size == window->capacity || (isnan(sample) && window->size)) {
+        window->tail++;
         window->size -= 1;
     }
 
     if (!isnan(sample)) {
-        // Add the new sample to the window if it's not NAN
         window->data[window->head++] = sample;
         window->size += 1;
-    } else {
-        // If it is actually NAN, then remove a sample if we didn't already
-        // remove one due to reaching capacity (and if it's not empty)
-        if (0 < window->size && window->size < window->capacity - 1) {
-            window->size -= 1;
-        }
     }
 
     // Fix indices if they overflowed
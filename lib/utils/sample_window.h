@@ -5,21 +5,33 @@
 
 #include "status.h"
 
+// Largest capacity, so windows can be statically allocated
+#define SAMPLE_WINDOW_MAX_CAPACITY 64
+
 typedef struct {
-    float* data;      // Array for storing samples
+    // Array for storing samples
+    float data[SAMPLE_WINDOW_MAX_CAPACITY];
+
     size_t capacity;  // Number of slots in the window
     size_t size;      // Number of samples in the window
     size_t tail;      // Index of the oldest sample in the window
     size_t head;      // Index at which the newest sample is to be inserted
-    float sum;        // Sum of the samples in the window
 } SampleWindow;
 
 Status sample_window_init(SampleWindow* window, size_t capacity);
 
 Status sample_window_reset(SampleWindow* window);
 
+/**
+ * @brief Add a sample, dropping the oldest if the window is full
+ *
+ * A NAN sample isn't added, but still drops the oldest sample.
+ */
 Status sample_window_insert(SampleWindow* window, float sample);
 
+/**
+ * @brief Sample idx places after the oldest, NAN if there isn't one
+ */
 float sample_window_get(SampleWindow* window, size_t idx);
 
 #endif  // SAMPLE_WINDOW_H
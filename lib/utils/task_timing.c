@@ -0,0 +1,148 @@
+#include "task_timing.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static TaskTiming* s_tasks[TASK_TIMING_MAX_TASKS];
+static size_t s_num_tasks = 0;
+
+static void task_timing_register(TaskTiming* timing) {
+    for (size_t i = 0; i < s_num_tasks; i++) {
+        if (s_tasks[i] == timing) {
+            return;
+        }
+    }
+    if (s_num_tasks < TASK_TIMING_MAX_TASKS) {
+        s_tasks[s_num_tasks++] = timing;
+    }
+}
+
+void task_timing_init(TaskTiming* timing, const char* name,
+                      uint32_t deadline_us) {
+    timing->name = name;
+    task_timing_reset(timing, deadline_us);
+    task_timing_register(timing);
+}
+
+void task_timing_reset(TaskTiming* timing, uint32_t deadline_us) {
+    const char* name = timing->name;
+    memset(timing, 0, sizeof(*timing));
+    timing->name = name;
+    timing->deadline_us = deadline_us;
+}
+
+int task_timing_bucket(uint32_t time_us) {
+    int bucket = 0;
+    while (time_us > 0 && bucket < TASK_TIMING_NUM_BUCKETS - 1) {
+        time_us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void task_timing_begin(TaskTiming* timing, uint64_t release_us,
+                       uint64_t now_us) {
+    // A release in the future (e.g. from a clock that was read late) counts
+    // as no latency
+    uint32_t latency_us = now_us > release_us ? now_us - release_us : 0;
+    timing->latency_hist[task_timing_bucket(latency_us)]++;
+    if (latency_us > timing->max_latency_us) {
+        timing->max_latency_us = latency_us;
+    }
+
+    timing->release_us = now_us > release_us ? release_us : now_us;
+    timing->start_us = now_us;
+    timing->running = true;
+}
+
+void task_timing_begin_periodic(TaskTiming* timing, uint64_t now_us) {
+    uint64_t release_us = timing->next_release_us;
+    if (release_us == 0) {
+        release_us = now_us;
+    }
+    timing->next_release_us = release_us + timing->deadline_us;
+    task_timing_begin(timing, release_us, now_us);
+}
+
+void task_timing_end(TaskTiming* timing, uint64_t now_us) {
+    if (!timing->running) {
+        return;
+    }
+    timing->running = false;
+
+    uint32_t exec_us = now_us - timing->start_us;
+    timing->exec_hist[task_timing_bucket(exec_us)]++;
+    if (exec_us > timing->max_exec_us) {
+        timing->max_exec_us = exec_us;
+    }
+
+    timing->runs++;
+    if (now_us - timing->release_us > timing->deadline_us) {
+        timing->misses++;
+    }
+}
+
+// snprintf that keeps track of how much of the buffer is left
+static void append(char* buf, size_t len, size_t* pos, const char* fmt, ...) {
+    if (*pos >= len) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *pos, len - *pos, fmt, args);
+    va_end(args);
+    if (n > 0) {
+        *pos += n;
+    }
+    if (*pos >= len) {
+        *pos = len - 1;
+    }
+}
+
+static void append_hist(char* buf, size_t len, size_t* pos, const char* label,
+                        uint32_t max_us, const uint32_t* hist) {
+    append(buf, len, pos, "  %s max %lu us:", label, (unsigned long)max_us);
+    for (int i = 0; i < TASK_TIMING_NUM_BUCKETS; i++) {
+        if (hist[i] == 0) {
+            continue;
+        }
+        if (i == TASK_TIMING_NUM_BUCKETS - 1) {
+            append(buf, len, pos, " >=%lu:%lu", 1UL << (i - 1),
+                   (unsigned long)hist[i]);
+        } else {
+            append(buf, len, pos, " <%lu:%lu", 1UL << i,
+                   (unsigned long)hist[i]);
+        }
+    }
+    append(buf, len, pos, "\n");
+}
+
+size_t task_timing_format(const TaskTiming* timing, char* buf, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+
+    size_t pos = 0;
+    append(buf, len, &pos, "%s: %lu runs, %lu missed (deadline %lu us)\n",
+           timing->name, (unsigned long)timing->runs,
+           (unsigned long)timing->misses, (unsigned long)timing->deadline_us);
+    append_hist(buf, len, &pos, "latency", timing->max_latency_us,
+                timing->latency_hist);
+    append_hist(buf, len, &pos, "exec", timing->max_exec_us,
+                timing->exec_hist);
+    return pos;
+}
+
+TaskTiming* task_timing_get(size_t index) {
+    return index < s_num_tasks ? s_tasks[index] : NULL;
+}
+
+void task_timing_print_all() {
+    char buf[TASK_TIMING_FORMAT_LEN];
+    for (size_t i = 0; i < s_num_tasks; i++) {
+        task_timing_format(s_tasks[i], buf, sizeof(buf));
+        printf("%s", buf);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef TASK_TIMING_H
+#define TASK_TIMING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Histogram buckets are powers of two: bucket 0 counts times under 1 us,
+// bucket i times from 2^(i-1) up to 2^i us, and the last bucket everything
+// from 2^(TASK_TIMING_NUM_BUCKETS - 2) us (about 0.5 s) up
+#define TASK_TIMING_NUM_BUCKETS 21
+
+// Most tasks that can be registered for task_timing_get
+#define TASK_TIMING_MAX_TASKS 8
+
+// Enough for any task_timing_format output
+#define TASK_TIMING_FORMAT_LEN 1024
+
+// Timing of one periodic task, built up from begin/end markers around each
+// iteration of its loop
+typedef struct {
+    const char* name;
+    uint32_t deadline_us;  // Allowed time from release to end of iteration
+
+    uint64_t next_release_us;  // For task_timing_begin_periodic, 0 if unknown
+    uint64_t release_us;
+    uint64_t start_us;
+    bool running;
+
+    // Statistics
+    uint32_t runs;
+    uint32_t misses;
+    uint32_t max_latency_us;
+    uint32_t max_exec_us;
+    uint32_t latency_hist[TASK_TIMING_NUM_BUCKETS];  // Release to start
+    uint32_t exec_hist[TASK_TIMING_NUM_BUCKETS];     // Start to end
+} TaskTiming;
+
+/**
+ * @brief Set up a task's timing, and register it
+ *
+ * @param deadline_us Allowed time from release to end of iteration, usually
+ * the task's period
+ */
+void task_timing_init(TaskTiming* timing, const char* name,
+                      uint32_t deadline_us);
+
+/**
+ * @brief Clear the statistics, e.g. after changing the period
+ */
+void task_timing_reset(TaskTiming* timing, uint32_t deadline_us);
+
+/**
+ * @brief Mark the start of an iteration that was released at release_us
+ */
+void task_timing_begin(TaskTiming* timing, uint64_t release_us,
+                       uint64_t now_us);
+
+/**
+ * @brief Mark the start of an iteration of a task that runs every
+ * deadline_us, e.g. with vTaskDelayUntil
+ *
+ * The first iteration is taken to be released on time, and each later one a
+ * period after the one before, however late that one started.
+ */
+void task_timing_begin_periodic(TaskTiming* timing, uint64_t now_us);
+
+/**
+ * @brief Mark the end of the iteration
+ */
+void task_timing_end(TaskTiming* timing, uint64_t now_us);
+
+/**
+ * @brief Histogram bucket of a time, see TASK_TIMING_NUM_BUCKETS
+ */
+int task_timing_bucket(uint32_t time_us);
+
+/**
+ * @brief Write a summary of the statistics, one line for the latency and one
+ * for the execution time, listing only the non-empty buckets
+ *
+ * @return Characters written, not counting the terminating null
+ */
+size_t task_timing_format(const TaskTiming* timing, char* buf, size_t len);
+
+/**
+ * @brief Registered tasks, in the order they were set up
+ *
+ * @return NULL once index is past the last one
+ */
+TaskTiming* task_timing_get(size_t index);
+
+/**
+ * @brief Print the statistics of every registered task
+ */
+void task_timing_print_all();
+
+#endif  // TASK_TIMING_H
@@ -1,32 +1,88 @@
 #include "terminal.h"
 
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+
 #include "Regex.h"
 
 typedef struct {
+    char name[TERMINAL_MAX_NAME_LEN];
     Regex regex;
     void (*callback)(char *);
 
 } TerminalCmd;
 
-TerminalCmd cmd_list[TERMINAL_MAX_CMDS];
-int num_cmds = 0;
+// Compiled regexes point into themselves, so the commands stay where they
+// were added and are sorted by name through s_by_name, for binary search
+static TerminalCmd s_cmds[TERMINAL_MAX_CMDS];
+static int s_by_name[TERMINAL_MAX_CMDS];
+static int s_num_cmds = 0;
+
+// Copies the command name at the start of str, returns its length (0 if
+// there isn't one, or it's too long)
+static size_t cmd_name(const char *str, char *name) {
+    size_t len = 0;
+    while (isalnum((unsigned char)str[len]) || str[len] == '_') {
+        if (len >= TERMINAL_MAX_NAME_LEN - 1) {
+            return 0;
+        }
+        name[len] = str[len];
+        len++;
+    }
+    name[len] = '\0';
+    return len;
+}
+
+// Index of the first command whose name is not less than name
+static int cmd_lower_bound(const char *name) {
+    int lo = 0;
+    int hi = s_num_cmds;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(s_cmds[s_by_name[mid]].name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
 
 void terminal_init() {}
 
 void terminal_add_cmd(const char *cmd_regex, void (*callback)(char *)) {
     // Too many commands
-    if (num_cmds >= TERMINAL_MAX_CMDS) {
+    if (s_num_cmds >= TERMINAL_MAX_CMDS) {
         return;
     }
 
     // Null callback
-    if (callback == NULL) {
+    if (callback == NULL || cmd_regex == NULL) {
+        return;
+    }
+
+    // No name to look it up by
+    char name[TERMINAL_MAX_NAME_LEN];
+    if (cmd_name(cmd_regex[0] == '^' ? cmd_regex + 1 : cmd_regex, name) == 0) {
         return;
     }
 
-    regexCompile(&cmd_list[num_cmds].regex, cmd_regex);
-    cmd_list[num_cmds].callback = callback;
-    num_cmds++;
+    // Already registered
+    int pos = cmd_lower_bound(name);
+    if (pos < s_num_cmds && strcmp(s_cmds[s_by_name[pos]].name, name) == 0) {
+        return;
+    }
+
+    TerminalCmd *cmd = &s_cmds[s_num_cmds];
+    strcpy(cmd->name, name);
+    regexCompile(&cmd->regex, cmd_regex);
+    cmd->callback = callback;
+
+    memmove(&s_by_name[pos + 1], &s_by_name[pos],
+            (s_num_cmds - pos) * sizeof(int));
+    s_by_name[pos] = s_num_cmds;
+    s_num_cmds++;
 }
 
 void terminal_process(char *str) {
@@ -36,17 +92,42 @@ void terminal_process(char *str) {
     }
 
     // Null commands
-    if (num_cmds <= 0) {
+    if (s_num_cmds <= 0) {
         return;
     }
 
-    // Find the first matching command
-    Matcher match;
-    for (int i = 0; i < num_cmds; i++) {
-        match = regexMatch(&cmd_list[i].regex, str);
-        if (match.isFound) {
-            cmd_list[i].callback(str);
-            return;
+    // Find the command by name, then check the rest of the line
+    char name[TERMINAL_MAX_NAME_LEN];
+    if (cmd_name(str, name) == 0) {
+        return;
+    }
+    int pos = cmd_lower_bound(name);
+    if (pos >= s_num_cmds || strcmp(s_cmds[s_by_name[pos]].name, name) != 0) {
+        return;
+    }
+
+    TerminalCmd *cmd = &s_cmds[s_by_name[pos]];
+    Matcher match = regexMatch(&cmd->regex, str);
+    if (match.isFound) {
+        cmd->callback(str);
+    }
+}
+
+void terminal_receive(char *str) {
+    // Null buffer
+    if (str == NULL) {
+        return;
+    }
+
+    while (*str != '\0') {
+        size_t len = strcspn(str, "\r\n");
+        char *next = str + len;
+        if (*next != '\0') {
+            *next++ = '\0';
+        }
+        if (len > 0) {
+            terminal_process(str);
         }
+        str = next;
     }
-}
\ No newline at end of file
+}
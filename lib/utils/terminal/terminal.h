@@ -3,10 +3,30 @@
 
 #define TERMINAL_MAX_CMDS 32
 
+// Longest command name, including the terminating null
+#define TERMINAL_MAX_NAME_LEN 32
+
 void terminal_init();
 
+/**
+ * @brief Register a command
+ *
+ * The command is looked up by its name, the letters, digits and underscores
+ * at the start of cmd_regex (after the ^). The full regex is only checked
+ * against lines that start with that name. Commands whose regex doesn't start
+ * with a name, or with a name that's already registered, are ignored.
+ */
 void terminal_add_cmd(const char *cmd_regex, void (*callback)(char *));
 
+/**
+ * @brief Run the command on a line, if there is one that matches it
+ */
 void terminal_process(char *str);
 
-#endif  // TERMINAL_H
\ No newline at end of file
+/**
+ * @brief Run the commands on each line of received text. The text is split
+ * in place, and the last line doesn't need to be terminated.
+ */
+void terminal_receive(char *str);
+
+#endif  // TERMINAL_H
@@ -0,0 +1,194 @@
+"""Generate lib/storage/frame_encode.{c,h} from the logged .proto files.
+
+The generated encoders write the same length-delimited bytes as nanopb's
+pb_encode_ex(..., PB_ENCODE_DELIMITED), but with every tag and field unrolled,
+so nothing is looked up in the descriptor tables at run time.
+
+Usage: python scripts/gen_frame_encode.py
+Rerun it whenever sensor.proto or state.proto changes.
+"""
+
+import os
+import re
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PROTO_DIR = os.path.join(REPO_DIR, "lib", "storage", "proto")
+OUT_DIR = os.path.join(REPO_DIR, "lib", "storage")
+
+# Messages written every control cycle
+PROTOS = ["sensor.proto", "state.proto"]
+
+WT_VARINT = 0
+WT_FIXED32 = 5
+
+# Wire type, and the largest encoded value
+TYPES = {
+    "uint64": (WT_VARINT, 10),
+    "uint32": (WT_VARINT, 5),
+    "float": (WT_FIXED32, 4),
+}
+
+GENERATED_NOTE = ("// Generated by scripts/gen_frame_encode.py from "
+                  "lib/storage/proto, do not edit\n")
+
+
+def varint_bytes(value):
+    out = []
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return out
+
+
+def parse_proto(path):
+    """Return the message name and its (type, name, number) fields."""
+    with open(path) as f:
+        text = re.sub(r"//.*", "", f.read())
+
+    match = re.search(r"message\s+(\w+)\s*\{([^}]*)\}", text)
+    if match is None:
+        raise ValueError(f"No message in {path}")
+    fields = []
+    for field in re.finditer(r"(\w+)\s+(\w+)\s*=\s*(\d+)\s*;", match.group(2)):
+        field_type, name, number = field.groups()
+        if field_type not in TYPES:
+            raise ValueError(f"Unsupported type {field_type} in {path}")
+        fields.append((field_type, name, int(number)))
+    return match.group(1), sorted(fields, key=lambda f: f[2])
+
+
+def short_name(message):
+    # SensorFrame -> sensor
+    return re.sub(r"Frame$", "", message).lower()
+
+
+def max_lens(fields):
+    body = 0
+    for field_type, _, number in fields:
+        wire_type, value_len = TYPES[field_type]
+        body += len(varint_bytes(number << 3 | wire_type)) + value_len
+    if body >= 1 << 14:
+        raise ValueError("Messages must fit a two byte length prefix")
+    return body, len(varint_bytes(body))
+
+
+def gen_header(messages):
+    out = [GENERATED_NOTE, "\n#ifndef FRAME_ENCODE_H\n#define FRAME_ENCODE_H\n"]
+    out.append("\n#include <stddef.h>\n#include <stdint.h>\n\n")
+    for proto in PROTOS:
+        out.append(f'#include "{proto[:-len(".proto")]}.pb.h"\n')
+
+    out.append("\n// Largest encoded message, including the length prefix\n")
+    for message, fields in messages:
+        body, prefix = max_lens(fields)
+        macro = f"FRAME_ENCODE_{short_name(message).upper()}_MAX_LEN"
+        out.append(f"#define {macro} {body + prefix}\n")
+
+    for message, _ in messages:
+        name = short_name(message)
+        out.append(
+            "\n/**\n"
+            f" * @brief Encode a {message} as a length-delimited protobuf "
+            "message\n"
+            " *\n"
+            " * Writes the same bytes as nanopb with PB_ENCODE_DELIMITED\n"
+            " *\n"
+            f" * @param buf At least FRAME_ENCODE_{name.upper()}_MAX_LEN "
+            "bytes\n"
+            " * @return Bytes written\n"
+            " */\n"
+            f"size_t frame_encode_{name}(const {message}* frame, "
+            "uint8_t* buf);\n")
+
+    out.append("\n#endif  // FRAME_ENCODE_H\n")
+    return "".join(out)
+
+
+SOURCE_HELPERS = """
+#include "frame_encode.h"
+
+#include <string.h>
+
+// Tags are passed as their varint encoding, first byte lowest
+static inline uint8_t* put_tag(uint8_t* p, uint16_t tag) {
+    *p++ = tag & 0xFF;
+    if (tag > 0xFF) {
+        *p++ = tag >> 8;
+    }
+    return p;
+}
+
+// Fields with default values are left out, as in proto3
+static inline uint8_t* put_varint(uint8_t* p, uint16_t tag, uint64_t value) {
+    if (value == 0) {
+        return p;
+    }
+    p = put_tag(p, tag);
+    while (value >= 0x80) {
+        *p++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+// Like nanopb, only +0 counts as the default, since it compares the bytes.
+// Note: fixed32 is little endian, so this assumes a little endian host.
+static inline uint8_t* put_float(uint8_t* p, uint16_t tag, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    if (bits == 0) {
+        return p;
+    }
+    p = put_tag(p, tag);
+    memcpy(p, &bits, 4);
+    return p + 4;
+}
+
+// The message is written after room for the longest length prefix, and moved
+// down if the actual prefix is shorter
+static inline size_t put_length(uint8_t* buf, size_t prefix_len, uint8_t* end) {
+    size_t len = end - (buf + prefix_len);
+    if (len < 0x80) {
+        if (prefix_len > 1) {
+            memmove(buf + 1, buf + prefix_len, len);
+        }
+        buf[0] = len;
+        return len + 1;
+    }
+    buf[0] = (len & 0x7F) | 0x80;
+    buf[1] = len >> 7;
+    return len + 2;
+}
+"""
+
+
+def gen_source(messages):
+    out = [GENERATED_NOTE, SOURCE_HELPERS]
+    for message, fields in messages:
+        _, prefix = max_lens(fields)
+        out.append(f"\nsize_t frame_encode_{short_name(message)}"
+                   f"(const {message}* frame, uint8_t* buf) {{\n")
+        out.append(f"    uint8_t* p = buf + {prefix};\n")
+        for field_type, name, number in fields:
+            wire_type, _ = TYPES[field_type]
+            tag = varint_bytes(number << 3 | wire_type)
+            packed = sum(b << (8 * i) for i, b in enumerate(tag))
+            put = "put_float" if wire_type == WT_FIXED32 else "put_varint"
+            out.append(f"    p = {put}(p, 0x{packed:0{2 * len(tag)}X}, "
+                       f"frame->{name});\n")
+        out.append(f"    return put_length(buf, {prefix}, p);\n}}\n")
+    return "".join(out)
+
+
+def main():
+    messages = [parse_proto(os.path.join(PROTO_DIR, p)) for p in PROTOS]
+    with open(os.path.join(OUT_DIR, "frame_encode.h"), "w") as f:
+        f.write(gen_header(messages))
+    with open(os.path.join(OUT_DIR, "frame_encode.c"), "w") as f:
+        f.write(gen_source(messages))
+
+
+if __name__ == "__main__":
+    main()
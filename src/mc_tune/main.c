@@ -0,0 +1,642 @@
+// Monte Carlo tuning harness for the state estimator
+//
+// Usage: mc_tune [options] [param_sets.txt]
+//   -n RUNS              runs per parameter set (default 200)
+//   -j JOBS              simulations at once (default: number of CPUs)
+//   -s SEED              first run's seed (default 1)
+//   -p NAME=VALUE        sensor perturbation, see s_perturb_names
+//   -o runs.csv          write every run's result
+//
+// Each run replays the HWIL flight (hwil_data_dir) through se_update and
+// fp_update, the same way SWIL does, with its own draw of sensor noise, bias
+// and dropouts. Runs with the same seed see the same perturbations whatever
+// the parameter set, so sets are compared on equal terms.
+//
+// A parameter set file has one set per line: a name, then any of
+//   q1=7 values  q2=7 values  r1=3 values  r2=3 values
+//   gate=stdevs  windows=median,sma,diff,vel_sma
+// comma separated, replacing those in the board config's estimator block.
+// Anything not given keeps its default. Blank lines and lines starting with #
+// are skipped. With no file, only the defaults are run.
+//
+// The estimator keeps its state in file statics, as on the board, so every
+// run is a forked process rather than a thread; they run JOBS at a time and
+// write their results into shared memory.
+//
+// Apogee is taken from the unperturbed pressure, smoothed over
+// REF_SMOOTH_US: the detection latency is the time from there to
+// FP_COAST -> FP_DROGUE, and the altitude error is the EKF altitude at
+// detection less the baro altitude of that apogee.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "board_config.h"
+#include "flight_control.h"
+#include "hwil/hwil.h"
+#include "state_estimation.h"
+#include "timer.h"
+
+#define MAX_SETS 32
+#define MAX_NAME_LEN 32
+#define MAX_LINE_LEN 512
+#define DEFAULT_RUNS 200
+#define PAD_AVERAGE_US (1000000)
+#define REF_SMOOTH_US (1000000)
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    EstimatorConfig config;
+} ParamSet;
+
+// Added to the HWIL sensor frames, in their units. Biases are drawn once per
+// run, uniformly within +/- the given value.
+typedef struct {
+    float baro_noise_mbar;
+    float baro_bias_mbar;
+    float acc_noise_g;
+    float acc_bias_g;
+    float gyro_noise_dps;
+    float gyro_bias_dps;
+    float dropout_prob;    // Chance per frame of a sensor starting a dropout
+    float dropout_frames;  // Longest dropout, uniformly 1 to this
+} Perturbation;
+
+static Perturbation s_perturb = {
+    .baro_noise_mbar = 0.05f,
+    .baro_bias_mbar = 0.5f,
+    .acc_noise_g = 0.01f,
+    .acc_bias_g = 0.02f,
+    .gyro_noise_dps = 0.2f,
+    .gyro_bias_dps = 1.f,
+    .dropout_prob = 0.005f,
+    .dropout_frames = 10,
+};
+
+static const struct {
+    const char* name;
+    float* value;
+} s_perturb_names[] = {
+    {"baro_noise", &s_perturb.baro_noise_mbar},
+    {"baro_bias", &s_perturb.baro_bias_mbar},
+    {"acc_noise", &s_perturb.acc_noise_g},
+    {"acc_bias", &s_perturb.acc_bias_g},
+    {"gyro_noise", &s_perturb.gyro_noise_dps},
+    {"gyro_bias", &s_perturb.gyro_bias_dps},
+    {"dropout", &s_perturb.dropout_prob},
+    {"dropout_len", &s_perturb.dropout_frames},
+};
+
+#define NUM_PERTURB_NAMES \
+    (sizeof(s_perturb_names) / sizeof(s_perturb_names[0]))
+
+typedef struct {
+    bool done;      // Set last, so a crashed run is left out
+    bool detected;  // Apogee was detected
+    bool error;     // Flight logic ended up in FP_ERROR
+    float latency_s;
+    float alt_err_m;
+} RunResult;
+
+typedef struct {
+    uint64_t apogee_us;
+    float apogee_m;  // Above the pad
+} Reference;
+
+/**********/
+/* RANDOM */
+/**********/
+
+// splitmix64, so each run's stream depends only on its seed
+typedef struct {
+    uint64_t state;
+} Rng;
+
+static uint64_t rng_next(Rng* rng) {
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// In [0, 1)
+static float rng_uniform(Rng* rng) {
+    return (rng_next(rng) >> 40) * (1.f / (1ull << 24));
+}
+
+static float rng_symmetric(Rng* rng, float half_width) {
+    return half_width * (2.f * rng_uniform(rng) - 1.f);
+}
+
+static float rng_gaussian(Rng* rng, float stdev) {
+    if (stdev == 0) {
+        return 0;
+    }
+    // Box-Muller, throwing away the second value
+    float u1 = 1.f - rng_uniform(rng);
+    float u2 = rng_uniform(rng);
+    return stdev * sqrtf(-2.f * logf(u1)) * cosf(2.f * (float)M_PI * u2);
+}
+
+/**************/
+/* SIMULATION */
+/**************/
+
+typedef struct {
+    float baro_bias;
+    float acc_h_bias[3];
+    float acc_i_bias[3];
+    float gyro_bias[3];
+    uint32_t baro_dropout;  // Frames left in each dropout
+    uint32_t acc_h_dropout;
+    uint32_t imu_dropout;
+} RunPerturbation;
+
+static void perturb_vec(Rng* rng, float* x, float* y, float* z,
+                        const float* bias, float noise) {
+    *x += bias[0] + rng_gaussian(rng, noise);
+    *y += bias[1] + rng_gaussian(rng, noise);
+    *z += bias[2] + rng_gaussian(rng, noise);
+}
+
+static bool dropped(Rng* rng, uint32_t* frames_left) {
+    if (*frames_left == 0 && rng_uniform(rng) < s_perturb.dropout_prob) {
+        *frames_left = 1 + (uint32_t)(rng_uniform(rng) *
+                                      fmaxf(s_perturb.dropout_frames, 1));
+    }
+    if (*frames_left == 0) {
+        return false;
+    }
+    (*frames_left)--;
+    return true;
+}
+
+static void perturb_frame(Rng* rng, RunPerturbation* run, SensorFrame* frame) {
+    frame->pressure +=
+        run->baro_bias + rng_gaussian(rng, s_perturb.baro_noise_mbar);
+    perturb_vec(rng, &frame->acc_h_x, &frame->acc_h_y, &frame->acc_h_z,
+                run->acc_h_bias, s_perturb.acc_noise_g);
+    perturb_vec(rng, &frame->acc_i_x, &frame->acc_i_y, &frame->acc_i_z,
+                run->acc_i_bias, s_perturb.acc_noise_g);
+    perturb_vec(rng, &frame->rot_i_x, &frame->rot_i_y, &frame->rot_i_z,
+                run->gyro_bias, s_perturb.gyro_noise_dps);
+
+    // A failed read leaves the sensor's fields as NAN
+    if (dropped(rng, &run->baro_dropout)) {
+        frame->pressure = NAN;
+        frame->temperature = NAN;
+    }
+    if (dropped(rng, &run->acc_h_dropout)) {
+        frame->acc_h_x = frame->acc_h_y = frame->acc_h_z = NAN;
+    }
+    if (dropped(rng, &run->imu_dropout)) {
+        frame->acc_i_x = frame->acc_i_y = frame->acc_i_z = NAN;
+        frame->rot_i_x = frame->rot_i_y = frame->rot_i_z = NAN;
+    }
+}
+
+// One flight, in a freshly forked process
+static void simulate(const ParamSet* set, uint64_t seed, const Reference* ref,
+                     RunResult* result) {
+    Rng rng = {.state = seed};
+    srand((unsigned)seed);  // SWIL's timer jitter
+
+    RunPerturbation run = {
+        .baro_bias = rng_symmetric(&rng, s_perturb.baro_bias_mbar),
+    };
+    for (int i = 0; i < 3; i++) {
+        run.acc_h_bias[i] = rng_symmetric(&rng, s_perturb.acc_bias_g);
+        run.acc_i_bias[i] = rng_symmetric(&rng, s_perturb.acc_bias_g);
+        run.gyro_bias[i] = rng_symmetric(&rng, s_perturb.gyro_bias_dps);
+    }
+
+    config_get_ptr()->estimator = set->config;
+    if (se_init() != STATUS_OK || fp_init() != STATUS_OK) {
+        return;
+    }
+
+    SensorFrame sensor_frame;
+    uint64_t next_gps_ms = 0;
+    while (get_hwil_sensor_frame(&sensor_frame) == STATUS_OK) {
+        sensor_frame.timestamp = MICROS();
+        perturb_frame(&rng, &run, &sensor_frame);
+
+        FlightPhase fp_before = fp_get();
+        fp_update(&sensor_frame);
+        if (fp_before == FP_COAST && fp_get() == FP_DROGUE) {
+            result->detected = true;
+            result->latency_s =
+                ((int64_t)MICROS() - (int64_t)ref->apogee_us) / 1e6f;
+            result->alt_err_m = se_as_frame().pos_ekf - ref->apogee_m;
+            break;
+        }
+        if (fp_get() == FP_ERROR) {
+            result->error = true;
+            break;
+        }
+
+        GpsFrame gps_frame;
+        if (MILLIS() >= next_gps_ms &&
+            get_hwil_gps_frame(&gps_frame) == STATUS_OK) {
+            next_gps_ms = MILLIS() + config_get_ptr()->gps_loop_period_ms;
+            gps_frame.timestamp = MICROS();
+            se_update_gps(fp_get(), &gps_frame);
+        }
+
+        DELAY(config_get_ptr()->control_loop_period_ms);
+    }
+
+    result->done = true;
+}
+
+/*************/
+/* REFERENCE */
+/*************/
+
+static float baro_alt_m(float p_mbar) {
+    return 44330.f * (1.f - powf(p_mbar / 1013.25f, 1.f / 5.255f));
+}
+
+// Apogee from the recorded pressure, smoothed over REF_SMOOTH_US
+static bool find_reference(Reference* ref) {
+    double pad_sum = 0;
+    size_t pad_count = 0;
+    uint64_t start_us = HWIL_SENSOR_DATA[0].timestamp;
+
+    double min_p = INFINITY;
+    size_t lo = 0;
+    size_t hi = 0;
+    double window_sum = 0;
+    size_t window_count = 0;
+    for (size_t i = 0; i < HWIL_SENSOR_DATA_SIZE; i++) {
+        uint64_t t = HWIL_SENSOR_DATA[i].timestamp;
+        float p = HWIL_SENSOR_DATA[i].pressure;
+        if (t - start_us < PAD_AVERAGE_US && isfinite(p)) {
+            pad_sum += p;
+            pad_count++;
+        }
+
+        // Centred window [t - REF_SMOOTH_US / 2, t + REF_SMOOTH_US / 2]
+        for (; hi < HWIL_SENSOR_DATA_SIZE &&
+               HWIL_SENSOR_DATA[hi].timestamp <= t + REF_SMOOTH_US / 2;
+             hi++) {
+            if (isfinite(HWIL_SENSOR_DATA[hi].pressure)) {
+                window_sum += HWIL_SENSOR_DATA[hi].pressure;
+                window_count++;
+            }
+        }
+        for (; HWIL_SENSOR_DATA[lo].timestamp + REF_SMOOTH_US / 2 < t; lo++) {
+            if (isfinite(HWIL_SENSOR_DATA[lo].pressure)) {
+                window_sum -= HWIL_SENSOR_DATA[lo].pressure;
+                window_count--;
+            }
+        }
+
+        if (window_count > 0 && window_sum / window_count < min_p) {
+            min_p = window_sum / window_count;
+            ref->apogee_us = t;
+        }
+    }
+
+    if (pad_count == 0 || !isfinite(min_p)) {
+        return false;
+    }
+    ref->apogee_m = baro_alt_m(min_p) - baro_alt_m(pad_sum / pad_count);
+    return true;
+}
+
+/**************/
+/* PARAMETERS */
+/**************/
+
+static bool parse_floats(const char* str, float* out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char* end;
+        out[i] = strtof(str, &end);
+        if (end == str || *end != (i + 1 < len ? ',' : '\0')) {
+            return false;
+        }
+        str = end + 1;
+    }
+    return true;
+}
+
+static bool parse_set(char* line, ParamSet* set) {
+    const char* sep = " \t\r\n";
+    char* tok = strtok(line, sep);
+    if (tok == NULL) {
+        return false;
+    }
+    *set = (ParamSet){.config = ESTIMATOR_CONFIG_DEFAULT};
+    snprintf(set->name, sizeof(set->name), "%s", tok);
+    EstimatorConfig* config = &set->config;
+
+    while ((tok = strtok(NULL, sep)) != NULL) {
+        char* value = strchr(tok, '=');
+        if (value == NULL) {
+            return false;
+        }
+        *value++ = '\0';
+
+        bool ok;
+        float windows[4];
+        if (strcmp(tok, "q1") == 0) {
+            ok = parse_floats(value, config->q_vars_1, ESTIMATOR_NUM_STATES);
+        } else if (strcmp(tok, "q2") == 0) {
+            ok = parse_floats(value, config->q_vars_2, ESTIMATOR_NUM_STATES);
+        } else if (strcmp(tok, "r1") == 0) {
+            ok = parse_floats(value, config->r_diag_1,
+                              ESTIMATOR_NUM_KIN_MEAS);
+        } else if (strcmp(tok, "r2") == 0) {
+            ok = parse_floats(value, config->r_diag_2,
+                              ESTIMATOR_NUM_KIN_MEAS);
+        } else if (strcmp(tok, "gate") == 0) {
+            ok = parse_floats(value, &config->pressure_gate_stdevs, 1);
+        } else if (strcmp(tok, "windows") == 0) {
+            ok = parse_floats(value, windows, 4);
+            config->baro_alt_median_window = windows[0];
+            config->baro_alt_sma_window = windows[1];
+            config->baro_diff_window = windows[2];
+            config->baro_vel_sma_window = windows[3];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    // se_init would quietly fall back to the defaults
+    return se_check_config(config) == STATUS_OK;
+}
+
+// Number of sets read, or -1
+static int load_sets(const char* fname, ParamSet* sets) {
+    FILE* file = fopen(fname, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", fname);
+        return -1;
+    }
+
+    int num_sets = 0;
+    char line[MAX_LINE_LEN];
+    for (int line_num = 1; fgets(line, sizeof(line), file); line_num++) {
+        const char* start = line + strspn(line, " \t\r\n");
+        if (*start == '#' || *start == '\0') {
+            continue;
+        }
+        if (num_sets == MAX_SETS) {
+            fprintf(stderr, "More than %d parameter sets\n", MAX_SETS);
+            num_sets = -1;
+            break;
+        }
+        if (!parse_set(line, &sets[num_sets])) {
+            fprintf(stderr, "%s:%d: bad parameter set\n", fname, line_num);
+            num_sets = -1;
+            break;
+        }
+        num_sets++;
+    }
+
+    fclose(file);
+    return num_sets;
+}
+
+static bool set_perturbation(const char* arg) {
+    const char* value = strchr(arg, '=');
+    if (value == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < NUM_PERTURB_NAMES; i++) {
+        const char* name = s_perturb_names[i].name;
+        if (strlen(name) == (size_t)(value - arg) &&
+            strncmp(arg, name, value - arg) == 0) {
+            char* end;
+            *s_perturb_names[i].value = strtof(value + 1, &end);
+            return end != value + 1 && *end == '\0';
+        }
+    }
+    return false;
+}
+
+/**********/
+/* REPORT */
+/**********/
+
+static int compare_floats(const void* a, const void* b) {
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+// Of n sorted values
+static float percentile(const float* sorted, size_t n, float pct) {
+    size_t i = (size_t)(pct / 100.f * (n - 1) + 0.5f);
+    return sorted[i];
+}
+
+static void report(const ParamSet* set, const RunResult* results,
+                   size_t num_runs) {
+    float* latency = malloc(num_runs * sizeof(float));
+    float* abs_err = malloc(num_runs * sizeof(float));
+    size_t n = 0;
+    size_t errors = 0;
+    size_t failed = 0;
+    double err_sum = 0;
+    double err_sq_sum = 0;
+    for (size_t i = 0; i < num_runs; i++) {
+        if (!results[i].done) {
+            failed++;
+        } else if (results[i].error) {
+            errors++;
+        } else if (results[i].detected) {
+            latency[n] = results[i].latency_s;
+            abs_err[n] = fabsf(results[i].alt_err_m);
+            err_sum += results[i].alt_err_m;
+            err_sq_sum += results[i].alt_err_m * results[i].alt_err_m;
+            n++;
+        }
+    }
+
+    printf("%-16s %5zu/%-5zu %5zu %5zu", set->name, n, num_runs, errors,
+           failed);
+    if (n > 0) {
+        qsort(latency, n, sizeof(float), compare_floats);
+        qsort(abs_err, n, sizeof(float), compare_floats);
+        double err_mean = err_sum / n;
+        double err_std = sqrt(fmax(err_sq_sum / n - err_mean * err_mean, 0));
+        printf(" %7.2f %7.2f %7.2f %7.2f  %7.1f %7.1f %7.1f %7.1f",
+               percentile(latency, n, 0), percentile(latency, n, 50),
+               percentile(latency, n, 90), percentile(latency, n, 100),
+               err_mean, err_std, percentile(abs_err, n, 90),
+               percentile(abs_err, n, 100));
+    }
+    printf("\n");
+
+    free(latency);
+    free(abs_err);
+}
+
+static bool write_runs(const char* fname, const ParamSet* sets, int num_sets,
+                       const RunResult* results, size_t num_runs,
+                       uint64_t seed) {
+    FILE* file = fopen(fname, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", fname);
+        return false;
+    }
+    fprintf(file, "set,seed,done,error,detected,latency_s,alt_err_m\n");
+    for (int s = 0; s < num_sets; s++) {
+        for (size_t i = 0; i < num_runs; i++) {
+            const RunResult* r = &results[s * num_runs + i];
+            fprintf(file, "%s,%llu,%d,%d,%d,%.4f,%.3f\n", sets[s].name,
+                    (unsigned long long)(seed + i), r->done, r->error,
+                    r->detected,
+                    r->detected ? r->latency_s : NAN,
+                    r->detected ? r->alt_err_m : NAN);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/********/
+/* MAIN */
+/********/
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: mc_tune [-n RUNS] [-j JOBS] [-s SEED] [-p NAME=VALUE]... "
+            "[-o runs.csv] [param_sets.txt]\n"
+            "Perturbations:");
+    for (size_t i = 0; i < NUM_PERTURB_NAMES; i++) {
+        fprintf(stderr, " %s=%g", s_perturb_names[i].name,
+                *s_perturb_names[i].value);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv) {
+    size_t num_runs = DEFAULT_RUNS;
+    long num_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = 1;
+    const char* runs_fname = NULL;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        const char* opt = argv[arg];
+        if (arg + 1 >= argc) {
+            usage();
+            return 2;
+        } else if (strcmp(opt, "-n") == 0) {
+            num_runs = strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(opt, "-j") == 0) {
+            num_jobs = strtol(argv[++arg], NULL, 10);
+        } else if (strcmp(opt, "-s") == 0) {
+            seed = strtoull(argv[++arg], NULL, 10);
+        } else if (strcmp(opt, "-o") == 0) {
+            runs_fname = argv[++arg];
+        } else if (strcmp(opt, "-p") == 0) {
+            if (!set_perturbation(argv[++arg])) {
+                usage();
+                return 2;
+            }
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (argc - arg > 1 || num_runs == 0 || num_jobs < 1) {
+        usage();
+        return 2;
+    }
+
+    ParamSet sets[MAX_SETS];
+    int num_sets = 1;
+    sets[0] = (ParamSet){.name = "default",
+                         .config = ESTIMATOR_CONFIG_DEFAULT};
+    if (arg < argc) {
+        num_sets = load_sets(argv[arg], sets);
+        if (num_sets <= 0) {
+            return 1;
+        }
+    }
+
+    Reference ref = {0};
+    if (!find_reference(&ref)) {
+        fprintf(stderr, "No apogee in the HWIL data\n");
+        return 1;
+    }
+    printf("Reference apogee: %.1f m at %.2f s\n", ref.apogee_m,
+           ref.apogee_us / 1e6);
+
+    size_t total_runs = num_sets * num_runs;
+    RunResult* results =
+        mmap(NULL, total_runs * sizeof(RunResult), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        fprintf(stderr, "Failed to map results: %s\n", strerror(errno));
+        return 1;
+    }
+    memset(results, 0, total_runs * sizeof(RunResult));
+
+    // PAL_LOG* writes to FDs 3 and 4
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STORAGE_FILENO);
+    dup2(null_fd, USB_FILENO);
+
+    printf("%d parameter sets x %zu runs, %ld at a time\n", num_sets, num_runs,
+           num_jobs);
+    fflush(stdout);
+
+    size_t started = 0;
+    long running = 0;
+    while (started < total_runs || running > 0) {
+        if (started < total_runs && running < num_jobs) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                dup2(null_fd, STDOUT_FILENO);
+                simulate(&sets[started / num_runs],
+                         seed + started % num_runs, &ref, &results[started]);
+                _exit(0);
+            } else if (pid < 0) {
+                fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+                break;
+            }
+            started++;
+            running++;
+        } else if (wait(NULL) > 0) {
+            running--;
+        } else {
+            break;
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+
+    printf("\n%-16s %11s %5s %5s %7s %7s %7s %7s  %7s %7s %7s %7s\n", "set",
+           "detected", "error", "fail", "lat min", "p50", "p90", "max",
+           "err avg", "std", "|p90|", "|max|");
+    for (int s = 0; s < num_sets; s++) {
+        report(&sets[s], &results[s * num_runs], num_runs);
+    }
+    printf("Latency in s from the reference apogee, error in m from its "
+           "altitude\n");
+
+    if (runs_fname != NULL &&
+        !write_runs(runs_fname, sets, num_sets, results, num_runs, seed)) {
+        return 1;
+    }
+
+    munmap(results, total_runs * sizeof(RunResult));
+    return 0;
+}
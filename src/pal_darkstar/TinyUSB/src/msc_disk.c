@@ -23,13 +23,17 @@
  *
  */
 
+#include "block_cache.h"
 #include "fatfs/diskio.h"
 #include "tasks/storage.h"
 #include "tusb.h"
 
 #if CFG_TUD_MSC
 
-#define MAX_BLOCK_SIZE (512)
+#define MAX_BLOCK_SIZE (BLOCK_CACHE_BLOCK_LEN)
+
+// Not in TinyUSB's list of SCSI commands
+#define SCSI_CMD_SYNCHRONIZE_CACHE_10 0x35
 
 static uint8_t s_buf[MAX_BLOCK_SIZE];
 
@@ -37,6 +41,38 @@ static uint32_t s_block_count;
 static uint16_t s_block_size;
 static bool s_ejected = false;
 
+// Host reads and writes go through a cache, which is in RAM_D2 so that it's
+// filled and written out by DMA in runs of several blocks
+RAM_D2 static BlockCache s_cache;
+static bool s_cache_ready = false;
+
+static Status cache_read(void* ctx, uint8_t* buf, uint32_t lba,
+                         uint32_t count) {
+    (void)ctx;
+    return disk_read(0, buf, lba, count) == RES_OK ? STATUS_OK
+                                                   : STATUS_HARDWARE_ERROR;
+}
+
+static Status cache_write(void* ctx, const uint8_t* buf, uint32_t lba,
+                          uint32_t count) {
+    (void)ctx;
+    return disk_write(0, buf, lba, count) == RES_OK ? STATUS_OK
+                                                    : STATUS_HARDWARE_ERROR;
+}
+
+// Write out anything held back, and forget what was read if the storage
+// task may have changed the disk since
+static Status cache_flush(bool invalidate) {
+    if (!s_cache_ready) {
+        return STATUS_OK;
+    }
+    ASSERT_OK(block_cache_flush(&s_cache), "MSC cache flush");
+    if (invalidate) {
+        block_cache_invalidate(&s_cache);
+    }
+    return STATUS_OK;
+}
+
 static void get_disk_capacity() {
     DWORD count;
     DWORD size;
@@ -79,6 +115,8 @@ bool tud_msc_test_unit_ready_cb(uint8_t lun) {
 
     // Wait for storage task to clean up
     if (storage_is_active()) {
+        cache_flush(true);
+
         // SCIS SCI 04-01 is Not Ready - becoming ready
         tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x01);
         return false;
@@ -89,11 +127,17 @@ bool tud_msc_test_unit_ready_cb(uint8_t lun) {
     get_disk_capacity();
 
     // Make sure we can actually support this
-    if (s_block_size > MAX_BLOCK_SIZE) {
+    if (s_block_size != MAX_BLOCK_SIZE) {
         tud_msc_set_sense(lun, SCSI_SENSE_HARDWARE_ERROR, 0x00, 0x00);
         return false;
     }
 
+    if (!s_cache_ready || s_cache.num_blocks != s_block_count) {
+        block_cache_init(&s_cache, cache_read, cache_write, NULL,
+                         s_block_count);
+        s_cache_ready = true;
+    }
+
     return true;
 }
 
@@ -119,6 +163,7 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start,
     (void)power_condition;
 
     if (load_eject && !start) {
+        cache_flush(true);
         storage_start(STORAGE_PAUSE_MSC);
         s_ejected = true;
     }
@@ -132,16 +177,18 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
                           void* buffer, uint32_t bufsize) {
     (void)lun;
 
-    DRESULT res;
+    if (!s_cache_ready) {
+        return -1;
+    }
 
     uint32_t btr = bufsize;
     uint32_t br = 0;
 
-    // If we have a large aligned access, do a burst transfer
-    if (offset == 0 && bufsize > s_block_size) {
+    // Whole blocks are copied straight from the cache
+    if (offset == 0 && bufsize >= s_block_size) {
         uint32_t blocks_to_read = bufsize / s_block_size;
-        res = disk_read(0, buffer, lba, blocks_to_read);
-        if (res != RES_OK) {
+        if (block_cache_read(&s_cache, lba, buffer, blocks_to_read) !=
+            STATUS_OK) {
             return br;
         }
         lba += blocks_to_read;
@@ -151,8 +198,7 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
 
     while (btr) {
         // Read a single block into the intermediate buffer
-        res = disk_read(0, s_buf, lba, 1);
-        if (res != RES_OK) {
+        if (block_cache_read(&s_cache, lba, s_buf, 1) != STATUS_OK) {
             return br;
         }
 
@@ -192,16 +238,18 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
                            uint8_t* buffer, uint32_t bufsize) {
     (void)lun;
 
-    DRESULT res;
+    if (!s_cache_ready) {
+        return -1;
+    }
 
     uint32_t btw = bufsize;
     uint32_t bw = 0;
 
-    // If we have a large aligned access, do a burst transfer
-    if (offset == 0 && bufsize > s_block_size) {
+    // Whole blocks go straight to the cache, to be written out together
+    if (offset == 0 && bufsize >= s_block_size) {
         uint32_t blocks_to_write = bufsize / s_block_size;
-        res = disk_write(0, buffer, lba, blocks_to_write);
-        if (res != RES_OK) {
+        if (block_cache_write(&s_cache, lba, buffer, blocks_to_write) !=
+            STATUS_OK) {
             return bw;
         }
         lba += blocks_to_write;
@@ -217,8 +265,7 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
         }
 
         // If we're not copying a whole block, read it first
-        res = disk_read(0, s_buf, lba, 1);
-        if (res != RES_OK) {
+        if (block_cache_read(&s_cache, lba, s_buf, 1) != STATUS_OK) {
             return bw;
         }
 
@@ -226,8 +273,7 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
         memcpy(s_buf + offset, (BYTE*)buffer + bw, btc);
 
         // Write a single block from the intermediate buffer
-        res = disk_write(0, s_buf, lba, 1);
-        if (res != RES_OK) {
+        if (block_cache_write(&s_cache, lba, s_buf, 1) != STATUS_OK) {
             return bw;
         }
 
@@ -239,6 +285,12 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
         lba++;
     }
 
+    // Each chunk reaches the disk before it's acknowledged, in one transfer,
+    // so the host hears about any failure in the command's status
+    if (cache_flush(false) != STATUS_OK) {
+        return -1;
+    }
+
     return bw;
 }
 
@@ -256,6 +308,16 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer,
     bool in_xfer = true;
 
     switch (scsi_cmd[0]) {
+        case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+            if (cache_flush(false) != STATUS_OK) {
+                // Set Sense = Write Error
+                tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+                resplen = -1;
+                break;
+            }
+            resplen = 0;
+            break;
+
         default:
             // Set Sense = Invalid Command Operation
             tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
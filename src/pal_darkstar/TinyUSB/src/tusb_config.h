@@ -97,21 +97,23 @@ extern "C" {
 #endif
 
 //------------- CLASS -------------//
-#define CFG_TUD_CDC 1
+#define CFG_TUD_CDC 2  // Terminal, and bulk data
 #define CFG_TUD_MSC 1
 #define CFG_TUD_HID 0
 #define CFG_TUD_MIDI 0
 #define CFG_TUD_VENDOR 0
 
-// CDC FIFO size of TX and RX
-#define CFG_TUD_CDC_RX_BUFSIZE (TUD_OPT_HIGH_SPEED ? 512 : 64)
+// CDC FIFO size of TX and RX. The RX FIFO needs room for a whole endpoint
+// transfer buffer.
+#define CFG_TUD_CDC_RX_BUFSIZE CFG_TUD_CDC_EP_BUFSIZE
 #define CFG_TUD_CDC_TX_BUFSIZE 4096  //(TUD_OPT_HIGH_SPEED ? 512 : 64)
 
-// CDC Endpoint transfer buffer size, more is faster
-#define CFG_TUD_CDC_EP_BUFSIZE (TUD_OPT_HIGH_SPEED ? 512 : 64)
+// CDC Endpoint transfer buffer size, more is faster. Each transfer can carry
+// several packets, and the FIFO keeps taking data while one is on the bus.
+#define CFG_TUD_CDC_EP_BUFSIZE 1024
 
 // MSC Buffer size of Device Mass storage
-#define CFG_TUD_MSC_EP_BUFSIZE 512
+#define CFG_TUD_MSC_EP_BUFSIZE 4096
 
 #ifdef __cplusplus
 }
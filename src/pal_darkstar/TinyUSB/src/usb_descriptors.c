@@ -77,7 +77,16 @@ uint8_t const *tud_descriptor_device_cb(void) {
 // Configuration Descriptor
 //--------------------------------------------------------------------+
 
-enum { ITF_NUM_CDC = 0, ITF_NUM_CDC_DATA, ITF_NUM_MSC, ITF_NUM_TOTAL };
+// The second CDC interface (for bulk data) comes after the MSC one, so the
+// terminal and the disk keep their interface numbers
+enum {
+    ITF_NUM_CDC = 0,
+    ITF_NUM_CDC_DATA,
+    ITF_NUM_MSC,
+    ITF_NUM_CDC_1,
+    ITF_NUM_CDC_1_DATA,
+    ITF_NUM_TOTAL
+};
 
 #if CFG_TUSB_MCU == OPT_MCU_LPC175X_6X || \
     CFG_TUSB_MCU == OPT_MCU_LPC177X_8X || CFG_TUSB_MCU == OPT_MCU_LPC40XX
@@ -90,6 +99,10 @@ enum { ITF_NUM_CDC = 0, ITF_NUM_CDC_DATA, ITF_NUM_MSC, ITF_NUM_TOTAL };
 #define EPNUM_MSC_OUT 0x05
 #define EPNUM_MSC_IN 0x85
 
+#define EPNUM_CDC_1_NOTIF 0x84
+#define EPNUM_CDC_1_OUT 0x08
+#define EPNUM_CDC_1_IN 0x88
+
 #elif CFG_TUSB_MCU == OPT_MCU_CXD56
 // CXD56 USB driver has fixed endpoint type (bulk/interrupt/iso) and direction
 // (IN/OUT) by its number 0 control (IN/OUT), 1 Bulk (IN), 2 Bulk (OUT), 3 In
@@ -101,6 +114,8 @@ enum { ITF_NUM_CDC = 0, ITF_NUM_CDC_DATA, ITF_NUM_MSC, ITF_NUM_TOTAL };
 #define EPNUM_MSC_OUT 0x05
 #define EPNUM_MSC_IN 0x84
 
+#error "Not enough endpoints for the second CDC interface"
+
 #elif defined(TUD_ENDPOINT_ONE_DIRECTION_ONLY)
 // MCUs that don't support a same endpoint number with different direction IN
 // and OUT defined in tusb_mcu.h
@@ -112,6 +127,10 @@ enum { ITF_NUM_CDC = 0, ITF_NUM_CDC_DATA, ITF_NUM_MSC, ITF_NUM_TOTAL };
 #define EPNUM_MSC_OUT 0x04
 #define EPNUM_MSC_IN 0x85
 
+#define EPNUM_CDC_1_NOTIF 0x86
+#define EPNUM_CDC_1_OUT 0x07
+#define EPNUM_CDC_1_IN 0x88
+
 #else
 #define EPNUM_CDC_NOTIF 0x81
 #define EPNUM_CDC_OUT 0x02
@@ -120,10 +139,14 @@ enum { ITF_NUM_CDC = 0, ITF_NUM_CDC_DATA, ITF_NUM_MSC, ITF_NUM_TOTAL };
 #define EPNUM_MSC_OUT 0x03
 #define EPNUM_MSC_IN 0x83
 
+#define EPNUM_CDC_1_NOTIF 0x84
+#define EPNUM_CDC_1_OUT 0x05
+#define EPNUM_CDC_1_IN 0x85
+
 #endif
 
 #define CONFIG_TOTAL_LEN \
-    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
+    (TUD_CONFIG_DESC_LEN + 2 * TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
 
 uint8_t const desc_fs_configuration[] = {
     // Config number, interface count, string index, total length, attribute,
@@ -137,6 +160,10 @@ uint8_t const desc_fs_configuration[] = {
 
     // Interface number, string index, EP Out & EP In address, EP size
     TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 5, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+
+    // Data interface
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_1, 6, EPNUM_CDC_1_NOTIF, 8, EPNUM_CDC_1_OUT,
+                       EPNUM_CDC_1_IN, 64),
 };
 
 #if TUD_OPT_HIGH_SPEED
@@ -156,6 +183,10 @@ uint8_t const desc_hs_configuration[] = {
 
     // Interface number, string index, EP Out & EP In address, EP size
     TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 5, EPNUM_MSC_OUT, EPNUM_MSC_IN, 512),
+
+    // Data interface
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_1, 6, EPNUM_CDC_1_NOTIF, 8, EPNUM_CDC_1_OUT,
+                       EPNUM_CDC_1_IN, 512),
 };
 
 // other speed configuration
@@ -242,6 +273,7 @@ char const *string_desc_arr[] = {
     NULL,                        // 3: Serials will use unique ID if possible
     "PAL 9000 CDC",              // 4: CDC Interface
     "PAL 9000 MSC",              // 5: MSC Interface
+    "PAL 9000 Data",             // 6: CDC data interface
 };
 
 static uint16_t _desc_str[32 + 1];
@@ -1,8 +1,12 @@
 #include "board_config.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "backup/backup.h"
 #include "fatlog.h"
 #include "pyros.h"
+#include "state_estimation.h"
 #include "stdio.h"
 
 static uint32_t s_valid_config_loaded = 0;
@@ -14,6 +18,10 @@ const static BoardConfig s_default_config = {
     .control_loop_period_ms = 10,             // ms
     .sensor_loop_period_ms = 100,             // ms
     .storage_loop_period_ms = 1000,           // ms
+    .storage_sensor_blocks = false,           // plain SensorFrames
+    .storage_prealloc_mb = 64,                // MB
+    .storage_sync_kb = 256,                   // KB
+    .storage_idle_sync_ms = 2000,             // ms
     .gps_loop_period_ms = 200,                // ms
     .pspcom_rx_loop_period_ms = 100,          // ms
     .pspcom_tx_ground_loop_period_ms = 5000,  // ms
@@ -41,6 +49,7 @@ const static BoardConfig s_default_config = {
     .stage_max_sep_altitude_m = 1e9f,
     .stage_min_sep_angle_deg = -1e4,
     .stage_max_sep_angle_deg = 1e4,
+    .stage_max_sep_tilt_rate_dps = 1e4,
     .stage_sep_pyro_channel = PYRO_A1,
 
     // Stage ignititon settings
@@ -52,6 +61,7 @@ const static BoardConfig s_default_config = {
     .stage_max_ignite_altitude_m = 1e6f,
     .stage_min_ignite_angle_deg = 0,
     .stage_max_ignite_angle_deg = 0,
+    .stage_max_ignite_tilt_rate_dps = 1e4,
     .stage_ignite_pyro_channel = PYRO_A1,
 
     // Recovery settings
@@ -61,6 +71,10 @@ const static BoardConfig s_default_config = {
 
     // Telemetry settings
     .telemetry_frequency_hz = 433350000,  // Hz
+    .telemetry_duty_cycle_pct = 40,       // %
+
+    // Estimator settings
+    .estimator = ESTIMATOR_CONFIG_DEFAULT,
 };
 
 // Simple summing checksum with non-zero initialization
@@ -77,6 +91,16 @@ static uint32_t calc_config_checksum(const BoardConfig* config) {
     return sum;
 }
 
+// A config can pass its checksum with an estimator block that's from an older
+// version or out of bounds; only that block goes back to the defaults
+static void check_estimator_config(BoardConfig* config) {
+    if (se_check_config(&config->estimator) != STATUS_OK) {
+        PAL_LOGW("Estimator config is invalid; using defaults\n");
+        config->estimator = s_default_config.estimator;
+        config->checksum = calc_config_checksum(config);
+    }
+}
+
 static Status load_config_from_disk(BoardConfig* config) {
     ASSERT_OK(fatlog_open_file_for_read(&s_configfile, s_configfile_path),
               "failed to open config file\n");
@@ -106,6 +130,7 @@ Status config_load() {
 
     if (calc_config_checksum(sram_config) == sram_config->checksum) {
         // If the checksum verifies, do nothing
+        check_estimator_config(sram_config);
         s_valid_config_loaded = 1;
         PAL_LOGI("Config loaded from SRAM\n");
         config_print();
@@ -117,6 +142,7 @@ Status config_load() {
         // Verify checksum of the config we just loaded
         if (calc_config_checksum(sram_config) == sram_config->checksum) {
             // If the checksum verifies, we're done
+            check_estimator_config(sram_config);
             s_valid_config_loaded = 2;
             PAL_LOGI("Config loaded from flash\n");
             config_print();
@@ -168,6 +194,14 @@ Status config_invalidate() {
     return STATUS_OK;
 }
 
+static void print_floats(const char* name, const float* values, size_t len) {
+    printf("%s:", name);
+    for (size_t i = 0; i < len; i++) {
+        printf(" %g", values[i]);
+    }
+    printf("\n");
+}
+
 void config_print() {
     BoardConfig* config = config_get_ptr();
     printf("===== BOARD CONFIG =====\n");
@@ -176,6 +210,11 @@ void config_print() {
     printf("Control loop period: %ld ms\n", config->control_loop_period_ms);
     printf("Sensor loop period: %ld ms\n", config->sensor_loop_period_ms);
     printf("Storage loop period: %ld ms\n", config->storage_loop_period_ms);
+    printf("Storage sensor blocks: %s\n",
+           config->storage_sensor_blocks ? "Yes" : "No");
+    printf("Storage preallocation: %ld MB\n", config->storage_prealloc_mb);
+    printf("Storage sync interval: %ld KB\n", config->storage_sync_kb);
+    printf("Storage idle sync age: %ld ms\n", config->storage_idle_sync_ms);
     printf("GPS loop period: %ld ms\n", config->gps_loop_period_ms);
     printf("PSPCOM RX loop period: %ld ms\n", config->pspcom_rx_loop_period_ms);
     printf("PSPCOM TX ground loop period: %ld ms\n",
@@ -208,6 +247,8 @@ void config_print() {
     printf("Stage max sep alt: %.2f m\n", config->stage_max_sep_altitude_m);
     printf("Stage min sep angle: %.2f deg\n", config->stage_min_sep_angle_deg);
     printf("Stage max sep angle: %.2f deg\n", config->stage_max_sep_angle_deg);
+    printf("Stage max sep tilt rate: %.2f deg/s\n",
+           config->stage_max_sep_tilt_rate_dps);
     printf("Stage sep pyro channel: %ld\n", config->stage_sep_pyro_channel);
 
     printf("\n----- STAGE IGNITION -----\n");
@@ -226,6 +267,8 @@ void config_print() {
            config->stage_min_ignite_angle_deg);
     printf("Stage max ignite angle: %.2f deg\n",
            config->stage_max_ignite_angle_deg);
+    printf("Stage max ignite tilt rate: %.2f deg/s\n",
+           config->stage_max_ignite_tilt_rate_dps);
     printf("Stage ignite pyro channel: %ld\n",
            config->stage_ignite_pyro_channel);
 
@@ -236,17 +279,62 @@ void config_print() {
 
     printf("\n----- TELEMETRY -----\n");
     printf("Telemetry frequency: %ld Hz\n", config->telemetry_frequency_hz);
+    printf("Telemetry duty cycle: %.1f %%\n",
+           config->telemetry_duty_cycle_pct);
+
+    const EstimatorConfig* est = &config->estimator;
+    printf("\n----- ESTIMATOR -----\n");
+    printf("Estimator config version: %ld\n", est->version);
+    print_floats("Q vars (boost/coast)", est->q_vars_1, ESTIMATOR_NUM_STATES);
+    print_floats("Q vars (chute)", est->q_vars_2, ESTIMATOR_NUM_STATES);
+    print_floats("R diag (boost/coast)", est->r_diag_1, ESTIMATOR_NUM_KIN_MEAS);
+    print_floats("R diag (chute)", est->r_diag_2, ESTIMATOR_NUM_KIN_MEAS);
+    printf("Pressure gate: %.1f stdevs\n", est->pressure_gate_stdevs);
+    printf("Baro median window: %ld\n", est->baro_alt_median_window);
+    printf("Baro alt SMA window: %ld\n", est->baro_alt_sma_window);
+    printf("Baro diff window: %ld\n", est->baro_diff_window);
+    printf("Baro vel SMA window: %ld\n", est->baro_vel_sma_window);
 
     printf("\nChecksum: %08lx\n", config->checksum);
     printf("========================\n");
 }
 
+// Element i of an estimator array, from a key like est_q_vars_1_<i>
+static float* estimator_element(EstimatorConfig* est, const char* key) {
+    const struct {
+        const char* prefix;
+        float* values;
+        size_t len;
+    } arrays[] = {
+        {"est_q_vars_1_", est->q_vars_1, ESTIMATOR_NUM_STATES},
+        {"est_q_vars_2_", est->q_vars_2, ESTIMATOR_NUM_STATES},
+        {"est_r_diag_1_", est->r_diag_1, ESTIMATOR_NUM_KIN_MEAS},
+        {"est_r_diag_2_", est->r_diag_2, ESTIMATOR_NUM_KIN_MEAS},
+    };
+
+    for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++) {
+        size_t prefix_len = strlen(arrays[a].prefix);
+        if (strncmp(key, arrays[a].prefix, prefix_len) != 0) {
+            continue;
+        }
+        char* end;
+        unsigned long i = strtoul(key + prefix_len, &end, 10);
+        if (end == key + prefix_len || *end != '\0' || i >= arrays[a].len) {
+            return NULL;
+        }
+        return &arrays[a].values[i];
+    }
+    return NULL;
+}
+
 Status config_set_value(const char* key, void* value, int is_float) {
     BoardConfig* config = config_get_ptr();
 
     if (config == NULL) {
         return STATUS_ERROR;
     }
+    const EstimatorConfig old_estimator = config->estimator;
+    float* est_element = NULL;
 
     float val_f;
     uint32_t val_u32;
@@ -264,6 +352,14 @@ Status config_set_value(const char* key, void* value, int is_float) {
         config->sensor_loop_period_ms = val_u32;
     } else if (strcmp(key, "storage_loop_period_ms") == 0) {
         config->storage_loop_period_ms = val_u32;
+    } else if (strcmp(key, "storage_sensor_blocks") == 0) {
+        config->storage_sensor_blocks = val_u32;
+    } else if (strcmp(key, "storage_prealloc_mb") == 0) {
+        config->storage_prealloc_mb = val_u32;
+    } else if (strcmp(key, "storage_sync_kb") == 0) {
+        config->storage_sync_kb = val_u32;
+    } else if (strcmp(key, "storage_idle_sync_ms") == 0) {
+        config->storage_idle_sync_ms = val_u32;
     } else if (strcmp(key, "gps_loop_period_ms") == 0) {
         config->gps_loop_period_ms = val_u32;
     } else if (strcmp(key, "pspcom_rx_loop_period_ms") == 0) {
@@ -308,6 +404,8 @@ Status config_set_value(const char* key, void* value, int is_float) {
         config->stage_min_sep_angle_deg = val_f;
     } else if (strcmp(key, "stage_max_sep_angle_deg") == 0) {
         config->stage_max_sep_angle_deg = val_f;
+    } else if (strcmp(key, "stage_max_sep_tilt_rate_dps") == 0) {
+        config->stage_max_sep_tilt_rate_dps = val_f;
     } else if (strcmp(key, "stage_sep_pyro_channel") == 0) {
         config->stage_sep_pyro_channel = val_u32;
     } else if (strcmp(key, "stage_is_igniter_bool") == 0) {
@@ -326,6 +424,8 @@ Status config_set_value(const char* key, void* value, int is_float) {
         config->stage_min_ignite_angle_deg = val_f;
     } else if (strcmp(key, "stage_max_ignite_angle_deg") == 0) {
         config->stage_max_ignite_angle_deg = val_f;
+    } else if (strcmp(key, "stage_max_ignite_tilt_rate_dps") == 0) {
+        config->stage_max_ignite_tilt_rate_dps = val_f;
     } else if (strcmp(key, "stage_ignite_pyro_channel") == 0) {
         config->stage_ignite_pyro_channel = val_u32;
     } else if (strcmp(key, "main_height_m") == 0) {
@@ -337,9 +437,30 @@ Status config_set_value(const char* key, void* value, int is_float) {
         config->deploy_lockout_ms = val_u32;
     } else if (strcmp(key, "telemetry_frequency_hz") == 0) {
         config->telemetry_frequency_hz = val_u32;
+    } else if (strcmp(key, "telemetry_duty_cycle_pct") == 0) {
+        config->telemetry_duty_cycle_pct = val_f;
+    } else if ((est_element = estimator_element(&config->estimator, key))) {
+        *est_element = val_f;
+    } else if (strcmp(key, "est_pressure_gate_stdevs") == 0) {
+        config->estimator.pressure_gate_stdevs = val_f;
+    } else if (strcmp(key, "est_baro_alt_median_window") == 0) {
+        config->estimator.baro_alt_median_window = val_u32;
+    } else if (strcmp(key, "est_baro_alt_sma_window") == 0) {
+        config->estimator.baro_alt_sma_window = val_u32;
+    } else if (strcmp(key, "est_baro_diff_window") == 0) {
+        config->estimator.baro_diff_window = val_u32;
+    } else if (strcmp(key, "est_baro_vel_sma_window") == 0) {
+        config->estimator.baro_vel_sma_window = val_u32;
     } else {
         return STATUS_ERROR;
     }
+
+    // Estimator settings take effect at the next se_init, so they're checked
+    // now rather than being found bad then
+    if (se_check_config(&config->estimator) != STATUS_OK) {
+        config->estimator = old_estimator;
+        return STATUS_PARAMETER_ERROR;
+    }
     config_commit();
     return STATUS_OK;
 }
\ No newline at end of file
@@ -328,5 +328,6 @@ __attribute__((unused)) static uint32_t GPIO_PIN_TO_MODEPOS[] = {
 #define PIN_RADIO_SCK PIN_PB13
 #define PIN_RADIO_MISO PIN_PC2
 #define PIN_RADIO_MOSI PIN_PC3
+#define PIN_RADIO_DIO0 PIN_PB14
 
 #endif  // BOARD_DARKSTAR_H
\ No newline at end of file
@@ -4,12 +4,16 @@
 #include "backup/backup.h"
 #include "board_config.h"
 #include "fatlog.h"
+#include "instr_queue.h"
 #include "regex.h"
 #include "rtc/rtc.h"
 #include "status.h"
 #include "stm32h7xx_hal.h"
+#include "tasks/control.h"
 #include "tasks/storage.h"
+#include "task_timing.h"
 #include "timer.h"
+#include "usb.h"
 #include "wlcomm.h"
 
 // Help command
@@ -27,7 +31,13 @@ void cmd_help(char *str) {
         "  reformat_storage                      reformat storage\n"
         "  set_frequency [frequency in Hz]       sets the frequency\n"
         "  set_config_value [key] [value]        sets a config value\n"
-        "  get_firmware_spec                     prints the firmware spec\n");
+        "  get_firmware_spec                     prints the firmware spec\n"
+        "  storage_stats                         prints log file sync stats\n"
+        "  task_timing                           prints task latency stats\n"
+        "  queue_stats                           prints queue fill stats\n"
+        "  data_stats                            prints USB data stream stats\n"
+        "  wlcomm_stats                          prints radio link stats\n"
+        "  control_stats                         prints launch replay stats\n");
 }
 // clang-format on
 
@@ -143,6 +153,12 @@ const char *boardConfigDescription =
     "requests (ms)\n"
     "storage_loop_period_ms: Period between file system flushes and pause "
     "checks (ms)\n"
+    "storage_sensor_blocks: Log sensor frames as compressed blocks (0 or 1)\n"
+    "storage_prealloc_mb: Space reserved for each log file when created (MB)\n"
+    "storage_sync_kb: Data written to a log file between syncs, 0 for only "
+    "at launch, apogee, landing and when idle (KB)\n"
+    "storage_idle_sync_ms: Age of unsynced data at which a log file is synced "
+    "when storage is idle, 0 for never (ms)\n"
     "gps_loop_period_ms: Period between GPS polls (ms)\n"
     "pspcom_rx_loop_period_ms: Period for checking incoming telemetry messages "
     "(ms)\n"
@@ -176,6 +192,7 @@ const char *boardConfigDescription =
     "stage_max_sep_altitude_m: Maximum separation altitude (m)\n"
     "stage_min_sep_angle_deg: Minimum angle from vertical for separation (°)\n"
     "stage_max_sep_angle_deg: Maximum angle from vertical for separation (°)\n"
+    "stage_max_sep_tilt_rate_dps: Maximum tilt rate for separation (°/s)\n"
     "stage_sep_pyro_channel: Pyro channel for stage separation\n"
     "\n"
     "STAGE IGNITION SETTINGS\n"
@@ -187,6 +204,7 @@ const char *boardConfigDescription =
     "stage_max_ignite_altitude_m: Maximum altitude for ignition (m)\n"
     "stage_min_ignite_angle_deg: Minimum angle from vertical for ignition (°)\n"
     "stage_max_ignite_angle_deg: Maximum angle from vertical for ignition (°)\n"
+    "stage_max_ignite_tilt_rate_dps: Maximum tilt rate for ignition (°/s)\n"
     "stage_ignite_pyro_channel: Pyro channel for stage ignition\n"
     "\n"
     "RECOVERY SETTINGS\n"
@@ -197,6 +215,8 @@ const char *boardConfigDescription =
     "TELEMETRY SETTINGS\n"
     "telemetry_frequency_hz: Frequency for telemetry transmission/reception "
     "(Hz)\n"
+    "telemetry_duty_cycle_pct: Share of time spent transmitting telemetry "
+    "(%)\n"
     "\n"
     "CHECKSUM\n"
     "checksum: CRC-32 checksum for config verification\n";
@@ -207,4 +227,24 @@ void cmd_get_firmware_spec(char *str) {
     printf("Firmware spec: %s\n", FIRMWARE_SPECIFIER);
 }
 
+// Print storage flush stats command
+char regex_storage_stats[] = "^storage_stats[\n]*$";
+void cmd_storage_stats(char *str) { storage_print_stats(); }
+
+// Print task timing command
+char regex_task_timing[] = "^task_timing[\n]*$";
+void cmd_task_timing(char *str) { task_timing_print_all(); }
+
+char regex_queue_stats[] = "^queue_stats[\n]*$";
+void cmd_queue_stats(char *str) { instr_queue_print_all(); }
+
+char regex_data_stats[] = "^data_stats[\n]*$";
+void cmd_data_stats(char *str) { usb_data_print_stats(); }
+
+char regex_wlcomm_stats[] = "^wlcomm_stats[\n]*$";
+void cmd_wlcomm_stats(char *str) { wlcomm_print_stats(); }
+
+char regex_control_stats[] = "^control_stats[\n]*$";
+void cmd_control_stats(char *str) { control_print_stats(); }
+
 #endif  // COMMANDS_H
\ No newline at end of file
@@ -33,6 +33,17 @@ const char *VolumeStr[FF_VOLUMES] = {"MMC", "NAND"};
 
 RAM_D2 static uint8_t rw_buf[512];  // DMA happy buffer
 
+// SDMMC2's DMA only reaches the D2 SRAM (see RAM_D2 in linkerscript.ld)
+#define RAM_D2_START 0x30000000UL
+#define RAM_D2_END (RAM_D2_START + 32 * 1024)
+
+// Buffers in RAM_D2 are transferred in one go, anything else goes through
+// rw_buf a block at a time
+static bool is_dma_buffer(const BYTE *buff) {
+    uintptr_t addr = (uintptr_t)buff;
+    return addr >= RAM_D2_START && addr < RAM_D2_END;
+}
+
 /* MMC/SD command */
 #define CMD0 (0)           /* GO_IDLE_STATE */
 #define CMD1 (1)           /* SEND_OP_COND (MMC) */
@@ -236,6 +247,12 @@ DRESULT disk_read(
     DWORD sect = (DWORD)sector;
 
     if (drv == 0) {
+        if (is_dma_buffer(buff)) {
+            return sdmmc_read_blocks(&s_sd_sdmmc_device, (uint8_t *)buff, sect,
+                                     count) == STATUS_OK
+                       ? RES_OK
+                       : RES_ERROR;
+        }
         while (count--) {
             if (sdmmc_read_blocks(&s_sd_sdmmc_device, (uint8_t *)rw_buf, sect++,
                                   1) != STATUS_OK) {
@@ -275,6 +292,12 @@ DRESULT disk_write(BYTE drv,         /* Physical drive number (0) */
     DWORD sect = (DWORD)sector;
 
     if (drv == 0) {
+        if (is_dma_buffer(buff)) {
+            return sdmmc_write_blocks(&s_sd_sdmmc_device, (uint8_t *)buff,
+                                      sect, count) == STATUS_OK
+                       ? RES_OK
+                       : RES_ERROR;
+        }
         while (count--) {
             memcpy(rw_buf, buff, 512);
             buff += 512;
@@ -17,6 +17,7 @@
 #define FNAME_LEN 64
 #define HEADER_LEN 64
 #define MAXPATH_LEN 256
+#define PREALLOC_JOURNAL MOUNT_POINT "/prealloc.jnl"
 
 static FATFS s_fs;
 
@@ -61,6 +62,257 @@ Status fatlog_close_file(FIL* fp) {
     return STATUS_OK;
 }
 
+// Every open preallocated file has a slot in the journal, holding how much of
+// it was synced. Its directory entry keeps the preallocated size until it's
+// closed, so if it never is, the next mount trims it back to that.
+typedef struct {
+    char fname[FNAME_LEN];
+    FSIZE_t size;
+} PreallocSlot;
+
+static PreallocSlot s_prealloc_slots[FATLOG_MAX_PREALLOC];
+static FIL s_prealloc_journal;
+static int s_prealloc_open = 0;
+
+static Status journal_write_slot(int slot) {
+    UINT bw;
+    if (f_lseek(&s_prealloc_journal, slot * sizeof(PreallocSlot)) != FR_OK ||
+        f_write(&s_prealloc_journal, &s_prealloc_slots[slot],
+                sizeof(PreallocSlot), &bw) != FR_OK ||
+        bw != sizeof(PreallocSlot) || f_sync(&s_prealloc_journal) != FR_OK) {
+        return STATUS_HARDWARE_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+// A slot only counts as taken once it's been written
+static Status journal_take_slot(const char* fname, int* slot) {
+    *slot = -1;
+    if (strlen(fname) >= FNAME_LEN) {
+        return STATUS_PARAMETER_ERROR;
+    }
+
+    int free_slot = 0;
+    if (s_prealloc_open == 0) {
+        memset(s_prealloc_slots, 0, sizeof(s_prealloc_slots));
+        if (f_open(&s_prealloc_journal, PREALLOC_JOURNAL,
+                   FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+            return STATUS_HARDWARE_ERROR;
+        }
+    } else {
+        while (free_slot < FATLOG_MAX_PREALLOC &&
+               s_prealloc_slots[free_slot].fname[0] != '\0') {
+            free_slot++;
+        }
+        if (free_slot == FATLOG_MAX_PREALLOC) {
+            return STATUS_PARAMETER_ERROR;
+        }
+    }
+
+    strcpy(s_prealloc_slots[free_slot].fname, fname);
+    s_prealloc_slots[free_slot].size = 0;
+    Status status = journal_write_slot(free_slot);
+    if (status != STATUS_OK) {
+        memset(&s_prealloc_slots[free_slot], 0, sizeof(PreallocSlot));
+        if (s_prealloc_open == 0) {
+            f_close(&s_prealloc_journal);
+            f_unlink(PREALLOC_JOURNAL);
+        }
+        return status;
+    }
+
+    s_prealloc_open++;
+    *slot = free_slot;
+    return STATUS_OK;
+}
+
+static Status journal_free_slot(int slot) {
+    if (slot < 0 || slot >= FATLOG_MAX_PREALLOC || s_prealloc_open == 0) {
+        return STATUS_PARAMETER_ERROR;
+    }
+
+    memset(&s_prealloc_slots[slot], 0, sizeof(PreallocSlot));
+    s_prealloc_open--;
+    if (s_prealloc_open > 0) {
+        return journal_write_slot(slot);
+    }
+
+    // Nothing left to trim
+    if (f_close(&s_prealloc_journal) != FR_OK ||
+        f_unlink(PREALLOC_JOURNAL) != FR_OK) {
+        return STATUS_HARDWARE_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+// Trim the files that were still open when the journal was last written
+static Status journal_recover() {
+    // Mounting drops whatever was open
+    s_prealloc_open = 0;
+
+    FIL journal;
+    FRESULT res = f_open(&journal, PREALLOC_JOURNAL, FA_OPEN_EXISTING | FA_READ);
+    if (res == FR_NO_FILE) {
+        return STATUS_OK;
+    } else if (res != FR_OK) {
+        return STATUS_HARDWARE_ERROR;
+    }
+
+    PreallocSlot slot;
+    UINT br;
+    while (f_read(&journal, &slot, sizeof(slot), &br) == FR_OK &&
+           br == sizeof(slot)) {
+        if (slot.fname[0] == '\0') {
+            continue;
+        }
+        slot.fname[FNAME_LEN - 1] = '\0';
+
+        // Seeking past the end would grow it instead
+        char path[MAXPATH_LEN];
+        snprintf(path, MAXPATH_LEN, MOUNT_POINT "%s", slot.fname);
+        FIL fp;
+        if (f_open(&fp, path, FA_OPEN_EXISTING | FA_WRITE) != FR_OK) {
+            continue;
+        }
+        if (slot.size < f_size(&fp) && f_lseek(&fp, slot.size) == FR_OK &&
+            f_truncate(&fp) == FR_OK) {
+            PAL_LOGW("Trimmed %s to %lu bytes\n", slot.fname,
+                     (unsigned long)slot.size);
+        }
+        f_close(&fp);
+    }
+
+    if (f_close(&journal) != FR_OK || f_unlink(PREALLOC_JOURNAL) != FR_OK) {
+        return STATUS_HARDWARE_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+// Give up on a file that couldn't be set up, leaving nothing preallocated
+static void prealloc_abort(FatlogFile* file) {
+    f_truncate(&file->fp);
+    f_close(&file->fp);
+    file->fp.obj.fs = NULL;
+    if (file->slot >= 0) {
+        journal_free_slot(file->slot);
+        file->slot = -1;
+    }
+}
+
+Status fatlog_open_prealloc(FatlogFile* file, const char* fname,
+                            FSIZE_t prealloc_bytes) {
+    file->chunk_len = 0;
+    file->unsynced_bytes = 0;
+    file->slot = -1;
+    ASSERT_OK(fatlog_open_file_for_write(&file->fp, fname), "file open");
+
+    // In the journal before it's expanded, so that it's never left at the
+    // preallocated size without a record of what to trim it to
+    Status status = journal_take_slot(fname, &file->slot);
+    if (status != STATUS_OK) {
+        prealloc_abort(file);
+        ASSERT_OK(status, "prealloc journal");
+    }
+    if (prealloc_bytes > 0 && f_expand(&file->fp, prealloc_bytes, 1) != FR_OK) {
+        PAL_LOGW("No contiguous space to preallocate %s\n", fname);
+    }
+    if (f_sync(&file->fp) != FR_OK) {
+        prealloc_abort(file);
+        return STATUS_HARDWARE_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+static Status write_chunk(FatlogFile* file) {
+    UINT bw;
+    if (f_write(&file->fp, file->chunk, file->chunk_len, &bw) != FR_OK ||
+        bw != file->chunk_len) {
+        return STATUS_HARDWARE_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+Status fatlog_write_prealloc(FatlogFile* file, const uint8_t* data,
+                             size_t size) {
+    if (data == NULL || file->fp.obj.fs == NULL) {
+        return STATUS_ERROR;
+    }
+
+    while (size > 0) {
+        size_t n = FATLOG_CHUNK_LEN - file->chunk_len;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(file->chunk + file->chunk_len, data, n);
+        file->chunk_len += n;
+        file->unsynced_bytes += n;
+        data += n;
+        size -= n;
+
+        // Full chunks start on a sector boundary, so FatFs writes them
+        // straight from the chunk without a read-modify-write
+        if (file->chunk_len == FATLOG_CHUNK_LEN) {
+            ASSERT_OK(write_chunk(file), "chunk write");
+            file->chunk_len = 0;
+        }
+    }
+
+    return STATUS_OK;
+}
+
+Status fatlog_sync_prealloc(FatlogFile* file) {
+    if (file->fp.obj.fs == NULL) {
+        return STATUS_ERROR;
+    }
+
+    // Write out the partial chunk, but keep it so that it's written again as
+    // a whole when it fills up
+    if (file->chunk_len > 0) {
+        ASSERT_OK(write_chunk(file), "chunk write");
+    }
+    if (f_sync(&file->fp) != FR_OK) {
+        return STATUS_HARDWARE_ERROR;
+    }
+
+    // Only once the data is durable, so the journal never covers more
+    s_prealloc_slots[file->slot].size = file->fp.fptr;
+    ASSERT_OK(journal_write_slot(file->slot), "prealloc journal");
+
+    if (file->chunk_len > 0 &&
+        f_lseek(&file->fp, file->fp.fptr - file->chunk_len) != FR_OK) {
+        return STATUS_HARDWARE_ERROR;
+    }
+    file->unsynced_bytes = 0;
+
+    return STATUS_OK;
+}
+
+Status fatlog_close_prealloc(FatlogFile* file) {
+    if (file->fp.obj.fs == NULL) {
+        return STATUS_ERROR;
+    }
+
+    if (file->chunk_len > 0) {
+        ASSERT_OK(write_chunk(file), "chunk write");
+        file->chunk_len = 0;
+    }
+
+    // Give back the space past the end of the data
+    if (f_truncate(&file->fp) != FR_OK) {
+        return STATUS_HARDWARE_ERROR;
+    }
+    ASSERT_OK(fatlog_close_file(&file->fp), "file close");
+
+    int slot = file->slot;
+    file->slot = -1;
+    return journal_free_slot(slot);
+}
+
 Status fatlog_write_data(FIL* fp, uint8_t* data, size_t size) {
     // Check if data pointer is valid
     if (data == NULL) {
@@ -133,6 +385,7 @@ Status fatlog_init() {
 #endif
         return STATUS_HARDWARE_ERROR;
     }
+    EXPECT_OK(journal_recover(), "prealloc journal");
 
     // Get free space
     uint64_t total_bytes;
@@ -237,7 +490,7 @@ Status fatlog_reinit() {
         return STATUS_HARDWARE_ERROR;
     }
 
-    return STATUS_OK;
+    return journal_recover();
 }
 
 Status fatlog_deinit() {
@@ -7,6 +7,23 @@
 #include "sensor.pb.h"
 #include "state.pb.h"
 
+// Preallocated files are written in chunks of whole sectors
+#define FATLOG_CHUNK_LEN (8 * FF_MAX_SS)
+
+// Preallocated files that can be open at once
+#define FATLOG_MAX_PREALLOC 4
+
+// Log file whose clusters are allocated up front, so that writing it doesn't
+// touch the FAT or the allocation bitmap. Until it's closed, its size on disk
+// is the preallocated size, and a journal holds how much of it was synced.
+typedef struct {
+    FIL fp;
+    int slot;  // In the journal, -1 if none
+    uint8_t chunk[FATLOG_CHUNK_LEN];
+    size_t chunk_len;
+    uint32_t unsynced_bytes;  // Written since the last sync
+} FatlogFile;
+
 Status fatlog_init();
 
 Status fatlog_reinit();
@@ -25,6 +42,32 @@ Status fatlog_open_file_for_read(FIL* fp, const char* fname);
 
 Status fatlog_close_file(FIL* fp);
 
+/**
+ * @brief Create a file, and allocate prealloc_bytes of contiguous space to it
+ *
+ * If there isn't enough contiguous space, the file grows as it's written
+ * instead. At most FATLOG_MAX_PREALLOC can be open at once.
+ */
+Status fatlog_open_prealloc(FatlogFile* file, const char* fname,
+                            FSIZE_t prealloc_bytes);
+
+Status fatlog_write_prealloc(FatlogFile* file, const uint8_t* data,
+                             size_t size);
+
+/**
+ * @brief Make everything written so far durable
+ *
+ * The bytes written are recorded in the journal, so that if the file is never
+ * closed, the next mount trims it back to them instead of leaving it ending
+ * in whatever the preallocated space held before
+ */
+Status fatlog_sync_prealloc(FatlogFile* file);
+
+/**
+ * @brief Write out any remaining data, and free the unused preallocation
+ */
+Status fatlog_close_prealloc(FatlogFile* file);
+
 Status fatlog_mkdir(const char* fname);
 
 char** fatlog_get_file_list(const char* path, size_t* num_files);
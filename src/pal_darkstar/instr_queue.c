@@ -0,0 +1,88 @@
+#include "instr_queue.h"
+
+#include <stdio.h>
+
+#include "status.h"
+#include "timer.h"
+
+QueueHandle_t instr_queue_create(InstrQueue* queue, const char* name,
+                                 UBaseType_t length, UBaseType_t item_size) {
+    uint32_t* stamps_us = pvPortMalloc(length * sizeof(uint32_t));
+    if (stamps_us == NULL) {
+        queue->handle = NULL;
+        return NULL;
+    }
+
+    queue->handle = xQueueCreate(length, item_size);
+    if (queue->handle == NULL) {
+        vPortFree(stamps_us);
+        return NULL;
+    }
+
+    queue_stats_init(&queue->stats, name, length, stamps_us, MICROS());
+    return queue->handle;
+}
+
+BaseType_t instr_queue_send(InstrQueue* queue, const void* item,
+                            TickType_t wait_ticks) {
+    BaseType_t ret = xQueueSend(queue->handle, item, wait_ticks);
+
+    // Senders and receivers may be in different tasks
+    taskENTER_CRITICAL();
+    if (ret == pdPASS) {
+        queue_stats_sent(&queue->stats, MICROS());
+    } else {
+        queue_stats_dropped(&queue->stats);
+    }
+    taskEXIT_CRITICAL();
+
+    return ret;
+}
+
+void instr_queue_overwrite(InstrQueue* queue, const void* item) {
+    // Check and overwrite together, so the receiver can't get in between
+    taskENTER_CRITICAL();
+    bool full = uxQueueMessagesWaiting(queue->handle) > 0;
+    xQueueOverwrite(queue->handle, item);
+    if (full) {
+        queue_stats_overwritten(&queue->stats, MICROS());
+    } else {
+        queue_stats_sent(&queue->stats, MICROS());
+    }
+    taskEXIT_CRITICAL();
+}
+
+BaseType_t instr_queue_receive(InstrQueue* queue, void* item,
+                               TickType_t wait_ticks) {
+    BaseType_t ret = xQueueReceive(queue->handle, item, wait_ticks);
+
+    if (ret == pdPASS) {
+        taskENTER_CRITICAL();
+        queue_stats_received(&queue->stats, MICROS());
+        taskEXIT_CRITICAL();
+    }
+
+    return ret;
+}
+
+void instr_queue_print_all() {
+    char buf[QUEUE_STATS_FORMAT_LEN];
+    for (size_t i = 0; queue_stats_get(i) != NULL; i++) {
+        taskENTER_CRITICAL();
+        queue_stats_format(queue_stats_get(i), MICROS(), buf, sizeof(buf));
+        taskEXIT_CRITICAL();
+        printf("%s", buf);
+    }
+}
+
+void instr_queue_log_drops() {
+    for (size_t i = 0; queue_stats_get(i) != NULL; i++) {
+        QueueStats* stats = queue_stats_get(i);
+        taskENTER_CRITICAL();
+        uint32_t drops = queue_stats_new_drops(stats);
+        taskEXIT_CRITICAL();
+        if (drops) {
+            PAL_LOGW("%lu overflows in %s queue\n", drops, stats->name);
+        }
+    }
+}
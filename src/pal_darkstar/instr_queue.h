@@ -0,0 +1,47 @@
+#ifndef INSTR_QUEUE_H
+#define INSTR_QUEUE_H
+
+#include "queue_stats.h"
+
+// FreeRTOS
+#include "FreeRTOS.h"
+#include "queue.h"
+
+// FreeRTOS queue that keeps track of its occupancy. All sends and receives
+// must go through these functions for the statistics to add up.
+typedef struct {
+    QueueHandle_t handle;
+    QueueStats stats;
+} InstrQueue;
+
+/**
+ * @brief Create the queue, and register its statistics
+ *
+ * @return The FreeRTOS queue, e.g. for adding to a queue set, or NULL if it
+ * couldn't be created
+ */
+QueueHandle_t instr_queue_create(InstrQueue* queue, const char* name,
+                                 UBaseType_t length, UBaseType_t item_size);
+
+BaseType_t instr_queue_send(InstrQueue* queue, const void* item,
+                            TickType_t wait_ticks);
+
+/**
+ * @brief Like xQueueOverwrite, for queues of length 1
+ */
+void instr_queue_overwrite(InstrQueue* queue, const void* item);
+
+BaseType_t instr_queue_receive(InstrQueue* queue, void* item,
+                               TickType_t wait_ticks);
+
+/**
+ * @brief Print the statistics of every queue
+ */
+void instr_queue_print_all();
+
+/**
+ * @brief Log a warning for each queue that dropped sends since the last call
+ */
+void instr_queue_log_drops();
+
+#endif  // INSTR_QUEUE_H
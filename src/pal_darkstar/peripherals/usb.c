@@ -9,17 +9,47 @@
 #include "button_event.h"
 #include "commands.h"
 #include "fifos.h"
+#include "frame_encode.h"
 #include "gpio/gpio.h"
 #include "main.h"
+#include "pb_create.h"
 #include "rtc/rtc.h"
+#include "semphr.h"
+#include "task.h"
 #include "tasks/storage.h"
 #include "terminal/terminal.h"
 #include "timer.h"
 #include "tusb.h"
 
+// How long the USB task waits for events before checking for commands
+#define USB_POLL_PERIOD_MS 10
+
+// Longest command output waits for the host to make room for it
+#define USB_WRITE_TIMEOUT_MS 100
+
 static bool s_usb_initialized = false;
 static uint32_t s_usb_initialized_time = 0;
 
+// Terminal commands run in the USB task, outside of tud_task
+static TaskHandle_t s_usb_task = NULL;
+static bool s_running_cmds = false;
+static char s_rx_buf[CFG_TUD_CDC_RX_BUFSIZE];
+
+// Commands can arrive over several reads, so they're put together here until
+// the end of the line. A line too long to fit is dropped.
+static char s_line_buf[CFG_TUD_CDC_RX_BUFSIZE + 1];
+static size_t s_line_len = 0;
+static bool s_line_overflow = false;
+
+// Writers to the data interface take turns, so that records don't get mixed
+// up, and wait on s_data_sent when the TX FIFO is full
+static StaticSemaphore_t s_data_lock_buf;
+static SemaphoreHandle_t s_data_lock;
+static StaticSemaphore_t s_data_sent_buf;
+static SemaphoreHandle_t s_data_sent;
+static uint32_t s_data_records = 0;
+static uint32_t s_data_drops = 0;
+
 #ifdef DEBUG
 static uint8_t s_usb_serial_buffer[CFG_TUD_CDC_TX_BUFSIZE];
 static FIFO_t s_usb_serial_fifo = {
@@ -35,6 +65,9 @@ uint8_t ser_out_buf[CFG_TUD_CDC_TX_BUFSIZE];
 #endif
 
 Status usb_init() {
+    s_data_lock = xSemaphoreCreateMutexStatic(&s_data_lock_buf);
+    s_data_sent = xSemaphoreCreateBinaryStatic(&s_data_sent_buf);
+
 #ifdef DEBUG
     // Low level Init
     __HAL_RCC_USB1_OTG_HS_CLK_ENABLE();
@@ -54,11 +87,42 @@ Status usb_init() {
     terminal_add_cmd(regex_set_frequency, cmd_set_frequency);
     terminal_add_cmd(regex_set_config_value, cmd_set_config_value);
     terminal_add_cmd(regex_get_firmware_spec, cmd_get_firmware_spec);
+    terminal_add_cmd(regex_storage_stats, cmd_storage_stats);
+    terminal_add_cmd(regex_task_timing, cmd_task_timing);
+    terminal_add_cmd(regex_queue_stats, cmd_queue_stats);
+    terminal_add_cmd(regex_data_stats, cmd_data_stats);
+    terminal_add_cmd(regex_wlcomm_stats, cmd_wlcomm_stats);
+    terminal_add_cmd(regex_control_stats, cmd_control_stats);
 #endif
 
     return STATUS_OK;
 }
 
+#ifdef DEBUG
+// Output of terminal commands is streamed through the CDC TX FIFO, running
+// the USB stack whenever it fills up rather than dropping the rest. Anything
+// else is only written if there's room, as it may be called from tud_task.
+static void usb_cdc_write(const char *data, uint32_t len) {
+    uint32_t written = tud_cdc_write(data, len);
+    if (!s_running_cmds || xTaskGetCurrentTaskHandle() != s_usb_task) {
+        return;
+    }
+
+    uint64_t last_write_ms = MILLIS();
+    while (written < len && tud_cdc_connected() &&
+           MILLIS() - last_write_ms < USB_WRITE_TIMEOUT_MS) {
+        tud_cdc_write_flush();
+        tud_task_ext(1, false);
+
+        uint32_t n = tud_cdc_write(data + written, len - written);
+        if (n > 0) {
+            written += n;
+            last_write_ms = MILLIS();
+        }
+    }
+}
+#endif
+
 // Serial debug stuff -- used by printf
 int _write(int file, char *data, int len) {
     if ((file != STDOUT_FILENO) && (file != STDERR_FILENO) &&
@@ -96,30 +160,133 @@ int _write(int file, char *data, int len) {
         // If the USB is initialized, write the data to the USB interface.
         int new_len = s_usb_serial_fifo.count;
         fifo_dequeuen(&s_usb_serial_fifo, ser_out_buf, new_len);
-        tud_cdc_write(ser_out_buf, new_len);
+        usb_cdc_write((char *)ser_out_buf, new_len);
 
         // Send data
-        tud_cdc_write(data, len);
+        usb_cdc_write(data, len);
     }
 #endif
     return len;
 }
 
-void tud_cdc_rx_cb(uint8_t itf) {
-    int len = tud_cdc_available();
+void tud_cdc_tx_complete_cb(uint8_t itf) {
+    if (itf == USB_DATA_ITF) {
+        xSemaphoreGive(s_data_sent);
+    }
+}
 
-    // char str[*len + 1];
-    char *str = malloc(len + 1);
-    tud_cdc_read(str, len);
-    str[len] = '\0';
+Status usb_data_write(const uint8_t *data, uint32_t len, uint32_t timeout_ms) {
+    if (!tud_cdc_n_connected(USB_DATA_ITF)) {
+        return STATUS_STATE_ERROR;
+    }
+    if (len > CFG_TUD_CDC_TX_BUFSIZE) {
+        return STATUS_PARAMETER_ERROR;
+    }
+    if (xTaskGetCurrentTaskHandle() == s_usb_task) {
+        timeout_ms = 0;
+    }
+
+    uint64_t start_ms = MILLIS();
+    if (xSemaphoreTake(s_data_lock, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        s_data_drops++;
+        return STATUS_BUSY;
+    }
+
+    while (tud_cdc_n_write_available(USB_DATA_ITF) < len) {
+        uint32_t waited_ms = MILLIS() - start_ms;
+        if (waited_ms >= timeout_ms) {
+            s_data_drops++;
+            xSemaphoreGive(s_data_lock);
+            return STATUS_BUSY;
+        }
+
+        // Make sure what's there is on its way, and wait for it to go
+        tud_cdc_n_write_flush(USB_DATA_ITF);
+        xSemaphoreTake(s_data_sent, pdMS_TO_TICKS(timeout_ms - waited_ms));
+    }
 
-    terminal_process(str);
+    tud_cdc_n_write(USB_DATA_ITF, data, len);
+    s_data_records++;
+    xSemaphoreGive(s_data_lock);
 
-    free(str);
+    return STATUS_OK;
+}
+
+void usb_stream_sensors(const SensorFrame *frame) {
+    if (!tud_cdc_n_connected(USB_DATA_ITF)) {
+        return;
+    }
+
+    uint8_t buf[1 + FRAME_ENCODE_SENSOR_MAX_LEN];
+    buf[0] = USB_DATA_SENSOR;
+    size_t len = 1 + frame_encode_sensor(frame, buf + 1);
+    usb_data_write(buf, len, 0);
+}
+
+void usb_stream_state(const StateFrame *frame) {
+    if (!tud_cdc_n_connected(USB_DATA_ITF)) {
+        return;
+    }
+
+    uint8_t buf[1 + FRAME_ENCODE_STATE_MAX_LEN];
+    buf[0] = USB_DATA_STATE;
+    size_t len = 1 + frame_encode_state(frame, buf + 1);
+    usb_data_write(buf, len, 0);
+}
+
+void usb_stream_gps(const GpsFrame *frame) {
+    if (!tud_cdc_n_connected(USB_DATA_ITF)) {
+        return;
+    }
+
+    uint8_t buf[1 + GPS_BUF_LEN];
+    buf[0] = USB_DATA_GPS;
+    pb_ostream_t ostream = pb_ostream_from_buffer(buf + 1, GPS_BUF_LEN);
+    if (!pb_encode_ex(&ostream, &GpsFrame_msg, frame, PB_ENCODE_DELIMITED)) {
+        return;
+    }
+    usb_data_write(buf, 1 + ostream.bytes_written, 0);
+}
+
+void usb_data_print_stats() {
+    printf("USB data: %s, %lu records sent, %lu dropped\n",
+           tud_cdc_n_connected(USB_DATA_ITF) ? "open" : "closed",
+           s_data_records, s_data_drops);
+}
+
+static void usb_run_cmds() {
+    if (tud_cdc_available() == 0) {
+        return;
+    }
+
+    uint32_t len = tud_cdc_read(s_rx_buf, sizeof(s_rx_buf));
+
+    s_running_cmds = true;
+    for (uint32_t i = 0; i < len; i++) {
+        char c = s_rx_buf[i];
+        if (c != '\r' && c != '\n') {
+            if (s_line_len < sizeof(s_line_buf) - 1) {
+                s_line_buf[s_line_len++] = c;
+            } else {
+                s_line_overflow = true;
+            }
+            continue;
+        }
+
+        // End of the line; anything left over waits for the next read
+        if (s_line_len > 0 && !s_line_overflow) {
+            s_line_buf[s_line_len] = '\0';
+            terminal_process(s_line_buf);
+        }
+        s_line_len = 0;
+        s_line_overflow = false;
+    }
+    s_running_cmds = false;
 }
 
 void task_usb(void *param) {
     (void)param;
+    s_usb_task = xTaskGetCurrentTaskHandle();
 
     // Configure DM DP Pins
     GPIO_InitTypeDef GPIO_InitStruct = {0};
@@ -145,11 +312,14 @@ void task_usb(void *param) {
 
     // RTOS forever loop
     while (1) {
-        // put this thread to waiting state until there is new events
-        tud_task();
+        // put this thread to waiting state until there is new events, waking
+        // up regularly to run any commands that came in
+        tud_task_ext(USB_POLL_PERIOD_MS, false);
+
+        usb_run_cmds();
 
-        // following code only run if tud_task() process at least 1 event
         tud_cdc_write_flush();
+        tud_cdc_n_write_flush(USB_DATA_ITF);
     }
 }
 
@@ -4,12 +4,48 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "gps.pb.h"
+#include "sensor.pb.h"
+#include "state.pb.h"
 #include "status.h"
 
+// The second CDC interface carries binary data rather than the terminal
+#define USB_DATA_ITF 1
+
+// Each record on the data interface is one of these, then the frame as a
+// length-delimited protobuf, the same as in the log files
+typedef enum {
+    USB_DATA_SENSOR = 1,
+    USB_DATA_STATE = 2,
+    USB_DATA_GPS = 3,
+} UsbDataType;
+
 Status usb_init();
 
 void task_usb(void *param);
 
+/**
+ * @brief Queue a record on the data interface, all of it or none of it
+ *
+ * Waits up to timeout_ms for the host to make room for it. Calls from the USB
+ * task don't wait, as the USB task is what makes room.
+ *
+ * @return STATUS_BUSY if there wasn't room in time, STATUS_STATE_ERROR if no
+ * host has the interface open
+ */
+Status usb_data_write(const uint8_t *data, uint32_t len, uint32_t timeout_ms);
+
+// Send frames live to a host that has the data interface open. They're
+// dropped rather than waited for if the host falls behind.
+void usb_stream_sensors(const SensorFrame *frame);
+void usb_stream_state(const StateFrame *frame);
+void usb_stream_gps(const GpsFrame *frame);
+
+/**
+ * @brief Print how many records were sent and dropped on the data interface
+ */
+void usb_data_print_stats();
+
 extern int _write(int file, char *data, int len);
 
 #endif  // USB_H
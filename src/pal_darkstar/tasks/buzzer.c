@@ -2,12 +2,13 @@
 
 #include "FreeRTOS.h"
 #include "board.h"
+#include "instr_queue.h"
 #include "queue.h"
 #include "stdio.h"
 #include "stm32h7xx_hal.h"
 #include "timer.h"
 
-QueueHandle_t buzzer_queue;
+InstrQueue buzzer_queue;
 
 TIM_HandleTypeDef tim1_handle = {0};
 
@@ -56,8 +57,9 @@ Status buzzer_init() {
     HAL_TIM_OC_ConfigChannel(&tim1_handle, &tim1_oc_conf, TIM_CHANNEL_1);
 
     // Configure queue
-    buzzer_queue = xQueueCreate(BUZZER_QUEUE_LEN, sizeof(BuzzerSound));
-    configASSERT(buzzer_queue);
+    instr_queue_create(&buzzer_queue, "buzzer", BUZZER_QUEUE_LEN,
+                       sizeof(BuzzerSound));
+    configASSERT(buzzer_queue.handle);
 
     return STATUS_OK;
 }
@@ -214,14 +216,15 @@ void buzzer_play(BuzzerSound sound) {
         buzzer_init();
     }
 
-    xQueueSend(buzzer_queue, &sound, 0);
+    instr_queue_send(&buzzer_queue, &sound, 0);
 }
 
 void task_buzzer() {
     BuzzerSound sound;
 
     while (1) {
-        if (xQueueReceive(buzzer_queue, &sound, portMAX_DELAY) != pdPASS) {
+        if (instr_queue_receive(&buzzer_queue, &sound, portMAX_DELAY) !=
+            pdPASS) {
             continue;
         }
         switch (sound) {
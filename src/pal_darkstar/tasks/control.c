@@ -1,17 +1,21 @@
 #include "control.h"
 
 #include <math.h>
+#include <stdio.h>
 
 #include "board.h"
 #include "board_config.h"
 #include "flight_control.h"
 #include "gpio/gpio.h"
+#include "instr_queue.h"
 #include "sensors.h"
 #include "state.pb.h"
 #include "state_estimation.h"
 #include "storage.h"
+#include "task_timing.h"
 #include "telem.h"
 #include "timer.h"
+#include "usb.h"
 
 // FreeRTOS
 #include "FreeRTOS.h"
@@ -20,10 +24,16 @@
 /********************/
 /* STATIC VARIABLES */
 /********************/
-static QueueHandle_t s_sensor_queue;
+static InstrQueue s_sensor_queue;
+static InstrQueue s_gps_queue;
+
+// Every frame received since the last iteration
+static SensorFrame s_sensor_frames[CONTROL_SENSOR_QUEUE_LEN];
 
 static BoardConfig* s_config_ptr;
 
+static TaskTiming s_timing;
+
 static SensorFrame s_nan_frame = {
     .timestamp = 0,
 
@@ -59,10 +69,18 @@ Status control_init() {
     ASSERT_OK(se_init(), "failed to init state est\n");
     ASSERT_OK(fp_init(), "failed to init control logic\n");
 
-    // Each iteration of the control loop triggers one sensor read, so there
-    // can't be more than one frame in the queue. The reason to use a queue is
-    // for synchronization guarantees rather than actual buffering.
-    s_sensor_queue = xQueueCreate(1, sizeof(SensorFrame));
+    // Each iteration of the control loop triggers a sensor read, but the
+    // sensors may also produce frames on their own between iterations, so
+    // every frame is queued and the whole backlog handled in one batch
+    instr_queue_create(&s_sensor_queue, "control_sensor",
+                       CONTROL_SENSOR_QUEUE_LEN, sizeof(SensorFrame));
+    configASSERT(s_sensor_queue.handle);
+
+    // GPS fixes are fused after the sensor frames, once the EKF has caught up
+    // to when they were taken
+    instr_queue_create(&s_gps_queue, "control_gps", CONTROL_GPS_QUEUE_LEN,
+                       sizeof(GpsFrame));
+    configASSERT(s_gps_queue.handle);
 
     s_config_ptr = config_get_ptr();
     if (s_config_ptr == NULL) {
@@ -73,42 +91,90 @@ Status control_init() {
 }
 
 Status control_update_sensors(const SensorFrame* sensor_frame) {
-    xQueueOverwrite(s_sensor_queue, sensor_frame);
+    // If the queue is full, the control task has fallen far behind and the
+    // newest frame is dropped (and counted)
+    if (instr_queue_send(&s_sensor_queue, sensor_frame, 0) != pdPASS) {
+        return STATUS_BUSY;
+    }
+    return STATUS_OK;
+}
+
+Status control_update_gps(const GpsFrame* gps_frame) {
+    if (instr_queue_send(&s_gps_queue, gps_frame, 0) != pdPASS) {
+        return STATUS_BUSY;
+    }
     return STATUS_OK;
 }
 
+void control_print_stats() {
+    const LaunchReplayStats* stats = fp_launch_replay_stats();
+    printf("Launch replay: %lu frames, %lu dropped, caught up in %lu us\n",
+           stats->frames, stats->dropped, stats->catchup_us);
+}
+
 void task_control(TaskHandle_t* handle_ptr) {
     TickType_t last_iteration_start_tick = xTaskGetTickCount();
+    task_timing_init(&s_timing, "control",
+                     s_config_ptr->control_loop_period_ms * 1000);
 
     while (1) {
-        SensorFrame sensor_frame;
+        task_timing_begin_periodic(&s_timing, MICROS());
+
         Status update_status;
 
-        // Check if we have sensor data available without waiting
-        if (xQueueReceive(s_sensor_queue, &sensor_frame, 0) != pdPASS) {
+        // Take every frame that's available without waiting
+        size_t num_frames = 0;
+        while (num_frames < CONTROL_SENSOR_QUEUE_LEN &&
+               instr_queue_receive(&s_sensor_queue,
+                                   &s_sensor_frames[num_frames],
+                                   0) == pdPASS) {
+            num_frames++;
+        }
+
+        if (num_frames == 0) {
             // If we didn't have new data available, send the NAN frame
             // but with an updated timestamp so that state estimation
             // can correctly compute the dt from adjacent iterations
             s_nan_frame.timestamp = MICROS();
             update_status = fp_update(&s_nan_frame);
         } else {
-            // Otherwise just forward the frame as is
-            update_status = fp_update(&sensor_frame);
+            // Otherwise integrate all of them, and update the EKF once
+            update_status = fp_update_batch(s_sensor_frames, num_frames);
+        }
+
+        // Then any GPS fix that's come in
+        GpsFrame gps_frame;
+        while (instr_queue_receive(&s_gps_queue, &gps_frame, 0) == pdPASS) {
+            se_update_gps(fp_get(), &gps_frame);
         }
 
         // Trigger sensor read for next iteration
         sensors_start_read();
 
+        // States replayed at launch were held back while it was detected,
+        // so they go out before this cycle's
+        const StateFrame* replay_states;
+        size_t num_replay_states = fp_take_replay_states(&replay_states);
+        for (size_t i = 0; i < num_replay_states; i++) {
+            StateFrame state_frame = replay_states[i];
+            state_frame.gentimestamp = MICROS();
+            storage_queue_state(&state_frame);
+            usb_stream_state(&state_frame);
+        }
+
         // Store the state only if update returned OK
         if (update_status == STATUS_OK) {
             StateFrame state_frame = se_as_frame();
             state_frame.gentimestamp = MICROS();
             storage_queue_state(&state_frame);
+            telem_update_state(&state_frame);
+            usb_stream_state(&state_frame);
         }
 
         // Get new state and send state updates where required
         FlightPhase flight_phase = fp_get();
         telem_update_fp(flight_phase);
+        storage_update_fp(flight_phase);
 
         // Yellow LED is solid when READY, strobing when in flight
         if (flight_phase == FP_READY) {
@@ -145,6 +211,7 @@ void task_control(TaskHandle_t* handle_ptr) {
             storage_start(STORAGE_PAUSE_BRK);
         }
 
+        task_timing_end(&s_timing, MICROS());
         vTaskDelayUntil(&last_iteration_start_tick,
                         pdMS_TO_TICKS(s_config_ptr->control_loop_period_ms));
     }
@@ -1,6 +1,7 @@
 #ifndef CONTROL_H
 #define CONTROL_H
 
+#include "gps.pb.h"
 #include "sensor.pb.h"
 #include "status.h"
 
@@ -8,10 +9,23 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
+// Sensor frames that can wait for the control task
+#define CONTROL_SENSOR_QUEUE_LEN 8
+
+// GPS fixes that can wait for the control task
+#define CONTROL_GPS_QUEUE_LEN 2
+
 Status control_init();
 
 Status control_update_sensors(const SensorFrame* sensor_frame);
 
+Status control_update_gps(const GpsFrame* gps_frame);
+
+/**
+ * @brief Print how the launch replay went
+ */
+void control_print_stats();
+
 void task_control(TaskHandle_t* handle_ptr);
 
 #endif  // CONTROL_H
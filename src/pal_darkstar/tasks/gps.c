@@ -2,14 +2,17 @@
 
 #include "board.h"
 #include "board_config.h"
+#include "control.h"
 #include "gpio/gpio.h"
 #include "gps.pb.h"
 #include "i2c/i2c.h"
 #include "max_m10s.h"
 #include "rtc/rtc.h"
 #include "storage.h"
+#include "task_timing.h"
 #include "telem.h"
 #include "timer.h"
+#include "usb.h"
 
 // FreeRTOS
 #include "FreeRTOS.h"
@@ -38,6 +41,8 @@ static I2cDevice s_gps_conf = {
 static TaskHandle_t* s_handle_ptr = NULL;
 static BoardConfig* s_config_ptr = NULL;
 
+static TaskTiming s_timing;
+
 /********************/
 /* HELPER FUNCTIONS */
 /********************/
@@ -102,8 +107,11 @@ Status gps_init() {
 void task_gps(TaskHandle_t* handle_ptr) {
     s_handle_ptr = handle_ptr;
     TickType_t last_iteration_start_tick = xTaskGetTickCount();
+    task_timing_init(&s_timing, "gps", s_config_ptr->gps_loop_period_ms * 1000);
 
     while (1) {
+        task_timing_begin_periodic(&s_timing, MICROS());
+
         GPS_Fix_TypeDef fix;
         if (max_m10s_poll_fix(&s_gps_conf, &fix) == STATUS_OK) {
 #ifdef HWIL_TEST
@@ -122,9 +130,10 @@ void task_gps(TaskHandle_t* handle_ptr) {
                                      ? GPIO_HIGH
                                      : GPIO_LOW);
 
-            // update_gps_for_control(&gps_frame);
+            control_update_gps(&gps_frame);
             storage_queue_gps(&gps_frame);
             telem_update_gps(&fix);
+            usb_stream_gps(&gps_frame);
 
             // Update RTC
             RTCDateTime rtc_datetime = rtc_get_datetime();
@@ -156,6 +165,7 @@ void task_gps(TaskHandle_t* handle_ptr) {
         }
 
         // Delay until next time
+        task_timing_end(&s_timing, MICROS());
         vTaskDelayUntil(&last_iteration_start_tick,
                         pdMS_TO_TICKS(s_config_ptr->gps_loop_period_ms));
     }
@@ -2,6 +2,7 @@
 
 #include "FreeRTOS.h"
 #include "gpio/gpio.h"
+#include "instr_queue.h"
 #include "main.h"
 #include "queue.h"
 #include "status.h"
@@ -10,7 +11,7 @@
 /********************/
 /* STATIC VARIABLES */
 /********************/
-static QueueHandle_t s_pyro_queue_handle;
+static InstrQueue s_pyro_queue;
 
 static uint32_t s_retries_left[] = {
     [PYRO_MAIN] = PYRO_MAX_RETRIES, [PYRO_DRG] = PYRO_MAX_RETRIES,
@@ -66,13 +67,13 @@ Status pyros_init() {
     gpio_write(PIN_FIREA2, GPIO_LOW);
     gpio_write(PIN_FIREA3, GPIO_LOW);
 
-    s_pyro_queue_handle = xQueueCreate(PYRO_QUEUE_LEN, sizeof(Pyro));
+    instr_queue_create(&s_pyro_queue, "pyro", PYRO_QUEUE_LEN, sizeof(Pyro));
 
     return STATUS_OK;
 }
 
 Status pyros_fire(Pyro pyro) {
-    if (xQueueSend(s_pyro_queue_handle, &pyro, 0) != pdPASS) {
+    if (instr_queue_send(&s_pyro_queue, &pyro, 0) != pdPASS) {
         return STATUS_BUSY;
     }
 
@@ -96,7 +97,7 @@ bool pyros_cont(Pyro pyro) {
 void task_pyros() {
     while (1) {
         Pyro pyro;
-        if (xQueueReceive(s_pyro_queue_handle, &pyro, portMAX_DELAY) !=
+        if (instr_queue_receive(&s_pyro_queue, &pyro, portMAX_DELAY) !=
             pdPASS) {
             // If we somehow time out here, just go back to the start because we
             // do NOT want to accidentally trigger pyros
@@ -130,7 +131,7 @@ void task_pyros() {
             PAL_LOGW("Pyro retrying (%lu retries left)\n",
                      s_retries_left[pyro] - 1);
 
-            while (xQueueSend(s_pyro_queue_handle, &pyro, 1) != pdPASS) {
+            while (instr_queue_send(&s_pyro_queue, &pyro, 1) != pdPASS) {
                 // This should be impossible with a long enough queue,
                 // but retry a few times anyway just in case
                 s_retries_left[pyro] -= 1;
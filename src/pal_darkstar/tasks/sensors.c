@@ -4,14 +4,18 @@
 
 #include "board.h"
 #include "board_config.h"
+#include "button_event.h"
 #include "control.h"
 #include "spi/spi.h"
 #include "storage.h"
+#include "task_timing.h"
 #include "telem.h"
 #include "timer.h"
+#include "usb.h"
 
 // Sensor drivers
 #include "bmi088/bmi088.h"
+#include "frame_merge/frame_merge.h"
 #include "i2c/i2c.h"
 #include "iis2mdc/iis2mdc.h"
 #include "kx134/kx134.h"
@@ -74,16 +78,198 @@ static I2cDevice s_mag_conf = {
     .sda = PIN_PB7,
 };
 
+// Data-ready lines, for boards that route them to the MCU. Each needs an
+// EXTI line (its pin number within the port) that no other event uses, such
+// as PIN_PAUSE or PIN_RADIO_DIO0. Sensors without one are polled.
+#define SENSOR_DRDY_POLLED 0xFF
+#ifndef PIN_KX134_INT1
+#define PIN_KX134_INT1 SENSOR_DRDY_POLLED
+#endif
+#ifndef PIN_BMI088_INT1
+#define PIN_BMI088_INT1 SENSOR_DRDY_POLLED
+#endif
+#ifndef PIN_BMI088_INT3
+#define PIN_BMI088_INT3 SENSOR_DRDY_POLLED
+#endif
+#ifndef PIN_IIS2MDC_DRDY
+#define PIN_IIS2MDC_DRDY SENSOR_DRDY_POLLED
+#endif
+
+// Samples further than this from the IMU accelerometer's aren't put in the
+// same frame; two periods at the slowest rate in use
+#define SENSOR_MERGE_MAX_AGE_US 20000
+
+// Task notification bits: one per data-ready sensor, by FrameSource, and one
+// for a frame request
+#define SENSORS_NOTIFY_DRDY(source) (1UL << (source))
+#define SENSORS_NOTIFY_FRAME (1UL << 31)
+
 /********************/
 /* STATIC VARIABLES */
 /********************/
 static TaskHandle_t* s_handle_ptr = NULL;
 static BoardConfig* s_config_ptr = NULL;
 
+// Reads are released by the control task, which needs the frame by its next
+// iteration
+static TaskTiming s_timing;
+static volatile uint64_t s_read_requested_us;
+
+// A sensor read when its data-ready line goes high, or with each frame
+typedef struct {
+    const char* name;
+    ButtonEventConfig drdy;
+    bool interrupt;  // Data-ready interrupt set up
+
+    volatile uint64_t capture_us;  // When the data became ready
+    volatile bool pending;         // Ready but not yet read
+    volatile uint32_t edges;
+    volatile uint32_t missed;  // Edges while still pending
+    uint32_t polls;            // Reads with a frame rather than on data ready
+} SensorSource;
+
+static void drdy_acc_h_handler();
+static void drdy_acc_i_handler();
+static void drdy_rot_i_handler();
+static void drdy_mag_i_handler();
+
+static SensorSource s_sources[FRAME_NUM_SOURCES] = {
+    [FRAME_SOURCE_ACC_H] = {.name = "acc_h",
+                            .drdy = {.pin = PIN_KX134_INT1,
+                                     .rising = true,
+                                     .event_handler = drdy_acc_h_handler}},
+    [FRAME_SOURCE_ACC_I] = {.name = "acc_i",
+                            .drdy = {.pin = PIN_BMI088_INT1,
+                                     .rising = true,
+                                     .event_handler = drdy_acc_i_handler}},
+    [FRAME_SOURCE_ROT_I] = {.name = "rot_i",
+                            .drdy = {.pin = PIN_BMI088_INT3,
+                                     .rising = true,
+                                     .event_handler = drdy_rot_i_handler}},
+    [FRAME_SOURCE_MAG_I] = {.name = "mag_i",
+                            .drdy = {.pin = PIN_IIS2MDC_DRDY,
+                                     .rising = true,
+                                     .event_handler = drdy_mag_i_handler}},
+    [FRAME_SOURCE_BARO] = {.name = "baro",
+                           .drdy = {.pin = SENSOR_DRDY_POLLED}},
+};
+
+// Only touched by the sensors task
+static FrameMerge s_merge;
+
 /********************/
 /* HELPER FUNCTIONS */
 /********************/
 
+// Timestamp the data and have the task read it
+static void sensor_drdy(FrameSource source) {
+    SensorSource* sensor = &s_sources[source];
+    sensor->capture_us = MICROS();
+    sensor->edges++;
+    if (sensor->pending) {
+        sensor->missed++;
+    }
+    sensor->pending = true;
+
+    if (s_handle_ptr == NULL) {
+        return;
+    }
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(*s_handle_ptr, SENSORS_NOTIFY_DRDY(source), eSetBits,
+                       &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void drdy_acc_h_handler() { sensor_drdy(FRAME_SOURCE_ACC_H); }
+static void drdy_acc_i_handler() { sensor_drdy(FRAME_SOURCE_ACC_I); }
+static void drdy_rot_i_handler() { sensor_drdy(FRAME_SOURCE_ROT_I); }
+static void drdy_mag_i_handler() { sensor_drdy(FRAME_SOURCE_MAG_I); }
+
+static Status sensor_enable_drdy(FrameSource source) {
+    switch (source) {
+        case FRAME_SOURCE_ACC_H:
+            return kx134_enable_drdy_int(&s_acc_conf);
+        case FRAME_SOURCE_ACC_I:
+        case FRAME_SOURCE_ROT_I:
+            return bmi088_enable_drdy_int(&s_imu_acc_conf, &s_imu_rot_conf);
+        case FRAME_SOURCE_MAG_I:
+            return iis2mdc_enable_drdy_int(&s_mag_conf);
+        default:
+            return STATUS_PARAMETER_ERROR;
+    }
+}
+
+// Read a sensor and pass its sample, in the frame's axes, on to the merge.
+// Without a capture time, it's taken once the read is done. Returns the one
+// used.
+static uint64_t sensor_read(FrameSource source, uint64_t capture_us) {
+    float values[FRAME_MERGE_MAX_VALUES];
+
+    switch (source) {
+        case FRAME_SOURCE_ACC_H: {
+            // Reads +1g on x-axis; want +1g on z-axis
+            Accel acch = kx134_read_accel(&s_acc_conf);
+            values[0] = -acch.accelZ;
+            values[1] = +acch.accelY;
+            values[2] = +acch.accelX;
+            break;
+        }
+        case FRAME_SOURCE_ACC_I: {
+            // Reads +1g on y-axis; want +1g on z-axis
+            Accel accel = bmi088_acc_read(&s_imu_acc_conf);
+            values[0] = -accel.accelZ;
+            values[1] = -accel.accelX;
+            values[2] = +accel.accelY;
+            break;
+        }
+        case FRAME_SOURCE_ROT_I: {
+            // Apply same transformation to gyro
+            Gyro gyro = bmi088_gyro_read(&s_imu_rot_conf);
+            values[0] = -gyro.gyroZ;
+            values[1] = -gyro.gyroX;
+            values[2] = +gyro.gyroY;
+            break;
+        }
+        case FRAME_SOURCE_MAG_I: {
+            Mag mag = iis2mdc_read(&s_mag_conf);
+            values[0] = mag.magX;
+            values[1] = mag.magY;
+            values[2] = mag.magZ;
+            break;
+        }
+        case FRAME_SOURCE_BARO:
+        default: {
+            BaroData baro = ms5637_read(&s_baro_conf, OSR_256);
+            values[0] = baro.temperature;
+            values[1] = baro.pressure;
+            break;
+        }
+    }
+
+    if (capture_us == 0) {
+        capture_us = MICROS();
+    }
+    frame_merge_sample(&s_merge, source, capture_us, values);
+    return capture_us;
+}
+
+// Read a sensor whose data-ready line went high
+static void sensor_read_ready(FrameSource source) {
+    SensorSource* sensor = &s_sources[source];
+
+    // The capture time is 64 bits, so can't be read while the ISR writes it
+    taskENTER_CRITICAL();
+    uint64_t capture_us = sensor->capture_us;
+    bool pending = sensor->pending;
+    sensor->pending = false;
+    taskEXIT_CRITICAL();
+
+    if (pending) {
+        sensor_read(source, capture_us);
+    }
+}
+
 /*****************/
 /* API FUNCTIONS */
 /*****************/
@@ -113,6 +299,20 @@ Status sensors_init() {
                         BMI088_GYRO_RANGE_2000_DPS, BMI088_ACC_RANGE_24_G),
             "IMU initialization failed\n", 5));
 
+    // Sensors with a data-ready line are read as soon as they have new data
+    for (FrameSource source = 0; source < FRAME_NUM_SOURCES; source++) {
+        SensorSource* sensor = &s_sources[source];
+        if (sensor->drdy.pin == SENSOR_DRDY_POLLED) {
+            continue;
+        }
+        sensor->interrupt =
+            EXPECT_OK(sensor_enable_drdy(source), "Data ready enable\n") ==
+                STATUS_OK &&
+            EXPECT_OK(button_event_create(&sensor->drdy),
+                      "Data ready interrupt\n") == STATUS_OK;
+    }
+    frame_merge_init(&s_merge, FRAME_SOURCE_ACC_I, SENSOR_MERGE_MAX_AGE_US);
+
     s_config_ptr = config_get_ptr();
     if (s_config_ptr == NULL) {
         ASSERT_OK(STATUS_STATE_ERROR, "unable to get ptr to config\n");
@@ -125,53 +325,78 @@ Status sensors_start_read() {
     if (s_handle_ptr == NULL) {
         return STATUS_ERROR;
     }
-    xTaskNotifyGive(*s_handle_ptr);
+    s_read_requested_us = MICROS();
+    xTaskNotify(*s_handle_ptr, SENSORS_NOTIFY_FRAME, eSetBits);
     return STATUS_OK;
 }
 
+void sensors_print_stats() {
+    printf("Sensor stats (%lu frames):\n", s_merge.frames);
+    for (int i = 0; i < FRAME_NUM_SOURCES; i++) {
+        const SensorSource* sensor = &s_sources[i];
+        const FrameSourceStats* stats = &s_merge.stats[i];
+        printf("  %-5s %-9s edges %lu, missed %lu, polls %lu, samples %lu, "
+               "overwritten %lu, stale %lu\n",
+               sensor->name, sensor->interrupt ? "interrupt" : "polled",
+               sensor->edges, sensor->missed, sensor->polls, stats->samples,
+               stats->overwritten, stats->stale);
+    }
+}
+
 void task_sensors(TaskHandle_t* handle_ptr) {
     s_handle_ptr = handle_ptr;
+    task_timing_init(&s_timing, "sensors",
+                     s_config_ptr->control_loop_period_ms * 1000);
 
+    uint32_t period_us = s_config_ptr->sensor_loop_period_ms * 1000;
+    uint64_t frame_due_us = MICROS() + period_us;
     while (1) {
-        uint32_t notif_value;
+        // Wait for data, or a frame to be due
+        uint64_t now_us = MICROS();
+        TickType_t timeout =
+            now_us < frame_due_us
+                ? pdMS_TO_TICKS((frame_due_us - now_us + 999) / 1000)
+                : 0;
+        uint32_t notif_value = 0;
         xTaskNotifyWait(0 /* Don't clear any bits on entry */,
                         ULONG_MAX /* Clear all bits on exit */, &notif_value,
-                        pdMS_TO_TICKS(s_config_ptr->sensor_loop_period_ms));
-
-        // Read all the sensors, measuring the timestamp after the barometer
-        // read since everything else is really fast
-        BaroData baro = ms5637_read(&s_baro_conf, OSR_256);
-        uint64_t timestamp = MICROS();
-        Accel acch = kx134_read_accel(&s_acc_conf);
-        Accel accel = bmi088_acc_read(&s_imu_acc_conf);
-        Gyro gyro = bmi088_gyro_read(&s_imu_rot_conf);
-        Mag mag = iis2mdc_read(&s_mag_conf);
-
-        // Copy data into a sensor frame
-        SensorFrame sensor_frame;
-        sensor_frame.timestamp = timestamp;
-
-        // Reads +1g on x-axis; want +1g on z-axis
-        sensor_frame.acc_h_x = -acch.accelZ;
-        sensor_frame.acc_h_y = +acch.accelY;
-        sensor_frame.acc_h_z = +acch.accelX;
+                        timeout);
 
-        // Reads +1g on y-axis; want +1g on z-axis
-        sensor_frame.acc_i_x = -accel.accelZ;
-        sensor_frame.acc_i_y = -accel.accelX;
-        sensor_frame.acc_i_z = +accel.accelY;
+        // Read the sensors that have new data right away, so it isn't
+        // overwritten before the frame is due
+        for (FrameSource source = 0; source < FRAME_NUM_SOURCES; source++) {
+            if (notif_value & SENSORS_NOTIFY_DRDY(source)) {
+                sensor_read_ready(source);
+            }
+        }
 
-        // Apply same transformation to gyro
-        sensor_frame.rot_i_x = -gyro.gyroZ;
-        sensor_frame.rot_i_y = -gyro.gyroX;
-        sensor_frame.rot_i_z = +gyro.gyroY;
+        // Without a request, the frame is released by the timeout
+        bool requested = notif_value & SENSORS_NOTIFY_FRAME;
+        if (!requested && MICROS() < frame_due_us) {
+            continue;
+        }
+        uint64_t release_us = requested ? s_read_requested_us : frame_due_us;
+        task_timing_begin(&s_timing, release_us, MICROS());
 
-        sensor_frame.mag_i_x = mag.magX;
-        sensor_frame.mag_i_y = mag.magY;
-        sensor_frame.mag_i_z = mag.magZ;
+        // Read the barometer and the other polled sensors, measuring the
+        // timestamp after the barometer read since everything else is really
+        // fast. Any whose data-ready line has gone quiet are polled too.
+        uint64_t timestamp = sensor_read(FRAME_SOURCE_BARO, 0);
+        for (FrameSource source = 0; source < FRAME_NUM_SOURCES; source++) {
+            if (source == FRAME_SOURCE_BARO) {
+                continue;
+            }
+            if (!s_sources[source].interrupt ||
+                !frame_merge_is_recent(&s_merge, source, timestamp)) {
+                sensor_read(source, timestamp);
+                s_sources[source].polls++;
+            }
+        }
 
-        sensor_frame.temperature = baro.temperature;
-        sensor_frame.pressure = baro.pressure;
+        // Put the samples closest to the IMU accelerometer's together
+        SensorFrame sensor_frame;
+        frame_merge_take(&s_merge, timestamp, &sensor_frame);
+        frame_due_us = MICROS() + period_us;
 
 #ifdef HWIL_TEST
         // If we're doing a HWIL test, overwrite the actual sensor frame with
@@ -186,5 +411,7 @@ void task_sensors(TaskHandle_t* handle_ptr) {
         control_update_sensors(&sensor_frame);
         storage_queue_sensors(&sensor_frame);
         telem_update_sensors(&sensor_frame);
+        usb_stream_sensors(&sensor_frame);
+        task_timing_end(&s_timing, MICROS());
     }
 }
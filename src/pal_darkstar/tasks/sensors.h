@@ -11,6 +11,12 @@ Status sensors_init();
 
 Status sensors_start_read();
 
+/**
+ * @brief Print how each sensor has been read, and how its samples fared
+ * being merged into frames
+ */
+void sensors_print_stats();
+
 void task_sensors(TaskHandle_t* handle_ptr);
 
 #endif  // SENSORS_H
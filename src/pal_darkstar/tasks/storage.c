@@ -1,36 +1,41 @@
 #include "storage.h"
 
+#include <string.h>
 #include <sys/types.h>
 
 #include "Regex.h"
 #include "backup/backup.h"
 #include "buttons.h"
+#include "control.h"
 #include "fatlog.h"
 #include "fifos.h"
+#include "instr_queue.h"
 #include "main.h"
 #include "pb_create.h"
 #include "rtc/rtc.h"
 #include "sdmmc/sdmmc.h"
+#include "sensor_block.h"
+#include "sensors.h"
 #include "stdio.h"
 #include "stdlib.h"
+#include "task_timing.h"
 #include "timer.h"
 
 // FreeRTOS
 #include "FreeRTOS.h"
 #include "queue.h"
 
+// How often the timing of the periodic tasks and the queue stats are logged
+#define TASK_TIMING_LOG_PERIOD_MS (10000UL)
+
 /********************/
 /* STATIC VARIABLES */
 /********************/
 static BoardConfig* s_config_ptr;
 
-static uint32_t s_sensor_overflows;
-static uint32_t s_state_overflows;
-static uint32_t s_gps_overflows;
-
-static QueueHandle_t s_sensor_queue;
-static QueueHandle_t s_state_queue;
-static QueueHandle_t s_gps_queue;
+static InstrQueue s_sensor_queue;
+static InstrQueue s_state_queue;
+static InstrQueue s_gps_queue;
 
 static QueueSetHandle_t s_queue_set;
 
@@ -42,13 +47,67 @@ static char s_datfile_path[64];
 static char s_fslfile_path[64];
 static char s_gpsfile_path[64];
 
-static FIL s_logfile;
-static FIL s_datfile;
-static FIL s_fslfile;
-static FIL s_gpsfile;
+static FatlogFile s_logfile;
+static FatlogFile s_datfile;
+static FatlogFile s_fslfile;
+static FatlogFile s_gpsfile;
+
+typedef enum {
+    STORAGE_SYNC_BYTES,  // storage_sync_kb written since the last sync
+    STORAGE_SYNC_PHASE,  // Launch, apogee or landing
+    STORAGE_SYNC_IDLE,   // Queues empty, data older than storage_idle_sync_ms
+    STORAGE_NUM_SYNC_REASONS,
+} StorageSyncReason;
+
+typedef struct {
+    const char* name;
+    FatlogFile* file;
+    uint64_t unsynced_since_ms;  // When the oldest unsynced data was written
+    uint32_t syncs[STORAGE_NUM_SYNC_REASONS];
+    uint32_t synced_bytes;
+    uint32_t max_unsynced_bytes;
+    uint32_t max_sync_us;
+} StorageFile;
+
+// Flush policy state of each open file, in priority order: when several files
+// are due for a sync, the first ones are synced first
+typedef enum {
+    STORAGE_FILE_STATE,
+    STORAGE_FILE_SENSOR,
+    STORAGE_FILE_GPS,
+    STORAGE_FILE_LOG,
+    STORAGE_NUM_FILES,
+} StorageFileId;
+
+static StorageFile s_files[STORAGE_NUM_FILES] = {
+    [STORAGE_FILE_STATE] = {.name = "state", .file = &s_fslfile},
+    [STORAGE_FILE_SENSOR] = {.name = "sensor", .file = &s_datfile},
+    [STORAGE_FILE_GPS] = {.name = "gps", .file = &s_gpsfile},
+    [STORAGE_FILE_LOG] = {.name = "log", .file = &s_logfile},
+};
+
+static const char* s_sync_reason_names[STORAGE_NUM_SYNC_REASONS] = {
+    [STORAGE_SYNC_BYTES] = "bytes",
+    [STORAGE_SYNC_PHASE] = "phase",
+    [STORAGE_SYNC_IDLE] = "idle",
+};
+
+// Set by the control task at launch, apogee and landing, so that the files
+// are synced at the end of the storage loop
+static volatile bool s_sync_requested = false;
+static FlightPhase s_flight_phase = FP_INIT;
+
+// Most data that would have been lost to a power cut at any one time
+static uint32_t s_max_at_risk_bytes;
 
 static uint8_t s_header[] = FIRMWARE_SPECIFIER "\n";
 
+// Sensor frames waiting to be written as a block, if the open sensor file is
+// in the sensor block format
+static bool s_sensor_blocks = false;
+static SensorBlockEncoder s_sensor_block;
+static uint8_t s_sensor_block_buf[SENSOR_BLOCK_MAX_LEN];
+
 static uint8_t s_log_buffer[4096];
 static FIFO_t s_log_fifo = {
     .buffer = s_log_buffer,
@@ -68,6 +127,8 @@ static char s_prf_buf[1024];  // 40 bytes per task
 
 static Status s_status = STATUS_OK;
 
+static uint64_t s_timing_log_ms = 0;
+
 /*****************/
 /* API FUNCTIONS */
 /*****************/
@@ -100,11 +161,119 @@ static void storage_save_event_handler() {
     }
 }
 
+// Bytes that are written but not synced, or still waiting to be written
+static uint32_t storage_at_risk_bytes() {
+    uint32_t bytes = s_sensor_block.num_frames * sizeof(SensorFrame);
+    for (int i = 0; i < STORAGE_NUM_FILES; i++) {
+        bytes += s_files[i].file->unsynced_bytes;
+    }
+    return bytes;
+}
+
+static Status storage_sync_file(StorageFile* file, StorageSyncReason reason);
+
+static Status storage_write(StorageFileId id, const uint8_t* data,
+                            size_t size) {
+    StorageFile* file = &s_files[id];
+    if (file->file->unsynced_bytes == 0) {
+        file->unsynced_since_ms = MILLIS();
+    }
+    ASSERT_OK(fatlog_write_prealloc(file->file, data, size), "file write");
+
+    uint32_t at_risk = storage_at_risk_bytes();
+    if (at_risk > s_max_at_risk_bytes) {
+        s_max_at_risk_bytes = at_risk;
+    }
+
+    uint32_t sync_bytes = s_config_ptr->storage_sync_kb << 10;
+    if (sync_bytes > 0 && file->file->unsynced_bytes >= sync_bytes) {
+        return storage_sync_file(file, STORAGE_SYNC_BYTES);
+    }
+
+    return STATUS_OK;
+}
+
+// Write out the sensor frames collected so far, even if the block isn't full
+static Status storage_write_sensor_block() {
+    size_t len = sensor_block_encode(&s_sensor_block, s_sensor_block_buf);
+    if (len == 0) {
+        return STATUS_OK;
+    }
+    return storage_write(STORAGE_FILE_SENSOR, s_sensor_block_buf, len);
+}
+
+static Status storage_sync_file(StorageFile* file, StorageSyncReason reason) {
+    // Frames held for a partial block would otherwise stay at risk. (Once
+    // written, the block may hit the byte budget and sync the file itself.)
+    // Other syncs leave them to fill the block, to keep it compact.
+    if (file->file == &s_datfile && s_sensor_blocks &&
+        reason == STORAGE_SYNC_PHASE) {
+        ASSERT_OK(storage_write_sensor_block(), "sensor block write");
+    }
+    if (file->file->unsynced_bytes == 0) {
+        return STATUS_OK;
+    }
+
+    uint32_t unsynced_bytes = file->file->unsynced_bytes;
+    uint64_t start_us = MICROS();
+    ASSERT_OK(fatlog_sync_prealloc(file->file), "file sync");
+    uint32_t sync_us = MICROS() - start_us;
+
+    file->syncs[reason] += 1;
+    file->synced_bytes += unsynced_bytes;
+    if (unsynced_bytes > file->max_unsynced_bytes) {
+        file->max_unsynced_bytes = unsynced_bytes;
+    }
+    if (sync_us > file->max_sync_us) {
+        file->max_sync_us = sync_us;
+    }
+
+    return STATUS_OK;
+}
+
+// Sync every file on request. Otherwise, if the queues are drained, sync the
+// highest priority file holding data older than storage_idle_sync_ms. Only one
+// file is synced per loop this way, so the queues are never held up for long.
+static Status storage_apply_flush_policy() {
+    Status status = STATUS_OK;
+
+    if (s_sync_requested) {
+        s_sync_requested = false;
+        for (int i = 0; i < STORAGE_NUM_FILES; i++) {
+            StorageFile* file = &s_files[i];
+            UPDATE_STATUS(status,
+                          EXPECT_OK(storage_sync_file(file, STORAGE_SYNC_PHASE),
+                                    file->name));
+        }
+        return status;
+    }
+
+    uint32_t idle_ms = s_config_ptr->storage_idle_sync_ms;
+    if (idle_ms == 0 || uxQueueMessagesWaiting(s_sensor_queue.handle) ||
+        uxQueueMessagesWaiting(s_state_queue.handle) ||
+        uxQueueMessagesWaiting(s_gps_queue.handle)) {
+        return STATUS_OK;
+    }
+    for (int i = 0; i < STORAGE_NUM_FILES; i++) {
+        StorageFile* file = &s_files[i];
+        if (file->file->unsynced_bytes > 0 &&
+            MILLIS() - file->unsynced_since_ms >= idle_ms) {
+            return EXPECT_OK(storage_sync_file(file, STORAGE_SYNC_IDLE),
+                             file->name);
+        }
+    }
+
+    return STATUS_OK;
+}
+
 static Status storage_close_files() {
-    ASSERT_OK(fatlog_close_file(&s_logfile), "failed to close log\n");
-    ASSERT_OK(fatlog_close_file(&s_datfile), "failed to close sens\n");
-    ASSERT_OK(fatlog_close_file(&s_fslfile), "failed to close state\n");
-    ASSERT_OK(fatlog_close_file(&s_gpsfile), "failed to close gps\n");
+    if (s_sensor_blocks) {
+        EXPECT_OK(storage_write_sensor_block(), "failed to write sens\n");
+    }
+    ASSERT_OK(fatlog_close_prealloc(&s_logfile), "failed to close log\n");
+    ASSERT_OK(fatlog_close_prealloc(&s_datfile), "failed to close sens\n");
+    ASSERT_OK(fatlog_close_prealloc(&s_fslfile), "failed to close state\n");
+    ASSERT_OK(fatlog_close_prealloc(&s_gpsfile), "failed to close gps\n");
 
     return STATUS_OK;
 }
@@ -156,8 +325,12 @@ static Status storage_open_files() {
     // Create the file paths
     sprintf(s_logfile_path, LOG_DIR "/log_%04ld-%02ld-%02ld-%d.txt", dt.year,
             dt.month, dt.day, max_num + 1);
-    sprintf(s_datfile_path, SENSOR_DIR "/dat_%04ld-%02ld-%02ld-%d.pb3", dt.year,
-            dt.month, dt.day, max_num + 1);
+    // The format is fixed for the life of the file
+    s_sensor_blocks = s_config_ptr->storage_sensor_blocks;
+    sensor_block_init(&s_sensor_block);
+    sprintf(s_datfile_path, SENSOR_DIR "/%s_%04ld-%02ld-%02ld-%d.pb3",
+            s_sensor_blocks ? "sbk" : "dat", dt.year, dt.month, dt.day,
+            max_num + 1);
     sprintf(s_fslfile_path, STATE_DIR "/fsl_%04ld-%02ld-%02ld-%d.pb3", dt.year,
             dt.month, dt.day, max_num + 1);
     sprintf(s_gpsfile_path, GPS_DIR "/gps_%04ld-%02ld-%02ld-%d.pb3", dt.year,
@@ -165,28 +338,35 @@ static Status storage_open_files() {
 
     // Open files if we are not in MTP mode
     if (!backup_get_ptr()->flag_mtp_pressed) {
-        ASSERT_OK(fatlog_open_file_for_write(&s_logfile, s_logfile_path),
+        FSIZE_t prealloc = (FSIZE_t)s_config_ptr->storage_prealloc_mb << 20;
+        ASSERT_OK(fatlog_open_prealloc(&s_logfile, s_logfile_path, prealloc),
                   "failed to open log\n");
-        ASSERT_OK(fatlog_open_file_for_write(&s_datfile, s_datfile_path),
+        ASSERT_OK(fatlog_open_prealloc(&s_datfile, s_datfile_path, prealloc),
                   "failed to open sensor\n");
-        ASSERT_OK(fatlog_open_file_for_write(&s_fslfile, s_fslfile_path),
+        ASSERT_OK(fatlog_open_prealloc(&s_fslfile, s_fslfile_path, prealloc),
                   "failed to open state\n");
-        ASSERT_OK(fatlog_open_file_for_write(&s_gpsfile, s_gpsfile_path),
+        ASSERT_OK(fatlog_open_prealloc(&s_gpsfile, s_gpsfile_path, prealloc),
                   "failed to open gps\n");
 
+        for (int i = 0; i < STORAGE_NUM_FILES; i++) {
+            StorageFile* file = &s_files[i];
+            memset(file->syncs, 0, sizeof(file->syncs));
+            file->synced_bytes = 0;
+            file->max_unsynced_bytes = 0;
+            file->max_sync_us = 0;
+        }
+        s_max_at_risk_bytes = 0;
+
         // Write the header to each file
-        ASSERT_OK(
-            fatlog_write_data(&s_logfile, s_header, strlen((char*)s_header)),
-            "failed to write log header\n");
-        ASSERT_OK(
-            fatlog_write_data(&s_datfile, s_header, strlen((char*)s_header)),
-            "failed to write sensor header\n");
-        ASSERT_OK(
-            fatlog_write_data(&s_fslfile, s_header, strlen((char*)s_header)),
-            "failed to write state header\n");
-        ASSERT_OK(
-            fatlog_write_data(&s_gpsfile, s_header, strlen((char*)s_header)),
-            "failed to write gps header\n");
+        size_t header_len = strlen((char*)s_header);
+        ASSERT_OK(storage_write(STORAGE_FILE_LOG, s_header, header_len),
+                  "failed to write log header\n");
+        ASSERT_OK(storage_write(STORAGE_FILE_SENSOR, s_header, header_len),
+                  "failed to write sensor header\n");
+        ASSERT_OK(storage_write(STORAGE_FILE_STATE, s_header, header_len),
+                  "failed to write state header\n");
+        ASSERT_OK(storage_write(STORAGE_FILE_GPS, s_header, header_len),
+                  "failed to write gps header\n");
     }
 
     return STATUS_OK;
@@ -197,8 +377,8 @@ static void storage_dump_log() {
     while (log_left) {
         // Write as many bytes as we can contiguously by looking
         // directly into the buffer to avoid having to copy
-        fatlog_write_data(&s_logfile, &s_log_fifo.buffer[s_log_fifo.head],
-                          log_left);
+        storage_write(STORAGE_FILE_LOG, &s_log_fifo.buffer[s_log_fifo.head],
+                      log_left);
         fifo_discardn(&s_log_fifo, log_left);
         log_left = fifo_size_contig(&s_log_fifo);
     }
@@ -208,21 +388,26 @@ Status storage_init() {
     Status status = STATUS_OK;
 
     // Create the queues
-    s_sensor_queue = xQueueCreate(SENSOR_QUEUE_LENGTH, SENSOR_QUEUE_ITEM_SIZE);
-    s_state_queue = xQueueCreate(STATE_QUEUE_LENGTH, STATE_QUEUE_ITEM_SIZE);
-    s_gps_queue = xQueueCreate(GPS_QUEUE_LENGTH, GPS_QUEUE_ITEM_SIZE);
+    QueueHandle_t sensor_queue =
+        instr_queue_create(&s_sensor_queue, "storage_sensor",
+                           SENSOR_QUEUE_LENGTH, SENSOR_QUEUE_ITEM_SIZE);
+    QueueHandle_t state_queue =
+        instr_queue_create(&s_state_queue, "storage_state",
+                           STATE_QUEUE_LENGTH, STATE_QUEUE_ITEM_SIZE);
+    QueueHandle_t gps_queue = instr_queue_create(
+        &s_gps_queue, "storage_gps", GPS_QUEUE_LENGTH, GPS_QUEUE_ITEM_SIZE);
     s_queue_set = xQueueCreateSet(QUEUE_SET_LENGTH);
 
     // Check that everything was successfully created
-    configASSERT(s_sensor_queue);
-    configASSERT(s_state_queue);
-    configASSERT(s_gps_queue);
+    configASSERT(sensor_queue);
+    configASSERT(state_queue);
+    configASSERT(gps_queue);
     configASSERT(s_queue_set);
 
     // Add the queues to the set
-    xQueueAddToSet(s_sensor_queue, s_queue_set);
-    xQueueAddToSet(s_state_queue, s_queue_set);
-    xQueueAddToSet(s_gps_queue, s_queue_set);
+    xQueueAddToSet(sensor_queue, s_queue_set);
+    xQueueAddToSet(state_queue, s_queue_set);
+    xQueueAddToSet(gps_queue, s_queue_set);
 
     // Initialize FATFS
     UPDATE_STATUS(status,  ///
@@ -269,9 +454,39 @@ void storage_pause(StoragePauseMode mode) { s_pause_mode |= mode; }
 
 void storage_start(StoragePauseMode mode) { s_pause_mode &= ~mode; }
 
+void storage_update_fp(FlightPhase flight_phase) {
+    if (flight_phase == s_flight_phase) {
+        return;
+    }
+
+    // Launch, apogee and landing
+    if (flight_phase == FP_BOOST || flight_phase == FP_DROGUE ||
+        flight_phase == FP_LANDED) {
+        s_sync_requested = true;
+    }
+    s_flight_phase = flight_phase;
+}
+
+void storage_print_stats() {
+    uint64_t now_ms = MILLIS();
+    printf("Storage flush stats (at risk now %lu B, max %lu B):\n",
+           storage_at_risk_bytes(), s_max_at_risk_bytes);
+    for (int i = 0; i < STORAGE_NUM_FILES; i++) {
+        const StorageFile* file = &s_files[i];
+        uint32_t unsynced_ms =
+            file->file->unsynced_bytes ? now_ms - file->unsynced_since_ms : 0;
+        printf("  %-6s unsynced %lu B for %lu ms, max %lu B, synced %lu B,",
+               file->name, file->file->unsynced_bytes, unsynced_ms,
+               file->max_unsynced_bytes, file->synced_bytes);
+        for (int r = 0; r < STORAGE_NUM_SYNC_REASONS; r++) {
+            printf(" %s %lu", s_sync_reason_names[r], file->syncs[r]);
+        }
+        printf(", max sync %lu us\n", file->max_sync_us);
+    }
+}
+
 Status storage_queue_sensors(const SensorFrame* sensor_frame) {
-    if (xQueueSend(s_sensor_queue, sensor_frame, 0) != pdPASS) {
-        s_sensor_overflows += 1;
+    if (instr_queue_send(&s_sensor_queue, sensor_frame, 0) != pdPASS) {
         return STATUS_BUSY;
     }
 
@@ -279,8 +494,7 @@ Status storage_queue_sensors(const SensorFrame* sensor_frame) {
 }
 
 Status storage_queue_state(const StateFrame* state_frame) {
-    if (xQueueSend(s_state_queue, state_frame, 0) != pdPASS) {
-        s_state_overflows += 1;
+    if (instr_queue_send(&s_state_queue, state_frame, 0) != pdPASS) {
         return STATUS_BUSY;
     }
 
@@ -288,8 +502,7 @@ Status storage_queue_state(const StateFrame* state_frame) {
 }
 
 Status storage_queue_gps(const GpsFrame* gps_frame) {
-    if (xQueueSend(s_gps_queue, gps_frame, 0) != pdPASS) {
-        s_gps_overflows += 1;
+    if (instr_queue_send(&s_gps_queue, gps_frame, 0) != pdPASS) {
         return STATUS_BUSY;
     }
 
@@ -327,30 +540,38 @@ void task_storage(TaskHandle_t* handle_ptr) {
                     xQueueSelectFromSet(s_queue_set, max_wait_ticks);
 
                 // Receive from the selected queue and store it
-                if (activated_queue == s_sensor_queue) {
+                if (activated_queue == s_sensor_queue.handle) {
                     SensorFrame sensor_frame;
-                    xQueueReceive(s_sensor_queue, &sensor_frame, 0);
-
-                    size_t sensor_buf_size;
-                    pb_byte_t* sensor_buf =
-                        create_sensor_buffer(&sensor_frame, &sensor_buf_size);
-                    fatlog_write_data(&s_datfile, sensor_buf, sensor_buf_size);
-                } else if (activated_queue == s_state_queue) {
+                    instr_queue_receive(&s_sensor_queue, &sensor_frame, 0);
+
+                    if (s_sensor_blocks) {
+                        if (sensor_block_add(&s_sensor_block, &sensor_frame)) {
+                            storage_write_sensor_block();
+                        }
+                    } else {
+                        size_t sensor_buf_size;
+                        pb_byte_t* sensor_buf = create_sensor_buffer(
+                            &sensor_frame, &sensor_buf_size);
+                        storage_write(STORAGE_FILE_SENSOR, sensor_buf,
+                                      sensor_buf_size);
+                    }
+                } else if (activated_queue == s_state_queue.handle) {
                     StateFrame state_frame;
-                    xQueueReceive(s_state_queue, &state_frame, 0);
+                    instr_queue_receive(&s_state_queue, &state_frame, 0);
 
                     size_t state_buf_size;
                     pb_byte_t* state_buf =
                         create_state_buffer(&state_frame, &state_buf_size);
-                    fatlog_write_data(&s_fslfile, state_buf, state_buf_size);
-                } else if (activated_queue == s_gps_queue) {
+                    storage_write(STORAGE_FILE_STATE, state_buf,
+                                  state_buf_size);
+                } else if (activated_queue == s_gps_queue.handle) {
                     GpsFrame gps_frame;
-                    xQueueReceive(s_gps_queue, &gps_frame, 0);
+                    instr_queue_receive(&s_gps_queue, &gps_frame, 0);
 
                     size_t gps_buf_size;
                     pb_byte_t* gps_buf =
                         create_gps_buffer(&gps_frame, &gps_buf_size);
-                    fatlog_write_data(&s_gpsfile, gps_buf, gps_buf_size);
+                    storage_write(STORAGE_FILE_GPS, gps_buf, gps_buf_size);
                 } else {
                     // Should print an error but don't want to spam log
                     // and anyway this should never happen in the first place
@@ -362,30 +583,20 @@ void task_storage(TaskHandle_t* handle_ptr) {
             // Write the log out to disk
             storage_dump_log();
 
-            // Flush everything to disk
-            UPDATE_STATUS(s_status,
-                          EXPECT_OK(fatlog_flush(&s_datfile), "Sensor flush"));
             UPDATE_STATUS(s_status,
-                          EXPECT_OK(fatlog_flush(&s_fslfile), "State flush"));
-            UPDATE_STATUS(s_status,
-                          EXPECT_OK(fatlog_flush(&s_gpsfile), "GPS flush"));
-            UPDATE_STATUS(s_status,
-                          EXPECT_OK(fatlog_flush(&s_logfile), "Log flush"));
+                          EXPECT_OK(storage_apply_flush_policy(), "Flush"));
 
             gpio_write(PIN_GREEN, s_status == STATUS_OK);
 
             // Check for and log any queue overflows
-            if (s_sensor_overflows) {
-                PAL_LOGW("%lu overflows in sensor queue\n", s_sensor_overflows);
-                s_sensor_overflows = 0;
-            }
-            if (s_state_overflows) {
-                PAL_LOGW("%lu overflows in state queue\n", s_state_overflows);
-                s_state_overflows = 0;
-            }
-            if (s_gps_overflows) {
-                PAL_LOGW("%lu overflows in gps queue\n", s_gps_overflows);
-                s_gps_overflows = 0;
+            instr_queue_log_drops();
+
+            if (MILLIS() - s_timing_log_ms >= TASK_TIMING_LOG_PERIOD_MS) {
+                s_timing_log_ms = MILLIS();
+                PAL_LOGI("Task timing:\n");
+                task_timing_print_all();
+                PAL_LOGI("Queue stats:\n");
+                instr_queue_print_all();
             }
         }
 
@@ -395,6 +606,11 @@ void task_storage(TaskHandle_t* handle_ptr) {
             // Gather and dump stats when pausing
             vTaskGetRunTimeStats(s_prf_buf);
             PAL_LOGI("Profiling stats:\n%s\n", s_prf_buf);
+            storage_print_stats();
+            sensors_print_stats();
+            control_print_stats();
+            task_timing_print_all();
+            instr_queue_print_all();
         }
 
         // Final log dump before closing filesystem
@@ -17,7 +17,8 @@
 
 // Queue lengths
 #define SENSOR_QUEUE_LENGTH (64UL)
-#define STATE_QUEUE_LENGTH (64UL)
+// Room for a launch replay's states on top of the usual backlog
+#define STATE_QUEUE_LENGTH (64UL + LD_RING_MAX_FRAMES)
 #define GPS_QUEUE_LENGTH (16UL)
 #define QUEUE_SET_LENGTH \
     (SENSOR_QUEUE_LENGTH + STATE_QUEUE_LENGTH + GPS_QUEUE_LENGTH)
@@ -45,6 +46,14 @@ bool storage_status();
 void storage_pause(StoragePauseMode mode);
 void storage_start(StoragePauseMode mode);
 
+// Sync all files at the end of the current storage loop if the rocket just
+// launched, reached apogee or landed
+void storage_update_fp(FlightPhase flight_phase);
+
+// Print how much logged data is not yet durable, and how often each file was
+// synced and why
+void storage_print_stats();
+
 Status storage_queue_sensors(const SensorFrame* sensor_frame);
 Status storage_queue_state(const StateFrame* state_frame);
 Status storage_queue_gps(const GpsFrame* gps_frame);
@@ -3,19 +3,62 @@
 #include "FreeRTOS.h"
 #include "board.h"
 #include "board_config.h"
+#include "instr_queue.h"
 #include "pspcom.h"
 #include "queue.h"
+#include "task.h"
+#include "task_timing.h"
+#include "telem_sched/telem_sched.h"
+#include "timer.h"
+
+// How long to wait before checking again when there's nothing to send
+#define TELEM_IDLE_PERIOD_MS 50
+
+// Shortest time between state packets in flight (airtime is the real limit)
+#define TELEM_FLIGHT_STATE_PERIOD_MS 100
+
+// How often health packets are sent in flight, in units of the flight period
+#define TELEM_FLIGHT_HEALTH_PERIODS 5
+
+// Don't send GPS fixes or state estimates older than this
+#define TELEM_GPS_MAX_AGE_MS 2000
+#define TELEM_STATE_MAX_AGE_MS 500
 
 /********************/
 /* STATIC VARIABLES */
 /********************/
 
-static QueueHandle_t s_sensor_queue;
-static QueueHandle_t s_gps_queue;
-static QueueHandle_t s_fp_queue;
+static InstrQueue s_sensor_queue;
+static InstrQueue s_state_queue;
+static InstrQueue s_gps_queue;
+static InstrQueue s_fp_queue;
 
 static BoardConfig *s_config_ptr = NULL;
 
+static TelemSched s_sched;
+
+// A packet is released when the data it carries arrives
+static TaskTiming s_tx_timing;
+
+// Modem settings, also used to estimate the airtime of each packet
+static const LoraParams s_lora_params = {
+    .bandwidth_hz = 125000,
+    .spreading_factor = 10,
+    .coding_rate = 5,
+    .preamble_len = 8,
+    .implicit_header = false,
+    .crc_on = true,
+    .low_data_rate = false,
+};
+
+// Packet lengths as sent, including device and message ID
+static const uint32_t s_payload_lens[TELEM_NUM_CLASSES] = {
+    [TELEM_CLASS_EVENT] = 2 + PSPCOM_EVENT_PAYLOAD_LEN,
+    [TELEM_CLASS_STATE] = 2 + PSPCOM_STATE_PAYLOAD_LEN,
+    [TELEM_CLASS_GPS] = 2 + PSPCOM_GPS_PAYLOAD_LEN,
+    [TELEM_CLASS_HEALTH] = 2 + PSPCOM_HEALTH_PAYLOAD_LEN,
+};
+
 /*****************/
 /* RADIO DRIVERS */
 /*****************/
@@ -23,6 +66,8 @@ static BoardConfig *s_config_ptr = NULL;
 static Status radio_init();
 static Status radio_recv_msg(pspcommsg *msg);
 static Status radio_send_msg(pspcommsg *msg);
+static bool radio_tx_busy();
+static void radio_wait(uint32_t timeout_ms);
 
 #ifdef COMPAT_9K5
 #include "wlcomm.h"
@@ -45,8 +90,16 @@ static Status radio_send_msg(pspcommsg *msg) {
     return wlcomm_send_msg(msg);
 }
 
+static bool radio_tx_busy() { return wlcomm_tx_busy(); }
+
+static void radio_wait(uint32_t timeout_ms) {
+    vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+}
+
 #else  // not COMPAT_9K5
+#include "button_event.h"
 #include "sx1276/sx1276.h"
+#include "sx1276/sx1276_link.h"
 
 static SpiDevice s_radio_device = {
     .periph = P_SPI2,
@@ -59,56 +112,135 @@ static SpiDevice s_radio_device = {
     .cpol = 0,
 };
 
+// Only the task in radio_wait() talks to the radio; received messages are
+// passed on to task_telem_rx through the queue
+static Sx1276Link s_radio_link;
+static TaskHandle_t s_radio_task = NULL;
+static InstrQueue s_rx_queue;
+
+// DIO0 goes high on TxDone or RxDone
+static void radio_dio0_handler() {
+    if (s_radio_task == NULL) {
+        return;
+    }
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_radio_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static ButtonEventConfig s_radio_dio0 = {
+    .pin = PIN_RADIO_DIO0,
+    .rising = true,
+    .falling = false,
+    .event_handler = radio_dio0_handler,
+};
+
 static Status radio_init() {
+    instr_queue_create(&s_rx_queue, "telem_rx", SX1276_LINK_QUEUE_LEN,
+                       sizeof(pspcommsg));
+    configASSERT(s_rx_queue.handle);
+
     ASSERT_OK(sx1276_init(&s_radio_device, PIN_PC5,
-                          s_config_ptr->telemetry_frequency_hz, 20, 125000, 10,
-                          5, 8, false, true, false),
+                          s_config_ptr->telemetry_frequency_hz, 20,
+                          s_lora_params.bandwidth_hz,
+                          s_lora_params.spreading_factor,
+                          s_lora_params.coding_rate, s_lora_params.preamble_len,
+                          s_lora_params.implicit_header, s_lora_params.crc_on,
+                          s_lora_params.low_data_rate),
               "LoRa init\n");
-    ASSERT_OK(sx1276_start_receive(&s_radio_device), "LoRa recv start\n");
+    ASSERT_OK(sx1276_link_init(&s_radio_link, &s_radio_device),
+              "LoRa recv start\n");
+    ASSERT_OK(button_event_create(&s_radio_dio0), "LoRa DIO0 interrupt\n");
 
     return STATUS_OK;
 }
 
 static Status radio_recv_msg(pspcommsg *msg) {
-    int ret = sx1276_packet_available(&s_radio_device);
-    if (ret == 1) {
-        int len;
-        static uint8_t buf[PSPCOM_MAX_PAYLOAD_LEN + 2];
-        ret = sx1276_read_packet(&s_radio_device, buf, &len);
-        if (ret == STATUS_OK) {
-            // Parse message
-            msg->device_id = buf[0];
-            msg->msg_id = buf[1];
-            msg->payload_len = len - 2;
-            memcpy(msg->payload, buf + 2, msg->payload_len);
-            return STATUS_OK;
-        }
-    } else if (ret < 0) {
-        PAL_LOGE("Error reading sx1276 packet\n");
+    // Block until the radio task passes on a message
+    if (instr_queue_receive(&s_rx_queue, msg, portMAX_DELAY) != pdPASS) {
+        return STATUS_ERROR;
     }
-    return STATUS_ERROR;
+    return STATUS_OK;
 }
 
 static Status radio_send_msg(pspcommsg *msg) {
-    Status status = STATUS_OK;
-
     // Prepare packet
     static uint8_t buf[PSPCOM_MAX_PAYLOAD_LEN + 2];
     buf[0] = msg->device_id;
     buf[1] = msg->msg_id;
     memcpy(buf + 2, msg->payload, msg->payload_len);
 
-    // Send message
-    UPDATE_STATUS(status,
-                  sx1276_transmit(&s_radio_device, buf, 2 + msg->payload_len));
+    // Queue it; the link returns to receiving once it has been sent
+    return sx1276_link_send(&s_radio_link, buf, 2 + msg->payload_len);
+}
+
+static bool radio_tx_busy() { return sx1276_link_tx_busy(&s_radio_link); }
 
-    // When done, start receiving again
-    UPDATE_STATUS(status, sx1276_start_receive(&s_radio_device));
+static void radio_wait(uint32_t timeout_ms) {
+    s_radio_task = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
 
-    return STATUS_OK;
+    // Also run after a timeout, in case an interrupt was missed
+    EXPECT_OK(sx1276_link_service(&s_radio_link), "LoRa service\n");
+
+    // Parse received packets
+    static uint8_t buf[SX1276_LINK_MAX_PACKET_LEN];
+    int len;
+    while (sx1276_link_recv(&s_radio_link, buf, &len)) {
+        if (len < 2) {
+            continue;
+        }
+        pspcommsg msg;
+        msg.device_id = buf[0];
+        msg.msg_id = buf[1];
+        msg.payload_len = len - 2;
+        memcpy(msg.payload, buf + 2, msg.payload_len);
+        if (instr_queue_send(&s_rx_queue, &msg, 0) != pdPASS) {
+            PAL_LOGW("Dropped received telemetry message\n");
+        }
+    }
 }
 #endif  // not COMPAT_9K5
 
+/********************/
+/* HELPER FUNCTIONS */
+/********************/
+
+// Rates and priorities of each packet class for a flight phase
+static void telem_set_policy(FlightPhase flight_phase) {
+    uint32_t ground_ms = s_config_ptr->pspcom_tx_ground_loop_period_ms;
+    uint32_t flight_ms = s_config_ptr->pspcom_tx_flight_loop_period_ms;
+
+    TelemClassPolicy policy[TELEM_NUM_CLASSES];
+    policy[TELEM_CLASS_EVENT] = (TelemClassPolicy){true, 0, 0, 0};
+
+    if (flight_phase == FP_BOOST || flight_phase == FP_COAST) {
+        // Ascent: as many state updates as the budget allows
+        policy[TELEM_CLASS_STATE] = (TelemClassPolicy){
+            true, 1, TELEM_FLIGHT_STATE_PERIOD_MS, TELEM_STATE_MAX_AGE_MS};
+        policy[TELEM_CLASS_GPS] =
+            (TelemClassPolicy){true, 2, flight_ms, TELEM_GPS_MAX_AGE_MS};
+        policy[TELEM_CLASS_HEALTH] = (TelemClassPolicy){
+            true, 3, TELEM_FLIGHT_HEALTH_PERIODS * flight_ms, 0};
+    } else if (flight_phase == FP_DROGUE || flight_phase == FP_MAIN) {
+        // Descent: GPS matters most for recovery
+        policy[TELEM_CLASS_GPS] =
+            (TelemClassPolicy){true, 1, flight_ms, TELEM_GPS_MAX_AGE_MS};
+        policy[TELEM_CLASS_STATE] = (TelemClassPolicy){
+            true, 2, flight_ms / 2, TELEM_STATE_MAX_AGE_MS};
+        policy[TELEM_CLASS_HEALTH] = (TelemClassPolicy){
+            true, 3, TELEM_FLIGHT_HEALTH_PERIODS * flight_ms, 0};
+    } else {
+        // Grounded: slow updates, with pyro status ahead of the state
+        policy[TELEM_CLASS_HEALTH] = (TelemClassPolicy){true, 1, ground_ms, 0};
+        policy[TELEM_CLASS_GPS] = (TelemClassPolicy){true, 1, ground_ms, 0};
+        policy[TELEM_CLASS_STATE] = (TelemClassPolicy){true, 2, ground_ms, 0};
+    }
+
+    telem_sched_set_policy(&s_sched, policy);
+}
+
 /*****************/
 /* API FUNCTIONS */
 /*****************/
@@ -120,28 +252,40 @@ Status telem_init() {
     }
 
     // Queues for synchronization, not buffering
-    s_sensor_queue = xQueueCreate(1, sizeof(SensorFrame));
-    s_gps_queue = xQueueCreate(1, sizeof(GPS_Fix_TypeDef));
-    s_fp_queue = xQueueCreate(1, sizeof(FlightPhase));
-
-    configASSERT(s_sensor_queue);
-    configASSERT(s_gps_queue);
-    configASSERT(s_fp_queue);
+    instr_queue_create(&s_sensor_queue, "telem_sensor", 1, sizeof(SensorFrame));
+    instr_queue_create(&s_state_queue, "telem_state", 1, sizeof(StateFrame));
+    instr_queue_create(&s_gps_queue, "telem_gps", 1, sizeof(GPS_Fix_TypeDef));
+    instr_queue_create(&s_fp_queue, "telem_fp", 1, sizeof(FlightPhase));
+
+    configASSERT(s_sensor_queue.handle);
+    configASSERT(s_state_queue.handle);
+    configASSERT(s_gps_queue.handle);
+    configASSERT(s_fp_queue.handle);
+
+    // Schedule packets within the configured share of airtime
+    telem_sched_init(&s_sched, &s_lora_params, s_payload_lens,
+                     s_config_ptr->telemetry_duty_cycle_pct / 100.f,
+                     MILLIS());
+    telem_set_policy(FP_INIT);
 
     // Initialize radio
     return radio_init();
 }
 
 void telem_update_sensors(SensorFrame *sensor_frame) {
-    xQueueOverwrite(s_sensor_queue, sensor_frame);
+    instr_queue_overwrite(&s_sensor_queue, sensor_frame);
+}
+
+void telem_update_state(StateFrame *state_frame) {
+    instr_queue_overwrite(&s_state_queue, state_frame);
 }
 
 void telem_update_gps(GPS_Fix_TypeDef *gps_fix) {
-    xQueueOverwrite(s_gps_queue, gps_fix);
+    instr_queue_overwrite(&s_gps_queue, gps_fix);
 }
 
 void telem_update_fp(FlightPhase flight_phase) {
-    xQueueOverwrite(s_fp_queue, &flight_phase);
+    instr_queue_overwrite(&s_fp_queue, &flight_phase);
 }
 
 void task_telem_rx() {
@@ -150,56 +294,86 @@ void task_telem_rx() {
     while (1) {
         pspcommsg msg;
 
+        // Blocks until a message comes in, if the radio can wait for one
         if (radio_recv_msg(&msg) == STATUS_OK) {
             pspcom_handle_message(&msg);
+        } else {
+            vTaskDelayUntil(
+                &last_rx_time,
+                pdMS_TO_TICKS(s_config_ptr->pspcom_rx_loop_period_ms));
         }
-
-        vTaskDelayUntil(&last_rx_time,
-                        pdMS_TO_TICKS(s_config_ptr->pspcom_rx_loop_period_ms));
     }
 }
 
 void task_telem_tx() {
-    TickType_t last_tx_time = xTaskGetTickCount();
-
     static SensorFrame s_sensor_frame;
+    static StateFrame s_state_frame;
     static GPS_Fix_TypeDef s_gps_fix;
-    static FlightPhase s_flight_phase;
+    static FlightPhase s_flight_phase = FP_INIT;
+    static uint32_t s_phase_change_ms = 0;
+    task_timing_init(&s_tx_timing, "telem_tx",
+                     s_config_ptr->pspcom_tx_flight_loop_period_ms * 1000);
 
     while (1) {
-        // Get latest data
-        if (xQueueReceive(s_sensor_queue, &s_sensor_frame, 0) != pdPASS) {
-            PAL_LOGW("telem didn't get new sensor data\n");
-            // We didn't have new data available; set error flag
+        uint32_t now_ms = MILLIS();
+
+        // Mark the classes that have new data
+        if (instr_queue_receive(&s_state_queue, &s_state_frame, 0) == pdPASS) {
+            telem_sched_update(&s_sched, TELEM_CLASS_STATE, now_ms);
         }
-        if (xQueueReceive(s_gps_queue, &s_gps_fix, 0) != pdPASS) {
-            PAL_LOGW("telem didn't get new GPS data\n");
-            // We didn't have new data available; set error flag
+        if (instr_queue_receive(&s_gps_queue, &s_gps_fix, 0) == pdPASS) {
+            telem_sched_update(&s_sched, TELEM_CLASS_GPS, now_ms);
         }
-        if (xQueueReceive(s_fp_queue, &s_flight_phase, 0) != pdPASS) {
-            PAL_LOGW("telem didn't get new flight phase\n");
-            // We didn't have new data available; set error flag
+        if (instr_queue_receive(&s_sensor_queue, &s_sensor_frame, 0) ==
+            pdPASS) {
+            telem_sched_update(&s_sched, TELEM_CLASS_HEALTH, now_ms);
         }
 
-        // Create standard telemetry packet from the received data
-        pspcommsg msg =
-            pspcom_make_standard(&s_sensor_frame, &s_gps_fix, s_flight_phase);
+        // A phase change is an event, and changes the rates of everything else
+        FlightPhase flight_phase;
+        if (instr_queue_receive(&s_fp_queue, &flight_phase, 0) == pdPASS &&
+            flight_phase != s_flight_phase) {
+            s_flight_phase = flight_phase;
+            s_phase_change_ms = now_ms;
+            telem_set_policy(flight_phase);
+            telem_sched_update(&s_sched, TELEM_CLASS_EVENT, now_ms);
+        }
 
-        // Transmit the packet
-        EXPECT_OK(radio_send_msg(&msg), "failed to transmit packet\n");
+        // Only pick a packet once the radio is free, so it has the latest data
+        TelemClass cls = TELEM_CLASS_NONE;
+        if (!radio_tx_busy()) {
+            cls = telem_sched_next(&s_sched, now_ms);
+        }
+        if (cls == TELEM_CLASS_NONE) {
+            // Sleep until the radio is done, or something may be due
+            radio_wait(TELEM_IDLE_PERIOD_MS);
+            continue;
+        }
 
-        // Then wait until the next period
-        FlightPhase flight_phase = fp_get();
-        if (flight_phase < FP_BOOST || flight_phase > FP_MAIN) {
-            // If grounded, send less frequently
-            vTaskDelayUntil(
-                &last_tx_time,
-                pdMS_TO_TICKS(s_config_ptr->pspcom_tx_ground_loop_period_ms));
-        } else {
-            // Otherwise, send more frequently
-            vTaskDelayUntil(
-                &last_tx_time,
-                pdMS_TO_TICKS(s_config_ptr->pspcom_tx_flight_loop_period_ms));
+        task_timing_begin(&s_tx_timing,
+                          (uint64_t)s_sched.classes[cls].update_ms * 1000,
+                          MICROS());
+
+        pspcommsg msg;
+        switch (cls) {
+            case TELEM_CLASS_EVENT:
+                msg = pspcom_make_event(s_flight_phase, s_phase_change_ms);
+                break;
+            case TELEM_CLASS_STATE:
+                msg = pspcom_make_state(&s_state_frame, s_flight_phase);
+                break;
+            case TELEM_CLASS_GPS:
+                msg = pspcom_make_gps(&s_gps_fix);
+                break;
+            default:
+                msg = pspcom_make_health(&s_sensor_frame, &s_gps_fix,
+                                         s_flight_phase);
+                break;
         }
+
+        // Transmit the packet
+        EXPECT_OK(radio_send_msg(&msg), "failed to transmit packet\n");
+        telem_sched_sent(&s_sched, cls, now_ms);
+        task_timing_end(&s_tx_timing, MICROS());
     }
 }
@@ -4,10 +4,12 @@
 #include "flight_control.h"
 #include "max_m10s.h"
 #include "sensor.pb.h"
+#include "state.pb.h"
 
 Status telem_init();
 
 void telem_update_sensors(SensorFrame *sensor_frame);
+void telem_update_state(StateFrame *state_frame);
 void telem_update_gps(GPS_Fix_TypeDef *gps_fix);
 void telem_update_fp(FlightPhase flight_phase);
 
@@ -1,46 +1,55 @@
 #include "wlcomm.h"
 
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "FreeRTOS.h"
+#include "semphr.h"
 #include "stm32h7xx_hal.h"
 #include "timer.h"
-#include "timers.h"
+#include "wlcomm_link/wlcomm_link.h"
 
 #define UART_BUFFER_SIZE 512
 
-#define DMA_WRITE_PTR                                         \
-    ((UART_BUFFER_SIZE -                                      \
-      ((DMA_Stream_TypeDef*)huart9.hdmarx->Instance)->NDTR) & \
-     (UART_BUFFER_SIZE - 1))
+// How long wlcomm_recv_msg waits for bytes before giving up
+#define WLCOMM_RX_TIMEOUT_MS 1000
 
-RAM_D2 struct {
-    uint8_t buffer[UART_BUFFER_SIZE];
-    size_t rd_ptr;
-} cb;
+// The received body is parsed straight into the message
+_Static_assert(offsetof(pspcommsg, payload) == WLCOMM_LINK_HEADER_LEN,
+               "pspcommsg must be laid out like a frame body");
+
+// Both are read and written by DMA
+RAM_D2 static uint8_t s_rx_buf[UART_BUFFER_SIZE];
+RAM_D2 static WlcommTx s_tx;
+
+static WlcommRx s_rx;
+static SemaphoreHandle_t s_rx_sem = NULL;
+static uint32_t s_tx_errors = 0;
 
 UART_HandleTypeDef huart9;
 DMA_HandleTypeDef hdma_uart9_rx;
 DMA_HandleTypeDef hdma_uart9_tx;
-TimerHandle_t arm_timer;
 
-static uint32_t s_global_nack = 0;
-static uint32_t s_global_ack = 0;
+static volatile uint32_t s_global_nack = 0;
+static volatile uint32_t s_global_ack = 0;
 
 static Status start_uart_reading();
-static void circular_buffer_init();
-static uint8_t circular_buffer_is_empty();
-static Status circular_buffer_pop(uint8_t* data);
+static void start_uart_writing();
 
 Status wlcomm_init() {
     __HAL_RCC_UART9_CLK_ENABLE();
     __HAL_RCC_DMA1_CLK_ENABLE();
 
-    HAL_NVIC_SetPriority(UART9_IRQn, 3, 0);
+    // Low enough to wake the task waiting on received messages
+    HAL_NVIC_SetPriority(UART9_IRQn,
+                         configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
     HAL_NVIC_EnableIRQ(UART9_IRQn);
-    HAL_NVIC_SetPriority(DMA1_Stream0_IRQn, 3, 0);
+    HAL_NVIC_SetPriority(DMA1_Stream0_IRQn,
+                         configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
     HAL_NVIC_EnableIRQ(DMA1_Stream0_IRQn);
-    HAL_NVIC_SetPriority(DMA1_Stream1_IRQn, 3, 0);
+    HAL_NVIC_SetPriority(DMA1_Stream1_IRQn,
+                         configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
     HAL_NVIC_EnableIRQ(DMA1_Stream1_IRQn);
 
     GPIO_InitTypeDef GPIO_InitStruct = {0};
@@ -61,7 +70,9 @@ Status wlcomm_init() {
     huart9.Init.OverSampling = UART_OVERSAMPLING_16;
     huart9.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
     huart9.Init.ClockPrescaler = UART_PRESCALER_DIV1;
-    huart9.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+    // An overrun would stop the DMA; the parser copes with the lost byte
+    huart9.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_RXOVERRUNDISABLE_INIT;
+    huart9.AdvancedInit.OverrunDisable = UART_ADVFEATURE_OVERRUN_DISABLE;
     if (HAL_UART_Init(&huart9) != HAL_OK) {
         return STATUS_ERROR;
     }
@@ -112,103 +123,69 @@ Status wlcomm_init() {
 
     __HAL_LINKDMA(&huart9, hdmatx, hdma_uart9_tx);
 
-    circular_buffer_init();
+    if (s_rx_sem == NULL) {
+        s_rx_sem = xSemaphoreCreateBinary();
+        if (s_rx_sem == NULL) {
+            return STATUS_MEMORY_ERROR;
+        }
+    }
+    wlcomm_link_rx_init(&s_rx, s_rx_buf, UART_BUFFER_SIZE);
+    wlcomm_link_tx_init(&s_tx);
     ASSERT_OK(start_uart_reading(), "wlcomm UART read\n");
 
     return STATUS_OK;
 }
 
 Status wlcomm_recv_msg(pspcommsg* msg) {
-    uint8_t current_byte = 0;
-    static uint8_t state = 0;
-    static uint16_t checksum;
-    static uint8_t payload_ctr = 0;
-
-    while (!circular_buffer_is_empty()) {
-        switch (state) {
-            case 0:
-                memset(msg, 0, sizeof(pspcommsg));
-                payload_ctr = 0;
-                checksum = 0;
-                circular_buffer_pop(&current_byte);
-                if (current_byte == '!') {
-                    state = 1;
-                }
-                break;
-            case 1:
-                circular_buffer_pop(&current_byte);
-                if (current_byte == '$') {
-                    state = 2;
-                } else {
-                    state = 0;
-                }
-                break;
-            case 2:
-                circular_buffer_pop(&current_byte);
-                msg->payload_len = current_byte;
-                state = 3;
-                break;
-            case 3:
-                circular_buffer_pop(&current_byte);
-                msg->device_id = current_byte;
-                state = 4;
-                break;
-            case 4:
-                circular_buffer_pop(&current_byte);
-                msg->msg_id = current_byte;
-                state = 5;
-                break;
-            case 5:
-                if (payload_ctr < msg->payload_len) {
-                    circular_buffer_pop(&current_byte);
-                    msg->payload[payload_ctr] = current_byte;
-                    payload_ctr++;
-                    break;
-                } else {
-                    state = 6;
-                }
-            case 6:
-                circular_buffer_pop(&current_byte);
-                checksum = current_byte;
-                state = 7;
-                break;
-            case 7:
-                circular_buffer_pop(&current_byte);
-                checksum += ((uint16_t)current_byte) << 8;
-                if (crc16(CRC16_INIT, msg) == checksum) {
-                    state = 0;
-                    return STATUS_OK;
-                }
-                state = 0;
-                break;
+    // Frames are parsed where the DMA left them, whenever the line goes idle
+    // (or the buffer is half full), so there's nothing to do in between
+    while (!wlcomm_link_rx_next(&s_rx, (uint8_t*)msg)) {
+        if (xSemaphoreTake(s_rx_sem, pdMS_TO_TICKS(WLCOMM_RX_TIMEOUT_MS)) !=
+            pdTRUE) {
+            return STATUS_TIMEOUT_ERROR;
         }
     }
 
-    return STATUS_ERROR;
+    // Replies from the radio board to wlcomm_set_freq
+    if (msg->msg_id == ACK) {
+        s_global_ack = 1;
+    } else if (msg->msg_id == NACK) {
+        s_global_nack = 1;
+    }
+
+    return STATUS_OK;
 }
 
 Status wlcomm_send_msg(pspcommsg* msg) {
-    uint16_t checksum = crc16(CRC16_INIT, msg);
-    char buf[7 + msg->payload_len];
+    taskENTER_CRITICAL();
+    WlcommTxSlot* slot = wlcomm_link_tx_reserve(&s_tx);
+    taskEXIT_CRITICAL();
 
-    sprintf(buf, "!$%c%c%c", msg->payload_len, msg->device_id, msg->msg_id);
-    memcpy(buf + 5, msg->payload, msg->payload_len);
-    sprintf(buf + 5 + msg->payload_len, "%c%c", (uint8_t)checksum,
-            (uint8_t)(checksum >> 8));
+    // Rather than wait for the UART, drop the message if it's backed up
+    if (slot == NULL) {
+        return STATUS_BUSY;
+    }
 
-    HAL_UART_Transmit_DMA(&huart9, (uint8_t*)buf, 7 + msg->payload_len);
+    wlcomm_link_tx_fill(slot, (const uint8_t*)msg);
 
-    uint64_t timeout = MILLIS();
-    while (HAL_UART_GetState(&huart9) == HAL_UART_STATE_BUSY_TX) {
-        if (MILLIS() - timeout > 100) {
-            break;
-        }
-        DELAY(1);
-    }
+    taskENTER_CRITICAL();
+    start_uart_writing();
+    taskEXIT_CRITICAL();
 
     return STATUS_OK;
 }
 
+bool wlcomm_tx_busy() { return wlcomm_link_tx_busy(&s_tx); }
+
+void wlcomm_print_stats() {
+    printf("wlcomm RX: %lu frames, %lu CRC errors, %lu bytes skipped, "
+           "%lu overruns\n",
+           s_rx.stats.frames, s_rx.stats.crc_errors, s_rx.stats.skipped,
+           s_rx.stats.overruns);
+    printf("wlcomm TX: %lu frames, %lu dropped, %lu errors\n", s_tx.sent,
+           s_tx.dropped, s_tx_errors);
+}
+
 Status wlcomm_set_freq(uint32_t frequency_hz) {
     s_global_ack = 0;
     s_global_nack = 0;
@@ -247,27 +224,69 @@ Status wlcomm_set_freq(uint32_t frequency_hz) {
 }
 
 static Status start_uart_reading() {
-    if (HAL_UART_Receive_DMA(&huart9, cb.buffer, UART_BUFFER_SIZE) != HAL_OK) {
+    // Circular, with an event at each half, the end, and an idle line
+    if (HAL_UARTEx_ReceiveToIdle_DMA(&huart9, s_rx_buf, UART_BUFFER_SIZE) !=
+        HAL_OK) {
         return STATUS_ERROR;
     }
     return STATUS_OK;
 }
 
-static void circular_buffer_init() { cb.rd_ptr = 0; }
+// Start on the next frame, if one is ready and the UART is free. Must be
+// called in a critical section.
+static void start_uart_writing() {
+    WlcommTxSlot* slot = wlcomm_link_tx_start(&s_tx);
+    if (slot == NULL) {
+        return;
+    }
+    if (HAL_UART_Transmit_DMA(&huart9, slot->frame, slot->len) != HAL_OK) {
+        // Free the slot so the queue doesn't stall
+        s_tx_errors++;
+        wlcomm_link_tx_done(&s_tx);
+    }
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t Size) {
+    if (huart != &huart9) {
+        return;
+    }
+
+    // Size is how far into the buffer the DMA has got
+    wlcomm_link_rx_written(&s_rx, Size);
 
-static uint8_t circular_buffer_is_empty() {
-    if (cb.rd_ptr == DMA_WRITE_PTR) {
-        return 1;
+    BaseType_t woken = pdFALSE;
+    if (s_rx_sem != NULL) {
+        xSemaphoreGiveFromISR(s_rx_sem, &woken);
     }
-    return 0;
+    portYIELD_FROM_ISR(woken);
 }
 
-static Status circular_buffer_pop(uint8_t* data) {
-    if (cb.rd_ptr != DMA_WRITE_PTR) {
-        *data = cb.buffer[cb.rd_ptr++];
-        cb.rd_ptr %= UART_BUFFER_SIZE;
-        return STATUS_OK;
-    } else {
-        return STATUS_ERROR;
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart) {
+    if (huart != &huart9) {
+        return;
+    }
+
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    wlcomm_link_tx_done(&s_tx);
+    start_uart_writing();
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart) {
+    if (huart != &huart9) {
+        return;
+    }
+
+    // Noise and framing errors leave reception running, but a DMA error
+    // stops it, so start again from the beginning of the buffer
+    if (huart->RxState == HAL_UART_STATE_READY) {
+        wlcomm_link_rx_restart(&s_rx);
+        start_uart_reading();
     }
 }
+
+void UART9_IRQHandler(void) { HAL_UART_IRQHandler(&huart9); }
+
+void DMA1_Stream0_IRQHandler(void) { HAL_DMA_IRQHandler(&hdma_uart9_rx); }
+
+void DMA1_Stream1_IRQHandler(void) { HAL_DMA_IRQHandler(&hdma_uart9_tx); }
@@ -1,14 +1,32 @@
 #ifndef WLCOMM_H
 #define WLCOMM_H
 
+#include <stdbool.h>
+
 #include "pspcom.h"
 #include "status.h"
 
 Status wlcomm_init();
 
+/**
+ * @brief Wait for the next message from the radio board
+ *
+ * @return STATUS_TIMEOUT_ERROR if nothing arrived for a while
+ */
 Status wlcomm_recv_msg(pspcommsg* msg);
+
+/**
+ * @brief Queue a message to be sent by DMA, without waiting for it to go
+ *
+ * @return STATUS_BUSY if the queue is full and the message was dropped
+ */
 Status wlcomm_send_msg(pspcommsg* msg);
 
+// Whether a message is waiting or being sent
+bool wlcomm_tx_busy();
+
+void wlcomm_print_stats();
+
 Status wlcomm_set_freq(uint32_t freq_hz);
 
 #endif  // WLCOMM_H
@@ -0,0 +1,435 @@
+// Native decoder for the .pb3 logs written by task_storage
+//
+// Usage: pb3_decode [options] input.pb3 output
+//   -t TYPE              sensor, state, gps or sensor_block (default: guessed
+//                        from dat_/fsl_/gps_/sbk_)
+//   -f csv|col           output format (default: csv)
+//   -e SPECIFIER         fail unless the header matches this firmware spec
+//   -n                   leave out the CSV column names (HWIL data format)
+//
+// An output of "-" writes to stdout. Floats are written like the Python
+// decoder (%.6f), and GPS validity flags are unpacked into extra columns.
+// Sensor blocks are written one row per frame, the same as sensor records.
+//
+// The columnar format (-f col) is little endian:
+//   "PB3COL1\n"
+//   u32 num_cols, then per column: u8 type (0 u32, 1 u64, 2 f32),
+//                                  u8 name_len, name
+//   blocks until EOF: u32 num_rows, then each column as num_rows values
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pb3_decode.h"
+
+#define READ_BUF_LEN (4 << 20)
+#define WRITE_BUF_LEN (1 << 20)
+#define COL_BLOCK_ROWS 65536
+#define MAX_OUT_COLS (PB3_MAX_FIELDS + 16)
+#define MAX_SPEC_LEN (PB3_MAX_HEADER_LEN + 1)
+
+typedef enum {
+    OUT_CSV,
+    OUT_COL,
+} OutFormat;
+
+// A column derived from a bit field of another one
+typedef struct {
+    const char* name;
+    uint64_t mask;
+    int shift;
+} FlagColumn;
+
+// Same unpacking as scripts/decode_protobuf_bin.py
+static const FlagColumn s_gps_flags[] = {
+    {"date_valid", 1 << 0, 0},      {"time_valid", 1 << 1, 1},
+    {"time_resolved", 1 << 2, 2},   {"fix_type", 0b111 << 3, 3},
+    {"fix_valid", 1 << 8, 8},       {"diff_used", 1 << 9, 9},
+    {"psm_state", 0b111 << 10, 10}, {"hdg_veh_valid", 1 << 14, 14},
+    {"carrier_phase", 0b11 << 15, 15}, {"invalid_llh", 1 << 19, 19},
+};
+
+#define GPS_FLAGS_COL 7  // valid_flags
+
+typedef struct {
+    FILE* file;
+    char* buf;
+    size_t len;
+} Writer;
+
+typedef struct {
+    const Pb3Schema* schema;
+    OutFormat format;
+    Writer out;
+    size_t num_flags;
+
+    // Columnar output block
+    Pb3Value* block;
+    size_t block_rows;
+} Output;
+
+static void writer_flush(Writer* w) {
+    fwrite(w->buf, 1, w->len, w->file);
+    w->len = 0;
+}
+
+static inline void writer_reserve(Writer* w, size_t n) {
+    if (w->len + n > WRITE_BUF_LEN) {
+        writer_flush(w);
+    }
+}
+
+static void writer_write(Writer* w, const void* data, size_t n) {
+    writer_reserve(w, n);
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+}
+
+// Space reserved per CSV value, enough for any uint64 or %.6f float
+#define MAX_VALUE_CHARS 64
+
+static const char s_digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536"
+    "37383940414243444546474849505152535455565758596061626364656667686970717273"
+    "7475767778798081828384858687888990919293949596979899";
+
+static inline size_t fmt_u64(char* out, uint64_t value) {
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        p -= 2;
+        memcpy(p, &s_digit_pairs[2 * (value % 100)], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, &s_digit_pairs[2 * value], 2);
+    } else {
+        *--p = '0' + value;
+    }
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(out, p, n);
+    return n;
+}
+
+// Equivalent to "%.6f", without going through printf for ordinary values.
+// A float times 1e6 is exact in a double, so rounding it to nearest even
+// matches printf digit for digit.
+static inline size_t fmt_f32(char* out, float value) {
+    double v = value;
+    size_t n = 0;
+    if (signbit(v)) {
+        out[n++] = '-';
+        v = -v;
+    }
+
+    if (isnan(v)) {
+        memcpy(out + n, "nan", 3);
+        return n + 3;
+    }
+    if (isinf(v)) {
+        memcpy(out + n, "inf", 3);
+        return n + 3;
+    }
+    if (v >= 1e12) {
+        return n + snprintf(out + n, MAX_VALUE_CHARS - n, "%.6f", v);
+    }
+    uint64_t scaled = (uint64_t)nearbyint(v * 1e6);
+    n += fmt_u64(out + n, scaled / 1000000);
+    out[n++] = '.';
+    uint32_t frac = scaled % 1000000;
+    for (int i = 4; i >= 0; i -= 2) {
+        memcpy(&out[n + i], &s_digit_pairs[2 * (frac % 100)], 2);
+        frac /= 100;
+    }
+    return n + 6;
+}
+
+static void write_csv_header(Output* out) {
+    const Pb3Schema* schema = out->schema;
+    for (size_t i = 0; i < schema->num_cols; i++) {
+        if (i > 0) {
+            writer_write(&out->out, ",", 1);
+        }
+        writer_write(&out->out, schema->cols[i].name,
+                     strlen(schema->cols[i].name));
+    }
+    for (size_t i = 0; i < out->num_flags; i++) {
+        writer_write(&out->out, ",", 1);
+        writer_write(&out->out, s_gps_flags[i].name,
+                     strlen(s_gps_flags[i].name));
+    }
+    writer_write(&out->out, "\n", 1);
+}
+
+static void write_csv_row(const Pb3Value* values, void* ctx) {
+    Output* out = ctx;
+    const Pb3Schema* schema = out->schema;
+    Writer* w = &out->out;
+
+    writer_reserve(w, (schema->num_cols + out->num_flags) * MAX_VALUE_CHARS);
+    char* p = w->buf + w->len;
+    for (size_t i = 0; i < schema->num_cols; i++) {
+        if (i > 0) {
+            *p++ = ',';
+        }
+        if (schema->cols[i].type == PB3_COL_F32) {
+            p += fmt_f32(p, values[i].f);
+        } else {
+            p += fmt_u64(p, values[i].u);
+        }
+    }
+    for (size_t i = 0; i < out->num_flags; i++) {
+        const FlagColumn* flag = &s_gps_flags[i];
+        *p++ = ',';
+        p += fmt_u64(p, (values[GPS_FLAGS_COL].u & flag->mask) >> flag->shift);
+    }
+    *p++ = '\n';
+    w->len = p - w->buf;
+}
+
+static void write_u8(Writer* w, uint8_t value) { writer_write(w, &value, 1); }
+
+static void write_u32(Writer* w, uint32_t value) {
+    uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+    writer_write(w, bytes, 4);
+}
+
+static void write_col_header(Output* out) {
+    const Pb3Schema* schema = out->schema;
+    writer_write(&out->out, "PB3COL1\n", 8);
+    write_u32(&out->out, schema->num_cols + out->num_flags);
+    for (size_t i = 0; i < schema->num_cols; i++) {
+        const char* name = schema->cols[i].name;
+        write_u8(&out->out, schema->cols[i].type);
+        write_u8(&out->out, strlen(name));
+        writer_write(&out->out, name, strlen(name));
+    }
+    for (size_t i = 0; i < out->num_flags; i++) {
+        const char* name = s_gps_flags[i].name;
+        write_u8(&out->out, PB3_COL_U32);
+        write_u8(&out->out, strlen(name));
+        writer_write(&out->out, name, strlen(name));
+    }
+}
+
+// Note: assumes a little endian host, as the values are copied directly
+static void write_col_block(Output* out) {
+    if (out->block_rows == 0) {
+        return;
+    }
+
+    const Pb3Schema* schema = out->schema;
+    size_t num_cols = schema->num_cols + out->num_flags;
+    write_u32(&out->out, out->block_rows);
+    for (size_t c = 0; c < num_cols; c++) {
+        Pb3ColType type = c < schema->num_cols ? schema->cols[c].type
+                                               : PB3_COL_U32;
+        size_t size = type == PB3_COL_U64 ? 8 : 4;
+        writer_reserve(&out->out, out->block_rows * size);
+        char* p = out->out.buf + out->out.len;
+        for (size_t r = 0; r < out->block_rows; r++) {
+            const Pb3Value* value = &out->block[r * num_cols + c];
+            if (type == PB3_COL_F32) {
+                memcpy(p, &value->f, 4);
+            } else if (type == PB3_COL_U32) {
+                uint32_t u = value->u;
+                memcpy(p, &u, 4);
+            } else {
+                memcpy(p, &value->u, 8);
+            }
+            p += size;
+        }
+        out->out.len = p - out->out.buf;
+    }
+    out->block_rows = 0;
+}
+
+static void add_col_row(const Pb3Value* values, void* ctx) {
+    Output* out = ctx;
+    const Pb3Schema* schema = out->schema;
+    size_t num_cols = schema->num_cols + out->num_flags;
+
+    Pb3Value* row = &out->block[out->block_rows * num_cols];
+    memcpy(row, values, schema->num_cols * sizeof(Pb3Value));
+    for (size_t i = 0; i < out->num_flags; i++) {
+        const FlagColumn* flag = &s_gps_flags[i];
+        row[schema->num_cols + i].u =
+            (values[GPS_FLAGS_COL].u & flag->mask) >> flag->shift;
+    }
+
+    if (++out->block_rows == COL_BLOCK_ROWS) {
+        write_col_block(out);
+    }
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: pb3_decode [-t sensor|state|gps|sensor_block] "
+            "[-f csv|col] [-e SPECIFIER] [-n] input.pb3 output\n");
+}
+
+int main(int argc, char** argv) {
+    bool have_kind = false;
+    Pb3Kind kind = PB3_SENSOR;
+    OutFormat format = OUT_CSV;
+    const char* expected_spec = NULL;
+    bool csv_names = true;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        const char* opt = argv[arg];
+        if (strcmp(opt, "-n") == 0) {
+            csv_names = false;
+        } else if (arg + 1 >= argc) {
+            usage();
+            return 2;
+        } else if (strcmp(opt, "-t") == 0) {
+            if (!pb3_kind_from_name(argv[++arg], &kind)) {
+                usage();
+                return 2;
+            }
+            have_kind = true;
+        } else if (strcmp(opt, "-f") == 0) {
+            const char* fmt = argv[++arg];
+            if (strcmp(fmt, "csv") == 0) {
+                format = OUT_CSV;
+            } else if (strcmp(fmt, "col") == 0) {
+                format = OUT_COL;
+            } else {
+                usage();
+                return 2;
+            }
+        } else if (strcmp(opt, "-e") == 0) {
+            expected_spec = argv[++arg];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (argc - arg != 2) {
+        usage();
+        return 2;
+    }
+    const char* in_fname = argv[arg];
+    const char* out_fname = argv[arg + 1];
+
+    if (!have_kind && !pb3_kind_from_fname(in_fname, &kind)) {
+        fprintf(stderr, "Can't tell the message type of %s, use -t\n",
+                in_fname);
+        return 2;
+    }
+
+    FILE* in = fopen(in_fname, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Failed to open %s\n", in_fname);
+        return 1;
+    }
+
+    uint8_t* read_buf = malloc(READ_BUF_LEN);
+    size_t buf_len = fread(read_buf, 1, READ_BUF_LEN, in);
+    bool eof = buf_len < READ_BUF_LEN;
+
+    // Header line
+    char spec[MAX_SPEC_LEN];
+    size_t pos = pb3_parse_header(read_buf, buf_len, spec, sizeof(spec));
+    if (pos == 0) {
+        fprintf(stderr, "Warning: no firmware specifier header\n");
+        if (expected_spec != NULL) {
+            return 1;
+        }
+    } else {
+        fprintf(stderr, "Firmware specifier: %s\n", spec);
+        if (expected_spec != NULL && strcmp(spec, expected_spec) != 0) {
+            fprintf(stderr, "Expected firmware specifier %s\n",
+                    expected_spec);
+            return 1;
+        }
+    }
+
+    Output out = {
+        .schema = pb3_schema(kind),
+        .format = format,
+        .num_flags = kind == PB3_GPS
+                         ? sizeof(s_gps_flags) / sizeof(s_gps_flags[0])
+                         : 0,
+    };
+
+    if (strcmp(out_fname, "-") == 0) {
+        out.out.file = stdout;
+    } else {
+        out.out.file = fopen(out_fname, "wb");
+        if (out.out.file == NULL) {
+            fprintf(stderr, "Failed to open %s\n", out_fname);
+            return 1;
+        }
+    }
+    out.out.buf = malloc(WRITE_BUF_LEN);
+
+    Pb3RecordCallback cb;
+    if (format == OUT_CSV) {
+        if (csv_names) {
+            write_csv_header(&out);
+        }
+        cb = write_csv_row;
+    } else {
+        out.block = malloc(COL_BLOCK_ROWS * MAX_OUT_COLS * sizeof(Pb3Value));
+        write_col_header(&out);
+        cb = add_col_row;
+    }
+
+    Pb3Decoder dec;
+    pb3_decoder_init(&dec, kind);
+    // Without a header there is no known record boundary to start from
+    dec.in_sync = pos != 0;
+
+    clock_t start = clock();
+    uint64_t total_bytes = buf_len;
+    while (true) {
+        pos += pb3_decode_buffer(&dec, read_buf + pos, buf_len - pos, eof, cb,
+                                 &out);
+        if (eof) {
+            break;
+        }
+
+        // Keep the undecoded tail and refill behind it
+        memmove(read_buf, read_buf + pos, buf_len - pos);
+        buf_len -= pos;
+        pos = 0;
+        size_t n = fread(read_buf + buf_len, 1, READ_BUF_LEN - buf_len, in);
+        buf_len += n;
+        total_bytes += n;
+        eof = buf_len < READ_BUF_LEN;
+    }
+
+    if (format == OUT_COL) {
+        write_col_block(&out);
+    }
+    writer_flush(&out.out);
+    double elapsed_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    fprintf(stderr, "Decoded %llu %s records from %llu bytes in %.3f s",
+            (unsigned long long)dec.records, out.schema->name,
+            (unsigned long long)total_bytes, elapsed_s);
+    if (elapsed_s > 0) {
+        fprintf(stderr, " (%.1f MB/s)", total_bytes / elapsed_s / 1e6);
+    }
+    fprintf(stderr, "\n");
+    if (dec.skipped_bytes > 0) {
+        fprintf(stderr, "Skipped %llu corrupted bytes (%llu resyncs)\n",
+                (unsigned long long)dec.skipped_bytes,
+                (unsigned long long)dec.resyncs);
+    }
+
+    fclose(in);
+    if (out.out.file != stdout) {
+        fclose(out.out.file);
+    }
+    free(read_buf);
+    free(out.out.buf);
+    free(out.block);
+    return 0;
+}
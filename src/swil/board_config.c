@@ -10,6 +10,10 @@ static BoardConfig s_config = {
     .control_loop_period_ms = 10,             // ms
     .sensor_loop_period_ms = 100,             // ms
     .storage_loop_period_ms = 1000,           // ms
+    .storage_sensor_blocks = false,           // plain SensorFrames
+    .storage_prealloc_mb = 64,                // MB
+    .storage_sync_kb = 256,                   // KB
+    .storage_idle_sync_ms = 2000,             // ms
     .gps_loop_period_ms = 200,                // ms
     .pspcom_rx_loop_period_ms = 100,          // ms
     .pspcom_tx_ground_loop_period_ms = 5000,  // ms
@@ -38,6 +42,7 @@ static BoardConfig s_config = {
     .stage_max_sep_altitude_m = 1e9f,
     .stage_min_sep_angle_deg = -1e4,
     .stage_max_sep_angle_deg = 1e4,
+    .stage_max_sep_tilt_rate_dps = 1e4,
     .stage_sep_pyro_channel = PYRO_A1,
 
     // Stage ignititon settings
@@ -49,6 +54,7 @@ static BoardConfig s_config = {
     .stage_max_ignite_altitude_m = 1e6f,
     .stage_min_ignite_angle_deg = 0,
     .stage_max_ignite_angle_deg = 0,
+    .stage_max_ignite_tilt_rate_dps = 1e4,
     .stage_ignite_pyro_channel = PYRO_A1,
 
     // Recovery settings
@@ -58,6 +64,10 @@ static BoardConfig s_config = {
 
     // Telemetry settings
     .telemetry_frequency_hz = 433000000,  // Hz
+    .telemetry_duty_cycle_pct = 40,       // %
+
+    // Estimator settings
+    .estimator = ESTIMATOR_CONFIG_DEFAULT,
 };
 
 BoardConfig* config_get_ptr() { return &s_config; }
@@ -88,6 +98,11 @@ void config_print() {
     printf("Control loop period: %ld ms\n", config->control_loop_period_ms);
     printf("Sensor loop period: %ld ms\n", config->sensor_loop_period_ms);
     printf("Storage loop period: %ld ms\n", config->storage_loop_period_ms);
+    printf("Storage sensor blocks: %s\n",
+           config->storage_sensor_blocks ? "Yes" : "No");
+    printf("Storage preallocation: %ld MB\n", config->storage_prealloc_mb);
+    printf("Storage sync interval: %ld KB\n", config->storage_sync_kb);
+    printf("Storage idle sync age: %ld ms\n", config->storage_idle_sync_ms);
     printf("GPS loop period: %ld ms\n", config->gps_loop_period_ms);
     printf("PSPCOM RX loop period: %ld ms\n", config->pspcom_rx_loop_period_ms);
     printf("PSPCOM TX ground loop period: %ld ms\n",
@@ -118,6 +133,8 @@ void config_print() {
     printf("Stage max sep alt: %.2f m\n", config->stage_max_sep_altitude_m);
     printf("Stage min sep angle: %.2f deg\n", config->stage_min_sep_angle_deg);
     printf("Stage max sep angle: %.2f deg\n", config->stage_max_sep_angle_deg);
+    printf("Stage max sep tilt rate: %.2f deg/s\n",
+           config->stage_max_sep_tilt_rate_dps);
     printf("Stage sep pyro channel: %ld\n", config->stage_sep_pyro_channel);
 
     printf("\n----- STAGE IGNITION -----\n");
@@ -136,6 +153,8 @@ void config_print() {
            config->stage_min_ignite_angle_deg);
     printf("Stage max ignite angle: %.2f deg\n",
            config->stage_max_ignite_angle_deg);
+    printf("Stage max ignite tilt rate: %.2f deg/s\n",
+           config->stage_max_ignite_tilt_rate_dps);
     printf("Stage ignite pyro channel: %ld\n",
            config->stage_ignite_pyro_channel);
 
@@ -146,6 +165,13 @@ void config_print() {
 
     printf("\n----- TELEMETRY -----\n");
     printf("Telemetry frequency: %ld Hz\n", config->telemetry_frequency_hz);
+    printf("Telemetry duty cycle: %.1f %%\n",
+           config->telemetry_duty_cycle_pct);
+
+    printf("\n----- ESTIMATOR -----\n");
+    printf("Estimator config version: %ld\n", config->estimator.version);
+    printf("Pressure gate: %.1f stdevs\n",
+           config->estimator.pressure_gate_stdevs);
 
     printf("\nChecksum: %08lx\n", config->checksum);
     printf("========================\n");
@@ -36,6 +36,7 @@ int main() {
     printf("^ @ %.1f s\n\n", MILLIS() / 1000.);
 
     SensorFrame hwil_sensor_frame;
+    uint64_t next_gps_ms = 0;
     while (get_hwil_sensor_frame(&hwil_sensor_frame) == STATUS_OK) {
         hwil_sensor_frame.timestamp = MICROS();
         store_sensor_frame(&hwil_sensor_frame);
@@ -46,6 +47,23 @@ int main() {
             printf("^ @ %.1f s\n\n", MILLIS() / 1000.);
         }
 
+        // Poll the GPS as often as the GPS task would
+        GpsFrame hwil_gps_frame;
+        if (MILLIS() >= next_gps_ms &&
+            get_hwil_gps_frame(&hwil_gps_frame) == STATUS_OK) {
+            next_gps_ms = MILLIS() + config_get_ptr()->gps_loop_period_ms;
+            hwil_gps_frame.timestamp = MICROS();
+            se_update_gps(fp_get(), &hwil_gps_frame);
+        }
+
+        const StateFrame* replay_states;
+        size_t num_replay_states = fp_take_replay_states(&replay_states);
+        for (size_t i = 0; i < num_replay_states; i++) {
+            StateFrame state_frame = replay_states[i];
+            state_frame.gentimestamp = MICROS();
+            store_state_frame(&state_frame);
+        }
+
         if (update_status == STATUS_OK) {
             StateFrame state_frame = se_as_frame();
             state_frame.gentimestamp = MICROS();
@@ -0,0 +1,13 @@
+#include "gpio/gpio.h"
+
+// Pins don't do anything, but outputs read back what was written
+static GpioValue s_pins[256];
+
+Status gpio_mode(uint8_t pin, GpioMode mode) { return STATUS_OK; }
+
+Status gpio_write(uint8_t pin, GpioValue value) {
+    s_pins[pin] = value;
+    return STATUS_OK;
+}
+
+GpioValue gpio_read(uint8_t pin) { return s_pins[pin]; }
@@ -0,0 +1,10 @@
+#include "spi/spi.h"
+
+// Model headers
+#include "sx1276/sx1276_model.h"
+
+Status spi_exchange(SpiDevice *dev, uint8_t *tx_buf, uint8_t *rx_buf,
+                    uint16_t len) {
+    // The radio is the only SPI device modelled so far
+    return sx1276_model_spi_exchange(dev, tx_buf, rx_buf, len);
+}
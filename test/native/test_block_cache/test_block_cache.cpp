@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+#include "block_cache.h"
+}
+
+// In-memory disk image that records the transfers made to it
+class Disk {
+   public:
+    explicit Disk(uint32_t num_blocks)
+        : data(num_blocks * BLOCK_CACHE_BLOCK_LEN) {
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = (uint8_t)(i * 7 + i / BLOCK_CACHE_BLOCK_LEN);
+        }
+    }
+
+    static Status read(void* ctx, uint8_t* buf, uint32_t lba, uint32_t count) {
+        Disk* disk = (Disk*)ctx;
+        if (disk->fail) {
+            return STATUS_HARDWARE_ERROR;
+        }
+        disk->reads.push_back({lba, count});
+        memcpy(buf, &disk->data[lba * BLOCK_CACHE_BLOCK_LEN],
+               count * BLOCK_CACHE_BLOCK_LEN);
+        return STATUS_OK;
+    }
+
+    static Status write(void* ctx, const uint8_t* buf, uint32_t lba,
+                        uint32_t count) {
+        Disk* disk = (Disk*)ctx;
+        if (disk->fail) {
+            return STATUS_HARDWARE_ERROR;
+        }
+        disk->writes.push_back({lba, count});
+        memcpy(&disk->data[lba * BLOCK_CACHE_BLOCK_LEN], buf,
+               count * BLOCK_CACHE_BLOCK_LEN);
+        return STATUS_OK;
+    }
+
+    const uint8_t* block(uint32_t lba) {
+        return &data[lba * BLOCK_CACHE_BLOCK_LEN];
+    }
+
+    std::vector<uint8_t> data;
+    std::vector<std::pair<uint32_t, uint32_t>> reads;
+    std::vector<std::pair<uint32_t, uint32_t>> writes;
+    bool fail = false;
+};
+
+class TestBlockCache : public ::testing::Test {
+   protected:
+    TestBlockCache() : disk(100) {
+        block_cache_init(&cache, Disk::read, Disk::write, &disk, 100);
+    }
+
+    Disk disk;
+    BlockCache cache;
+    uint8_t buf[4 * BLOCK_CACHE_BLOCK_LEN];
+};
+
+TEST_F(TestBlockCache, SequentialReadAhead) {
+    // One block at a time, like the MSC callbacks
+    for (uint32_t lba = 10; lba < 10 + 2 * BLOCK_CACHE_RUN_BLOCKS + 1; lba++) {
+        ASSERT_EQ(block_cache_read(&cache, lba, buf, 1), STATUS_OK);
+        ASSERT_EQ(memcmp(buf, disk.block(lba), BLOCK_CACHE_BLOCK_LEN), 0);
+    }
+
+    // The first read can't tell it's sequential, after that it's whole runs
+    std::vector<std::pair<uint32_t, uint32_t>> expected = {
+        {10, 1},
+        {11, BLOCK_CACHE_RUN_BLOCKS},
+        {11 + BLOCK_CACHE_RUN_BLOCKS, BLOCK_CACHE_RUN_BLOCKS},
+    };
+    EXPECT_EQ(disk.reads, expected);
+    EXPECT_EQ(cache.stats.misses, 3);
+    EXPECT_EQ(cache.stats.hits, 2 * BLOCK_CACHE_RUN_BLOCKS - 2);
+}
+
+TEST_F(TestBlockCache, ReadAheadStopsAtEnd) {
+    ASSERT_EQ(block_cache_read(&cache, 95, buf, 1), STATUS_OK);
+    ASSERT_EQ(block_cache_read(&cache, 96, buf, 4), STATUS_OK);
+    EXPECT_EQ(memcmp(buf, disk.block(96), 4 * BLOCK_CACHE_BLOCK_LEN), 0);
+    EXPECT_EQ(disk.reads.back(), std::make_pair(96u, 4u));
+
+    EXPECT_EQ(block_cache_read(&cache, 97, buf, 4), STATUS_PARAMETER_ERROR);
+}
+
+TEST_F(TestBlockCache, RandomReads) {
+    // Only what was asked for, and cached for next time
+    ASSERT_EQ(block_cache_read(&cache, 50, buf, 2), STATUS_OK);
+    ASSERT_EQ(block_cache_read(&cache, 5, buf, 1), STATUS_OK);
+    ASSERT_EQ(block_cache_read(&cache, 51, buf, 1), STATUS_OK);
+    EXPECT_EQ(memcmp(buf, disk.block(51), BLOCK_CACHE_BLOCK_LEN), 0);
+
+    std::vector<std::pair<uint32_t, uint32_t>> expected = {{50, 2}, {5, 1}};
+    EXPECT_EQ(disk.reads, expected);
+}
+
+TEST_F(TestBlockCache, CoalescedWrites) {
+    uint8_t data[BLOCK_CACHE_BLOCK_LEN];
+    for (uint32_t lba = 20; lba < 20 + BLOCK_CACHE_WRITE_BLOCKS + 2; lba++) {
+        memset(data, lba, sizeof(data));
+        ASSERT_EQ(block_cache_write(&cache, lba, data, 1), STATUS_OK);
+    }
+
+    // Held back until there's a full run, then the rest until a flush
+    std::vector<std::pair<uint32_t, uint32_t>> expected = {
+        {20, BLOCK_CACHE_WRITE_BLOCKS}};
+    EXPECT_EQ(disk.writes, expected);
+    ASSERT_EQ(block_cache_flush(&cache), STATUS_OK);
+    expected.push_back({20 + BLOCK_CACHE_WRITE_BLOCKS, 2});
+    EXPECT_EQ(disk.writes, expected);
+
+    for (uint32_t lba = 20; lba < 20 + BLOCK_CACHE_WRITE_BLOCKS + 2; lba++) {
+        EXPECT_EQ(disk.block(lba)[0], lba);
+        EXPECT_EQ(disk.block(lba)[BLOCK_CACHE_BLOCK_LEN - 1], lba);
+    }
+
+    // Nothing left to write
+    ASSERT_EQ(block_cache_flush(&cache), STATUS_OK);
+    EXPECT_EQ(disk.writes.size(), 2u);
+}
+
+TEST_F(TestBlockCache, OutOfOrderWriteFlushes) {
+    uint8_t data[BLOCK_CACHE_BLOCK_LEN] = {1};
+    ASSERT_EQ(block_cache_write(&cache, 30, data, 1), STATUS_OK);
+    ASSERT_EQ(block_cache_write(&cache, 31, data, 1), STATUS_OK);
+    ASSERT_EQ(block_cache_write(&cache, 40, data, 1), STATUS_OK);
+
+    std::vector<std::pair<uint32_t, uint32_t>> expected = {{30, 2}};
+    EXPECT_EQ(disk.writes, expected);
+}
+
+TEST_F(TestBlockCache, ReadSeesWrites) {
+    // Cached block is updated
+    ASSERT_EQ(block_cache_read(&cache, 60, buf, 1), STATUS_OK);
+    uint8_t data[BLOCK_CACHE_BLOCK_LEN];
+    memset(data, 0xAB, sizeof(data));
+    ASSERT_EQ(block_cache_write(&cache, 60, data, 1), STATUS_OK);
+    ASSERT_EQ(block_cache_read(&cache, 60, buf, 1), STATUS_OK);
+    EXPECT_EQ(memcmp(buf, data, sizeof(data)), 0);
+
+    // Block that's only held back is written before it's read
+    memset(data, 0xCD, sizeof(data));
+    ASSERT_EQ(block_cache_write(&cache, 70, data, 1), STATUS_OK);
+    ASSERT_EQ(block_cache_read(&cache, 69, buf, 2), STATUS_OK);
+    EXPECT_EQ(memcmp(buf + BLOCK_CACHE_BLOCK_LEN, data, sizeof(data)), 0);
+    EXPECT_EQ(cache.write_count, 0u);
+}
+
+TEST_F(TestBlockCache, ReadAheadSeesWrites) {
+    ASSERT_EQ(block_cache_read(&cache, 0, buf, 1), STATUS_OK);
+
+    // Held back, outside what's read but inside the run read ahead
+    uint8_t data[BLOCK_CACHE_BLOCK_LEN];
+    memset(data, 0xAA, sizeof(data));
+    ASSERT_EQ(block_cache_write(&cache, 5, data, 1), STATUS_OK);
+    ASSERT_EQ(block_cache_read(&cache, 1, buf, 1), STATUS_OK);
+    EXPECT_EQ(cache.write_count, 0u);
+
+    ASSERT_EQ(block_cache_read(&cache, 5, buf, 1), STATUS_OK);
+    EXPECT_EQ(memcmp(buf, data, sizeof(data)), 0);
+    EXPECT_EQ(memcmp(disk.block(5), data, sizeof(data)), 0);
+}
+
+TEST_F(TestBlockCache, Invalidate) {
+    ASSERT_EQ(block_cache_read(&cache, 0, buf, 1), STATUS_OK);
+
+    // Something else writes to the disk
+    memset(&disk.data[0], 0x55, BLOCK_CACHE_BLOCK_LEN);
+    block_cache_invalidate(&cache);
+    ASSERT_EQ(block_cache_read(&cache, 0, buf, 1), STATUS_OK);
+    EXPECT_EQ(buf[0], 0x55);
+}
+
+TEST_F(TestBlockCache, Errors) {
+    disk.fail = true;
+    EXPECT_EQ(block_cache_read(&cache, 0, buf, 1), STATUS_HARDWARE_ERROR);
+
+    // Nothing was cached by the failed read
+    disk.fail = false;
+    ASSERT_EQ(block_cache_read(&cache, 0, buf, 1), STATUS_OK);
+    EXPECT_EQ(memcmp(buf, disk.block(0), BLOCK_CACHE_BLOCK_LEN), 0);
+
+    uint8_t data[BLOCK_CACHE_BLOCK_LEN] = {0};
+    ASSERT_EQ(block_cache_write(&cache, 10, data, 1), STATUS_OK);
+    disk.fail = true;
+    EXPECT_EQ(block_cache_flush(&cache), STATUS_HARDWARE_ERROR);
+
+    // Still held back, so it's written once the disk recovers
+    EXPECT_EQ(cache.write_count, 1u);
+    disk.fail = false;
+    ASSERT_EQ(block_cache_flush(&cache), STATUS_OK);
+    std::vector<std::pair<uint32_t, uint32_t>> expected = {{10, 1}};
+    EXPECT_EQ(disk.writes, expected);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
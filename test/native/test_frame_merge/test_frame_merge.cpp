@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <math.h>
+
+extern "C" {
+#include "frame_merge/frame_merge.h"
+}
+
+static void sample(FrameMerge* merge, FrameSource source, uint64_t capture_us,
+                   float value) {
+    const float values[] = {value, value + 1, value + 2};
+    ASSERT_EQ(frame_merge_sample(merge, source, capture_us, values),
+              STATUS_OK);
+}
+
+TEST(TestFrameMerge, AllSourcesTogether) {
+    FrameMerge merge;
+    EXPECT_EQ(frame_merge_init(&merge, FRAME_NUM_SOURCES, 1000),
+              STATUS_PARAMETER_ERROR);
+    ASSERT_EQ(frame_merge_init(&merge, FRAME_SOURCE_ACC_I, 1000), STATUS_OK);
+
+    // Polled one after the other
+    sample(&merge, FRAME_SOURCE_BARO, 5000, 20);
+    sample(&merge, FRAME_SOURCE_ACC_H, 5000, 1);
+    sample(&merge, FRAME_SOURCE_ACC_I, 5000, 4);
+    sample(&merge, FRAME_SOURCE_ROT_I, 5000, 7);
+    sample(&merge, FRAME_SOURCE_MAG_I, 5000, 10);
+
+    SensorFrame frame;
+    frame_merge_take(&merge, 5100, &frame);
+    EXPECT_EQ(frame.timestamp, 5000);
+    EXPECT_FLOAT_EQ(frame.temperature, 20);
+    EXPECT_FLOAT_EQ(frame.pressure, 21);
+    EXPECT_FLOAT_EQ(frame.acc_h_x, 1);
+    EXPECT_FLOAT_EQ(frame.acc_h_z, 3);
+    EXPECT_FLOAT_EQ(frame.acc_i_x, 4);
+    EXPECT_FLOAT_EQ(frame.acc_i_y, 5);
+    EXPECT_FLOAT_EQ(frame.rot_i_z, 9);
+    EXPECT_FLOAT_EQ(frame.mag_i_x, 10);
+    EXPECT_FLOAT_EQ(frame.mag_i_z, 12);
+    for (int i = 0; i < FRAME_NUM_SOURCES; i++) {
+        EXPECT_EQ(merge.stats[i].samples, 1);
+        EXPECT_EQ(merge.stats[i].overwritten, 0);
+        EXPECT_EQ(merge.stats[i].stale, 0);
+    }
+}
+
+TEST(TestFrameMerge, StampedWithTimebase) {
+    FrameMerge merge;
+    ASSERT_EQ(frame_merge_init(&merge, FRAME_SOURCE_ACC_I, 1000), STATUS_OK);
+
+    // Each sensor's own capture time, some after the timebase's
+    sample(&merge, FRAME_SOURCE_BARO, 9000, 20);
+    sample(&merge, FRAME_SOURCE_ACC_H, 9800, 1);
+    sample(&merge, FRAME_SOURCE_ACC_I, 10000, 4);
+    sample(&merge, FRAME_SOURCE_ROT_I, 10400, 7);
+    sample(&merge, FRAME_SOURCE_MAG_I, 11200, 10);
+
+    SensorFrame frame;
+    frame_merge_take(&merge, 11500, &frame);
+    EXPECT_EQ(frame.timestamp, 10000);
+    EXPECT_FLOAT_EQ(frame.temperature, 20);
+    EXPECT_FLOAT_EQ(frame.acc_h_x, 1);
+    EXPECT_FLOAT_EQ(frame.rot_i_x, 7);
+
+    // Too far after the timebase sample to belong with it
+    EXPECT_TRUE(isnan(frame.mag_i_x));
+    EXPECT_TRUE(isnan(frame.mag_i_y));
+    EXPECT_TRUE(isnan(frame.mag_i_z));
+    EXPECT_EQ(merge.stats[FRAME_SOURCE_MAG_I].stale, 1);
+    EXPECT_TRUE(frame_merge_is_recent(&merge, FRAME_SOURCE_MAG_I, 11500));
+    EXPECT_FALSE(frame_merge_is_recent(&merge, FRAME_SOURCE_BARO, 11500));
+}
+
+TEST(TestFrameMerge, TimestampsIncrease) {
+    FrameMerge merge;
+    ASSERT_EQ(frame_merge_init(&merge, FRAME_SOURCE_ACC_I, 1000), STATUS_OK);
+    SensorFrame frame;
+
+    // Nothing sampled yet
+    frame_merge_take(&merge, 1000, &frame);
+    EXPECT_EQ(frame.timestamp, 1000);
+    EXPECT_TRUE(isnan(frame.acc_i_x));
+    EXPECT_TRUE(isnan(frame.pressure));
+
+    sample(&merge, FRAME_SOURCE_ACC_I, 2000, 4);
+    frame_merge_take(&merge, 2100, &frame);
+    EXPECT_EQ(frame.timestamp, 2000);
+
+    // Without a new timebase sample, the old one is reused until it is stale
+    frame_merge_take(&merge, 2600, &frame);
+    EXPECT_EQ(frame.timestamp, 2600);
+    EXPECT_FLOAT_EQ(frame.acc_i_x, 4);
+    frame_merge_take(&merge, 3500, &frame);
+    EXPECT_EQ(frame.timestamp, 3500);
+    EXPECT_TRUE(isnan(frame.acc_i_x));
+
+    // A capture from before the last frame doesn't take time backwards
+    sample(&merge, FRAME_SOURCE_ACC_I, 3400, 5);
+    frame_merge_take(&merge, 3450, &frame);
+    EXPECT_EQ(frame.timestamp, 3501);
+    EXPECT_FLOAT_EQ(frame.acc_i_x, 5);
+}
+
+TEST(TestFrameMerge, Overwritten) {
+    FrameMerge merge;
+    ASSERT_EQ(frame_merge_init(&merge, FRAME_SOURCE_ACC_I, 1000), STATUS_OK);
+
+    // Sampled faster than frames are taken; only the latest is kept
+    sample(&merge, FRAME_SOURCE_ROT_I, 1000, 1);
+    sample(&merge, FRAME_SOURCE_ROT_I, 1250, 2);
+    sample(&merge, FRAME_SOURCE_ROT_I, 1500, 3);
+    sample(&merge, FRAME_SOURCE_ACC_I, 1500, 4);
+
+    SensorFrame frame;
+    frame_merge_take(&merge, 1600, &frame);
+    EXPECT_FLOAT_EQ(frame.rot_i_x, 3);
+    EXPECT_EQ(merge.stats[FRAME_SOURCE_ROT_I].samples, 3);
+    EXPECT_EQ(merge.stats[FRAME_SOURCE_ROT_I].overwritten, 2);
+
+    // Replacing a sample that made it into a frame isn't counted
+    sample(&merge, FRAME_SOURCE_ROT_I, 1750, 5);
+    EXPECT_EQ(merge.stats[FRAME_SOURCE_ROT_I].overwritten, 2);
+    EXPECT_EQ(merge.frames, 1);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
@@ -0,0 +1,568 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "kalman.h"
+}
+
+#define FLIGHT_DATA_DIR "data"
+#define GROUND_SAMPLES 100
+
+// Allowed difference between the batch and sequential updates
+#define POS_TOL_M 0.05f
+#define VEL_TOL_MPS 0.02f
+#define ACC_TOL_MPS2 0.01f
+
+// Allowed difference between the standard and UD filters, in standard
+// deviations (rounding can flip the baro speed cutoffs for a step)
+#define UD_TOL_SIGMA 0.05f
+
+// Allowed difference between the single rate and multirate filters, in
+// standard deviations, overall and at worst
+#define MULTIRATE_RMS_TOL_SIGMA 0.2f
+#define MULTIRATE_MAX_TOL_SIGMA 1.5f
+
+typedef struct {
+    float time_s;
+    float pressure;
+    float acc_h[3];
+    float acc_i[3];
+    float rot[3];
+} FlightSample;
+
+typedef struct {
+    float pos;
+    float vel;
+    float acc;
+    float pos_var;
+    float vel_var;
+    float acc_var;
+} KinState;
+
+typedef enum {
+    KF_MODE_BATCH,
+    KF_MODE_SEQUENTIAL,
+    KF_MODE_UD,
+} KfMode;
+
+static std::vector<FlightSample> load_flight(const std::string& path) {
+    std::vector<FlightSample> samples;
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return samples;
+    }
+
+    // timestamp,temperature,pressure,acc_h_xyz,acc_i_xyz,rot_i_xyz,mag_i_xyz
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        float cols[15];
+        int num_cols = 0;
+        char* tok = strtok(line, ",");
+        while (tok != nullptr && num_cols < 15) {
+            cols[num_cols++] = strtof(tok, nullptr);
+            tok = strtok(nullptr, ",");
+        }
+        if (num_cols < 12) {
+            continue;
+        }
+
+        FlightSample sample;
+        sample.time_s = cols[0] / 1e6f;
+        sample.pressure = cols[2];
+        for (int i = 0; i < 3; i++) {
+            sample.acc_h[i] = cols[3 + i];
+            sample.acc_i[i] = cols[6 + i];
+            sample.rot[i] = cols[9 + i] * M_PI / 180;
+        }
+        samples.push_back(sample);
+    }
+
+    fclose(file);
+    return samples;
+}
+
+typedef struct {
+    int up;  // accel axis that's up (the one reading ~1g)
+    float up_sign;
+    size_t apogee_idx;  // ascent until minimum pressure, descent after
+    float ground_pressure;
+} FlightInfo;
+
+static FlightInfo flight_info(const std::vector<FlightSample>& data) {
+    FlightInfo info = {0, 1, 0, 0};
+
+    float p_sum = 0;
+    int p_num = 0;
+    float axis_sum[3] = {0};
+    for (size_t i = 0; i < data.size() && i < GROUND_SAMPLES; i++) {
+        if (!isnan(data[i].pressure)) {
+            p_sum += data[i].pressure;
+            p_num++;
+        }
+        for (int j = 0; j < 3; j++) {
+            float acc = isnan(data[i].acc_i[j]) ? data[i].acc_h[j]
+                                                : data[i].acc_i[j];
+            if (!isnan(acc)) {
+                axis_sum[j] += acc;
+            }
+        }
+    }
+    for (int j = 1; j < 3; j++) {
+        if (fabsf(axis_sum[j]) > fabsf(axis_sum[info.up])) {
+            info.up = j;
+        }
+    }
+    info.up_sign = axis_sum[info.up] < 0 ? -1 : 1;
+    info.ground_pressure = p_sum / p_num;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i].pressure < data[info.apogee_idx].pressure) {
+            info.apogee_idx = i;
+        }
+    }
+    return info;
+}
+
+static void init_filter(const FlightInfo& info, KfMode mode) {
+    EXPECT_EQ(kf_init_mats(), STATUS_OK);
+    mfloat x0[NUM_TOT_STATES] = {0, 0, 0, 1, 0, 0, 0};
+    mfloat P0_diag[NUM_TOT_STATES] = {30, 30, 500, 1, 1, 1, 1};
+    kf_init_state(x0, P0_diag);
+    kf_set_initial_alt(kf_pressureToAlt(info.ground_pressure));
+    kf_set_sequential_update(mode == KF_MODE_SEQUENTIAL);
+    kf_set_ud_filter(mode == KF_MODE_UD);
+}
+
+static KinState read_state() {
+    StateEst state;
+    kf_write_state(&state);
+    return {state.posEkf,    state.velEkf,    state.accEkf,
+            state.posVarEkf, state.velVarEkf, state.accVarEkf};
+}
+
+// Replay a flight through the EKF, predicting and updating together
+static std::vector<KinState> run_flight(const std::vector<FlightSample>& data,
+                                        KfMode mode) {
+    std::vector<KinState> out;
+    FlightInfo info = flight_info(data);
+    init_filter(info, mode);
+
+    for (size_t i = 1; i < data.size(); i++) {
+        const FlightSample& s = data[i];
+        KfInputVector input = {
+            .pressure = s.pressure,
+            .acc_h = info.up_sign * s.acc_h[info.up],
+            .acc_i = info.up_sign * s.acc_i[info.up],
+            .rot_x = s.rot[0],
+            .rot_y = s.rot[1],
+            .rot_z = s.rot[2],
+        };
+        FlightPhase phase = i < info.apogee_idx ? FP_COAST : FP_DROGUE;
+        kf_do_kf(phase, input, s.time_s - data[i - 1].time_s);
+        out.push_back(read_state());
+    }
+
+    kf_set_ud_filter(false);
+    kf_free_mats();
+    return out;
+}
+
+// Replay a flight through the multirate filter, the same way se_update feeds
+// it, but with each baro reading arriving baro_delay samples late. Every
+// flush_every samples, the readings still to come are delivered.
+static std::vector<KinState> run_flight_multirate(
+    const std::vector<FlightSample>& data, KfMode mode, size_t baro_delay,
+    size_t flush_every) {
+    std::vector<KinState> out;
+    FlightInfo info = flight_info(data);
+    init_filter(info, mode);
+
+    size_t next_baro = 1;
+    for (size_t i = 1; i < data.size(); i++) {
+        const FlightSample& s = data[i];
+        FlightPhase phase = i < info.apogee_idx ? FP_COAST : FP_DROGUE;
+        kf_imu_step(phase, s.time_s, info.up_sign * s.acc_h[info.up],
+                    info.up_sign * s.acc_i[info.up], s.rot);
+
+        size_t last_baro = i;
+        if (i % flush_every != 0) {
+            last_baro = i > baro_delay ? i - baro_delay : 0;
+        }
+        for (; next_baro <= last_baro; next_baro++) {
+            const FlightSample& b = data[next_baro];
+            kf_baro_step(next_baro < info.apogee_idx ? FP_COAST : FP_DROGUE,
+                         b.time_s, b.pressure);
+        }
+        out.push_back(read_state());
+    }
+
+    kf_set_ud_filter(false);
+    kf_free_mats();
+    return out;
+}
+
+static std::vector<std::string> flight_files() {
+    std::vector<std::string> paths;
+    for (const auto& dir :
+         std::filesystem::directory_iterator(FLIGHT_DATA_DIR)) {
+        for (const auto& file : std::filesystem::directory_iterator(dir)) {
+            std::string path = file.path().string();
+            if (path.size() >= 7 && path.substr(path.size() - 7) == "dat.csv") {
+                paths.push_back(path);
+            }
+        }
+    }
+    return paths;
+}
+
+TEST(TestKalman, SequentialMatchesBatch) {
+    std::vector<std::string> paths = flight_files();
+    EXPECT_GT(paths.size(), 0);
+
+    for (const std::string& path : paths) {
+        SCOPED_TRACE(path);
+
+        std::vector<FlightSample> data = load_flight(path);
+        ASSERT_GT(data.size(), GROUND_SAMPLES);
+
+        std::vector<KinState> batch = run_flight(data, KF_MODE_BATCH);
+        std::vector<KinState> seq = run_flight(data, KF_MODE_SEQUENTIAL);
+        ASSERT_EQ(batch.size(), seq.size());
+
+        float pos_err = 0, vel_err = 0, acc_err = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            pos_err = fmaxf(pos_err, fabsf(batch[i].pos - seq[i].pos));
+            vel_err = fmaxf(vel_err, fabsf(batch[i].vel - seq[i].vel));
+            acc_err = fmaxf(acc_err, fabsf(batch[i].acc - seq[i].acc));
+        }
+        EXPECT_LT(pos_err, POS_TOL_M);
+        EXPECT_LT(vel_err, VEL_TOL_MPS);
+        EXPECT_LT(acc_err, ACC_TOL_MPS2);
+    }
+}
+
+TEST(TestKalman, UdMatchesBatch) {
+    std::vector<std::string> paths = flight_files();
+    EXPECT_GT(paths.size(), 0);
+
+    for (const std::string& path : paths) {
+        SCOPED_TRACE(path);
+
+        std::vector<FlightSample> data = load_flight(path);
+        ASSERT_GT(data.size(), GROUND_SAMPLES);
+
+        std::vector<KinState> batch = run_flight(data, KF_MODE_BATCH);
+        std::vector<KinState> ud = run_flight(data, KF_MODE_UD);
+        ASSERT_EQ(batch.size(), ud.size());
+
+        float pos_err = 0, vel_err = 0, acc_err = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            pos_err = fmaxf(pos_err, fabsf(batch[i].pos - ud[i].pos) /
+                                         sqrtf(batch[i].pos_var));
+            vel_err = fmaxf(vel_err, fabsf(batch[i].vel - ud[i].vel) /
+                                         sqrtf(batch[i].vel_var));
+            acc_err = fmaxf(acc_err, fabsf(batch[i].acc - ud[i].acc) /
+                                         sqrtf(batch[i].acc_var));
+            ASSERT_GT(ud[i].pos_var, 0);
+            ASSERT_GT(ud[i].vel_var, 0);
+            ASSERT_GT(ud[i].acc_var, 0);
+        }
+        EXPECT_LT(pos_err, UD_TOL_SIGMA);
+        EXPECT_LT(vel_err, UD_TOL_SIGMA);
+        EXPECT_LT(acc_err, UD_TOL_SIGMA);
+    }
+}
+
+TEST(TestKalman, MultirateMatchesSingleRate) {
+    // With every reading on time, the only difference is that the baro is
+    // linearized and gated after the accel update rather than before, which
+    // can flip the gate for a step
+    std::vector<std::string> paths = flight_files();
+    EXPECT_GT(paths.size(), 0);
+
+    for (const std::string& path : paths) {
+        SCOPED_TRACE(path);
+
+        std::vector<FlightSample> data = load_flight(path);
+        ASSERT_GT(data.size(), GROUND_SAMPLES);
+
+        std::vector<KinState> single = run_flight(data, KF_MODE_SEQUENTIAL);
+        std::vector<KinState> multi =
+            run_flight_multirate(data, KF_MODE_SEQUENTIAL, 0, 1);
+        ASSERT_EQ(single.size(), multi.size());
+
+        float pos_max = 0, vel_max = 0;
+        double pos_sq = 0, vel_sq = 0;
+        for (size_t i = 0; i < single.size(); i++) {
+            float pos_err = fabsf(single[i].pos - multi[i].pos) /
+                            sqrtf(single[i].pos_var);
+            float vel_err = fabsf(single[i].vel - multi[i].vel) /
+                            sqrtf(single[i].vel_var);
+            pos_max = fmaxf(pos_max, pos_err);
+            vel_max = fmaxf(vel_max, vel_err);
+            pos_sq += pos_err * pos_err;
+            vel_sq += vel_err * vel_err;
+        }
+        EXPECT_LT(sqrt(pos_sq / single.size()), MULTIRATE_RMS_TOL_SIGMA);
+        EXPECT_LT(sqrt(vel_sq / single.size()), MULTIRATE_RMS_TOL_SIGMA);
+        EXPECT_LT(pos_max, MULTIRATE_MAX_TOL_SIGMA);
+        EXPECT_LT(vel_max, MULTIRATE_MAX_TOL_SIGMA);
+    }
+}
+
+TEST(TestKalman, MultirateLateBaro) {
+    // Readings that arrive late are fused at their own time, so once they've
+    // all arrived the state is the same as if they'd been on time
+    std::vector<std::string> paths = flight_files();
+    EXPECT_GT(paths.size(), 0);
+
+    for (const std::string& path : paths) {
+        SCOPED_TRACE(path);
+
+        std::vector<FlightSample> data = load_flight(path);
+        ASSERT_GT(data.size(), GROUND_SAMPLES);
+
+        std::vector<KinState> on_time =
+            run_flight_multirate(data, KF_MODE_SEQUENTIAL, 0, 1);
+        std::vector<KinState> late = run_flight_multirate(
+            data, KF_MODE_SEQUENTIAL, KF_HISTORY_LEN - 1, 50);
+        ASSERT_EQ(on_time.size(), late.size());
+
+        for (size_t i = 49; i < on_time.size(); i += 50) {
+            ASSERT_NEAR(late[i].pos, on_time[i].pos, 1e-3) << i;
+            ASSERT_NEAR(late[i].vel, on_time[i].vel, 1e-3) << i;
+            ASSERT_NEAR(late[i].acc, on_time[i].acc, 1e-3) << i;
+            ASSERT_NEAR(late[i].pos_var, on_time[i].pos_var, 1e-3) << i;
+        }
+    }
+}
+
+TEST(TestKalman, MultirateTooLate) {
+    EXPECT_EQ(kf_init_mats(), STATUS_OK);
+    mfloat x0[NUM_TOT_STATES] = {100, 0, 0, 1, 0, 0, 0};
+    mfloat P0_diag[NUM_TOT_STATES] = {30, 30, 500, 1, 1, 1, 1};
+    kf_init_state(x0, P0_diag);
+    kf_set_sequential_update(true);
+
+    mfloat w[NUM_ROT_MEAS] = {0, 0, 0};
+    for (int i = 0; i <= KF_HISTORY_LEN + 1; i++) {
+        kf_imu_step(FP_COAST, 0.01f * i, 1, 1, w);
+    }
+    StateEst before;
+    kf_write_state(&before);
+
+    // From before the oldest step kept, so dropped
+    EXPECT_EQ(kf_baro_step(FP_COAST, 0, 1000), KF_TOO_OLD);
+    // No reading, so nothing to do
+    EXPECT_EQ(kf_baro_step(FP_COAST, 0.1f, NAN), KF_NO_VALID_MEAS);
+    StateEst after;
+    kf_write_state(&after);
+    EXPECT_EQ(before.posEkf, after.posEkf);
+    EXPECT_EQ(before.posVarEkf, after.posVarEkf);
+
+    // Within the history, so fused
+    EXPECT_EQ(kf_baro_step(FP_COAST, 0.05f, kf_altToPressure(100)),
+              KF_SUCCESS);
+    kf_write_state(&after);
+    EXPECT_LT(after.posVarEkf, before.posVarEkf);
+
+    kf_set_sequential_update(false);
+    kf_free_mats();
+}
+
+TEST(TestKalman, GpsUpdate) {
+    // Altitude and velocity are states, so each update is the scalar Kalman
+    // update, with either filter
+    for (bool ud : {false, true}) {
+        SCOPED_TRACE(ud ? "ud" : "standard");
+        EXPECT_EQ(kf_init_mats(), STATUS_OK);
+        mfloat x0[NUM_TOT_STATES] = {0, 0, 0, 1, 0, 0, 0};
+        mfloat P0_diag[NUM_TOT_STATES] = {30, 20, 500, 1, 1, 1, 1};
+        kf_init_state(x0, P0_diag);
+        kf_set_initial_alt(200);
+        kf_set_ud_filter(ud);
+
+        mfloat z_gps[NUM_GPS_MEAS] = {10, NAN};
+        mfloat R_gps[NUM_GPS_MEAS] = {10, 5};
+        EXPECT_EQ(kf_update_gps(z_gps, R_gps), KF_SUCCESS);
+        KinState state = read_state();
+        EXPECT_NEAR(state.pos, 10 * 30.f / 40, 1e-4);
+        EXPECT_NEAR(state.pos_var, 30 * 10.f / 40, 1e-4);
+        EXPECT_EQ(state.vel, 0);
+
+        z_gps[KF_GPS_ALT] = NAN;
+        z_gps[KF_GPS_VEL] = -5;
+        EXPECT_EQ(kf_update_gps(z_gps, R_gps), KF_SUCCESS);
+        state = read_state();
+        EXPECT_NEAR(state.vel, -5 * 20.f / 25, 1e-4);
+        EXPECT_NEAR(state.vel_var, 20 * 5.f / 25, 1e-4);
+
+        z_gps[KF_GPS_VEL] = NAN;
+        EXPECT_EQ(kf_update_gps(z_gps, R_gps), KF_NO_VALID_MEAS);
+
+        // Far outside the gate, so rejected, until P has grown to match
+        z_gps[KF_GPS_ALT] = 100;
+        EXPECT_EQ(kf_update_gps(z_gps, R_gps), KF_NO_VALID_MEAS);
+        EXPECT_EQ(read_state().pos, state.pos);
+        mfloat w[NUM_ROT_MEAS] = {0, 0, 0};
+        mfloat z[NUM_KIN_MEAS] = {NAN, NAN, NAN};
+        mfloat R_diag[NUM_KIN_MEAS];
+        kf_preprocess(z, R_diag, FP_COAST);  // sets Q
+        if (ud) {
+            kf_ud_to_P();
+        }
+        for (int i = 0; i < 100; i++) {
+            kf_predict(0.1f, w);
+        }
+        if (ud) {
+            kf_ud_factor();
+        }
+        EXPECT_EQ(kf_update_gps(z_gps, R_gps), KF_SUCCESS);
+
+        kf_set_ud_filter(false);
+        kf_free_mats();
+    }
+}
+
+// A climb at constant acceleration, with GPS fixes every gps_every samples
+// that arrive delay samples late. Fixes are fused at their own time if
+// compensate, otherwise at the time they arrive. Returns the position error
+// at each sample.
+static std::vector<float> run_gps_climb(size_t gps_every, size_t delay,
+                                        bool compensate,
+                                        std::vector<KinState>* out) {
+    const float dt = 0.01f;
+    const float acc = 20;
+    EXPECT_EQ(kf_init_mats(), STATUS_OK);
+    mfloat x0[NUM_TOT_STATES] = {0, 0, 0, 1, 0, 0, 0};
+    mfloat P0_diag[NUM_TOT_STATES] = {30, 30, 500, 1, 1, 1, 1};
+    kf_init_state(x0, P0_diag);
+    kf_set_initial_alt(0);
+    kf_set_sequential_update(true);
+
+    // Start off 20 m/s slow
+    mfloat z_gps[NUM_GPS_MEAS];
+    mfloat R_gps[NUM_GPS_MEAS] = {4, 0.25f};
+    mfloat w[NUM_ROT_MEAS] = {0, 0, 0};
+    std::vector<float> errors;
+    for (size_t i = 1; i < 500; i++) {
+        float t = i * dt;
+        float acc_meas = acc / G + 1;
+        kf_imu_step(FP_COAST, t, acc_meas, acc_meas, w);
+
+        if (i > delay && (i - delay) % gps_every == 0) {
+            float t_fix = (i - delay) * dt;
+            z_gps[KF_GPS_ALT] = 20 * t_fix + 0.5f * acc * t_fix * t_fix;
+            z_gps[KF_GPS_VEL] = 20 + acc * t_fix;
+            kf_gps_step(FP_COAST, compensate ? t_fix : t, z_gps, R_gps);
+        }
+
+        KinState state = read_state();
+        errors.push_back(state.pos - (20 * t + 0.5f * acc * t * t));
+        if (out != nullptr) {
+            out->push_back(state);
+        }
+    }
+
+    kf_set_sequential_update(false);
+    kf_free_mats();
+    return errors;
+}
+
+TEST(TestKalman, GpsLateFix) {
+    // Late fixes fused at their own time end up the same as on time fixes
+    std::vector<KinState> on_time;
+    std::vector<KinState> late;
+    run_gps_climb(20, 0, true, &on_time);
+    run_gps_climb(20, KF_HISTORY_LEN / 2, true, &late);
+    ASSERT_EQ(on_time.size(), late.size());
+    for (size_t i = KF_HISTORY_LEN / 2; i < on_time.size(); i += 20) {
+        ASSERT_NEAR(late[i - 1].pos, on_time[i - 1].pos, 1e-3) << i;
+        ASSERT_NEAR(late[i - 1].vel, on_time[i - 1].vel, 1e-3) << i;
+        ASSERT_NEAR(late[i - 1].pos_var, on_time[i - 1].pos_var, 1e-3) << i;
+    }
+
+    // And track the climb, where treating them as current lags behind
+    std::vector<float> compensated =
+        run_gps_climb(20, KF_HISTORY_LEN / 2, true, nullptr);
+    std::vector<float> naive =
+        run_gps_climb(20, KF_HISTORY_LEN / 2, false, nullptr);
+    EXPECT_LT(fabsf(compensated.back()), 0.5f);
+    EXPECT_GT(fabsf(naive.back()), 5 * fabsf(compensated.back()));
+}
+
+TEST(TestKalman, SequentialAllNans) {
+    EXPECT_EQ(kf_init_mats(), STATUS_OK);
+    mfloat x0[NUM_TOT_STATES] = {100, 0, 0, 1, 0, 0, 0};
+    mfloat P0_diag[NUM_TOT_STATES] = {30, 30, 500, 1, 1, 1, 1};
+    kf_init_state(x0, P0_diag);
+
+    mfloat z[NUM_KIN_MEAS] = {NAN, NAN, NAN};
+    mfloat R_diag[NUM_KIN_MEAS] = {4, 1, 1};
+    EXPECT_EQ(kf_update_sequential(z, R_diag), KF_NO_VALID_MEAS);
+
+    kf_free_mats();
+}
+
+TEST(TestKalman, UdPredictFailureKeepsFactors) {
+    EXPECT_EQ(kf_init_mats(), STATUS_OK);
+    mfloat x0[NUM_TOT_STATES] = {100, 0, 0, 1, 0, 0, 0};
+
+    // Not positive definite in the last state the predict works through
+    mfloat P0_diag[NUM_TOT_STATES] = {-1000, 30, 500, 1, 1, 1, 1};
+    kf_init_state(x0, P0_diag);
+    kf_set_ud_filter(true);
+
+    KinState before = read_state();
+    mfloat w[NUM_ROT_MEAS] = {0, 0, 0};
+    EXPECT_EQ(kf_predict_ud(0.01f, w), KF_ERROR);
+    KinState after = read_state();
+    EXPECT_EQ(after.pos_var, before.pos_var);
+    EXPECT_EQ(after.vel_var, before.vel_var);
+    EXPECT_EQ(after.acc_var, before.acc_var);
+
+    kf_set_ud_filter(false);
+    kf_free_mats();
+}
+
+TEST(TestKalman, NoiseOverride) {
+    EXPECT_EQ(kf_init_mats(), STATUS_OK);
+    mfloat x0[NUM_TOT_STATES] = {100, 0, 0, 1, 0, 0, 0};
+    mfloat P0_diag[NUM_TOT_STATES] = {30, 30, 500, 1, 1, 1, 1};
+    kf_init_state(x0, P0_diag);
+
+    const KfNoise defaults = *kf_get_noise();
+    KfNoise noise = defaults;
+    noise.r_diag_1[KF_BARO] = 1.5;
+    noise.r_diag_2[KF_BARO] = 0.25;
+    kf_set_noise(&noise);
+    noise.r_diag_1[KF_BARO] = 99;  // copied, so this doesn't count
+
+    mfloat z[NUM_KIN_MEAS] = {1000, 1, 1};
+    mfloat R_diag[NUM_KIN_MEAS];
+    kf_preprocess(z, R_diag, FP_COAST);
+    EXPECT_FLOAT_EQ(R_diag[KF_BARO], 1.5);
+    kf_preprocess(z, R_diag, FP_MAIN);
+    EXPECT_FLOAT_EQ(R_diag[KF_BARO], 0.25);
+
+    kf_set_noise(NULL);
+    kf_preprocess(z, R_diag, FP_COAST);
+    EXPECT_FLOAT_EQ(R_diag[KF_BARO], defaults.r_diag_1[KF_BARO]);
+
+    kf_free_mats();
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
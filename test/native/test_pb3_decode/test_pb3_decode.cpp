@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+#include "pb3_decode.h"
+#include "pb_create.h"
+}
+
+#define NUM_TEST_FRAMES 200
+#define TEST_HEADER "v1.2-3-gabcdef 0x1f2e3d\n"
+
+typedef std::vector<Pb3Value> Row;
+
+static float random_float(float min, float max) {
+    return min + ((float)rand() / RAND_MAX) * (max - min);
+}
+
+static SensorFrame make_sensor_frame(int i) {
+    SensorFrame frame;
+    frame.timestamp = 1000 + 10000 * (uint64_t)i;
+    frame.temperature = random_float(20.0, 30.0);
+    frame.pressure = random_float(900.0, 1100.0);
+    frame.acc_h_x = random_float(-16.0, 16.0);
+    frame.acc_h_y = random_float(-16.0, 16.0);
+    frame.acc_h_z = 0;  // Left out by the encoder
+    frame.acc_i_x = NAN;
+    frame.acc_i_y = -0.0f;
+    frame.acc_i_z = random_float(-16.0, 16.0);
+    frame.rot_i_x = random_float(-2000.0, 2000.0);
+    frame.rot_i_y = random_float(-2000.0, 2000.0);
+    frame.rot_i_z = random_float(-2000.0, 2000.0);
+    frame.mag_i_x = random_float(-1.0, 1.0);
+    frame.mag_i_y = random_float(-1.0, 1.0);
+    frame.mag_i_z = random_float(-1.0, 1.0);
+    return frame;
+}
+
+static void append(std::vector<uint8_t>& buf, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    buf.insert(buf.end(), bytes, bytes + size);
+}
+
+// Build a file the same way task_storage does
+static std::vector<uint8_t> make_sensor_file(
+    std::vector<SensorFrame>& frames) {
+    std::vector<uint8_t> file;
+    append(file, TEST_HEADER, strlen(TEST_HEADER));
+    for (int i = 0; i < NUM_TEST_FRAMES; i++) {
+        frames.push_back(make_sensor_frame(i));
+        size_t size;
+        pb_byte_t* buf = create_sensor_buffer(&frames.back(), &size);
+        EXPECT_NE(buf, nullptr);
+        append(file, buf, size);
+    }
+    return file;
+}
+
+static void collect_row(const Pb3Value* values, void* ctx) {
+    std::vector<Row>* rows = (std::vector<Row>*)ctx;
+    rows->push_back(Row(values, values + PB3_MAX_FIELDS));
+}
+
+static void expect_float_eq(float a, float b) {
+    if (isnan(a)) {
+        EXPECT_TRUE(isnan(b));
+    } else {
+        EXPECT_EQ(a, b);
+        EXPECT_EQ(signbit(a), signbit(b));
+    }
+}
+
+static void expect_sensor_eq(const SensorFrame& frame, const Row& row) {
+    EXPECT_EQ(frame.timestamp, row[0].u);
+    const float* fields = &frame.temperature;
+    for (int i = 0; i < 14; i++) {
+        expect_float_eq(fields[i], row[1 + i].f);
+    }
+}
+
+// Decode a whole file, feeding it in chunks like the pb3_decode tool
+static std::vector<Row> decode_file(Pb3Decoder* dec, Pb3Kind kind,
+                                    const std::vector<uint8_t>& file,
+                                    size_t chunk_len) {
+    std::vector<Row> rows;
+
+    size_t start = pb3_parse_header(file.data(), file.size(), nullptr, 0);
+    EXPECT_EQ(start, strlen(TEST_HEADER));
+    pb3_decoder_init(dec, kind);
+
+    std::vector<uint8_t> buf;
+    size_t pos = start;
+    while (true) {
+        size_t n = std::min(chunk_len, file.size() - pos);
+        append(buf, file.data() + pos, n);
+        pos += n;
+        bool eof = pos == file.size();
+
+        size_t used = pb3_decode_buffer(dec, buf.data(), buf.size(), eof,
+                                        collect_row, &rows);
+        buf.erase(buf.begin(), buf.begin() + used);
+        if (eof) {
+            break;
+        }
+    }
+    EXPECT_EQ(buf.size(), 0);
+    return rows;
+}
+
+TEST(TestPb3Decode, Header) {
+    char spec[64];
+    const uint8_t good[] = TEST_HEADER "\x08";
+    EXPECT_EQ(pb3_parse_header(good, sizeof(good) - 1, spec, sizeof(spec)),
+              strlen(TEST_HEADER));
+    EXPECT_STREQ(spec, "v1.2-3-gabcdef 0x1f2e3d");
+
+    // Truncated to fit the output
+    EXPECT_EQ(pb3_parse_header(good, sizeof(good) - 1, spec, 5),
+              strlen(TEST_HEADER));
+    EXPECT_STREQ(spec, "v1.2");
+
+    const uint8_t no_newline[] = "v1.2-3-gabcdef";
+    EXPECT_EQ(pb3_parse_header(no_newline, sizeof(no_newline) - 1, spec,
+                               sizeof(spec)),
+              0);
+
+    const uint8_t binary[] = "\x08\x90\x4e\n";
+    EXPECT_EQ(pb3_parse_header(binary, sizeof(binary) - 1, spec, sizeof(spec)),
+              0);
+
+    const uint8_t empty[] = "\n";
+    EXPECT_EQ(pb3_parse_header(empty, sizeof(empty) - 1, spec, sizeof(spec)),
+              0);
+}
+
+TEST(TestPb3Decode, KindFromName) {
+    Pb3Kind kind;
+    EXPECT_TRUE(pb3_kind_from_fname("dat_2024-06-01-0.pb3", &kind));
+    EXPECT_EQ(kind, PB3_SENSOR);
+    EXPECT_TRUE(pb3_kind_from_fname("logs/fsl/fsl_2024-06-01-3.pb3", &kind));
+    EXPECT_EQ(kind, PB3_STATE);
+    EXPECT_TRUE(pb3_kind_from_fname("C:\\logs\\gps_2024-06-01-3.pb3", &kind));
+    EXPECT_EQ(kind, PB3_GPS);
+    EXPECT_FALSE(pb3_kind_from_fname("log_2024-06-01-0.txt", &kind));
+
+    EXPECT_TRUE(pb3_kind_from_name("state", &kind));
+    EXPECT_EQ(kind, PB3_STATE);
+    EXPECT_FALSE(pb3_kind_from_name("dat", &kind));
+}
+
+TEST(TestPb3Decode, SensorRoundTrip) {
+    std::vector<SensorFrame> frames;
+    std::vector<uint8_t> file = make_sensor_file(frames);
+
+    // Whole file at once, and in chunks that split records
+    for (size_t chunk_len : {file.size(), (size_t)PB3_MIN_BUFFER_LEN,
+                             (size_t)7}) {
+        SCOPED_TRACE(chunk_len);
+        Pb3Decoder dec;
+        std::vector<Row> rows = decode_file(&dec, PB3_SENSOR, file, chunk_len);
+        ASSERT_EQ(rows.size(), NUM_TEST_FRAMES);
+        EXPECT_EQ(dec.records, NUM_TEST_FRAMES);
+        EXPECT_EQ(dec.resyncs, 0);
+        EXPECT_EQ(dec.skipped_bytes, 0);
+        for (int i = 0; i < NUM_TEST_FRAMES; i++) {
+            expect_sensor_eq(frames[i], rows[i]);
+        }
+    }
+}
+
+TEST(TestPb3Decode, StateAndGpsRoundTrip) {
+    StateFrame state;
+    memset(&state, 0, sizeof(state));
+    state.timestamp = 123456789012ULL;
+    state.flight_phase = 3;
+    state.pos_vert = 1234.5f;
+    state.gentimestamp = 123456789999ULL;
+    state.orient_var_ekf_z = -1e-7f;
+
+    GpsFrame gps;
+    memset(&gps, 0, sizeof(gps));
+    gps.timestamp = 42;
+    gps.year = 2024;
+    gps.sec = 59;
+    gps.valid_flags = 0xFFFFFFFFFFFFFFFFULL;
+    gps.num_sats = 12;
+    gps.lat = 40.4237f;
+    gps.accuracy_hdg = 180.0f;
+
+    size_t size;
+    const Pb3Schema* schema = pb3_schema(PB3_STATE);
+    pb_byte_t* buf = create_state_buffer(&state, &size);
+    ASSERT_NE(buf, nullptr);
+    Pb3Value values[PB3_MAX_FIELDS];
+    size_t consumed;
+    ASSERT_EQ(pb3_decode_record(schema, buf, size, values, &consumed),
+              PB3_RECORD_OK);
+    EXPECT_EQ(consumed, size);
+    EXPECT_EQ(values[0].u, state.timestamp);
+    EXPECT_EQ(values[1].u, state.flight_phase);
+    EXPECT_EQ(values[2].f, state.pos_vert);
+    EXPECT_EQ(values[3].f, 0);
+    EXPECT_EQ(values[14].u, state.gentimestamp);
+    EXPECT_EQ(values[35].f, state.orient_var_ekf_z);
+
+    // Any prefix of the record is too short to decide
+    for (size_t i = 0; i < size; i++) {
+        EXPECT_EQ(pb3_decode_record(schema, buf, i, values, &consumed),
+                  PB3_RECORD_SHORT);
+    }
+
+    schema = pb3_schema(PB3_GPS);
+    buf = create_gps_buffer(&gps, &size);
+    ASSERT_NE(buf, nullptr);
+    ASSERT_EQ(pb3_decode_record(schema, buf, size, values, &consumed),
+              PB3_RECORD_OK);
+    EXPECT_EQ(consumed, size);
+    EXPECT_EQ(values[0].u, gps.timestamp);
+    EXPECT_EQ(values[1].u, gps.year);
+    EXPECT_EQ(values[6].u, gps.sec);
+    EXPECT_EQ(values[7].u, gps.valid_flags);
+    EXPECT_EQ(values[8].u, gps.num_sats);
+    EXPECT_EQ(values[10].f, gps.lat);
+    EXPECT_EQ(values[21].f, gps.accuracy_hdg);
+
+    // Largest possible messages stay within the schema limits
+    memset(&state, 0xFF, sizeof(state));
+    state.flight_phase = UINT32_MAX;
+    buf = create_state_buffer(&state, &size);
+    ASSERT_NE(buf, nullptr);
+    EXPECT_EQ(pb3_decode_record(pb3_schema(PB3_STATE), buf, size, values,
+                                &consumed),
+              PB3_RECORD_OK);
+}
+
+TEST(TestPb3Decode, WrongMessageType) {
+    std::vector<SensorFrame> frames;
+    std::vector<uint8_t> file = make_sensor_file(frames);
+
+    // Sensor records have floats where GPS records have varints
+    Pb3Decoder dec;
+    std::vector<Row> rows = decode_file(&dec, PB3_GPS, file, file.size());
+    EXPECT_EQ(rows.size(), 0);
+}
+
+TEST(TestPb3Decode, ResyncAfterCorruption) {
+    std::vector<SensorFrame> frames;
+    std::vector<uint8_t> file = make_sensor_file(frames);
+
+    // Garble part of a record near the middle, and zero out a later stretch
+    size_t garbled = file.size() / 2;
+    for (size_t i = 0; i < 20; i++) {
+        file[garbled + i] = rand();
+    }
+    size_t zeroed = file.size() * 3 / 4;
+    memset(&file[zeroed], 0, 300);
+
+    // Cut off the last record
+    file.resize(file.size() - 5);
+
+    Pb3Decoder dec;
+    std::vector<Row> rows = decode_file(&dec, PB3_SENSOR, file, 4096);
+    EXPECT_GT(rows.size(), NUM_TEST_FRAMES - 10);
+    EXPECT_LT(rows.size(), NUM_TEST_FRAMES);
+    EXPECT_EQ(dec.resyncs, 3);
+    EXPECT_GT(dec.skipped_bytes, 300);
+
+    // Everything that was decoded is an original frame, in order
+    size_t j = 0;
+    for (const Row& row : rows) {
+        while (j < frames.size() && frames[j].timestamp != row[0].u) {
+            j++;
+        }
+        ASSERT_LT(j, frames.size());
+        expect_sensor_eq(frames[j], row);
+    }
+    EXPECT_EQ(rows.back()[0].u, frames[NUM_TEST_FRAMES - 2].timestamp);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <string>
+
+extern "C" {
+#include "queue_stats.h"
+}
+
+TEST(TestQueueStats, Levels) {
+    EXPECT_EQ(queue_stats_level(0, 64), 0);
+    EXPECT_EQ(queue_stats_level(1, 64), 1);
+    EXPECT_EQ(queue_stats_level(16, 64), 1);
+    EXPECT_EQ(queue_stats_level(17, 64), 2);
+    EXPECT_EQ(queue_stats_level(48, 64), 3);
+    EXPECT_EQ(queue_stats_level(49, 64), 4);
+    EXPECT_EQ(queue_stats_level(63, 64), 4);
+    EXPECT_EQ(queue_stats_level(64, 64), 5);
+    EXPECT_EQ(queue_stats_level(0, 1), 0);
+    EXPECT_EQ(queue_stats_level(1, 1), 5);
+}
+
+TEST(TestQueueStats, SendReceive) {
+    uint32_t stamps[4];
+    QueueStats stats;
+    queue_stats_init(&stats, "storage_gps", 4, stamps, 1000);
+
+    // Fill it up, with one send too many
+    for (int i = 0; i < 4; i++) {
+        queue_stats_sent(&stats, 1000 + 100 * i);
+    }
+    queue_stats_dropped(&stats);
+    EXPECT_EQ(queue_stats_depth(&stats), 4);
+    EXPECT_EQ(stats.high_water, 4);
+    EXPECT_EQ(stats.drops, 1);
+    EXPECT_EQ(queue_stats_oldest_age_us(&stats, 2000), 1000);
+
+    // Drain it, oldest first
+    queue_stats_received(&stats, 2000);
+    EXPECT_EQ(stats.max_wait_us, 1000);
+    EXPECT_EQ(queue_stats_oldest_age_us(&stats, 2000), 900);
+    for (int i = 0; i < 3; i++) {
+        queue_stats_received(&stats, 2100);
+    }
+    EXPECT_EQ(queue_stats_depth(&stats), 0);
+    EXPECT_EQ(queue_stats_oldest_age_us(&stats, 3000), 0);
+    EXPECT_EQ(stats.max_wait_us, 1000);
+
+    // Wraps around the stamps
+    queue_stats_sent(&stats, 5000);
+    queue_stats_received(&stats, 7000);
+    EXPECT_EQ(stats.max_wait_us, 2000);
+    EXPECT_EQ(stats.sends, 5);
+    EXPECT_EQ(stats.receives, 5);
+
+    EXPECT_EQ(queue_stats_new_drops(&stats), 1);
+    EXPECT_EQ(queue_stats_new_drops(&stats), 0);
+}
+
+TEST(TestQueueStats, ReceiveBeforeSend) {
+    // The receiver may account for an item before the sender does
+    uint32_t stamps[2];
+    QueueStats stats;
+    queue_stats_init(&stats, "pyro", 2, stamps, 0);
+    queue_stats_received(&stats, 10);
+    EXPECT_EQ(queue_stats_depth(&stats), 0);
+    queue_stats_sent(&stats, 5);
+    EXPECT_EQ(queue_stats_depth(&stats), 0);
+
+    // And everything lines up again afterwards
+    queue_stats_sent(&stats, 100);
+    EXPECT_EQ(queue_stats_depth(&stats), 1);
+    EXPECT_EQ(queue_stats_oldest_age_us(&stats, 150), 50);
+}
+
+TEST(TestQueueStats, Overwrite) {
+    uint32_t stamps[1];
+    QueueStats stats;
+    queue_stats_init(&stats, "control_sensor", 1, stamps, 0);
+
+    queue_stats_sent(&stats, 1000);
+    queue_stats_overwritten(&stats, 2000);
+    queue_stats_overwritten(&stats, 3000);
+    EXPECT_EQ(queue_stats_depth(&stats), 1);
+    EXPECT_EQ(stats.discards, 2);
+    EXPECT_EQ(queue_stats_oldest_age_us(&stats, 3500), 500);
+
+    queue_stats_received(&stats, 3500);
+    EXPECT_EQ(queue_stats_depth(&stats), 0);
+    EXPECT_EQ(stats.max_wait_us, 500);
+    EXPECT_EQ(queue_stats_new_drops(&stats), 0);
+}
+
+TEST(TestQueueStats, TimeAtLevel) {
+    uint32_t stamps[4];
+    QueueStats stats;
+    queue_stats_init(&stats, "state", 4, stamps, 0);
+
+    // Empty for 500 us, one item for 300, full for 200
+    queue_stats_sent(&stats, 500);
+    queue_stats_sent(&stats, 800);
+    queue_stats_sent(&stats, 800);
+    queue_stats_sent(&stats, 800);
+    EXPECT_EQ(stats.level_us[0], 500);
+    EXPECT_EQ(stats.level_us[1], 300);
+
+    char buf[QUEUE_STATS_FORMAT_LEN];
+    size_t len = queue_stats_format(&stats, 1000, buf, sizeof(buf));
+    EXPECT_EQ(len, strlen(buf));
+    EXPECT_EQ(std::string(buf),
+              "state: depth 4/4 (max 4), oldest 500 us (max 0 us), 4 sent, "
+              "0 dropped, 0 overwritten, time at fill 0:50% 1/4:30% 1:20%\n");
+
+    // Cut short, but still terminated
+    char small[8];
+    len = queue_stats_format(&stats, 1000, small, sizeof(small));
+    EXPECT_EQ(len, sizeof(small) - 1);
+    EXPECT_EQ(std::string(small), "state: ");
+}
+
+TEST(TestQueueStats, Registry) {
+    static uint32_t s_stamps[1];
+    static QueueStats s_first;
+    static QueueStats s_second;
+    size_t before = 0;
+    while (queue_stats_get(before) != NULL) {
+        before++;
+    }
+
+    queue_stats_init(&s_first, "telem_fp", 1, s_stamps, 0);
+    queue_stats_init(&s_second, "buzzer", 1, s_stamps, 0);
+    queue_stats_init(&s_first, "telem_fp", 1, s_stamps, 0);
+
+    EXPECT_EQ(queue_stats_get(before), &s_first);
+    EXPECT_EQ(queue_stats_get(before + 1), &s_second);
+    EXPECT_EQ(queue_stats_get(before + 2), nullptr);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+#include "pb3_decode.h"
+#include "pb_create.h"
+#include "sensor_block.h"
+}
+
+#define TEST_HEADER "v1.2-3-gabcdef 0x1f2e3d\n"
+
+static float random_float(float min, float max) {
+    return min + ((float)rand() / RAND_MAX) * (max - min);
+}
+
+static float* channels(SensorFrame* frame) { return &frame->temperature; }
+
+// A rocket on the pad: slowly varying readings plus sensor noise, sampled at
+// 1 kHz with a little timing jitter
+static SensorFrame make_sensor_frame(int i) {
+    SensorFrame frame;
+    frame.timestamp = 5000000 + 1000 * (uint64_t)i + rand() % 3;
+    frame.temperature = 25.0 + 0.001 * i + random_float(-0.01, 0.01);
+    frame.pressure = 1013.25 - 0.01 * i + random_float(-0.1, 0.1);
+    frame.acc_h_x = random_float(-0.01, 0.01);
+    frame.acc_h_y = random_float(-0.01, 0.01);
+    frame.acc_h_z = 1.0 + random_float(-0.01, 0.01);
+    frame.acc_i_x = random_float(-0.005, 0.005);
+    frame.acc_i_y = random_float(-0.005, 0.005);
+    frame.acc_i_z = 1.0 + random_float(-0.005, 0.005);
+    frame.rot_i_x = random_float(-0.5, 0.5);
+    frame.rot_i_y = random_float(-0.5, 0.5);
+    frame.rot_i_z = random_float(-0.5, 0.5);
+    frame.mag_i_x = 0.2 + random_float(-0.005, 0.005);
+    frame.mag_i_y = -0.1 + random_float(-0.005, 0.005);
+    frame.mag_i_z = 0.4 + random_float(-0.005, 0.005);
+    return frame;
+}
+
+static std::vector<uint8_t> encode(SensorBlockEncoder* enc,
+                                   const std::vector<SensorFrame>& frames) {
+    std::vector<uint8_t> buf(SENSOR_BLOCK_MAX_LEN);
+    sensor_block_init(enc);
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(sensor_block_add(enc, &frames[i]),
+                  i + 1 == SENSOR_BLOCK_MAX_FRAMES);
+    }
+    buf.resize(sensor_block_encode(enc, buf.data()));
+    return buf;
+}
+
+static std::vector<SensorFrame> decode(const std::vector<uint8_t>& buf) {
+    std::vector<SensorFrame> frames(SENSOR_BLOCK_MAX_FRAMES);
+    uint32_t num_frames = 0;
+    size_t consumed = 0;
+    EXPECT_EQ(sensor_block_decode(buf.data(), buf.size(), frames.data(),
+                                  &num_frames, &consumed),
+              SENSOR_BLOCK_OK);
+    EXPECT_EQ(consumed, buf.size());
+    frames.resize(num_frames);
+    return frames;
+}
+
+// Every value comes back within half a quantization step
+static void expect_close(SensorFrame expected, SensorFrame actual) {
+    EXPECT_EQ(expected.timestamp, actual.timestamp);
+    for (int c = 0; c < SENSOR_BLOCK_NUM_CHANNELS; c++) {
+        float step = ldexpf(1, sensor_block_default_exp(c));
+        EXPECT_LE(fabsf(channels(&expected)[c] - channels(&actual)[c]),
+                  step / 2)
+            << "channel " << c;
+    }
+}
+
+TEST(TestSensorBlock, RoundTrip) {
+    srand(1);
+    SensorBlockEncoder enc;
+    std::vector<SensorFrame> frames;
+    for (int i = 0; i < SENSOR_BLOCK_MAX_FRAMES; i++) {
+        frames.push_back(make_sensor_frame(i));
+    }
+
+    std::vector<uint8_t> buf = encode(&enc, frames);
+    ASSERT_GT(buf.size(), 0);
+    EXPECT_LE(buf.size(), SENSOR_BLOCK_MAX_LEN);
+    EXPECT_EQ(enc.num_frames, 0);
+
+    std::vector<SensorFrame> decoded = decode(buf);
+    ASSERT_EQ(decoded.size(), frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        expect_close(frames[i], decoded[i]);
+    }
+
+    // Nothing left to encode
+    EXPECT_EQ(sensor_block_encode(&enc, buf.data()), 0);
+}
+
+TEST(TestSensorBlock, PartialBlock) {
+    srand(2);
+    SensorBlockEncoder enc;
+    std::vector<SensorFrame> frames = {make_sensor_frame(0)};
+    std::vector<SensorFrame> decoded = decode(encode(&enc, frames));
+    ASSERT_EQ(decoded.size(), 1);
+    expect_close(frames[0], decoded[0]);
+
+    // Timestamps that go backwards still make it through
+    frames.push_back(make_sensor_frame(5));
+    frames.push_back(make_sensor_frame(1));
+    decoded = decode(encode(&enc, frames));
+    ASSERT_EQ(decoded.size(), 3);
+    for (size_t i = 0; i < frames.size(); i++) {
+        expect_close(frames[i], decoded[i]);
+    }
+}
+
+TEST(TestSensorBlock, SpecialValues) {
+    srand(3);
+    SensorBlockEncoder enc;
+    std::vector<SensorFrame> frames;
+    for (int i = 0; i < 8; i++) {
+        frames.push_back(make_sensor_frame(i));
+    }
+
+    // Channels that can't be quantized are kept bit for bit, while a
+    // negative zero is just zero
+    frames[3].acc_i_x = NAN;
+    frames[4].rot_i_y = -INFINITY;
+    frames[5].mag_i_z = -0.0f;
+    frames[6].rot_i_y = -0.0f;
+
+    // Values too big for the default step use a coarser one
+    frames[2].pressure = 3e9;
+    frames[6].acc_h_y = -1e12;
+
+    std::vector<SensorFrame> decoded = decode(encode(&enc, frames));
+    ASSERT_EQ(decoded.size(), frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(frames[i].timestamp, decoded[i].timestamp);
+        EXPECT_EQ(memcmp(&frames[i].acc_i_x, &decoded[i].acc_i_x, 4), 0);
+        EXPECT_EQ(memcmp(&frames[i].rot_i_y, &decoded[i].rot_i_y, 4), 0);
+        EXPECT_NEAR(frames[i].mag_i_z, decoded[i].mag_i_z, 0.001);
+        EXPECT_NEAR(frames[i].pressure, decoded[i].pressure, 2);
+        EXPECT_NEAR(frames[i].acc_h_y, decoded[i].acc_h_y, 1e3);
+        EXPECT_NEAR(frames[i].temperature, decoded[i].temperature, 0.004);
+    }
+    EXPECT_TRUE(isnan(decoded[3].acc_i_x));
+    EXPECT_EQ(decoded[5].mag_i_z, 0);
+    EXPECT_EQ(decoded[2].pressure, 3e9);
+    EXPECT_EQ(decoded[6].acc_h_y, -1e12f);
+}
+
+TEST(TestSensorBlock, Corrupted) {
+    srand(4);
+    SensorBlockEncoder enc;
+    std::vector<SensorFrame> frames;
+    for (int i = 0; i < 10; i++) {
+        frames.push_back(make_sensor_frame(i));
+    }
+    std::vector<uint8_t> buf = encode(&enc, frames);
+
+    SensorFrame decoded[SENSOR_BLOCK_MAX_FRAMES];
+    uint32_t num_frames;
+    size_t consumed;
+    for (size_t len = 0; len < buf.size(); len++) {
+        EXPECT_EQ(sensor_block_decode(buf.data(), len, decoded, &num_frames,
+                                      &consumed),
+                  SENSOR_BLOCK_SHORT);
+    }
+
+    // Any flipped bit is caught by the CRC
+    for (size_t i = 0; i < buf.size(); i++) {
+        std::vector<uint8_t> bad = buf;
+        bad[i] ^= 1 << (i % 8);
+        SensorBlockResult res = sensor_block_decode(
+            bad.data(), bad.size(), decoded, &num_frames, &consumed);
+        EXPECT_NE(res, SENSOR_BLOCK_OK) << "byte " << i;
+    }
+}
+
+static void collect_row(const Pb3Value* values, void* ctx) {
+    std::vector<SensorFrame>* frames = (std::vector<SensorFrame>*)ctx;
+    SensorFrame frame;
+    frame.timestamp = values[0].u;
+    for (int c = 0; c < SENSOR_BLOCK_NUM_CHANNELS; c++) {
+        channels(&frame)[c] = values[1 + c].f;
+    }
+    frames->push_back(frame);
+}
+
+TEST(TestSensorBlock, DecodeFile) {
+    srand(5);
+    const int num_frames = 1000;
+
+    // Build a file the same way task_storage does, with a partial block at
+    // the end, and the same frames as protobuf records for comparison
+    SensorBlockEncoder enc;
+    sensor_block_init(&enc);
+    std::vector<SensorFrame> frames;
+    std::vector<uint8_t> file(TEST_HEADER, TEST_HEADER + strlen(TEST_HEADER));
+    uint8_t block[SENSOR_BLOCK_MAX_LEN];
+    size_t pb_size = 0;
+    for (int i = 0; i < num_frames; i++) {
+        frames.push_back(make_sensor_frame(i));
+        size_t size;
+        ASSERT_NE(create_sensor_buffer(&frames.back(), &size), nullptr);
+        pb_size += size;
+
+        if (sensor_block_add(&enc, &frames.back()) || i == num_frames - 1) {
+            size_t len = sensor_block_encode(&enc, block);
+            file.insert(file.end(), block, block + len);
+        }
+    }
+    size_t block_size = file.size() - strlen(TEST_HEADER);
+    EXPECT_LT(block_size * 3, pb_size);
+
+    // Damage the middle of the second block
+    size_t start = pb3_parse_header(file.data(), file.size(), nullptr, 0);
+    ASSERT_EQ(start, strlen(TEST_HEADER));
+    uint32_t block_frames;
+    size_t first_len;
+    SensorFrame decoded[SENSOR_BLOCK_MAX_FRAMES];
+    ASSERT_EQ(sensor_block_decode(&file[start], file.size() - start, decoded,
+                                  &block_frames, &first_len),
+              SENSOR_BLOCK_OK);
+    file[start + first_len + 100] ^= 0x55;
+
+    Pb3Kind kind;
+    ASSERT_TRUE(pb3_kind_from_fname("sdcard/sensor/sbk_2024-06-01-1.pb3",
+                                    &kind));
+    ASSERT_EQ(kind, PB3_SENSOR_BLOCK);
+    Pb3Decoder dec;
+    pb3_decoder_init(&dec, kind);
+
+    // Feed it in pieces like the pb3_decode tool
+    std::vector<SensorFrame> rows;
+    std::vector<uint8_t> buf;
+    size_t pos = start;
+    while (true) {
+        size_t n = std::min((size_t)PB3_MIN_BUFFER_LEN, file.size() - pos);
+        buf.insert(buf.end(), &file[pos], &file[pos] + n);
+        pos += n;
+        bool eof = pos == file.size();
+        size_t used = pb3_decode_buffer(&dec, buf.data(), buf.size(), eof,
+                                        collect_row, &rows);
+        buf.erase(buf.begin(), buf.begin() + used);
+        if (eof) {
+            break;
+        }
+    }
+
+    // Everything but the second block comes back
+    EXPECT_EQ(buf.size(), 0);
+    EXPECT_EQ(dec.resyncs, 1);
+    ASSERT_EQ(rows.size(), num_frames - SENSOR_BLOCK_MAX_FRAMES);
+    EXPECT_EQ(dec.records, rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        // The second block was lost
+        size_t j = i;
+        if (i >= SENSOR_BLOCK_MAX_FRAMES) {
+            j += SENSOR_BLOCK_MAX_FRAMES;
+        }
+        expect_close(frames[j], rows[i]);
+    }
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
@@ -0,0 +1,260 @@
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "filter/sma_filter.h"
+#include "filter/smooth_diff.h"
+#include "sample_window.h"
+}
+
+// The SMA as it was: a plain running float sum
+class FloatSumSma {
+   public:
+    explicit FloatSumSma(size_t capacity) : capacity_(capacity) {}
+
+    float insert(float sample) {
+        if (samples_.size() == capacity_) {
+            sum_ -= samples_.front();
+            samples_.pop_front();
+        }
+        samples_.push_back(sample);
+        sum_ += sample;
+        return sum_ / samples_.size();
+    }
+
+   private:
+    size_t capacity_;
+    std::deque<float> samples_;
+    float sum_ = 0;
+};
+
+// Each stage computed from scratch on every sample, in double precision
+class GoldenChain {
+   public:
+    explicit GoldenChain(const SmoothDiffConfig& config) : config_(config) {}
+
+    void update(double t, float sample) {
+        push(median_in_, config_.median_len, sample);
+        double median = NAN;
+        if (!median_in_.empty()) {
+            std::vector<double> sorted(median_in_.begin(), median_in_.end());
+            std::sort(sorted.begin(), sorted.end());
+            size_t n = sorted.size();
+            median = n % 2 ? sorted[n / 2]
+                           : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+        }
+
+        push(sma_in_, config_.sma_len, median);
+        value = mean(sma_in_);
+
+        push(values_, config_.diff_len, value);
+        push(times_, config_.diff_len, isnan(value) ? NAN : t);
+        double diff = NAN;
+        if (!values_.empty()) {
+            diff = (value - values_.front()) / (t - times_.front());
+        }
+
+        push(rate_in_, config_.rate_sma_len, diff);
+        rate = mean(rate_in_);
+    }
+
+    double value = NAN;
+    double rate = NAN;
+
+   private:
+    // A NAN drops the oldest sample rather than being added
+    static void push(std::deque<double>& window, size_t len, double sample) {
+        if (window.size() == len || (isnan(sample) && !window.empty())) {
+            window.pop_front();
+        }
+        if (!isnan(sample)) {
+            window.push_back(sample);
+        }
+    }
+
+    static double mean(const std::deque<double>& window) {
+        if (window.empty()) {
+            return NAN;
+        }
+        double sum = 0;
+        for (double x : window) {
+            sum += x;
+        }
+        return sum / window.size();
+    }
+
+    SmoothDiffConfig config_;
+    std::deque<double> median_in_;
+    std::deque<double> sma_in_;
+    std::deque<double> values_;
+    std::deque<double> times_;
+    std::deque<double> rate_in_;
+};
+
+// The baro chain in state estimation
+static const SmoothDiffConfig s_baro_config = {
+    .median_len = 25,
+    .sma_len = 50,
+    .diff_len = 5,
+    .rate_sma_len = 25,
+};
+
+static void expect_same(float actual, double golden, double tol) {
+    if (isnan(golden)) {
+        EXPECT_TRUE(isnan(actual));
+    } else {
+        EXPECT_NEAR(actual, golden, tol);
+    }
+}
+
+TEST(TestSmoothDiff, SmaMatchesFloatSum) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0, 2);
+
+    SmaFilter sma;
+    ASSERT_EQ(sma_filter_init(&sma, 50), STATUS_OK);
+    FloatSumSma old_sma(50);
+    for (int i = 0; i < 1000; i++) {
+        float sample = 0.5f * i + noise(rng);
+        sma_filter_insert(&sma, sample);
+        EXPECT_NEAR(sma_filter_get_mean(&sma), old_sma.insert(sample), 1e-2);
+    }
+}
+
+TEST(TestSmoothDiff, SmaNoDrift) {
+    // Sitting on the pad for a few hours at 100 Hz, with a big offset
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0, 0.5);
+
+    SmaFilter sma;
+    ASSERT_EQ(sma_filter_init(&sma, 50), STATUS_OK);
+    std::deque<float> last;
+    for (int i = 0; i < 1000000; i++) {
+        float sample = 1500.f + noise(rng);
+        sma_filter_insert(&sma, sample);
+        last.push_back(sample);
+        if (last.size() > 50) {
+            last.pop_front();
+        }
+    }
+
+    double sum = 0;
+    for (float x : last) {
+        sum += x;
+    }
+    EXPECT_NEAR(sma_filter_get_mean(&sma), sum / 50, 1e-4);
+    EXPECT_NEAR(sma.sum, sum, 1e-2);
+}
+
+TEST(TestSmoothDiff, SmaMissingSamples) {
+    SmaFilter sma;
+    ASSERT_EQ(sma_filter_init(&sma, 4), STATUS_OK);
+    EXPECT_TRUE(isnan(sma_filter_get_mean(&sma)));
+    EXPECT_EQ(sma_filter_init(&sma, SMA_FILTER_MAX_CAPACITY + 1),
+              STATUS_PARAMETER_ERROR);
+    ASSERT_EQ(sma_filter_init(&sma, 4), STATUS_OK);
+
+    for (float x : {1.f, 2.f, 3.f}) {
+        sma_filter_insert(&sma, x);
+    }
+    EXPECT_FLOAT_EQ(sma_filter_get_mean(&sma), 2);
+
+    // Each NAN drops the oldest, full or not
+    sma_filter_insert(&sma, NAN);
+    EXPECT_FLOAT_EQ(sma_filter_get_mean(&sma), 2.5);
+    sma_filter_insert(&sma, NAN);
+    sma_filter_insert(&sma, NAN);
+    EXPECT_EQ(sma.size, 0u);
+    sma_filter_insert(&sma, NAN);
+    EXPECT_TRUE(isnan(sma_filter_get_mean(&sma)));
+}
+
+TEST(TestSmoothDiff, SampleWindowWraps) {
+    SampleWindow window;
+    ASSERT_EQ(sample_window_init(&window, 3), STATUS_OK);
+    for (int i = 0; i < 10; i++) {
+        sample_window_insert(&window, i);
+        size_t oldest = i < 2 ? 0 : i - 2;
+        EXPECT_FLOAT_EQ(sample_window_get(&window, 0), oldest);
+        EXPECT_FLOAT_EQ(sample_window_get(&window, window.size - 1), i);
+    }
+    EXPECT_TRUE(isnan(sample_window_get(&window, 3)));
+
+    sample_window_insert(&window, NAN);
+    EXPECT_EQ(window.size, 2u);
+    EXPECT_FLOAT_EQ(sample_window_get(&window, 0), 8);
+}
+
+TEST(TestSmoothDiff, GoldenFlight) {
+    // Pad, boost and coast to apogee, then descent under a parachute, at
+    // 100 Hz with noise, outliers and dropouts
+    std::mt19937 rng(9000);
+    std::normal_distribution<float> noise(0, 1.5);
+    std::uniform_real_distribution<float> uniform(0, 1);
+
+    SmoothDiff filter;
+    ASSERT_EQ(smooth_diff_init(&filter, &s_baro_config), STATUS_OK);
+    GoldenChain golden(s_baro_config);
+    EXPECT_TRUE(isnan(filter.value));
+    EXPECT_TRUE(isnan(filter.rate));
+
+    for (int i = 0; i < 12000; i++) {
+        double t = 1000.0 + i * 0.01;
+        double flight_t = i * 0.01 - 20;
+        double alt = 0;
+        if (flight_t > 0 && flight_t < 30) {
+            alt = 0.5 * 60 * flight_t * flight_t * (1 - flight_t / 45);
+        } else if (flight_t >= 30) {
+            alt = 18000 - 20 * (flight_t - 30);
+        }
+
+        float sample = alt + noise(rng);
+        float u = uniform(rng);
+        if (u < 0.01) {
+            sample += 500;  // Outlier
+        } else if (u < 0.02 || (i >= 5000 && i < 5100)) {
+            sample = NAN;  // Dropout
+        }
+
+        ASSERT_EQ(smooth_diff_update(&filter, t, sample), STATUS_OK);
+        golden.update((float)t, sample);
+
+        // Relative to the altitude, and to the rate over a 40 ms difference
+        expect_same(filter.value, golden.value, 1e-5 * fabs(alt) + 1e-3);
+        expect_same(filter.rate, golden.rate, 2e-5 * fabs(alt) / 0.04 + 1e-2);
+    }
+
+    // The long dropout drained every stage, but it filled back up since
+    EXPECT_FLOAT_EQ(smooth_diff_fill(&filter), 1);
+    smooth_diff_reset(&filter);
+    EXPECT_EQ(smooth_diff_fill(&filter), 0);
+    EXPECT_TRUE(isnan(filter.value));
+}
+
+TEST(TestSmoothDiff, Rate) {
+    // A steady climb comes out exactly, once every stage is full
+    SmoothDiff filter;
+    ASSERT_EQ(smooth_diff_init(&filter, &s_baro_config), STATUS_OK);
+    for (int i = 0; i < 200; i++) {
+        smooth_diff_update(&filter, i * 0.01f, 10.f * i * 0.01f);
+    }
+    EXPECT_NEAR(filter.rate, 10, 1e-3);
+    EXPECT_NEAR(filter.value, 10.f * (1.99f - 0.365f), 1e-3);
+
+    SmoothDiffConfig too_long = s_baro_config;
+    too_long.sma_len = SMA_FILTER_MAX_CAPACITY + 1;
+    EXPECT_EQ(smooth_diff_init(&filter, &too_long), STATUS_PARAMETER_ERROR);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
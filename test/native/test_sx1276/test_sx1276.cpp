@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include <string.h>
+
+extern "C" {
+#include "sx1276/sx1276.h"
+#include "sx1276/sx1276_link.h"
+#include "sx1276/sx1276_model.h"
+}
+
+static SpiDevice s_device = {
+    .clk = SPI_SPEED_10MHz,
+    .periph = P_SPI2,
+    .cpol = 0,
+    .cpha = 0,
+};
+
+static void init_radio() {
+    sx1276_model_reset();
+    ASSERT_EQ(sx1276_init(&s_device, 0, 915000000, 20, 125000, 10, 5, 8,
+                         false, true, false),
+              STATUS_OK);
+}
+
+// What the radio task does when DIO0 goes high
+static void handle_dio0(Sx1276Link* link) {
+    ASSERT_TRUE(sx1276_model_dio0());
+    EXPECT_EQ(sx1276_link_service(link), STATUS_OK);
+    EXPECT_FALSE(sx1276_model_dio0());
+}
+
+TEST(TestSX1276, Init) {
+    init_radio();
+
+    // LoRa standby, 915 MHz, 125 kHz, 4/5, SF10 with CRC
+    EXPECT_EQ(sx1276_model_get_reg(SX1276_REG_OP_MODE), 0x89);
+    EXPECT_EQ(sx1276_model_get_reg(SX1276_REG_FRF_MSB), 0xE4);
+    EXPECT_EQ(sx1276_model_get_reg(SX1276_REG_FRF_MID), 0xC0);
+    EXPECT_EQ(sx1276_model_get_reg(SX1276_REG_FRF_LSB), 0x00);
+    EXPECT_EQ(sx1276_model_get_reg(SX1276_REG_MODEM_CONFIG1), 0x72);
+    EXPECT_EQ(sx1276_model_get_reg(SX1276_REG_MODEM_CONFIG2), 0xA4);
+
+    // Clock too fast for the chip
+    sx1276_model_reset();
+    SpiDevice fast = s_device;
+    fast.clk = SPI_SPEED_20MHz;
+    EXPECT_NE(sx1276_init(&fast, 0, 915000000, 20, 125000, 10, 5, 8, false,
+                          true, false),
+              STATUS_OK);
+}
+
+TEST(TestSX1276, LinkTransmit) {
+    init_radio();
+    Sx1276Link link;
+    ASSERT_EQ(sx1276_link_init(&link, &s_device), STATUS_OK);
+    EXPECT_EQ(sx1276_model_get_mode(), SX1276_MODEL_MODE_RXCONTINUOUS);
+    EXPECT_FALSE(sx1276_link_tx_busy(&link));
+
+    // The first packet goes straight out, the rest wait their turn
+    uint8_t packets[3][4] = {{1, 2, 3, 4}, {5, 6}, {7, 8, 9}};
+    int lens[3] = {4, 2, 3};
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(sx1276_link_send(&link, packets[i], lens[i]), STATUS_OK);
+    }
+    EXPECT_EQ(link.state, SX1276_LINK_TX);
+    EXPECT_TRUE(sx1276_link_tx_busy(&link));
+    EXPECT_EQ(sx1276_model_get_mode(), SX1276_MODEL_MODE_TX);
+    EXPECT_FALSE(sx1276_model_dio0());
+
+    // Servicing without an interrupt changes nothing
+    EXPECT_EQ(sx1276_link_service(&link), STATUS_OK);
+    EXPECT_EQ(sx1276_model_get_mode(), SX1276_MODEL_MODE_TX);
+
+    for (int i = 0; i < 3; i++) {
+        uint8_t sent[SX1276_LINK_MAX_PACKET_LEN];
+        int len;
+        ASSERT_TRUE(sx1276_model_finish_tx(sent, &len));
+        ASSERT_EQ(len, lens[i]);
+        EXPECT_EQ(memcmp(sent, packets[i], len), 0);
+        handle_dio0(&link);
+    }
+
+    // Back to listening once the queue is empty
+    EXPECT_EQ(link.num_sent, 3);
+    EXPECT_FALSE(sx1276_link_tx_busy(&link));
+    EXPECT_EQ(link.state, SX1276_LINK_RX);
+    EXPECT_EQ(sx1276_model_get_mode(), SX1276_MODEL_MODE_RXCONTINUOUS);
+}
+
+TEST(TestSX1276, LinkQueueFull) {
+    init_radio();
+    Sx1276Link link;
+    ASSERT_EQ(sx1276_link_init(&link, &s_device), STATUS_OK);
+
+    uint8_t packet[SX1276_LINK_MAX_PACKET_LEN + 1] = {0};
+    EXPECT_EQ(sx1276_link_send(&link, packet, 0), STATUS_PARAMETER_ERROR);
+    EXPECT_EQ(sx1276_link_send(&link, packet, sizeof(packet)),
+              STATUS_PARAMETER_ERROR);
+
+    for (int i = 0; i < SX1276_LINK_QUEUE_LEN; i++) {
+        packet[0] = i;
+        EXPECT_EQ(sx1276_link_send(&link, packet, 1), STATUS_OK);
+    }
+    EXPECT_EQ(sx1276_link_send(&link, packet, 1), STATUS_BUSY);
+    EXPECT_EQ(link.num_tx_dropped, 1);
+
+    // Room again after one is sent, and the order is kept
+    uint8_t sent[SX1276_LINK_MAX_PACKET_LEN];
+    int len;
+    ASSERT_TRUE(sx1276_model_finish_tx(sent, &len));
+    handle_dio0(&link);
+    packet[0] = 0xAA;
+    EXPECT_EQ(sx1276_link_send(&link, packet, 1), STATUS_OK);
+    for (int i = 1; i < SX1276_LINK_QUEUE_LEN; i++) {
+        ASSERT_TRUE(sx1276_model_finish_tx(sent, &len));
+        EXPECT_EQ(sent[0], i);
+        handle_dio0(&link);
+    }
+    ASSERT_TRUE(sx1276_model_finish_tx(sent, &len));
+    EXPECT_EQ(sent[0], 0xAA);
+}
+
+TEST(TestSX1276, LinkReceive) {
+    init_radio();
+    Sx1276Link link;
+    ASSERT_EQ(sx1276_link_init(&link, &s_device), STATUS_OK);
+
+    uint8_t data[SX1276_LINK_MAX_PACKET_LEN];
+    int len;
+    EXPECT_FALSE(sx1276_link_recv(&link, data, &len));
+
+    const uint8_t packet[] = {0x10, 0x01, 0x02};
+    ASSERT_TRUE(sx1276_model_receive(packet, sizeof(packet), true));
+    handle_dio0(&link);
+    ASSERT_TRUE(sx1276_link_recv(&link, data, &len));
+    ASSERT_EQ(len, sizeof(packet));
+    EXPECT_EQ(memcmp(data, packet, len), 0);
+    EXPECT_FALSE(sx1276_link_recv(&link, data, &len));
+
+    // Corrupted packets are dropped
+    ASSERT_TRUE(sx1276_model_receive(packet, sizeof(packet), false));
+    handle_dio0(&link);
+    EXPECT_FALSE(sx1276_link_recv(&link, data, &len));
+    EXPECT_EQ(link.num_crc_errors, 1);
+
+    // Nothing is heard while transmitting, and receiving resumes after
+    EXPECT_EQ(sx1276_link_send(&link, packet, sizeof(packet)), STATUS_OK);
+    EXPECT_FALSE(sx1276_model_receive(packet, sizeof(packet), true));
+    ASSERT_TRUE(sx1276_model_finish_tx(data, &len));
+    handle_dio0(&link);
+    ASSERT_TRUE(sx1276_model_receive(packet, 2, true));
+    handle_dio0(&link);
+    ASSERT_TRUE(sx1276_link_recv(&link, data, &len));
+    EXPECT_EQ(len, 2);
+
+    // If nobody reads them, the newest packets are kept
+    for (int i = 0; i < SX1276_LINK_QUEUE_LEN + 2; i++) {
+        uint8_t numbered[] = {(uint8_t)i};
+        ASSERT_TRUE(sx1276_model_receive(numbered, 1, true));
+        handle_dio0(&link);
+    }
+    EXPECT_EQ(link.num_rx_dropped, 2);
+    for (int i = 2; i < SX1276_LINK_QUEUE_LEN + 2; i++) {
+        ASSERT_TRUE(sx1276_link_recv(&link, data, &len));
+        EXPECT_EQ(data[0], i);
+    }
+    EXPECT_EQ(link.num_received, 2 + SX1276_LINK_QUEUE_LEN + 2);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <string>
+
+extern "C" {
+#include "task_timing.h"
+}
+
+TEST(TestTaskTiming, Buckets) {
+    EXPECT_EQ(task_timing_bucket(0), 0);
+    EXPECT_EQ(task_timing_bucket(1), 1);
+    EXPECT_EQ(task_timing_bucket(2), 2);
+    EXPECT_EQ(task_timing_bucket(3), 2);
+    EXPECT_EQ(task_timing_bucket(1023), 10);
+    EXPECT_EQ(task_timing_bucket(1024), 11);
+    EXPECT_EQ(task_timing_bucket(1 << (TASK_TIMING_NUM_BUCKETS - 2)),
+              TASK_TIMING_NUM_BUCKETS - 1);
+    EXPECT_EQ(task_timing_bucket(UINT32_MAX), TASK_TIMING_NUM_BUCKETS - 1);
+}
+
+TEST(TestTaskTiming, Periodic) {
+    TaskTiming timing;
+    task_timing_init(&timing, "control", 10000);
+
+    // On time, late, and so late that it runs past its deadline. Releases
+    // stay on the 10 ms grid however late the task runs.
+    uint64_t t = 5000000;
+    task_timing_begin_periodic(&timing, t);
+    task_timing_end(&timing, t + 300);
+    task_timing_begin_periodic(&timing, t + 10000 + 50);
+    task_timing_end(&timing, t + 10000 + 400);
+    task_timing_begin_periodic(&timing, t + 20000 + 3000);
+    task_timing_end(&timing, t + 20000 + 12000);
+    task_timing_begin_periodic(&timing, t + 30000 + 2);
+    task_timing_end(&timing, t + 30000 + 200);
+
+    EXPECT_EQ(timing.runs, 4);
+    EXPECT_EQ(timing.misses, 1);
+    EXPECT_EQ(timing.max_latency_us, 3000);
+    EXPECT_EQ(timing.max_exec_us, 9000);
+    EXPECT_EQ(timing.latency_hist[task_timing_bucket(0)], 1);
+    EXPECT_EQ(timing.latency_hist[task_timing_bucket(2)], 1);
+    EXPECT_EQ(timing.latency_hist[task_timing_bucket(50)], 1);
+    EXPECT_EQ(timing.latency_hist[task_timing_bucket(3000)], 1);
+    EXPECT_EQ(timing.exec_hist[task_timing_bucket(300)], 2);
+
+    // Unmatched end markers are ignored
+    task_timing_end(&timing, t + 40000);
+    EXPECT_EQ(timing.runs, 4);
+}
+
+TEST(TestTaskTiming, Released) {
+    TaskTiming timing;
+    task_timing_init(&timing, "sensors", 10000);
+
+    task_timing_begin(&timing, 1000, 1120);
+    task_timing_end(&timing, 9000);
+    task_timing_begin(&timing, 20000, 25000);
+    task_timing_end(&timing, 31000);
+    // Release stamped after the task woke up
+    task_timing_begin(&timing, 40010, 40000);
+    task_timing_end(&timing, 40500);
+
+    EXPECT_EQ(timing.runs, 3);
+    EXPECT_EQ(timing.misses, 1);
+    EXPECT_EQ(timing.max_latency_us, 5000);
+    EXPECT_EQ(timing.latency_hist[0], 1);
+    EXPECT_EQ(timing.max_exec_us, 7880);
+
+    task_timing_reset(&timing, 5000);
+    EXPECT_STREQ(timing.name, "sensors");
+    EXPECT_EQ(timing.deadline_us, 5000);
+    EXPECT_EQ(timing.runs, 0);
+    EXPECT_EQ(timing.latency_hist[0], 0);
+}
+
+TEST(TestTaskTiming, Format) {
+    TaskTiming timing;
+    task_timing_init(&timing, "gps", 200000);
+    task_timing_begin_periodic(&timing, 1000);
+    task_timing_end(&timing, 1700);
+    task_timing_begin_periodic(&timing, 201000 + 1);
+    task_timing_end(&timing, 201000 + 1000000);
+
+    char buf[256];
+    size_t len = task_timing_format(&timing, buf, sizeof(buf));
+    EXPECT_EQ(len, strlen(buf));
+    EXPECT_EQ(std::string(buf),
+              "gps: 2 runs, 1 missed (deadline 200000 us)\n"
+              "  latency max 1 us: <1:1 <2:1\n"
+              "  exec max 999999 us: <1024:1 >=524288:1\n");
+
+    // Cut short, but still terminated
+    char small[16];
+    len = task_timing_format(&timing, small, sizeof(small));
+    EXPECT_EQ(len, sizeof(small) - 1);
+    EXPECT_EQ(std::string(small), std::string(buf, sizeof(small) - 1));
+}
+
+static size_t num_registered() {
+    size_t count = 0;
+    while (task_timing_get(count) != NULL) {
+        count++;
+    }
+    return count;
+}
+
+TEST(TestTaskTiming, Registry) {
+    static TaskTiming s_first;
+    static TaskTiming s_second;
+    size_t before = num_registered();
+
+    // Setting a task up again doesn't register it twice
+    task_timing_init(&s_first, "telem_tx", 1000);
+    task_timing_init(&s_second, "storage", 1000000);
+    task_timing_init(&s_first, "telem_tx", 1000);
+
+    ASSERT_EQ(num_registered(), before + 2);
+    EXPECT_EQ(task_timing_get(before), &s_first);
+    EXPECT_EQ(task_timing_get(before + 1), &s_second);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "telem_sched/telem_sched.h"
+}
+
+// Same settings as the darkstar telemetry radio
+static const LoraParams s_lora = {
+    .bandwidth_hz = 125000,
+    .spreading_factor = 10,
+    .coding_rate = 5,
+    .preamble_len = 8,
+    .implicit_header = false,
+    .crc_on = true,
+    .low_data_rate = false,
+};
+
+static const uint32_t s_payload_lens[TELEM_NUM_CLASSES] = {7, 10, 16, 7};
+
+// Ascent-like policy: state as fast as possible, GPS at 1 Hz
+static const TelemClassPolicy s_policy[TELEM_NUM_CLASSES] = {
+    [TELEM_CLASS_EVENT] = {true, 0, 0, 0},
+    [TELEM_CLASS_STATE] = {true, 1, 100, 500},
+    [TELEM_CLASS_GPS] = {true, 2, 1000, 2000},
+    [TELEM_CLASS_HEALTH] = {true, 3, 5000, 0},
+};
+
+static void update_all(TelemSched* sched, uint32_t now_ms) {
+    telem_sched_update(sched, TELEM_CLASS_STATE, now_ms);
+    telem_sched_update(sched, TELEM_CLASS_GPS, now_ms);
+    telem_sched_update(sched, TELEM_CLASS_HEALTH, now_ms);
+}
+
+TEST(TestTelemSched, TimeOnAir) {
+    // Reference values from the SX1276 datasheet formula
+    EXPECT_EQ(lora_time_on_air_us(&s_lora, 21), 370688);
+
+    LoraParams sf7 = s_lora;
+    sf7.spreading_factor = 7;
+    EXPECT_EQ(lora_time_on_air_us(&sf7, 10), 41216);
+
+    LoraParams sf12 = s_lora;
+    sf12.spreading_factor = 12;
+    sf12.low_data_rate = true;
+    EXPECT_EQ(lora_time_on_air_us(&sf12, 10), 991232);
+
+    // Longer packets never take less time
+    for (int len = 1; len < 255; len++) {
+        EXPECT_LE(lora_time_on_air_us(&s_lora, len - 1),
+                  lora_time_on_air_us(&s_lora, len));
+    }
+}
+
+TEST(TestTelemSched, PriorityAndPeriod) {
+    TelemSched sched;
+    telem_sched_init(&sched, &s_lora, s_payload_lens, 1.0f, 0);
+    telem_sched_set_policy(&sched, s_policy);
+
+    // Nothing to send without data
+    EXPECT_EQ(telem_sched_next(&sched, 0), TELEM_CLASS_NONE);
+
+    update_all(&sched, 0);
+    telem_sched_update(&sched, TELEM_CLASS_EVENT, 0);
+
+    EXPECT_EQ(telem_sched_next(&sched, 0), TELEM_CLASS_EVENT);
+    telem_sched_sent(&sched, TELEM_CLASS_EVENT, 0);
+    EXPECT_EQ(telem_sched_next(&sched, 0), TELEM_CLASS_EVENT);
+    telem_sched_sent(&sched, TELEM_CLASS_EVENT, 0);
+    EXPECT_EQ(telem_sched_next(&sched, 0), TELEM_CLASS_EVENT);
+    telem_sched_sent(&sched, TELEM_CLASS_EVENT, 0);
+
+    // Events are done after their repeats
+    EXPECT_EQ(telem_sched_next(&sched, 0), TELEM_CLASS_STATE);
+    telem_sched_sent(&sched, TELEM_CLASS_STATE, 300);
+
+    // State has no new data, so lower priorities get a turn
+    EXPECT_EQ(telem_sched_next(&sched, 300), TELEM_CLASS_GPS);
+    telem_sched_sent(&sched, TELEM_CLASS_GPS, 600);
+    EXPECT_EQ(telem_sched_next(&sched, 600), TELEM_CLASS_HEALTH);
+    telem_sched_sent(&sched, TELEM_CLASS_HEALTH, 900);
+    EXPECT_EQ(telem_sched_next(&sched, 900), TELEM_CLASS_NONE);
+
+    // New data for everything, but only state's period has passed
+    update_all(&sched, 950);
+    EXPECT_EQ(telem_sched_next(&sched, 950), TELEM_CLASS_STATE);
+    telem_sched_sent(&sched, TELEM_CLASS_STATE, 1250);
+    EXPECT_EQ(telem_sched_next(&sched, 1250), TELEM_CLASS_NONE);
+    EXPECT_EQ(telem_sched_next(&sched, 1600), TELEM_CLASS_GPS);
+}
+
+TEST(TestTelemSched, StaleData) {
+    TelemSched sched;
+    telem_sched_init(&sched, &s_lora, s_payload_lens, 1.0f, 0);
+    telem_sched_set_policy(&sched, s_policy);
+
+    // State older than its max age is dropped, health has no limit
+    telem_sched_update(&sched, TELEM_CLASS_STATE, 0);
+    telem_sched_update(&sched, TELEM_CLASS_HEALTH, 0);
+    EXPECT_EQ(telem_sched_next(&sched, 1000), TELEM_CLASS_HEALTH);
+}
+
+TEST(TestTelemSched, DutyCycleBudget) {
+    const float duty_cycle = 0.4f;
+    const uint32_t sim_ms = 120000;
+
+    TelemSched sched;
+    telem_sched_init(&sched, &s_lora, s_payload_lens, duty_cycle, 0);
+    telem_sched_set_policy(&sched, s_policy);
+
+    // New data every 10 ms, with the radio busy for the whole packet
+    uint64_t airtime_us = 0;
+    uint32_t busy_until_ms = 0;
+    for (uint32_t now_ms = 0; now_ms < sim_ms; now_ms += 10) {
+        update_all(&sched, now_ms);
+        if (now_ms < busy_until_ms) {
+            continue;
+        }
+        TelemClass cls = telem_sched_next(&sched, now_ms);
+        if (cls != TELEM_CLASS_NONE) {
+            uint32_t packet_us = sched.classes[cls].airtime_us;
+            busy_until_ms = now_ms + (packet_us + 999) / 1000;
+            telem_sched_sent(&sched, cls, busy_until_ms);
+            airtime_us += packet_us;
+        }
+    }
+
+    // Airtime stays within the budget plus the initial window
+    uint64_t budget_us =
+        (uint64_t)((sim_ms + TELEM_BUDGET_WINDOW_MS) * 1000 * duty_cycle);
+    EXPECT_LE(airtime_us, budget_us);
+    EXPECT_GT(airtime_us, budget_us * 9 / 10);
+
+    // Most of it goes to state updates, but GPS and health aren't starved
+    const TelemClassState* classes = sched.classes;
+    EXPECT_GT(classes[TELEM_CLASS_STATE].num_sent,
+              classes[TELEM_CLASS_GPS].num_sent +
+                  classes[TELEM_CLASS_HEALTH].num_sent);
+    EXPECT_GE(classes[TELEM_CLASS_GPS].num_sent, sim_ms / 3000);
+    EXPECT_GE(classes[TELEM_CLASS_HEALTH].num_sent, sim_ms / 20000);
+}
+
+TEST(TestTelemSched, EventsOverdraw) {
+    // Tiny budget that has been used up
+    TelemSched sched;
+    telem_sched_init(&sched, &s_lora, s_payload_lens, 0.01f, 0);
+    telem_sched_set_policy(&sched, s_policy);
+    sched.credit_us = 0;
+
+    update_all(&sched, 0);
+    EXPECT_EQ(telem_sched_next(&sched, 0), TELEM_CLASS_NONE);
+
+    telem_sched_update(&sched, TELEM_CLASS_EVENT, 0);
+    EXPECT_EQ(telem_sched_next(&sched, 0), TELEM_CLASS_EVENT);
+    telem_sched_sent(&sched, TELEM_CLASS_EVENT, 0);
+    EXPECT_LT(sched.credit_us, 0);
+
+    // Until the overdraft reaches a full window
+    int sent = 1;
+    while (telem_sched_next(&sched, 0) == TELEM_CLASS_EVENT) {
+        telem_sched_sent(&sched, TELEM_CLASS_EVENT, 0);
+        sent++;
+    }
+    EXPECT_LT(sent, TELEM_EVENT_REPEATS);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "terminal/terminal.h"
+}
+
+static std::vector<std::string> s_calls;
+
+static void cmd_help(char *str) { s_calls.push_back("help"); }
+static void cmd_set_frequency(char *str) {
+    s_calls.push_back(std::string("freq:") + str);
+}
+static void cmd_set_config_value(char *str) {
+    s_calls.push_back(std::string("config:") + str);
+}
+static void cmd_help_again(char *str) { s_calls.push_back("help again"); }
+
+class TestTerminal : public ::testing::Test {
+   protected:
+    static void SetUpTestSuite() {
+        // Out of order, to check the lookup
+        terminal_init();
+        terminal_add_cmd("^set_frequency [0-9]{1,10}[\n]*$",
+                         cmd_set_frequency);
+        terminal_add_cmd("^help[\n]*$", cmd_help);
+        terminal_add_cmd("^set_config_value.*$", cmd_set_config_value);
+
+        // Ignored
+        terminal_add_cmd("^help.*$", cmd_help_again);
+        terminal_add_cmd("^[a-z]+$", cmd_help_again);
+    }
+
+    void SetUp() override { s_calls.clear(); }
+};
+
+TEST_F(TestTerminal, Process) {
+    char help[] = "help\n";
+    terminal_process(help);
+    char freq[] = "set_frequency 915000000";
+    terminal_process(freq);
+    char config[] = "set_config_value a 1";
+    terminal_process(config);
+
+    EXPECT_EQ(s_calls, (std::vector<std::string>{
+                           "help",
+                           "freq:set_frequency 915000000",
+                           "config:set_config_value a 1",
+                       }));
+}
+
+TEST_F(TestTerminal, NoMatch) {
+    // Unknown name, name prefix, and known name that fails the regex
+    char unknown[] = "reboot\n";
+    terminal_process(unknown);
+    char prefix[] = "hel\n";
+    terminal_process(prefix);
+    char longer[] = "helpme\n";
+    terminal_process(longer);
+    char bad_arg[] = "set_frequency fast\n";
+    terminal_process(bad_arg);
+    char empty[] = "";
+    terminal_process(empty);
+    terminal_process(NULL);
+
+    EXPECT_TRUE(s_calls.empty());
+}
+
+TEST_F(TestTerminal, Receive) {
+    // Several commands in one transfer, with either line ending, and the
+    // last one unterminated
+    char text[] = "help\r\n\nset_frequency 433000000\rreboot\nhelp";
+    terminal_receive(text);
+
+    EXPECT_EQ(s_calls, (std::vector<std::string>{
+                           "help",
+                           "freq:set_frequency 433000000",
+                           "help",
+                       }));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
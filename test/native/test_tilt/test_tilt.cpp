@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <random>
+
+extern "C" {
+#include "quat.h"
+#include "tilt.h"
+}
+
+// Rotation about the body y axis, i.e. tilting away from vertical
+static Quaternion pitch(double angle_rad, double scale = 1) {
+    return {(float)(scale * cos(angle_rad / 2)), 0,
+            (float)(scale * sin(angle_rad / 2)), 0};
+}
+
+TEST(TestTilt, CosMatchesRotation) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> component(0, 1);
+    std::uniform_real_distribution<float> scale(0.5, 2);
+
+    Tilt tilt;
+    ASSERT_EQ(tilt_init(&tilt, 1), STATUS_OK);
+    EXPECT_FLOAT_EQ(tilt.cos_tilt, 1);
+
+    Vector still = VEC_ZERO;
+    Vector body_x = {1, 0, 0};
+    for (int i = 0; i < 1000; i++) {
+        Quaternion q = {component(rng), component(rng), component(rng),
+                        component(rng)};
+        Quaternion unit;
+        quat_normalize(&q, &unit);
+        Vector rotated;
+        quat_rot(&body_x, &unit, &rotated);
+
+        // Not normalized, as it comes out of integrating the body rates
+        Quaternion scaled;
+        quat_scale(&q, scale(rng), &scaled);
+        tilt_update(&tilt, &scaled, &still);
+        EXPECT_NEAR(tilt.cos_tilt, rotated.x, 1e-5);
+        EXPECT_LE(tilt.cos_tilt, 1);
+        EXPECT_GE(tilt.cos_tilt, -1);
+    }
+
+    // Straight down
+    Quaternion flipped = pitch(M_PI);
+    tilt_update(&tilt, &flipped, &still);
+    EXPECT_FLOAT_EQ(tilt.cos_tilt, -1);
+
+    Quaternion nan_quat = {NAN, 0, 0, 0};
+    tilt_update(&tilt, &nan_quat, &still);
+    EXPECT_TRUE(isnan(tilt.cos_tilt));
+    EXPECT_FALSE(tilt_within(&tilt, tilt_cos_limit(0), tilt_cos_limit(180)));
+}
+
+TEST(TestTilt, LimitsMatchAngles) {
+    EXPECT_FLOAT_EQ(tilt_cos_limit(-1e4), 1);
+    EXPECT_FLOAT_EQ(tilt_cos_limit(0), 1);
+    EXPECT_NEAR(tilt_cos_limit(60), 0.5, 1e-6);
+    EXPECT_FLOAT_EQ(tilt_cos_limit(180), -1);
+    EXPECT_FLOAT_EQ(tilt_cos_limit(1e4), -1);
+
+    Tilt tilt;
+    ASSERT_EQ(tilt_init(&tilt, 1), STATUS_OK);
+    Vector still = VEC_ZERO;
+    const float limits[][2] = {
+        {-1e4, 1e4}, {0, 0}, {0, 10}, {5, 30}, {30, 5}, {90, 180}};
+
+    // Away from the limits themselves, where rounding could go either way
+    for (double angle_deg = 0.25; angle_deg < 180; angle_deg += 0.5) {
+        Quaternion q = pitch(angle_deg * M_PI / 180, 0.9);
+        tilt_update(&tilt, &q, &still);
+        for (const auto& limit : limits) {
+            bool expected = angle_deg >= limit[0] && angle_deg <= limit[1];
+            EXPECT_EQ(tilt_within(&tilt, tilt_cos_limit(limit[0]),
+                                  tilt_cos_limit(limit[1])),
+                      expected)
+                << angle_deg << " deg in [" << limit[0] << ", " << limit[1]
+                << "]";
+        }
+    }
+}
+
+TEST(TestTilt, Rate) {
+    Tilt tilt;
+    EXPECT_EQ(tilt_init(&tilt, SMA_FILTER_MAX_CAPACITY + 1),
+              STATUS_PARAMETER_ERROR);
+    ASSERT_EQ(tilt_init(&tilt, 4), STATUS_OK);
+    Quaternion level = {1, 0, 0, 0};
+
+    // Rolling about the body axis doesn't tilt it
+    Vector roll = {10, 0, 0};
+    for (int i = 0; i < 10; i++) {
+        tilt_update(&tilt, &level, &roll);
+    }
+    EXPECT_FLOAT_EQ(tilt.rate, 0);
+
+    // Pitch and yaw together, smoothed over the window
+    Vector swing = {10, 0.3, -0.4};
+    tilt_update(&tilt, &level, &swing);
+    EXPECT_FLOAT_EQ(tilt.rate, 0.5 / 4);
+    for (int i = 0; i < 3; i++) {
+        tilt_update(&tilt, &level, &swing);
+    }
+    EXPECT_FLOAT_EQ(tilt.rate, 0.5);
+
+    // A dropped gyro reading doesn't poison the rate
+    Vector nan_rate = {NAN, NAN, NAN};
+    tilt_update(&tilt, &level, &nan_rate);
+    EXPECT_FLOAT_EQ(tilt.rate, 0.5);
+
+    // The peak is kept once the swinging stops
+    Vector still = VEC_ZERO;
+    for (int i = 0; i < 10; i++) {
+        tilt_update(&tilt, &level, &still);
+    }
+    EXPECT_FLOAT_EQ(tilt.rate, 0);
+    EXPECT_FLOAT_EQ(tilt.max_rate, 0.5);
+
+    tilt_reset(&tilt);
+    EXPECT_FLOAT_EQ(tilt.max_rate, 0);
+    EXPECT_FLOAT_EQ(tilt.cos_tilt, 1);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}
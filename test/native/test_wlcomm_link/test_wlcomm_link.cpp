@@ -0,0 +1,266 @@
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "wlcomm_link/wlcomm_link.h"
+}
+
+#define RING_SIZE 512
+
+// Bitwise CRC-16/CCITT, as the radio board computes it
+static uint16_t reference_crc(const std::vector<uint8_t>& data) {
+    uint16_t crc = 0xFFFF;
+    for (uint8_t byte : data) {
+        crc ^= (uint16_t)byte << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static std::vector<uint8_t> make_body(uint8_t msg_id, uint8_t payload_len) {
+    std::vector<uint8_t> body = {payload_len, 0x10, msg_id};
+    for (int i = 0; i < payload_len; i++) {
+        body.push_back(msg_id + i);
+    }
+    return body;
+}
+
+static std::vector<uint8_t> make_frame(const std::vector<uint8_t>& body) {
+    uint8_t frame[WLCOMM_LINK_MAX_FRAME_LEN];
+    uint32_t len = wlcomm_link_encode(body.data(), frame);
+    return std::vector<uint8_t>(frame, frame + len);
+}
+
+// A UART with DMA into a circular buffer
+class Uart {
+   public:
+    Uart() { wlcomm_link_rx_init(&rx, ring, RING_SIZE); }
+
+    // Bytes arrive, then the line goes idle
+    void receive(const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            ring[pos] = data[i];
+            pos = (pos + 1) % RING_SIZE;
+            // Half and full transfer interrupts
+            if (pos % (RING_SIZE / 2) == 0) {
+                wlcomm_link_rx_written(&rx, pos);
+            }
+        }
+        wlcomm_link_rx_written(&rx, pos);
+    }
+
+    void receive(const std::vector<uint8_t>& data) {
+        receive(data.data(), data.size());
+    }
+
+    // Everything the reader can get out of what's been received
+    std::vector<std::vector<uint8_t>> parse() {
+        std::vector<std::vector<uint8_t>> bodies;
+        uint8_t body[WLCOMM_LINK_MAX_BODY_LEN];
+        while (wlcomm_link_rx_next(&rx, body)) {
+            bodies.emplace_back(body, body + WLCOMM_LINK_HEADER_LEN + body[0]);
+        }
+        return bodies;
+    }
+
+    uint8_t ring[RING_SIZE];
+    size_t pos = 0;
+    WlcommRx rx;
+};
+
+TEST(TestWlcommLink, Encode) {
+    std::vector<uint8_t> body = {2, 0x10, 0x05, 0xAB, 0xCD};
+    std::vector<uint8_t> frame = make_frame(body);
+    ASSERT_EQ(frame.size(), 9u);
+    EXPECT_EQ(frame[0], '!');
+    EXPECT_EQ(frame[1], '$');
+    EXPECT_EQ(memcmp(frame.data() + 2, body.data(), body.size()), 0);
+
+    std::vector<uint8_t> covered(frame.begin(), frame.end() - 2);
+    uint16_t crc = reference_crc(covered);
+    EXPECT_EQ(frame[7], crc & 0xFF);
+    EXPECT_EQ(frame[8], crc >> 8);
+    EXPECT_EQ(wlcomm_link_crc16(0xFFFF, covered.data(), covered.size()), crc);
+
+    // Split anywhere, the CRC carries on
+    uint16_t part = wlcomm_link_crc16(0xFFFF, covered.data(), 3);
+    EXPECT_EQ(wlcomm_link_crc16(part, covered.data() + 3, covered.size() - 3),
+              crc);
+}
+
+TEST(TestWlcommLink, Fragmented) {
+    std::vector<uint8_t> stream;
+    std::vector<std::vector<uint8_t>> bodies;
+    for (int i = 0; i < 20; i++) {
+        bodies.push_back(make_body(0x80 + i, (i * 37) % 256));
+        std::vector<uint8_t> frame = make_frame(bodies.back());
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    // Every split size, including a byte at a time, and wrapping the ring
+    for (size_t chunk : {1, 2, 7, 100, 300}) {
+        Uart uart;
+        std::vector<std::vector<uint8_t>> got;
+        for (size_t i = 0; i < stream.size(); i += chunk) {
+            uart.receive(stream.data() + i,
+                         std::min(chunk, stream.size() - i));
+            for (auto& body : uart.parse()) {
+                got.push_back(body);
+            }
+        }
+        EXPECT_EQ(got, bodies) << "chunk " << chunk;
+        EXPECT_EQ(uart.rx.stats.frames, bodies.size());
+        EXPECT_EQ(uart.rx.stats.skipped, 0u);
+        EXPECT_EQ(uart.rx.stats.crc_errors, 0u);
+        EXPECT_FALSE(wlcomm_link_rx_pending(&uart.rx));
+    }
+}
+
+TEST(TestWlcommLink, Noise) {
+    Uart uart;
+
+    // Junk, including bytes that look like the start of a frame
+    std::vector<uint8_t> junk = {0x00, '!', 'x', '$', '!', '!', 0xFF};
+    std::vector<uint8_t> body = make_body(0x12, 4);
+    uart.receive(junk);
+    uart.receive(make_frame(body));
+    EXPECT_EQ(uart.parse(), std::vector<std::vector<uint8_t>>{body});
+    EXPECT_EQ(uart.rx.stats.skipped, junk.size());
+
+    // A false start whose length swallows a real frame
+    std::vector<uint8_t> false_start = {'!', '$', 30, 0x10, 0x01};
+    uart.receive(false_start);
+    uart.receive(make_frame(body));
+    EXPECT_TRUE(uart.parse().empty());
+    std::vector<uint8_t> padding(40, 0x55);
+    uart.receive(padding);
+    EXPECT_EQ(uart.parse(), std::vector<std::vector<uint8_t>>{body});
+    EXPECT_EQ(uart.rx.stats.crc_errors, 1u);
+
+    // A corrupted frame is dropped, and the next one still gets through
+    std::vector<uint8_t> bad = make_frame(body);
+    bad[6] ^= 0x01;
+    uart.receive(bad);
+    uart.receive(make_frame(body));
+    EXPECT_EQ(uart.parse(), std::vector<std::vector<uint8_t>>{body});
+    EXPECT_EQ(uart.rx.stats.frames, 3u);
+}
+
+TEST(TestWlcommLink, RandomNoise) {
+    std::mt19937 rng(9000);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> junk_len(0, 20);
+    std::uniform_int_distribution<int> chunk_len(1, 64);
+
+    std::vector<uint8_t> stream;
+    std::vector<std::vector<uint8_t>> bodies;
+    for (int i = 0; i < 200; i++) {
+        for (int j = junk_len(rng); j > 0; j--) {
+            stream.push_back(byte(rng));
+        }
+        bodies.push_back(make_body(byte(rng), byte(rng) % 32));
+        std::vector<uint8_t> frame = make_frame(bodies.back());
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    Uart uart;
+    std::vector<std::vector<uint8_t>> got;
+    for (size_t i = 0; i < stream.size();) {
+        size_t len = std::min<size_t>(chunk_len(rng), stream.size() - i);
+        uart.receive(stream.data() + i, len);
+        i += len;
+        for (auto& body : uart.parse()) {
+            got.push_back(body);
+        }
+    }
+
+    // Any frame that falls inside a false start's length turns up late, but
+    // none is lost or garbled
+    uart.receive(std::vector<uint8_t>(WLCOMM_LINK_MAX_FRAME_LEN, 0));
+    for (auto& body : uart.parse()) {
+        got.push_back(body);
+    }
+    EXPECT_EQ(got, bodies);
+}
+
+TEST(TestWlcommLink, Overrun) {
+    Uart uart;
+    std::vector<uint8_t> body = make_body(0x8E, 8);
+
+    // More than a ring's worth arrives before the reader gets to it
+    std::vector<uint8_t> flood(RING_SIZE + 10, 0x55);
+    uart.receive(flood);
+    EXPECT_TRUE(uart.parse().empty());
+    EXPECT_EQ(uart.rx.stats.overruns, 1u);
+    EXPECT_FALSE(wlcomm_link_rx_pending(&uart.rx));
+
+    uart.receive(make_frame(body));
+    EXPECT_EQ(uart.parse(), std::vector<std::vector<uint8_t>>{body});
+
+    // Reception stops part way through a frame, and starts again from the
+    // beginning of the buffer
+    std::vector<uint8_t> frame = make_frame(body);
+    uart.receive(frame.data(), 5);
+    wlcomm_link_rx_restart(&uart.rx);
+    uart.pos = 0;
+    uart.receive(make_frame(body));
+    EXPECT_EQ(uart.parse(), std::vector<std::vector<uint8_t>>{body});
+    EXPECT_EQ(uart.rx.stats.overruns, 2u);
+    EXPECT_EQ(uart.rx.stats.frames, 2u);
+}
+
+TEST(TestWlcommLink, Transmit) {
+    WlcommTx tx;
+    wlcomm_link_tx_init(&tx);
+    EXPECT_FALSE(wlcomm_link_tx_busy(&tx));
+    EXPECT_EQ(wlcomm_link_tx_start(&tx), nullptr);
+
+    // Two senders reserve, and the second finishes encoding first
+    WlcommTxSlot* first = wlcomm_link_tx_reserve(&tx);
+    WlcommTxSlot* second = wlcomm_link_tx_reserve(&tx);
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    std::vector<uint8_t> body_a = make_body(0x8A, 14);
+    std::vector<uint8_t> body_b = make_body(0x8E, 8);
+    wlcomm_link_tx_fill(second, body_b.data());
+    EXPECT_TRUE(wlcomm_link_tx_busy(&tx));
+    EXPECT_EQ(wlcomm_link_tx_start(&tx), nullptr);
+
+    // Frames go out in the order they were reserved, one at a time
+    wlcomm_link_tx_fill(first, body_a.data());
+    WlcommTxSlot* sending = wlcomm_link_tx_start(&tx);
+    ASSERT_EQ(sending, first);
+    std::vector<uint8_t> frame(sending->frame, sending->frame + sending->len);
+    EXPECT_EQ(frame, make_frame(body_a));
+    EXPECT_EQ(wlcomm_link_tx_start(&tx), nullptr);
+    wlcomm_link_tx_done(&tx);
+    EXPECT_EQ(wlcomm_link_tx_start(&tx), second);
+    wlcomm_link_tx_done(&tx);
+    EXPECT_FALSE(wlcomm_link_tx_busy(&tx));
+    EXPECT_EQ(tx.sent, 2u);
+
+    // When every slot is taken, frames are dropped rather than waited for
+    for (int i = 0; i < WLCOMM_LINK_TX_SLOTS; i++) {
+        WlcommTxSlot* slot = wlcomm_link_tx_reserve(&tx);
+        ASSERT_NE(slot, nullptr);
+        wlcomm_link_tx_fill(slot, body_a.data());
+    }
+    EXPECT_EQ(wlcomm_link_tx_reserve(&tx), nullptr);
+    EXPECT_EQ(tx.dropped, 1u);
+    ASSERT_NE(wlcomm_link_tx_start(&tx), nullptr);
+    wlcomm_link_tx_done(&tx);
+    EXPECT_NE(wlcomm_link_tx_reserve(&tx), nullptr);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (RUN_ALL_TESTS())
+        ;
+    // Always return zero-code and allow PlatformIO to parse results
+    return 0;
+}